@@ -0,0 +1,1844 @@
+// Headless CPU benchmarks for the renderer's per frame and load time stages.
+// Nothing in here needs a window or a D3D device so it builds and runs on Windows and Linux.
+// Usage: LevelRenderer_Benchmarks [benchmark name] [models folder]   (no name runs everything)
+#include "DepthSort.h"
+#include "MeshOptimizer.h"
+#include "GeometryDedup.h"
+#include "VertexQuantization.h"
+#include "VertexStreams.h"
+#include "Meshlets.h"
+#include "LevelOfDetail.h"
+#include "HLOD.h"
+#include "Bounds.h"
+#include "MaterialBatches.h"
+#include "DrawPackets.h"
+#include "LevelBakeCache.h"
+#include "ModelPack.h"
+#include "BlockCompression.h"
+#include "BinaryLevel.h"
+#include "SceneHierarchy.h"
+#include "DynamicTransforms.h"
+#include "InstanceFreeList.h"
+#include "LevelDelta.h"
+#include "WorldPartition.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+
+// .h2b files used by the import time benchmarks, CMake points this at DirectX11/Models
+#ifndef BENCHMARK_MODELS_FOLDER
+#define BENCHMARK_MODELS_FOLDER "../Models"
+#endif
+static std::string s_modelsFolder = BENCHMARK_MODELS_FOLDER;
+
+// Every .h2b in the models folder, sorted by name
+static std::vector<std::string> ListModels()
+{
+	std::vector<std::string> files;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(s_modelsFolder, error))
+		if (entry.path().extension() == ".h2b")
+			files.push_back(entry.path().string());
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+// Model instances of a GameLevel.txt (same layout Level_Data::ReadGameLevel reads)
+struct LEVEL_ENTRY
+{
+	std::string modelFile;
+	GW::MATH::GMATRIXF transform;
+};
+static std::vector<LEVEL_ENTRY> ReadLevelInstances(const std::string& _path)
+{
+	std::vector<LEVEL_ENTRY> entries;
+	std::ifstream file(_path);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.rfind("MESH", 0) != 0)
+			continue;
+		LEVEL_ENTRY entry;
+		std::getline(file, entry.modelFile);
+		entry.modelFile = entry.modelFile.substr(0, entry.modelFile.find_last_of(".")) + ".h2b";
+		for (int i = 0; i < 4 && std::getline(file, line); i++)
+			std::sscanf(line.c_str() + 13, "%f, %f, %f, %f", &entry.transform.data[i * 4], &entry.transform.data[i * 4 + 1],
+						&entry.transform.data[i * 4 + 2], &entry.transform.data[i * 4 + 3]);
+		entries.push_back(entry);
+	}
+	return entries;
+}
+
+// Checks that failed over the whole run, main returns non-zero when there are any
+static unsigned s_failedChecks = 0;
+
+// "yes" or "NO" for a report line, a NO fails the run
+static const char* Check(bool _passed)
+{
+	if (!_passed)
+		s_failedChecks++;
+	return _passed ? "yes" : "NO";
+}
+
+// Best of _repeats runs, in milliseconds
+static double TimeMS(const std::function<void()>& _work, int _repeats = 5)
+{
+	double best = 1e30;
+	for (int i = 0; i < _repeats; i++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		_work();
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start);
+		best = (std::min)(best, elapsed.count());
+	}
+	return best;
+}
+
+static void PrintRow(const std::string& _label, unsigned _count, double _ms)
+{
+	std::cout << "  " << std::left << std::setw(28) << _label << std::right << std::setw(9) << _count
+			  << std::setw(11) << std::fixed << std::setprecision(3) << _ms << " ms"
+			  << std::setw(10) << std::setprecision(1) << (_count / (_ms * 1000.0)) << " M/s" << std::endl;
+}
+
+// Depth keys + radix sort of 10k/100k/1M instances spread over 64 instance sets
+static void BenchmarkDepthSort()
+{
+	std::cout << "DepthSort (instance keys + 32 bit radix sort)" << std::endl;
+	const unsigned groupCount = 64;
+	for (unsigned count : { 10000u, 100000u, 1000000u })
+	{
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> coord(-500.0f, 500.0f);
+		std::vector<GW::MATH::GMATRIXF> transforms(count, GW::MATH::GIdentityMatrixF);
+		for (GW::MATH::GMATRIXF& t : transforms)
+			t.row4 = { coord(rng), coord(rng) * 0.1f, coord(rng), 1 };
+
+		std::vector<InstanceDepthSorter::SORT_GROUP> groups(groupCount);
+		for (unsigned g = 0; g < groupCount; g++)
+		{
+			unsigned start = (unsigned)((unsigned long long)count * g / groupCount);
+			unsigned end = (unsigned)((unsigned long long)count * (g + 1) / groupCount);
+			groups[g] = { start, end - start };
+		}
+
+		GW::MATH::GVECTORF camPos = { 0, 2, -600, 1 };
+		GW::MATH::GVECTORF camForward = { 0, 0, 1, 0 };
+		InstanceDepthSorter sorter;
+		unsigned threads = std::thread::hardware_concurrency();
+		PrintRow("radix, 1 thread", count, TimeMS([&] {
+			sorter.Sort(transforms.data(), groups.data(), groupCount, camPos, camForward, 0.1f, 2000.0f, 1);
+		}));
+		PrintRow("radix, " + std::to_string(threads) + " threads", count, TimeMS([&] {
+			sorter.Sort(transforms.data(), groups.data(), groupCount, camPos, camForward, 0.1f, 2000.0f, threads);
+		}));
+		// Same again split per LOD (LevelOfDetail.h), one more key bit per doubling of ranges
+		std::vector<uint8_t> lods(count);
+		for (uint8_t& lod : lods)
+			lod = (uint8_t)(rng() % (m_lodLevels + 1));
+		PrintRow("radix, " + std::to_string(threads) + " threads, LODs", count, TimeMS([&] {
+			sorter.Sort(transforms.data(), groups.data(), groupCount, camPos, camForward, 0.1f, 2000.0f, threads,
+						lods.data(), m_lodLevels + 1);
+		}));
+
+		// Reference: same keys through std::sort of (key, id) pairs
+		std::vector<uint64_t> pairs(count);
+		PrintRow("std::sort reference", count, TimeMS([&] {
+			for (unsigned g = 0; g < groupCount; g++)
+				for (unsigned i = groups[g].transformStart; i < groups[g].transformStart + groups[g].transformCount; i++)
+				{
+					float depth = transforms[i].row4.z - camPos.z;
+					pairs[i] = ((uint64_t)g << 52) | ((uint64_t)(uint32_t)(depth * 1000.0f) << 20) | i;
+				}
+			std::sort(pairs.begin(), pairs.end());
+		}));
+	}
+}
+
+// ACMR/ATVR of every shipped model before and after MeshOptimizer, FIFO cache of 16
+static void BenchmarkVertexCache()
+{
+	std::cout << "VertexCache (Forsyth + overdraw clusters + fetch remap, FIFO " << m_vertexCacheStatsSize
+			  << ")" << std::endl;
+	std::cout << "  " << std::left << std::setw(28) << "model" << std::right << std::setw(9) << "tris"
+			  << std::setw(16) << "ACMR" << std::setw(16) << "ATVR" << std::setw(12) << "time" << std::endl;
+	unsigned long long before = 0, after = 0, vertices = 0;
+	for (const std::string& file : ListModels())
+	{
+		H2B::Parser parsed;
+		if (!parsed.Parse(file.c_str()))
+			continue;
+		MESH_OPTIMIZE_REPORT report;
+		double ms = TimeMS([&] {
+			H2B::Parser copy = parsed;
+			report = OptimizeMesh(copy);
+		}, 1);
+		before += report.before.misses;
+		after += report.after.misses;
+		vertices += report.after.vertices;
+		std::cout << "  " << std::left << std::setw(28) << std::filesystem::path(file).filename().string()
+				  << std::right << std::setw(9) << report.before.triangles << std::fixed << std::setprecision(3)
+				  << std::setw(8) << report.before.acmr << " ->" << std::setw(6) << report.after.acmr
+				  << std::setw(8) << report.before.atvr << " ->" << std::setw(6) << report.after.atvr
+				  << std::setw(9) << ms << " ms" << std::endl;
+	}
+	if (vertices > 0)
+		std::cout << "  vertex shader invocations (one draw of every model): " << before << " -> " << after
+				  << " (ATVR " << std::setprecision(3) << (double)before / vertices << " -> "
+				  << (double)after / vertices << ")" << std::endl;
+	else
+		std::cout << "  no .h2b files found in " << s_modelsFolder << std::endl;
+}
+
+// Import path of the loader over every shipped model: weld, optimize, then share identical meshes
+static void BenchmarkGeometryDedup()
+{
+	std::cout << "GeometryDedup (vertex welding + cross model mesh sharing)" << std::endl;
+	std::vector<H2B::Parser> models;
+	for (const std::string& file : ListModels())
+	{
+		models.emplace_back();
+		if (!models.back().Parse(file.c_str()))
+			models.pop_back();
+	}
+	GeometryPool pool;
+	unsigned long long missesUnwelded = 0, missesWelded = 0;
+	std::vector<H2B::VERTEX> vertices;
+	std::vector<unsigned> indices;
+	double ms = TimeMS([&] {
+		pool.Clear();
+		vertices.clear();
+		indices.clear();
+		missesUnwelded = missesWelded = 0;
+		for (const H2B::Parser& model : models)
+		{
+			H2B::Parser copy = model;
+			H2B::Parser unwelded = model;
+			missesUnwelded += OptimizeMesh(unwelded).after.misses;
+			pool.AddWeldedVertices(WeldVertices(copy.vertices, copy.indices));
+			missesWelded += OptimizeMesh(copy).after.misses;
+			for (const H2B::MESH& mesh : copy.meshes)
+				pool.AddMesh(copy.vertices, copy.indices, mesh.drawInfo.indexOffset, mesh.drawInfo.indexCount,
+							 vertices, indices);
+		}
+	}, 1);
+	const GEOMETRY_DEDUP_REPORT& report = pool.GetReport();
+	unsigned meshes = report.meshesAdded + report.meshesShared;
+	std::cout << "  models                      " << models.size() << std::endl;
+	std::cout << "  meshes shared               " << report.meshesShared << " of " << meshes << std::endl;
+	std::cout << "  vertices welded             " << report.verticesWelded << std::endl;
+	std::cout << "  geometry bytes              " << report.bytesImported << " -> " << report.bytesStored
+			  << " (" << std::fixed << std::setprecision(3)
+			  << (report.bytesStored ? (double)report.bytesImported / report.bytesStored : 0.0) << "x)" << std::endl;
+	std::cout << "  vertex shader invocations   " << missesUnwelded << " -> " << missesWelded
+			  << " (optimized, without -> with welding)" << std::endl;
+	std::cout << "  import passes               " << std::setprecision(3) << ms << " ms" << std::endl;
+}
+
+// Compact vertex conversion of every shipped model (as the loader runs it) with its decode error
+static void BenchmarkVertexQuantization()
+{
+	std::cout << "VertexQuantization (unorm16 position, octahedral snorm16 normal, half2 uv)" << std::endl;
+	GeometryPool pool;
+	std::vector<H2B::VERTEX> vertices;
+	std::vector<unsigned> indices;
+	std::vector<GEOMETRY_RANGE> ranges;
+	for (const std::string& file : ListModels())
+	{
+		H2B::Parser parsed;
+		if (!parsed.Parse(file.c_str()))
+			continue;
+		WeldVertices(parsed.vertices, parsed.indices);
+		OptimizeMesh(parsed);
+		for (const H2B::MESH& mesh : parsed.meshes)
+			ranges.push_back(pool.AddMesh(parsed.vertices, parsed.indices, mesh.drawInfo.indexOffset,
+										  mesh.drawInfo.indexCount, vertices, indices));
+	}
+
+	std::vector<QUANTIZED_VERTEX> compact;
+	std::vector<uint16_t> indices16;
+	std::vector<unsigned> indices32;
+	std::vector<QUANTIZED_RANGE> compactRanges;
+	QUANTIZATION_REPORT report;
+	double ms = TimeMS([&] {
+		report = QuantizeLevelGeometry(vertices, indices, ranges, compact, indices16, indices32, compactRanges);
+	});
+
+	// Half conversion must round trip every half exactly
+	unsigned halfMismatches = 0;
+	for (unsigned h = 0; h < 0x10000; h++)
+	{
+		float value = HalfToFloat((uint16_t)h);
+		if (value == value && FloatToHalf(value) != h)
+			halfMismatches++;
+	}
+
+	std::cout << std::fixed << std::setprecision(6);
+	std::cout << "  vertices                    " << vertices.size() << " (" << sizeof(H2B::VERTEX) << " -> "
+			  << sizeof(QUANTIZED_VERTEX) << " bytes)" << std::endl;
+	std::cout << "  index ranges 16 / 32 bit    " << report.ranges16 << " / " << report.ranges32 << std::endl;
+	std::cout << "  vertex + index bytes        " << report.bytesBefore << " -> " << report.bytesAfter << " ("
+			  << std::setprecision(1) << 100.0 * report.bytesAfter / (std::max)(1ull, report.bytesBefore) << "%)"
+			  << std::endl;
+	std::cout << std::setprecision(6);
+	// 1% over half a step covers the float rounding of the decode itself
+	std::cout << "  max position error          " << report.maxPositionError << " units ("
+			  << report.maxPositionErrorRelative << " of extent), within half a step "
+			  << Check(report.maxPositionErrorRelative <= m_quantPositionErrorBound * 1.01f) << std::endl;
+	std::cout << "  max normal error            " << report.maxNormalErrorDegrees << " degrees, within bound "
+			  << Check(report.maxNormalErrorDegrees <= m_quantNormalErrorBoundDegrees) << std::endl;
+	std::cout << "  max uv error                " << report.maxUVError << " (" << report.maxUVErrorRelative
+			  << " of |uv|), within bound " << Check(report.maxUVErrorRelative <= m_quantUVErrorBound) << std::endl;
+	std::cout << "  half round trip mismatches  " << halfMismatches << ", none " << Check(halfMismatches == 0) << std::endl;
+	std::cout << "  conversion                  " << std::setprecision(3) << ms << " ms" << std::endl;
+}
+
+// AoS -> SoA transpose (scalar vs SSE) and a position only sweep over each layout
+static void BenchmarkVertexStreams()
+{
+	std::cout << "VertexStreams (position/attribute split, position only sweep)" << std::endl;
+	const unsigned count = 1000000;
+	std::mt19937 rng(99);
+	std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+	std::vector<H2B::VERTEX> vertices(count);
+	for (H2B::VERTEX& v : vertices)
+		v = { { value(rng), value(rng), value(rng) }, { value(rng), value(rng), 0 }, { value(rng), value(rng), value(rng) } };
+
+	std::vector<H2B::VECTOR> positions(count);
+	std::vector<VERTEX_ATTRIBUTES> attributes(count);
+	PrintRow("split", count, TimeMS([&] {
+		SplitVertexStreams(vertices.data(), count, positions.data(), attributes.data());
+	}));
+	bool same = true;
+	for (unsigned i = 0; i < count && same; i++)
+		same = std::memcmp(&positions[i], &vertices[i].pos, sizeof(H2B::VECTOR)) == 0 && attributes[i].u == vertices[i].uvw.x &&
+			   attributes[i].v == vertices[i].uvw.y && attributes[i].nx == vertices[i].nrm.x &&
+			   attributes[i].ny == vertices[i].nrm.y && attributes[i].nz == vertices[i].nrm.z;
+	std::cout << "  streams match the vertices  " << Check(same) << std::endl;
+
+	// What a depth only consumer pays: touch every position once
+	volatile float sink = 0;
+	double interleaved = TimeMS([&] {
+		float sum = 0;
+		for (const H2B::VERTEX& v : vertices)
+			sum += v.pos.x + v.pos.y + v.pos.z;
+		sink = sum;
+	});
+	double split = TimeMS([&] {
+		float sum = 0;
+		for (const H2B::VECTOR& p : positions)
+			sum += p.x + p.y + p.z;
+		sink = sum;
+	});
+	PrintRow("sweep, interleaved 36 B", count, interleaved);
+	PrintRow("sweep, position stream 12 B", count, split);
+	std::cout << "  bytes fetched per position  " << sizeof(H2B::VERTEX) << " -> " << sizeof(H2B::VECTOR)
+			  << " (compact: " << sizeof(QUANTIZED_VERTEX) << " -> " << sizeof(QUANTIZED_POSITION) << ")" << std::endl;
+}
+
+// Meshlets of every shipped mesh, then one frame of culling for a grid of 4096 instances of them
+static void BenchmarkMeshletCulling()
+{
+	std::cout << "MeshletCulling (" << m_meshletMaxVertices << " vertices / " << m_meshletMaxTriangles
+			  << " triangles, sphere + normal cone)" << std::endl;
+	struct MESH_ENTRY
+	{
+		std::vector<MESHLET> meshlets;
+		float center[3], radius;
+		unsigned triangles;
+	};
+	std::vector<MESH_ENTRY> meshes;
+	unsigned long long meshletTotal = 0;
+	double buildMS = 0;
+	for (const std::string& file : ListModels())
+	{
+		H2B::Parser parsed;
+		if (!parsed.Parse(file.c_str()))
+			continue;
+		WeldVertices(parsed.vertices, parsed.indices);
+		OptimizeMesh(parsed);
+		for (const H2B::MESH& mesh : parsed.meshes)
+		{
+			MESH_ENTRY entry;
+			buildMS += TimeMS([&] {
+				entry.meshlets.clear();
+				BuildMeshlets(parsed.vertices.data(), &parsed.indices[mesh.drawInfo.indexOffset],
+							  mesh.drawInfo.indexCount, entry.meshlets);
+			}, 1);
+			if (entry.meshlets.empty())
+				continue;
+			// Whole mesh sphere for the per instance reference
+			float minP[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxP[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (unsigned i = 0; i < mesh.drawInfo.indexCount; i++)
+			{
+				const float* p = &parsed.vertices[parsed.indices[mesh.drawInfo.indexOffset + i]].pos.x;
+				for (int k = 0; k < 3; k++)
+				{
+					minP[k] = (std::min)(minP[k], p[k]);
+					maxP[k] = (std::max)(maxP[k], p[k]);
+				}
+			}
+			for (int k = 0; k < 3; k++)
+				entry.center[k] = (minP[k] + maxP[k]) * 0.5f;
+			entry.radius = std::sqrt((maxP[0] - minP[0]) * (maxP[0] - minP[0]) + (maxP[1] - minP[1]) * (maxP[1] - minP[1]) +
+									 (maxP[2] - minP[2]) * (maxP[2] - minP[2])) * 0.5f;
+			entry.triangles = mesh.drawInfo.indexCount / 3;
+			meshletTotal += entry.meshlets.size();
+			meshes.push_back(std::move(entry));
+		}
+	}
+	if (meshes.empty())
+	{
+		std::cout << "  no .h2b files found in " << s_modelsFolder << std::endl;
+		return;
+	}
+	std::cout << "  meshlets built              " << meshletTotal << " from " << meshes.size() << " meshes in "
+			  << std::fixed << std::setprecision(3) << buildMS << " ms" << std::endl;
+
+	// 64 x 64 grid, 6 units apart, random yaw. Camera at the edge looking across it.
+	const unsigned side = 64;
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	std::vector<GW::MATH::GMATRIXF> transforms;
+	std::vector<unsigned> meshOf;
+	for (unsigned z = 0; z < side; z++)
+		for (unsigned x = 0; x < side; x++)
+		{
+			float yaw = angle(rng), c = std::cos(yaw), s = std::sin(yaw);
+			GW::MATH::GMATRIXF world = GW::MATH::GIdentityMatrixF;
+			world.row1 = { c, 0, -s, 0 };
+			world.row3 = { s, 0, c, 0 };
+			world.row4 = { (x - side * 0.5f) * 6.0f, 0, z * 6.0f, 1 };
+			transforms.push_back(world);
+			meshOf.push_back((unsigned)(rng() % meshes.size()));
+		}
+	GW::MATH::GVECTORF eye = { 0, 2, -10, 1 };
+	const float nearZ = 0.1f, farZ = 200.0f, yScale = 1.0f / std::tan(0.5f * 1.2f), xScale = yScale / (16.0f / 9.0f);
+	// view = translate(-eye) (looking down +z), proj = D3D left handed perspective, row vectors
+	float viewProj[16] = {
+		xScale, 0, 0, 0,
+		0, yScale, 0, 0,
+		0, 0, farZ / (farZ - nearZ), 1,
+		-eye.x * xScale, -eye.y * yScale, -eye.z * farZ / (farZ - nearZ) - nearZ * farZ / (farZ - nearZ), -eye.z
+	};
+	FRUSTUM frustum = ExtractFrustum(viewProj);
+
+	MeshletCuller culler;
+	unsigned long long instanceKept = 0, total = 0;
+	double cullMS = TimeMS([&] {
+		culler.Begin();
+		instanceKept = total = 0;
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			const MESH_ENTRY& mesh = meshes[meshOf[i]];
+			total += mesh.triangles;
+			// Reference: whole instance sphere against the frustum
+			const GW::MATH::GMATRIXF& w = transforms[i];
+			float c[3];
+			for (int k = 0; k < 3; k++)
+				c[k] = mesh.center[0] * (&w.row1.x)[k] + mesh.center[1] * (&w.row2.x)[k] +
+					   mesh.center[2] * (&w.row3.x)[k] + (&w.row4.x)[k];
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+				inside = frustum.planes[p][0] * c[0] + frustum.planes[p][1] * c[1] + frustum.planes[p][2] * c[2] +
+						 frustum.planes[p][3] >= -mesh.radius;
+			if (inside)
+				instanceKept += mesh.triangles;
+			culler.CullInstance(mesh.meshlets.data(), (unsigned)mesh.meshlets.size(), w, (unsigned)i, frustum, eye);
+		}
+	});
+	const MeshletCuller::CULL_STATS& stats = culler.GetStats();
+	std::cout << "  instances                   " << transforms.size() << std::endl;
+	std::cout << "  triangles submitted         " << total << " (no culling)" << std::endl;
+	std::cout << "                              " << instanceKept << " (per instance frustum)" << std::endl;
+	std::cout << "                              " << stats.trianglesKept << " (meshlet frustum + cone)" << std::endl;
+	std::cout << "  frustum / cone culled       " << stats.meshletsFrustumCulled << " / " << stats.meshletsConeCulled
+			  << " of " << stats.meshletsTested << std::endl;
+	std::cout << "  draw ranges after merging   " << culler.GetRanges().size() << std::endl;
+	PrintRow("cull, meshlets", stats.meshletsTested, cullMS);
+}
+
+// LOD chains of every shipped model, then LOD selection for instances at increasing distance
+static void BenchmarkLOD()
+{
+	std::cout << "LOD (" << m_lodLevels << " levels, quadric edge collapse, seams kept)" << std::endl;
+	struct MODEL_ENTRY
+	{
+		std::string name;
+		LOD_BOUNDS bounds;
+		unsigned triangles[m_lodLevels + 1];
+	};
+	std::vector<MODEL_ENTRY> models;
+	unsigned long long totals[m_lodLevels + 1] = {};
+	double buildMS = 0;
+	for (const std::string& file : ListModels())
+	{
+		H2B::Parser parsed;
+		if (!parsed.Parse(file.c_str()))
+			continue;
+		WeldVertices(parsed.vertices, parsed.indices);
+		OptimizeMesh(parsed);
+		MODEL_ENTRY entry = {};
+		entry.name = std::filesystem::path(file).stem().string();
+		ComputeBoundingSphere(parsed.vertices.data(), parsed.vertices.size(), entry.bounds.center, entry.bounds.radius);
+		for (const H2B::MESH& mesh : parsed.meshes)
+		{
+			std::vector<unsigned> lods[m_lodLevels];
+			float errors[m_lodLevels];
+			buildMS += TimeMS([&] {
+				GenerateMeshLODs(parsed.vertices.data(), (unsigned)parsed.vertices.size(),
+								 &parsed.indices[mesh.drawInfo.indexOffset], mesh.drawInfo.indexCount, lods, errors);
+			}, 1);
+			entry.triangles[0] += mesh.drawInfo.indexCount / 3;
+			for (unsigned l = 0; l < m_lodLevels; l++)
+			{
+				entry.triangles[l + 1] += (unsigned)lods[l].size() / 3;
+				entry.bounds.error[l + 1] = (std::max)(entry.bounds.error[l + 1], errors[l]);
+			}
+		}
+		for (unsigned l = 0; l <= m_lodLevels; l++)
+			totals[l] += entry.triangles[l];
+		models.push_back(entry);
+	}
+	if (models.empty())
+	{
+		std::cout << "  no .h2b files found in " << s_modelsFolder << std::endl;
+		return;
+	}
+	std::cout << "  " << std::left << std::setw(28) << "model" << std::right;
+	for (unsigned l = 0; l <= m_lodLevels; l++)
+		std::cout << std::setw(8) << ("LOD" + std::to_string(l));
+	std::cout << "   max error (of radius)" << std::endl;
+	for (const MODEL_ENTRY& entry : models)
+	{
+		std::cout << "  " << std::left << std::setw(28) << entry.name << std::right;
+		for (unsigned l = 0; l <= m_lodLevels; l++)
+			std::cout << std::setw(8) << entry.triangles[l];
+		std::cout << std::setw(11) << std::setprecision(4) << entry.bounds.error[m_lodLevels] / entry.bounds.radius << std::endl;
+	}
+	std::cout << "  " << std::left << std::setw(28) << "total" << std::right;
+	for (unsigned l = 0; l <= m_lodLevels; l++)
+		std::cout << std::setw(8) << totals[l];
+	std::cout << std::endl << "  built in " << std::setprecision(3) << buildMS << " ms" << std::endl;
+
+	// Every model at growing distances, 720p with a 1.2 rad vertical fov, 1 pixel of error
+	const float pixelsPerUnit = 0.5f * 720.0f / std::tan(0.5f * 1.2f);
+	LODSelector selector;
+	GW::MATH::GVECTORF eye = { 0, 0, 0, 1 };
+	std::cout << "  distance    triangles (all models, one instance each)" << std::endl;
+	for (float distance : { 2.0f, 10.0f, 25.0f, 50.0f, 100.0f, 200.0f })
+	{
+		selector.Begin(pixelsPerUnit, 1.0f, 0.25f);
+		unsigned long long triangles = 0;
+		for (const MODEL_ENTRY& entry : models)
+		{
+			GW::MATH::GMATRIXF world = GW::MATH::GIdentityMatrixF;
+			world.row4 = { -entry.bounds.center[0], -entry.bounds.center[1], distance - entry.bounds.center[2], 1 };
+			uint8_t lod = 0;
+			selector.SelectInstances(entry.bounds, &world, 1, eye, &lod);
+			triangles += entry.triangles[lod];
+		}
+		std::cout << "  " << std::fixed << std::setw(8) << std::setprecision(0) << distance << std::setw(13) << triangles
+				  << "  (" << std::setprecision(1) << 100.0 * triangles / totals[0] << "%)" << std::endl;
+	}
+
+	// Camera drifting back and forth over LOD boundaries, hysteresis keeps the switches down
+	for (float hysteresis : { 0.0f, 0.25f })
+	{
+		std::vector<uint8_t> lods(models.size(), 0);
+		unsigned changes = 0;
+		for (int frame = 0; frame < 1000; frame++)
+		{
+			float distance = 30.0f + 20.0f * std::sin(frame * 0.05f) + 0.5f * std::sin(frame * 1.7f);
+			selector.Begin(pixelsPerUnit, 1.0f, hysteresis);
+			for (size_t m = 0; m < models.size(); m++)
+			{
+				GW::MATH::GMATRIXF world = GW::MATH::GIdentityMatrixF;
+				world.row4 = { -models[m].bounds.center[0], -models[m].bounds.center[1], distance - models[m].bounds.center[2], 1 };
+				selector.SelectInstances(models[m].bounds, &world, 1, eye, &lods[m]);
+			}
+			changes += selector.GetStats().changes;
+		}
+		std::cout << "  LOD switches, hysteresis " << std::setprecision(2) << hysteresis << ": " << changes
+				  << " over 1000 frames" << std::endl;
+	}
+}
+
+// HLOD cells of the shipped level: how many draws and triangles a far cell costs before/after.
+// Like the level loader, proxies are built from every member's coarsest LOD.
+static void BenchmarkHLOD()
+{
+	std::cout << "HLOD (" << m_hlodCellSize << " unit cells, at least " << m_hlodMinInstances << " instances)" << std::endl;
+	std::vector<LEVEL_ENTRY> entries = ReadLevelInstances(s_modelsFolder + "/../Levels/GameLevel.txt");
+	struct MODEL_ENTRY
+	{
+		H2B::Parser parsed;
+		std::vector<std::vector<unsigned>> coarsest; // per mesh, relative to parsed.vertices
+		float center[3], radius;
+		bool loaded;
+	};
+	std::map<std::string, MODEL_ENTRY> models;
+	std::vector<float> spheres;
+	std::vector<const MODEL_ENTRY*> modelOf;
+	std::vector<LEVEL_ENTRY> placed;
+	for (const LEVEL_ENTRY& entry : entries)
+	{
+		auto found = models.find(entry.modelFile);
+		if (found == models.end())
+		{
+			MODEL_ENTRY& model = models[entry.modelFile];
+			model.loaded = model.parsed.Parse((s_modelsFolder + "/" + entry.modelFile).c_str());
+			if (model.loaded)
+			{
+				WeldVertices(model.parsed.vertices, model.parsed.indices);
+				ComputeBoundingSphere(model.parsed.vertices.data(), model.parsed.vertices.size(), model.center, model.radius);
+				for (const H2B::MESH& mesh : model.parsed.meshes)
+				{
+					std::vector<unsigned> lods[m_lodLevels];
+					float errors[m_lodLevels];
+					GenerateMeshLODs(model.parsed.vertices.data(), (unsigned)model.parsed.vertices.size(),
+									 &model.parsed.indices[mesh.drawInfo.indexOffset], mesh.drawInfo.indexCount, lods, errors);
+					model.coarsest.push_back(lods[m_lodLevels - 1]);
+				}
+			}
+			found = models.find(entry.modelFile);
+		}
+		if (!found->second.loaded)
+			continue;
+		const MODEL_ENTRY& model = found->second;
+		float sphere[4];
+		TransformBoundingSphere(model.center, model.radius, entry.transform, sphere);
+		spheres.insert(spheres.end(), sphere, sphere + 4);
+		modelOf.push_back(&model);
+		placed.push_back(entry);
+	}
+	if (modelOf.empty())
+	{
+		std::cout << "  no level instances found" << std::endl;
+		return;
+	}
+
+	std::vector<HLOD_CELL> cells;
+	std::vector<unsigned> members;
+	BuildHLODCells(reinterpret_cast<const float(*)[4]>(spheres.data()), modelOf.size(), cells, members);
+
+	unsigned long long memberDraws = 0, memberTriangles = 0, proxyTriangles = 0;
+	std::vector<std::vector<HLOD_PART>> cellParts(cells.size());
+	for (size_t c = 0; c < cells.size(); c++)
+		for (unsigned m = cells[c].memberStart; m < cells[c].memberStart + cells[c].memberCount; m++)
+		{
+			const MODEL_ENTRY& model = *modelOf[members[m]];
+			for (size_t j = 0; j < model.parsed.meshes.size(); j++)
+			{
+				const H2B::MESH& mesh = model.parsed.meshes[j];
+				cellParts[c].push_back({ model.parsed.vertices.data(), (unsigned)model.parsed.vertices.size(),
+										 model.coarsest[j].data(), (unsigned)model.coarsest[j].size(),
+										 placed[members[m]].transform, &model.parsed.materials[mesh.materialIndex].attrib });
+				memberTriangles += mesh.drawInfo.indexCount / 3;
+			}
+			memberDraws += model.parsed.meshes.size();
+		}
+	std::vector<HLOD_PROXY> proxies;
+	float worstError = 0;
+	unsigned threads = std::thread::hardware_concurrency();
+	double buildMS = TimeMS([&] { BuildHLODProxies(cellParts, proxies, 1); }, 1);
+	double threadedMS = TimeMS([&] { BuildHLODProxies(cellParts, proxies, threads); }, 1);
+	for (const HLOD_PROXY& proxy : proxies)
+	{
+		proxyTriangles += proxy.report.proxyTriangles;
+		worstError = (std::max)(worstError, proxy.report.error);
+	}
+	std::cout << "  instances                   " << modelOf.size() << ", " << (members.size()) << " in "
+			  << cells.size() << " cells" << std::endl;
+	std::cout << "  far draws                   " << memberDraws << " -> " << cells.size() << std::endl;
+	std::cout << "  far triangles (LOD0)        " << memberTriangles << " -> " << proxyTriangles << std::endl;
+	std::cout << "  max proxy error             " << std::setprecision(4) << worstError << " units" << std::endl;
+	std::cout << std::fixed << std::setprecision(0);
+	std::cout << "  built in                    " << buildMS << " ms, " << threadedMS << " ms on " << threads << " threads" << std::endl;
+}
+
+// Local bounds over a big vertex array and world bounds of 1M instances, scalar vs SSE
+static void BenchmarkBounds()
+{
+	std::cout << "Bounds (local AABB + sphere, world SoA bounds per instance)" << std::endl;
+	const unsigned count = 1000000;
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+	std::vector<H2B::VERTEX> vertices(count);
+	for (H2B::VERTEX& v : vertices)
+		v = { { value(rng), value(rng), value(rng) }, { value(rng), value(rng), 0 }, { value(rng), value(rng), value(rng) } };
+
+	// Gateware wants 16 byte points, the copy isn't timed
+	std::vector<GW::MATH::GVECTORF> points(count);
+	for (unsigned i = 0; i < count; i++)
+		points[i] = { vertices[i].pos.x, vertices[i].pos.y, vertices[i].pos.z, 1 };
+	GW::MATH::GAABBMMF gateware;
+	LOCAL_BOUNDS scalar, simd;
+	PrintRow("AABB, GCollision", count, TimeMS([&] { GW::MATH::GCollision::ComputeAABBFromPointsF(points.data(), count, gateware); }));
+	float minP[3], maxP[3];
+	PrintRow("AABB, scalar", count, TimeMS([&] { ComputeAABBScalar(vertices.data(), count, minP, maxP); }));
+	PrintRow("AABB, GCollision + copy", count, TimeMS([&] { ComputeAABB(vertices.data(), count, minP, maxP); }));
+	PrintRow("AABB + sphere, scalar", count, TimeMS([&] { scalar = ComputeBoundsScalar(vertices.data(), count); }));
+	PrintRow("AABB + sphere", count, TimeMS([&] { simd = ComputeBounds(vertices.data(), count); }));
+	bool same = std::memcmp(simd.min, scalar.min, sizeof(float) * 9) == 0 && std::fabs(simd.radius - scalar.radius) <= 1e-5f * scalar.radius &&
+				simd.min[0] == gateware.min.x && simd.max[2] == gateware.max.z;
+	std::cout << "  output matches scalar       " << Check(same) << std::endl;
+
+	// Random rotation, scale and position per instance
+	std::vector<GW::MATH::GMATRIXF> transforms(count);
+	for (GW::MATH::GMATRIXF& w : transforms)
+	{
+		float yaw = value(rng), scale = 1.0f + 0.05f * value(rng);
+		w = GW::MATH::GIdentityMatrixF;
+		w.row1 = { std::cos(yaw) * scale, 0, -std::sin(yaw) * scale, 0 };
+		w.row2 = { 0, scale, 0, 0 };
+		w.row3 = { std::sin(yaw) * scale, 0, std::cos(yaw) * scale, 0 };
+		w.row4 = { value(rng) * 10, value(rng), value(rng) * 10, 1 };
+	}
+	INSTANCE_BOUNDS reference, world;
+	reference.Resize(count);
+	world.Resize(count);
+	PrintRow("world bounds, scalar", count, TimeMS([&] { TransformBoundsScalar(simd, transforms.data(), 0, count, reference); }));
+	PrintRow("world bounds, SSE", count, TimeMS([&] { TransformBounds(simd, transforms.data(), 0, count, world); }));
+	float worst = 0;
+	for (unsigned i = 0; i < count; i++)
+		for (const std::vector<float> INSTANCE_BOUNDS::*component : { &INSTANCE_BOUNDS::minX, &INSTANCE_BOUNDS::maxZ,
+				&INSTANCE_BOUNDS::centerY, &INSTANCE_BOUNDS::radius })
+			worst = (std::max)(worst, std::fabs((world.*component)[i] - (reference.*component)[i]));
+	std::cout << "  SSE vs scalar max delta     " << std::setprecision(3) << worst << std::endl;
+}
+
+// Draw ranges per model before/after merging by material. The shipped files already have one
+// mesh per material, so every mesh is also split in 4 to stand in for a per object export.
+static void BenchmarkMaterialBatches()
+{
+	std::cout << "MaterialBatches (one draw range per material and model)" << std::endl;
+	unsigned shippedBefore = 0, shippedAfter = 0, splitBefore = 0, splitAfter = 0, materials = 0;
+	bool partsIntact = true;
+	double mergeMS = 0;
+	for (const std::string& file : ListModels())
+	{
+		H2B::Parser parsed;
+		if (!parsed.Parse(file.c_str()))
+			continue;
+		H2B::Parser split = parsed;
+		split.meshes.clear();
+		for (const H2B::MESH& mesh : parsed.meshes)
+		{
+			unsigned triangles = mesh.drawInfo.indexCount / 3, done = 0;
+			for (unsigned piece = 0; piece < 4; piece++)
+			{
+				unsigned count = (triangles * (piece + 1) / 4 - done) * 3;
+				if (count == 0)
+					continue;
+				split.meshes.push_back({ mesh.name, { count, mesh.drawInfo.indexOffset + done * 3 }, mesh.materialIndex });
+				done += count / 3;
+			}
+		}
+		split.meshCount = (unsigned)split.meshes.size();
+		std::vector<MESH_PART> parts;
+		shippedBefore += parsed.meshCount;
+		MergeMeshesByMaterial(parsed, parts);
+		shippedAfter += parsed.meshCount;
+
+		H2B::Parser original = split;
+		splitBefore += split.meshCount;
+		mergeMS += TimeMS([&] { split = original; MergeMeshesByMaterial(split, parts); }, 1);
+		splitAfter += split.meshCount;
+		materials += parsed.materialCount;
+		// Every part still holds exactly the triangles of the mesh it came from
+		for (size_t m = 0; m < original.meshes.size() && partsIntact; m++)
+		{
+			const H2B::BATCH& before = original.meshes[m].drawInfo;
+			bool found = false;
+			for (const MESH_PART& part : parts)
+				found |= part.indexCount == before.indexCount &&
+						 std::equal(original.indices.begin() + before.indexOffset, original.indices.begin() + before.indexOffset + before.indexCount,
+									split.indices.begin() + split.meshes[part.meshIndex].drawInfo.indexOffset + part.indexOffset);
+			partsIntact = found;
+		}
+	}
+	std::cout << "  shipped models, draw ranges " << shippedBefore << " -> " << shippedAfter << std::endl;
+	std::cout << "  split in 4, draw ranges     " << splitBefore << " -> " << splitAfter << " (" << materials << " materials)" << std::endl;
+	std::cout << "  parts match source meshes   " << Check(partsIntact) << std::endl;
+	std::cout << "  merged in                   " << std::setprecision(3) << mergeMS << " ms" << std::endl;
+}
+
+// Per draw CPU cost of building DrawIndexedInstanced arguments for a synthetic level, the
+// renderer's old instance set -> model -> mesh -> range chase vs a scan over draw packets.
+// Mimics Level_Data's structs; the depth sorter's per set/LOD ranges are a plain array.
+static void BenchmarkDrawPacketsLevel(unsigned _setCount)
+{
+	struct MODEL { const char* filename; unsigned vertexCount, indexCount, materialCount, meshCount;
+				   unsigned vertexStart, indexStart, materialStart, meshStart, batchStart, partStart, partCount; };
+	struct INSTANCES { unsigned modelIndex, transformStart, transformCount, flags; };
+	struct RANGE { unsigned start, count; };
+	struct ARGS
+	{
+		unsigned indexCount, instanceCount, indexStart, baseVertex, startInstance, material;
+		bool operator==(const ARGS& _other) const { return std::memcmp(this, &_other, sizeof(ARGS)) == 0; }
+	};
+	const unsigned setCount = _setCount, lodLevels = 3, lodCount = lodLevels + 1, materialCount = 64;
+	std::mt19937 rng(40);
+	std::vector<MODEL> models(setCount);
+	std::vector<INSTANCES> sets(setCount);
+	std::vector<H2B::MESH> meshes;
+	std::vector<QUANTIZED_RANGE> meshRanges, lodRanges;
+	std::vector<uint8_t> meshPermutation;
+	std::vector<RANGE> ranges(setCount * lodCount);
+	unsigned transforms = 0, index = 0;
+	for (unsigned m = 0; m < setCount; m++)
+	{
+		models[m] = {};
+		models[m].meshStart = (unsigned)meshes.size();
+		models[m].meshCount = 1 + rng() % 4;
+		for (unsigned j = 0; j < models[m].meshCount; j++)
+		{
+			unsigned material = rng() % materialCount;
+			meshes.push_back({ "mesh", { 300, index }, material });
+			meshPermutation.push_back((uint8_t)(material & 8));
+			meshRanges.push_back({ { 0, 0, 0 }, { 1, 1, 1 }, index, 300, index / 2, true });
+			for (unsigned lod = 1; lod < lodCount; lod++)
+				lodRanges.push_back({ { 0, 0, 0 }, { 1, 1, 1 }, index + 300 * lod, 300u >> lod, index / 2, true });
+			index += 1200;
+		}
+		sets[m] = { m, transforms, 1 + (unsigned)(rng() % 16), 0 };
+		// This frame's split of the set over its LODs
+		unsigned start = transforms;
+		for (unsigned lod = 0; lod < lodCount; lod++)
+		{
+			unsigned count = lod + 1 == lodCount ? transforms + sets[m].transformCount - start : rng() % (sets[m].transformCount + 1 - (start - transforms));
+			ranges[m * lodCount + lod] = { start, count };
+			start += count;
+		}
+		transforms += sets[m].transformCount;
+	}
+	// Models in file order aren't their instance sets' order
+	std::shuffle(sets.begin(), sets.end(), rng);
+
+	// Before: the renderer's draw items, lookups every frame
+	struct ITEM { unsigned instanceSet, meshIndex, permutationBits; bool meshletCulled; unsigned visibleFirst, visibleCount; };
+	std::vector<ITEM> items;
+	std::vector<DRAW_PACKET> packets;
+	for (unsigned i = 0; i < setCount; i++)
+	{
+		const MODEL& model = models[sets[i].modelIndex];
+		for (unsigned j = 0; j < model.meshCount; j++)
+		{
+			unsigned meshIndex = model.meshStart + j;
+			items.push_back({ i, meshIndex, meshPermutation[meshIndex], false, 0, 0 });
+			for (unsigned lod = 0; lod < lodCount; lod++)
+			{
+				const QUANTIZED_RANGE& geometry = lod == 0 ? meshRanges[meshIndex] : lodRanges[meshIndex * lodLevels + lod - 1];
+				packets.push_back(MakeDrawPacket(geometry.indexCount, geometry.indexStart, geometry.baseVertex, geometry.is16Bit, i,
+					sets[i].transformStart, sets[i].transformCount, meshIndex, meshes[meshIndex].materialIndex, meshPermutation[meshIndex], lod, false));
+			}
+		}
+	}
+	std::stable_sort(items.begin(), items.end(), [&](const ITEM& a, const ITEM& b) {
+		if (a.permutationBits != b.permutationBits)
+			return a.permutationBits < b.permutationBits;
+		return meshes[a.meshIndex].materialIndex < meshes[b.meshIndex].materialIndex;
+	});
+	SortDrawPackets(packets, [](unsigned) { return 0.0f; });
+	// Ranges are per instance set, sets were shuffled after the ranges were made
+	std::vector<RANGE> setRanges(ranges.size());
+	for (unsigned i = 0; i < setCount; i++)
+		for (unsigned lod = 0; lod < lodCount; lod++)
+			setRanges[i * lodCount + lod] = ranges[sets[i].modelIndex * lodCount + lod];
+
+	std::vector<ARGS> chased, itemized, scanned;
+	chased.reserve(packets.size());
+	itemized.reserve(packets.size());
+	scanned.reserve(packets.size());
+	const int frames = 20;
+	auto emit = [](std::vector<ARGS>& _out, const QUANTIZED_RANGE& _geometry, const RANGE& _range, unsigned _material) {
+		if (_range.count > 0)
+			_out.push_back({ _geometry.indexCount, _range.count, _geometry.indexStart, _geometry.baseVertex, _range.start, _material });
+	};
+	// Unsorted walk of the level's structures, what the loop did before draw items
+	double chaseMS = TimeMS([&] {
+		for (int f = 0; f < frames; f++)
+		{
+			chased.clear();
+			for (unsigned i = 0; i < setCount; i++)
+			{
+				const MODEL& model = models[sets[i].modelIndex];
+				for (unsigned j = 0; j < model.meshCount; j++)
+				{
+					const H2B::MESH& mesh = meshes[model.meshStart + j];
+					for (unsigned lod = 0; lod < lodCount; lod++)
+						emit(chased, lod == 0 ? meshRanges[model.meshStart + j] : lodRanges[(model.meshStart + j) * lodLevels + lod - 1],
+							 setRanges[i * lodCount + lod], mesh.materialIndex);
+				}
+			}
+		}
+	}) / frames;
+	double itemMS = TimeMS([&] {
+		for (int f = 0; f < frames; f++)
+		{
+			itemized.clear();
+			for (const ITEM& item : items)
+			{
+				unsigned material = meshes[item.meshIndex].materialIndex;
+				for (unsigned lod = 0; lod < lodCount; lod++)
+					emit(itemized, lod == 0 ? meshRanges[item.meshIndex] : lodRanges[item.meshIndex * lodLevels + lod - 1],
+						 setRanges[item.instanceSet * lodCount + lod], material);
+			}
+		}
+	}) / frames;
+	double packetMS = TimeMS([&] {
+		for (int f = 0; f < frames; f++)
+		{
+			scanned.clear();
+			for (const DRAW_PACKET& packet : packets)
+			{
+				const RANGE& range = setRanges[packet.instanceSet * lodCount + packet.GetLOD()];
+				if (range.count > 0)
+					scanned.push_back({ packet.indexCount, range.count, packet.indexStart, packet.baseVertex, range.start, packet.materialIndex });
+			}
+		}
+	}) / frames;
+
+	auto printDraws = [&](const char* _label, double _ms) {
+		std::cout << "  " << std::left << std::setw(28) << _label << std::right << std::setw(9) << packets.size()
+				  << std::setw(11) << std::fixed << std::setprecision(3) << _ms << " ms"
+				  << std::setw(10) << std::setprecision(2) << (_ms * 1e6 / packets.size()) << " ns/draw" << std::endl;
+	};
+	std::cout << " " << setCount << " instance sets" << std::endl;
+	printDraws("sets -> models -> meshes", chaseMS);
+	printDraws("draw items + lookups", itemMS);
+	printDraws("draw packets", packetMS);
+	std::sort(chased.begin(), chased.end(), [](const ARGS& a, const ARGS& b) { return std::memcmp(&a, &b, sizeof(ARGS)) < 0; });
+	std::vector<ARGS> sortedScan = scanned;
+	std::sort(sortedScan.begin(), sortedScan.end(), [](const ARGS& a, const ARGS& b) { return std::memcmp(&a, &b, sizeof(ARGS)) < 0; });
+	std::cout << "  packet bytes                " << packets.size() * sizeof(DRAW_PACKET) << " (" << sizeof(DRAW_PACKET) << " per draw)" << std::endl;
+	std::cout << "  same draws as before        " << Check(itemized == scanned && chased == sortedScan) << std::endl;
+}
+static void BenchmarkDrawPackets()
+{
+	std::cout << "DrawPackets (per draw submission cost, 16 bit quantized meshes, 4 LODs)" << std::endl;
+	// Level data in cache, then well past it
+	BenchmarkDrawPacketsLevel(4000);
+	BenchmarkDrawPacketsLevel(40000);
+}
+
+// GameLevel.txt imported (parse, weld, optimize, LODs per unique model, then combined) vs the
+// same arrays read back from a level bake. HLOD proxies, compact geometry and meshlets are left
+// out of the cold side, so the real cold load is slower still.
+static void BenchmarkLevelBake()
+{
+	std::cout << "LevelBake (cold import vs warm load of a baked level)" << std::endl;
+	std::string levelPath = s_modelsFolder + "/../Levels/GameLevel.txt";
+	std::vector<H2B::VERTEX> vertices;
+	std::vector<unsigned> indices;
+	std::vector<H2B::MESH> meshes;
+	std::vector<H2B::MATERIAL> materials;
+	std::vector<GW::MATH::GMATRIXF> transforms;
+	std::set<std::string> names;
+	double coldMS = TimeMS([&] {
+		vertices.clear(); indices.clear(); meshes.clear(); materials.clear(); transforms.clear(); names.clear();
+		std::map<std::string, std::vector<GW::MATH::GMATRIXF>> modelInstances;
+		for (const LEVEL_ENTRY& entry : ReadLevelInstances(levelPath))
+			modelInstances[entry.modelFile].push_back(entry.transform);
+		for (const auto& model : modelInstances)
+		{
+			H2B::Parser parsed;
+			if (!parsed.Parse((s_modelsFolder + "/" + model.first).c_str()))
+				continue;
+			WeldVertices(parsed.vertices, parsed.indices);
+			OptimizeMesh(parsed);
+			unsigned vertexStart = (unsigned)vertices.size(), indexStart = (unsigned)indices.size();
+			for (H2B::MESH mesh : parsed.meshes)
+			{
+				std::vector<unsigned> lods[m_lodLevels];
+				float errors[m_lodLevels];
+				GenerateMeshLODs(parsed.vertices.data(), parsed.vertices.size(), &parsed.indices[mesh.drawInfo.indexOffset],
+								 mesh.drawInfo.indexCount, lods, errors);
+				for (const std::vector<unsigned>& lod : lods)
+					indices.insert(indices.end(), lod.begin(), lod.end());
+				mesh.name = names.insert(mesh.name ? mesh.name : "").first->c_str();
+				mesh.drawInfo.indexOffset += indexStart;
+				meshes.push_back(mesh);
+			}
+			for (H2B::MATERIAL material : parsed.materials)
+			{
+				for (int k = 0; k < 10; k++)
+					if (*((&material.name) + k) != nullptr)
+						*((&material.name) + k) = names.insert(*((&material.name) + k)).first->c_str();
+				materials.push_back(material);
+			}
+			for (unsigned& index : parsed.indices)
+				index += vertexStart;
+			vertices.insert(vertices.end(), parsed.vertices.begin(), parsed.vertices.end());
+			indices.insert(indices.end(), parsed.indices.begin(), parsed.indices.end());
+			transforms.insert(transforms.end(), model.second.begin(), model.second.end());
+		}
+	}, 1);
+
+	uint64_t key = 0;
+	double hashMS = TimeMS([&] { HashLevelSources(levelPath, s_modelsFolder, key); });
+	std::string bakePath = (std::filesystem::temp_directory_path() / "LevelRenderer_Benchmark.lvb").string();
+	double writeMS = TimeMS([&] {
+		LevelBakeWriter bake;
+		std::vector<H2B::MESH> bakedMeshes = meshes;
+		for (H2B::MESH& mesh : bakedMeshes)
+			mesh.name = bake.AddString(mesh.name);
+		std::vector<H2B::MATERIAL> bakedMaterials = materials;
+		for (H2B::MATERIAL& material : bakedMaterials)
+			for (int k = 0; k < 10; k++)
+				*((&material.name) + k) = bake.AddString(*((&material.name) + k));
+		bake.AddArray(0, vertices);
+		bake.AddArray(1, indices);
+		bake.AddArray(2, bakedMeshes);
+		bake.AddArray(3, bakedMaterials);
+		bake.AddArray(4, transforms);
+		bake.Save(bakePath, key);
+	}, 1);
+
+	std::vector<H2B::VERTEX> warmVertices;
+	std::vector<unsigned> warmIndices;
+	std::vector<H2B::MESH> warmMeshes;
+	std::vector<H2B::MATERIAL> warmMaterials;
+	std::vector<GW::MATH::GMATRIXF> warmTransforms;
+	LevelBakeReader reader;
+	bool read = false;
+	double warmMS = TimeMS([&] {
+		uint64_t warmKey = 0;
+		read = HashLevelSources(levelPath, s_modelsFolder, warmKey) && reader.Open(bakePath, warmKey) &&
+			   reader.ReadArray(0, warmVertices) && reader.ReadArray(1, warmIndices) && reader.ReadArray(2, warmMeshes) &&
+			   reader.ReadArray(3, warmMaterials) && reader.ReadArray(4, warmTransforms);
+		for (H2B::MESH& mesh : warmMeshes)
+			mesh.name = reader.Relocate(mesh.name);
+		for (H2B::MATERIAL& material : warmMaterials)
+			for (int k = 0; k < 10; k++)
+				*((&material.name) + k) = reader.Relocate(*((&material.name) + k));
+	});
+	bool same = read && warmVertices.size() == vertices.size() &&
+				std::memcmp(warmVertices.data(), vertices.data(), sizeof(H2B::VERTEX) * vertices.size()) == 0 &&
+				warmIndices == indices && warmMeshes.size() == meshes.size() && warmTransforms.size() == transforms.size();
+	for (size_t m = 0; same && m < meshes.size(); m++)
+		same = std::strcmp(warmMeshes[m].name, meshes[m].name) == 0 && warmMeshes[m].drawInfo.indexOffset == meshes[m].drawInfo.indexOffset;
+	for (size_t m = 0; same && m < materials.size(); m++)
+		same = std::strcmp(warmMaterials[m].name, materials[m].name) == 0;
+
+	// Touching one source byte must miss
+	uint64_t changedKey = key;
+	std::string bytes;
+	{
+		std::ifstream level(levelPath, std::ios_base::binary);
+		bytes.assign(std::istreambuf_iterator<char>(level), std::istreambuf_iterator<char>());
+	}
+	std::string changedPath = (std::filesystem::temp_directory_path() / "LevelRenderer_Benchmark.txt").string();
+	std::ofstream(changedPath, std::ios_base::binary) << bytes << " ";
+	HashLevelSources(changedPath, s_modelsFolder, changedKey);
+	LevelBakeReader stale;
+	bool rebuilt = changedKey != key && !stale.Open(bakePath, changedKey);
+	reader.Close();
+	std::remove(changedPath.c_str());
+	std::remove(bakePath.c_str());
+
+	std::cout << "  cold import                 " << std::fixed << std::setprecision(1) << coldMS << " ms ("
+			  << meshes.size() << " meshes, " << transforms.size() << " instances)" << std::endl;
+	std::cout << "  bake written                " << std::setprecision(1) << writeMS << " ms, "
+			  << (sizeof(H2B::VERTEX) * vertices.size() + sizeof(unsigned) * indices.size()) / 1024 << " KiB of geometry" << std::endl;
+	std::cout << "  source hash (key)           " << std::setprecision(2) << hashMS << " ms" << std::endl;
+	std::cout << "  warm load (hash + map)      " << std::setprecision(2) << warmMS << " ms" << std::endl;
+	std::cout << "  warm arrays match cold      " << Check(same) << std::endl;
+	std::cout << "  source change misses        " << Check(rebuilt) << std::endl;
+}
+
+// Every model read loose (one open/read/close each) vs out of one mapped model pack, raw bytes
+// and parsed. Files are in the OS cache after the first run, so this is the per file overhead
+// only. On a cold cache or a network share every open also pays a seek or a round trip.
+static void BenchmarkModelPack()
+{
+	std::cout << "ModelPack (loose .h2b files vs one mapped pack)" << std::endl;
+	std::vector<std::string> files = ListModels();
+	std::string packPath = (std::filesystem::temp_directory_path() / "LevelRenderer_Benchmark.h2bpack").string();
+	double packMS = TimeMS([&] { WriteModelPack(files, packPath); }, 1);
+	std::vector<std::string> names;
+	for (const std::string& file : files)
+		names.push_back(std::filesystem::path(file).filename().string());
+
+	uint64_t looseSum = 0, packSum = 0;
+	std::vector<char> bytes;
+	double looseReadMS = TimeMS([&] {
+		looseSum = 0;
+		for (const std::string& file : files)
+		{
+			ReadWholeFile(file, bytes);
+			looseSum = HashBytes(bytes.data(), (std::min)(bytes.size(), (size_t)64), looseSum);
+		}
+	});
+	double packReadMS = TimeMS([&] {
+		ModelPack pack;
+		pack.Open(packPath);
+		packSum = 0;
+		for (const std::string& name : names)
+		{
+			const unsigned char* data = nullptr;
+			size_t size = 0;
+			if (pack.Find(name.c_str(), data, size))
+				packSum = HashBytes(data, (std::min)(size, (size_t)64), packSum);
+		}
+	});
+
+	H2B::Parser parsed;
+	size_t looseVertices = 0, packVertices = 0;
+	double looseParseMS = TimeMS([&] {
+		looseVertices = 0;
+		for (const std::string& file : files)
+			if (parsed.Parse(file.c_str()))
+				looseVertices += parsed.vertices.size();
+	});
+	bool sameModels = true;
+	double packParseMS = TimeMS([&] {
+		ModelPack pack;
+		pack.Open(packPath);
+		packVertices = 0;
+		for (const std::string& name : names)
+		{
+			const unsigned char* data = nullptr;
+			size_t size = 0;
+			if (pack.Find(name.c_str(), data, size) && parsed.Parse(data, size))
+				packVertices += parsed.vertices.size();
+			else
+				sameModels = false;
+		}
+	});
+	std::remove(packPath.c_str());
+
+	std::cout << "  pack written                " << std::fixed << std::setprecision(2) << packMS << " ms, " << files.size() << " models" << std::endl;
+	std::cout << "  read, loose files           " << std::setprecision(3) << looseReadMS << " ms" << std::endl;
+	std::cout << "  read, mapped pack           " << std::setprecision(3) << packReadMS << " ms" << std::endl;
+	std::cout << "  parse, loose files          " << std::setprecision(3) << looseParseMS << " ms" << std::endl;
+	std::cout << "  parse, mapped pack          " << std::setprecision(3) << packParseMS << " ms" << std::endl;
+	std::cout << "  same models from both       " << Check(sameModels && looseSum == packSum && looseVertices == packVertices) << std::endl;
+}
+
+// LZ block codec on the shipped models: ratio, encode/decode speed, and what a level load of
+// every model would take at a few disk/network bandwidths, loose bytes vs compressed bytes plus
+// the threaded decode. Also checks a compressed pack unpacks to the original files.
+static void BenchmarkBlockCompression()
+{
+	unsigned threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+	std::cout << "BlockCompression (" << m_compressionBlockSize / 1024 << " KiB LZ blocks, " << threads << " decode threads)" << std::endl;
+	std::vector<std::string> files = ListModels();
+	std::vector<uint8_t> raw;
+	std::vector<char> bytes;
+	for (const std::string& file : files)
+		if (ReadWholeFile(file, bytes))
+			raw.insert(raw.end(), bytes.begin(), bytes.end());
+
+	std::vector<uint8_t> stream;
+	std::vector<COMPRESSED_BLOCK> blocks;
+	double encodeMS = TimeMS([&] { stream.clear(); blocks.clear(); CompressBlocks(raw.data(), raw.size(), stream, blocks); }, 3);
+	std::vector<uint8_t> decoded(raw.size());
+	std::vector<BLOCK_JOB> jobs;
+	size_t at = 0;
+	for (const COMPRESSED_BLOCK& block : blocks)
+	{
+		jobs.push_back({ &block, decoded.data() + at });
+		at += block.rawSize;
+	}
+	bool ok = true;
+	double decodeMS = TimeMS([&] { ok &= DecompressBlocks(stream.data(), jobs, 1); });
+	double decodeThreadedMS = TimeMS([&] { ok &= DecompressBlocks(stream.data(), jobs, threads); });
+	bool same = ok && decoded == raw;
+	double ratio = (double)raw.size() / stream.size();
+	auto mbs = [](size_t _bytes, double _ms) { return _bytes / (_ms * 1000.0); };
+
+	std::cout << "  models                      " << raw.size() / 1024 << " KiB -> " << stream.size() / 1024 << " KiB in "
+			  << blocks.size() << " blocks, ratio " << std::fixed << std::setprecision(2) << ratio << std::endl;
+	std::cout << "  encode                      " << std::setprecision(1) << mbs(raw.size(), encodeMS) << " MB/s" << std::endl;
+	std::cout << "  decode, 1 thread            " << std::setprecision(1) << mbs(raw.size(), decodeMS) << " MB/s" << std::endl;
+	std::cout << "  decode, threaded            " << std::setprecision(1) << mbs(raw.size(), decodeThreadedMS) << " MB/s" << std::endl;
+	std::cout << "  round trip matches          " << Check(same) << std::endl;
+	// Load = transfer + decode (decode overlaps nothing here, so this is the pessimistic case)
+	for (double bandwidth : { 50.0, 200.0, 1000.0 })
+	{
+		double looseMS = raw.size() / (bandwidth * 1000.0);
+		double packedMS = stream.size() / (bandwidth * 1000.0) + decodeThreadedMS;
+		std::cout << "  at " << std::setw(5) << std::setprecision(0) << bandwidth << " MB/s: load " << std::setprecision(2)
+				  << looseMS << " ms raw vs " << packedMS << " ms compressed (" << std::setprecision(2) << looseMS / packedMS << "x)" << std::endl;
+	}
+
+	// The loader's path, a compressed pack unpacked on worker threads
+	std::string packPath = (std::filesystem::temp_directory_path() / "LevelRenderer_Benchmark_LZ.h2bpack").string();
+	bool packed = WriteModelPack(files, packPath, MODEL_PACK_COMPRESSED);
+	ModelPack pack;
+	std::vector<std::string> names;
+	for (const std::string& file : files)
+		names.push_back(std::filesystem::path(file).filename().string());
+	std::vector<unsigned char> unpacked;
+	std::vector<MODEL_PACK_SPAN> spans;
+	bool unpackedOK = false;
+	double unpackMS = TimeMS([&] { unpackedOK = packed && pack.Open(packPath) && pack.IsCompressed() && pack.Unpack(names, unpacked, spans, threads); });
+	for (size_t i = 0; unpackedOK && i < files.size(); i++)
+		unpackedOK = ReadWholeFile(files[i], bytes) && spans[i].size == bytes.size() && std::memcmp(spans[i].data, bytes.data(), bytes.size()) == 0;
+	pack.Close();
+	std::error_code error;
+	std::cout << "  compressed pack             " << std::filesystem::file_size(packPath, error) / 1024 << " KiB, unpacked in "
+			  << std::setprecision(2) << unpackMS << " ms, files match " << Check(unpackedOK) << std::endl;
+	std::remove(packPath.c_str());
+}
+
+// H2B::Writer on the shipped models: parse -> serialize must give back the exact file, and
+// what H2BOptimizer saves at load, parsing + weld + vertex cache optimize every model versus
+// parsing the already optimized bytes.
+static void BenchmarkH2BWriter()
+{
+	std::cout << "H2BWriter (round trip and build time optimization)" << std::endl;
+	std::vector<std::string> files = ListModels();
+	std::vector<std::vector<char>> sources(files.size()), optimized(files.size());
+	H2B::Parser parsed;
+	unsigned roundTrips = 0;
+	std::vector<char> bytes;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (!ReadWholeFile(files[i], sources[i]) || !parsed.Parse(sources[i].data(), sources[i].size()))
+			continue;
+		H2B::Writer::Serialize(parsed, bytes);
+		roundTrips += bytes == sources[i] ? 1 : 0;
+		WeldVertices(parsed.vertices, parsed.indices);
+		OptimizeMesh(parsed);
+		H2B::Writer::Serialize(parsed, optimized[i]);
+	}
+
+	size_t vertices = 0;
+	double importMS = TimeMS([&] {
+		vertices = 0;
+		for (const std::vector<char>& source : sources)
+			if (parsed.Parse(source.data(), source.size()))
+			{
+				WeldVertices(parsed.vertices, parsed.indices);
+				OptimizeMesh(parsed);
+				vertices += parsed.vertices.size();
+			}
+	}, 3);
+	size_t preVertices = 0;
+	double preOptimizedMS = TimeMS([&] {
+		preVertices = 0;
+		for (const std::vector<char>& source : optimized)
+			if (parsed.Parse(source.data(), source.size()))
+				preVertices += parsed.vertices.size();
+	}, 3);
+
+	std::cout << "  byte exact round trips      " << roundTrips << " of " << files.size() << std::endl;
+	std::cout << "  parse + weld + optimize     " << std::fixed << std::setprecision(3) << importMS << " ms" << std::endl;
+	std::cout << "  parse, pre-optimized        " << std::setprecision(3) << preOptimizedMS << " ms ("
+			  << std::setprecision(1) << importMS / preOptimizedMS << "x)" << std::endl;
+	std::cout << "  same vertices from both     " << Check(vertices == preVertices) << std::endl;
+
+	// Damaged files: every truncation and every inflated header count has to be refused
+	unsigned damaged = 0, refused = 0;
+	for (const std::vector<char>& source : sources)
+	{
+		if (source.size() < 20)
+			continue;
+		for (size_t cut = 0; cut < source.size(); cut += (std::max<size_t>)(1, source.size() / 97))
+		{
+			damaged++;
+			refused += parsed.Parse(source.data(), cut) ? 0 : 1;
+		}
+		for (unsigned count = 0; count < 4; count++)
+		{
+			std::vector<char> inflated = source;
+			unsigned huge = 0xFFFFFFF0u;
+			std::memcpy(inflated.data() + 4 + count * 4, &huge, 4);
+			damaged++;
+			refused += parsed.Parse(inflated.data(), inflated.size()) ? 0 : 1;
+		}
+	}
+	std::cout << "  damaged files refused       " << refused << " of " << damaged << " " << Check(refused == damaged) << std::endl;
+}
+
+// Both shipped levels as text vs the binary export: file size, reading them into grouped
+// transforms + lights, and that both give the same level
+static void BenchmarkBinaryLevel()
+{
+	std::cout << "BinaryLevel (text export vs grouped binary export)" << std::endl;
+	for (const char* name : { "GameLevel", "GameLevel2" })
+	{
+		std::string textPath = s_modelsFolder + "/../Levels/" + name + ".txt";
+		std::string binaryPath = (std::filesystem::temp_directory_path() / (std::string("LevelRenderer_Benchmark_") + name + ".lvl")).string();
+		LEVEL_FILE_CONTENT text, binary;
+		uint64_t sourceHash = 0;
+		if (!ReadLevelText(textPath, text) || !HashLevelText(textPath, sourceHash) || !WriteLevelFile(text, binaryPath, sourceHash))
+			continue;
+		size_t transforms = 0;
+		double textMS = TimeMS([&] { ReadLevelText(textPath, text); });
+		double binaryMS = TimeMS([&] {
+			LevelFileReader level;
+			level.Open(binaryPath);
+			binary = LEVEL_FILE_CONTENT();
+			transforms = 0;
+			for (uint32_t i = 0; i < level.ModelCount(); i++)
+			{
+				binary.models[level.ModelName(i)].assign(level.Transforms(i), level.Transforms(i) + level.TransformCount(i));
+				transforms += level.TransformCount(i);
+			}
+			binary.pointLights.assign(level.PointLights(), level.PointLights() + level.PointLightCount());
+			binary.spotLights.assign(level.SpotLights(), level.SpotLights() + level.SpotLightCount());
+		});
+		bool same = text.models.size() == binary.models.size() && text.pointLights.size() == binary.pointLights.size() &&
+					text.spotLights.size() == binary.spotLights.size() &&
+					std::memcmp(text.pointLights.data(), binary.pointLights.data(), sizeof(LEVEL_FILE_POINT_LIGHT) * text.pointLights.size()) == 0 &&
+					std::memcmp(text.spotLights.data(), binary.spotLights.data(), sizeof(LEVEL_FILE_SPOT_LIGHT) * text.spotLights.size()) == 0;
+		for (auto t = text.models.begin(), b = binary.models.begin(); same && t != text.models.end(); ++t, ++b)
+			same = t->first == b->first && t->second.size() == b->second.size() &&
+				   std::memcmp(t->second.data(), b->second.data(), sizeof(LEVEL_FILE_MATRIX) * t->second.size()) == 0;
+		std::error_code error;
+		uint64_t textBytes = std::filesystem::file_size(textPath, error), binaryBytes = std::filesystem::file_size(binaryPath, error);
+
+		// The .lvl is only read while the .txt next to it is the one it was converted from
+		std::string copiedText = std::filesystem::path(binaryPath).replace_extension(".txt").string();
+		std::filesystem::copy_file(textPath, copiedText, std::filesystem::copy_options::overwrite_existing, error);
+		LevelFileReader current;
+		bool fresh = OpenCurrentLevelFile(copiedText, current);
+		current.Close();
+		std::ofstream(copiedText, std::ios_base::app) << "\n";
+		bool stale = !OpenCurrentLevelFile(copiedText, current);
+		std::remove(copiedText.c_str());
+		std::remove(binaryPath.c_str());
+
+		std::cout << "  " << name << ": " << binary.models.size() << " models, " << transforms << " transforms, "
+				  << binary.pointLights.size() + binary.spotLights.size() << " lights" << std::endl;
+		std::cout << "  size                        " << textBytes / 1024 << " KiB -> " << binaryBytes / 1024 << " KiB ("
+				  << std::fixed << std::setprecision(1) << (double)textBytes / binaryBytes << "x smaller)" << std::endl;
+		std::cout << "  read + group, text          " << std::setprecision(3) << textMS << " ms" << std::endl;
+		std::cout << "  read, binary                " << std::setprecision(3) << binaryMS << " ms ("
+				  << std::setprecision(1) << textMS / binaryMS << "x)" << std::endl;
+		std::cout << "  same level from both        " << Check(same) << std::endl;
+		std::cout << "  edited text reread          " << Check(fresh && stale) << std::endl;
+	}
+}
+
+// 40k transforms as 2000 four level trees (1 + 4 + 4 + 11 nodes). Moving 1% of the roots a
+// frame: recomputing every world matrix (what a flat level has to do to keep children attached)
+// vs the dirty subtree update, plus how much of the instance buffer actually changed.
+static void BenchmarkSceneHierarchy()
+{
+	std::cout << "SceneHierarchy (dirty subtree world matrix updates)" << std::endl;
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> offset(-5.0f, 5.0f);
+	auto translation = [&](float _x, float _y, float _z) {
+		GW::MATH::GMATRIXF matrix = GW::MATH::GIdentityMatrixF;
+		matrix.row4 = { _x, _y, _z, 1 };
+		return matrix;
+	};
+	// every node's parent and world matrix, parents before children like an export
+	std::vector<int> parents;
+	std::vector<GW::MATH::GMATRIXF> worlds;
+	std::vector<unsigned> roots;
+	for (unsigned tree = 0; tree < 2000; tree++)
+	{
+		roots.push_back((unsigned)worlds.size());
+		int level[4] = { -1, -1, -1, -1 };
+		for (unsigned node = 0; node < 20; node++)
+		{
+			int depth = node == 0 ? 0 : node < 5 ? 1 : node < 9 ? 2 : 3;
+			int parent = depth == 0 ? -1 : level[depth - 1];
+			GW::MATH::GMATRIXF local = translation(offset(rng), offset(rng), offset(rng));
+			GW::MATH::GMATRIXF world = local;
+			if (parent >= 0)
+				GW::MATH::GMatrix::MultiplyMatrixF(local, worlds[parent], world);
+			level[depth] = (int)worlds.size();
+			parents.push_back(parent);
+			worlds.push_back(world);
+		}
+	}
+	// shuffle the slots so parents don't come first, Build has to order them
+	std::vector<unsigned> order(worlds.size());
+	for (unsigned i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::shuffle(order.begin(), order.end(), rng);
+	std::vector<unsigned> slotOf(order.size());
+	for (unsigned i = 0; i < order.size(); i++)
+		slotOf[order[i]] = i;
+	std::vector<int> slotParents(order.size());
+	std::vector<GW::MATH::GMATRIXF> transforms(order.size());
+	for (unsigned i = 0; i < order.size(); i++)
+	{
+		slotParents[i] = parents[order[i]] < 0 ? -1 : (int)slotOf[parents[order[i]]];
+		transforms[i] = worlds[order[i]];
+	}
+
+	SceneHierarchy hierarchy;
+	double buildMS = TimeMS([&] { hierarchy.Build(slotParents.data(), transforms.data(), (unsigned)transforms.size()); }, 3);
+	std::vector<GW::MATH::GMATRIXF> locals(transforms.size()), flat(transforms.size());
+	// flat: every world matrix again in the export's parent first order, scalar Gateware multiplies
+	auto recomputeAll = [&]() {
+		for (unsigned i = 0; i < locals.size(); i++)
+			locals[i] = hierarchy.GetLocal(i);
+		for (unsigned node = 0; node < parents.size(); node++)
+		{
+			unsigned slot = slotOf[node];
+			if (parents[node] < 0)
+				flat[slot] = locals[slot];
+			else
+				GW::MATH::GMatrix::MultiplyMatrixF(locals[slot], flat[slotOf[parents[node]]], flat[slot]);
+		}
+	};
+	double flatMS = TimeMS(recomputeAll);
+
+	std::vector<TRANSFORM_RANGE> ranges;
+	unsigned moved = 0;
+	size_t rangeTransforms = 0, rangeCount = 0;
+	std::uniform_int_distribution<unsigned> pick(0, (unsigned)roots.size() - 1);
+	double dirtyMS = TimeMS([&] {
+		for (unsigned r = 0; r < roots.size() / 100; r++)
+		{
+			unsigned slot = slotOf[roots[pick(rng)]];
+			GW::MATH::GMATRIXF local = hierarchy.GetLocal(slot);
+			local.row4.y += 0.01f;
+			hierarchy.SetLocal(slot, local);
+		}
+		moved = hierarchy.Update(transforms.data(), ranges);
+	});
+	for (const TRANSFORM_RANGE& range : ranges)
+		rangeTransforms += range.count;
+	rangeCount = ranges.size();
+
+	// both ways agree once every root has moved
+	for (unsigned root : roots)
+	{
+		GW::MATH::GMATRIXF local = hierarchy.GetLocal(slotOf[root]);
+		local.row4.x += 1.0f;
+		hierarchy.SetLocal(slotOf[root], local);
+	}
+	hierarchy.Update(transforms.data(), ranges);
+	recomputeAll();
+	float worst = 0;
+	for (unsigned i = 0; i < flat.size(); i++)
+		for (int k = 0; k < 16; k++)
+			worst = (std::max)(worst, std::fabs(flat[i].data[k] - transforms[i].data[k]));
+
+	std::cout << "  " << transforms.size() << " transforms, " << roots.size() << " trees, " << hierarchy.Depth() << " levels" << std::endl;
+	std::cout << "  build (order + locals)      " << std::fixed << std::setprecision(3) << buildMS << " ms" << std::endl;
+	std::cout << "  every world matrix          " << std::setprecision(3) << flatMS << " ms" << std::endl;
+	std::cout << "  1% of roots moved, dirty    " << std::setprecision(3) << dirtyMS << " ms, " << moved << " transforms in "
+			  << rangeCount << " ranges (" << std::setprecision(1) << 100.0 * rangeTransforms / transforms.size() << "% of the buffer)" << std::endl;
+	std::cout << "  matches full recompute      " << Check(worst < 1e-3f) << " (max error " << std::scientific
+			  << std::setprecision(1) << worst << ")" << std::defaultfloat << std::endl;
+}
+
+// Uploading only the moved ranges of the dynamic block into a ring of copies vs the whole buffer each frame
+static void BenchmarkDynamicTransforms()
+{
+	std::cout << "DynamicTransforms (static/dynamic split, changed ranges into a ring of copies)" << std::endl;
+	const unsigned staticCount = 36000, dynamicCount = 4000, frames = 200;
+	std::mt19937 rng(11);
+	std::vector<GW::MATH::GMATRIXF> transforms(staticCount + dynamicCount, GW::MATH::GIdentityMatrixF);
+	// what the GPU would hold: every transform, or the ring of dynamic copies
+	std::vector<GW::MATH::GMATRIXF> fullBuffer(transforms.size());
+	std::vector<GW::MATH::GMATRIXF> ring(dynamicCount * m_dynamicTransformFrames, GW::MATH::GIdentityMatrixF);
+	DynamicTransformRing tracker;
+	TRANSFORM_RANGE dynamicBlock = { staticCount, dynamicCount };
+	tracker.Reset(&dynamicBlock, 1, m_dynamicTransformFrames);
+
+	// a tenth of the dynamic instances move each frame, in runs of 8 like a small subtree
+	std::uniform_int_distribution<unsigned> pick(0, dynamicCount / 8 - 1);
+	std::vector<std::vector<TRANSFORM_RANGE>> moves(frames);
+	for (auto& frame : moves)
+		for (unsigned m = 0; m < dynamicCount / 80; m++)
+			frame.push_back({ staticCount + pick(rng) * 8, 8 });
+	auto move = [&](unsigned _frame) {
+		for (const TRANSFORM_RANGE& range : moves[_frame])
+			for (unsigned i = range.first; i < range.first + range.count; i++)
+				transforms[i].row4.y += 0.01f;
+	};
+
+	size_t fullBytes = 0, blockBytes = 0, ringBytes = 0;
+	double fullMS = TimeMS([&] {
+		for (unsigned f = 0; f < frames; f++)
+		{
+			move(f);
+			std::memcpy(fullBuffer.data(), transforms.data(), sizeof(GW::MATH::GMATRIXF) * transforms.size());
+			fullBytes += sizeof(GW::MATH::GMATRIXF) * transforms.size();
+		}
+	}, 1);
+	double blockMS = TimeMS([&] {
+		for (unsigned f = 0; f < frames; f++)
+		{
+			move(f);
+			std::memcpy(ring.data(), transforms.data() + staticCount, sizeof(GW::MATH::GMATRIXF) * dynamicCount);
+			blockBytes += sizeof(GW::MATH::GMATRIXF) * dynamicCount;
+		}
+	}, 1);
+	// the ring copies start out as loaded
+	for (unsigned c = 0; c < m_dynamicTransformFrames; c++)
+		std::memcpy(ring.data() + c * dynamicCount, transforms.data() + staticCount, sizeof(GW::MATH::GMATRIXF) * dynamicCount);
+	bool matches = true;
+	double ringMS = TimeMS([&] {
+		for (unsigned f = 0; f < frames; f++)
+		{
+			move(f);
+			tracker.MarkMoved(moves[f].data(), moves[f].size());
+			const std::vector<TRANSFORM_RANGE>& writes = tracker.NextWrites();
+			GW::MATH::GMATRIXF* copy = ring.data() + tracker.CurrentCopy() * dynamicCount;
+			for (const TRANSFORM_RANGE& write : writes)
+			{
+				std::memcpy(copy + write.first, transforms.data() + staticCount + write.first, sizeof(GW::MATH::GMATRIXF) * write.count);
+				ringBytes += sizeof(GW::MATH::GMATRIXF) * write.count;
+			}
+			matches &= std::memcmp(copy, transforms.data() + staticCount, sizeof(GW::MATH::GMATRIXF) * dynamicCount) == 0;
+		}
+	}, 1);
+
+	std::cout << "  " << transforms.size() << " transforms, " << dynamicCount << " dynamic, " << frames << " frames of "
+			  << moves[0].size() * 8 << " moved, " << m_dynamicTransformFrames << " copies" << std::endl;
+	auto report = [&](const char* _name, double _ms, size_t _bytes) {
+		std::cout << "  " << _name << std::fixed << std::setprecision(3) << _ms / frames << " ms, "
+				  << std::setprecision(1) << _bytes / frames / 1024.0 << " KiB per frame" << std::defaultfloat << std::endl;
+	};
+	report("whole buffer re-upload     ", fullMS, fullBytes);
+	report("whole dynamic block        ", blockMS, blockBytes);
+	report("changed ranges into ring   ", ringMS, ringBytes);
+	std::cout << "  current copy matches       " << Check(matches) << std::endl;
+
+	// a dynamic set grown at runtime lands past static slots (HLOD proxies, other grown sets):
+	// the ring packs both ranges and a move over everything only streams the dynamic slots
+	const TRANSFORM_RANGE grown[] = { { staticCount, dynamicCount / 2 }, { staticCount + dynamicCount, 64 } };
+	transforms.resize(staticCount + dynamicCount + 64, GW::MATH::GIdentityMatrixF);
+	tracker.Reset(grown, 2, m_dynamicTransformFrames);
+	std::vector<GW::MATH::GMATRIXF> packed(tracker.Count() * m_dynamicTransformFrames, GW::MATH::GIdentityMatrixF);
+	for (GW::MATH::GMATRIXF& transform : transforms)
+		transform.row4.x += 1.0f;
+	TRANSFORM_RANGE everything = { 0, (unsigned)transforms.size() };
+	unsigned outside = tracker.MarkMoved(&everything, 1);
+	const std::vector<TRANSFORM_RANGE>& grownWrites = tracker.NextWrites();
+	GW::MATH::GMATRIXF* copy = packed.data() + tracker.CurrentCopy() * tracker.Count();
+	unsigned streamed = 0;
+	for (const TRANSFORM_RANGE& write : grownWrites)
+	{
+		std::memcpy(copy + write.first, transforms.data() + tracker.Slot(write.first), sizeof(GW::MATH::GMATRIXF) * write.count);
+		streamed += write.count;
+	}
+	bool grownMatches = streamed == tracker.Count() && outside == transforms.size() - tracker.Count();
+	for (const TRANSFORM_RANGE& range : grown)
+		for (unsigned slot = range.first; slot < range.first + range.count; slot++)
+			grownMatches &= std::memcmp(&copy[tracker.PackedIndex(slot)], &transforms[slot], sizeof(GW::MATH::GMATRIXF)) == 0;
+	grownMatches &= tracker.PackedIndex(staticCount + dynamicCount / 2) == ~0u;
+	std::cout << "  grown set, statics left out " << Check(grownMatches) << " (" << streamed << " of " << transforms.size()
+			  << " streamed)" << std::endl;
+}
+
+// Removing, adding and moving instances through per set free lists vs rebuilding the level's buffers
+static void BenchmarkLevelEdits()
+{
+	std::cout << "LevelEdits (free slots per instance set vs reloading the level)" << std::endl;
+	const unsigned setCount = 200, perSet = 200, frames = 100;
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	LOCAL_BOUNDS local = { { -1, -1, -1 }, { 1, 1, 1 }, { 0, 0, 0 }, 1.7320508f };
+	std::vector<GW::MATH::GMATRIXF> transforms(setCount * perSet, GW::MATH::GIdentityMatrixF);
+	for (GW::MATH::GMATRIXF& transform : transforms)
+		transform.row4 = { position(rng), position(rng), position(rng), 1 };
+	INSTANCE_BOUNDS bounds;
+	bounds.Resize(transforms.size());
+	TransformBounds(local, transforms.data(), 0, transforms.size(), bounds);
+	std::vector<GW::MATH::GMATRIXF> gpu(transforms);
+
+	// per frame: 50 removed, 50 added back to the same models, 100 moved
+	std::uniform_int_distribution<unsigned> pickSlot(0, (unsigned)transforms.size() - 1);
+	InstanceFreeList freeList;
+	freeList.Resize(setCount, transforms.size());
+	std::vector<unsigned> removedSets;
+	size_t editBytes = 0, reused = 0;
+	auto place = [&](unsigned _slot) {
+		transforms[_slot].row4 = { position(rng), position(rng), position(rng), 1 };
+		TransformBounds(local, transforms.data(), _slot, 1, bounds);
+		std::memcpy(&gpu[_slot], &transforms[_slot], sizeof(GW::MATH::GMATRIXF)); // one box sized update
+		editBytes += sizeof(GW::MATH::GMATRIXF);
+	};
+	double editMS = TimeMS([&] {
+		for (unsigned f = 0; f < frames; f++)
+		{
+			removedSets.clear();
+			for (unsigned r = 0; r < 50; r++)
+			{
+				unsigned slot = pickSlot(rng);
+				if (freeList.Release(slot / perSet, slot, true))
+					removedSets.push_back(slot / perSet);
+			}
+			for (unsigned set : removedSets)
+			{
+				unsigned slot = freeList.Acquire(set);
+				reused += slot != ~0u;
+				if (slot != ~0u)
+					place(slot);
+			}
+			for (unsigned m = 0; m < 100; m++)
+			{
+				unsigned slot = pickSlot(rng);
+				if (!freeList.IsHidden(slot))
+					place(slot);
+			}
+		}
+	}, 1);
+	// the same frames as full rebuilds: every bound again and the whole buffer re-created
+	size_t reloadBytes = 0;
+	double reloadMS = TimeMS([&] {
+		for (unsigned f = 0; f < frames; f++)
+		{
+			for (unsigned m = 0; m < 200; m++)
+				transforms[pickSlot(rng)].row4.y += 0.01f;
+			TransformBounds(local, transforms.data(), 0, transforms.size(), bounds);
+			std::memcpy(gpu.data(), transforms.data(), sizeof(GW::MATH::GMATRIXF) * transforms.size());
+			reloadBytes += sizeof(GW::MATH::GMATRIXF) * transforms.size();
+		}
+	}, 1);
+	// the edited bounds equal bounds computed from scratch
+	INSTANCE_BOUNDS fresh;
+	fresh.Resize(transforms.size());
+	TransformBounds(local, transforms.data(), 0, transforms.size(), fresh);
+	bool matches = fresh.radius == bounds.radius && fresh.centerX == bounds.centerX && fresh.minY == bounds.minY;
+
+	std::cout << "  " << transforms.size() << " transforms in " << setCount << " sets, " << frames << " frames of 50 removes, "
+			  << "50 adds, 100 moves, " << freeList.HiddenSlots().size() << " slots left hidden" << std::endl;
+	std::cout << "  edits (free lists)  " << std::fixed << std::setprecision(4) << editMS / frames << " ms, "
+			  << std::setprecision(2) << editBytes / frames / 1024.0 << " KiB uploaded per frame, " << reused << " slots reused" << std::endl;
+	std::cout << "  full rebuild        " << std::setprecision(4) << reloadMS / frames << " ms, "
+			  << std::setprecision(2) << reloadBytes / frames / 1024.0 << " KiB uploaded per frame" << std::defaultfloat << std::endl;
+	std::cout << "  bounds match rebuild " << Check(matches) << std::endl;
+}
+
+// Diffs GameLevel against GameLevel2 and against a variant of itself: what each keeps, that the
+// counts add up and whether the switch edits the level or falls back to a full load
+static void BenchmarkLevelDelta()
+{
+	std::cout << "LevelDelta (switching by instance diff, full load when too little is kept)" << std::endl;
+	LEVEL_FILE_CONTENT first, second;
+	std::string levels = s_modelsFolder + "/../Levels/";
+	if (!ReadLevelText(levels + "GameLevel.txt", first) || !ReadLevelText(levels + "GameLevel2.txt", second))
+	{
+		std::cout << "  level exports not found" << std::endl;
+		return;
+	}
+	// a variant of GameLevel: 2% moved a little, 1% removed, 1% added
+	LEVEL_FILE_CONTENT variant = first;
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> roll(0.0f, 1.0f);
+	for (auto& model : variant.models)
+	{
+		std::vector<LEVEL_FILE_MATRIX> kept;
+		for (LEVEL_FILE_MATRIX transform : model.second)
+		{
+			float r = roll(rng);
+			if (r < 0.01f)
+				continue;
+			if (r < 0.03f)
+				transform.data[13] += 0.5f * m_levelDeltaMoveDistance;
+			kept.push_back(transform);
+			if (r > 0.99f)
+			{
+				transform.data[12] += 2.0f * m_levelDeltaMoveDistance;
+				kept.push_back(transform);
+			}
+		}
+		model.second.swap(kept);
+	}
+
+	struct TARGET { const char* name; const LEVEL_FILE_CONTENT* level; bool applies; };
+	for (const TARGET& target : { TARGET{ "GameLevel -> GameLevel2", &second, false }, TARGET{ "GameLevel -> variant", &variant, true } })
+	{
+		size_t current = 0, next = 0, kept = 0, moved = 0, added = 0, removed = 0;
+		bool countsAddUp = true, movesClose = true;
+		double diffMS = 0;
+		for (const auto& model : first.models)
+		{
+			const std::vector<LEVEL_FILE_MATRIX> none;
+			auto found = target.level->models.find(model.first);
+			const std::vector<LEVEL_FILE_MATRIX>& wanted = found == target.level->models.end() ? none : found->second;
+			const GW::MATH::GMATRIXF* transforms = reinterpret_cast<const GW::MATH::GMATRIXF*>(model.second.data());
+			const GW::MATH::GMATRIXF* nextTransforms = reinterpret_cast<const GW::MATH::GMATRIXF*>(wanted.data());
+			std::vector<unsigned> slots(model.second.size());
+			for (unsigned i = 0; i < slots.size(); i++)
+				slots[i] = i;
+			INSTANCE_DELTA delta;
+			diffMS += TimeMS([&] { DiffInstances(transforms, slots.data(), slots.size(), nextTransforms, wanted.size(), delta); });
+			countsAddUp &= delta.kept + delta.moved.size() + delta.removed.size() == slots.size() &&
+						   delta.kept + delta.moved.size() + delta.added.size() == wanted.size();
+			for (const auto& move : delta.moved)
+			{
+				const GW::MATH::GMATRIXF& from = transforms[move.first];
+				const GW::MATH::GMATRIXF& to = nextTransforms[move.second];
+				float x = from.row4.x - to.row4.x, y = from.row4.y - to.row4.y, z = from.row4.z - to.row4.z;
+				movesClose &= MatrixDifference(from, to, false) <= m_levelDeltaTolerance &&
+							  std::sqrt(x * x + y * y + z * z) <= m_levelDeltaMoveDistance;
+			}
+			current += slots.size();
+			kept += delta.kept;
+			moved += delta.moved.size();
+			added += delta.added.size();
+			removed += delta.removed.size();
+		}
+		// models only the target places come in with all their instances
+		for (const auto& model : target.level->models)
+		{
+			next += model.second.size();
+			if (first.models.count(model.first) == 0)
+				added += model.second.size();
+		}
+		bool applies = DeltaWorthApplying(kept, current, next);
+		std::cout << "  " << target.name << ": " << next << " instances, " << kept << " kept, " << moved << " moved, "
+				  << added << " added, " << removed << " removed, diff " << std::fixed << std::setprecision(3) << diffMS
+				  << " ms" << std::defaultfloat << std::endl;
+		std::cout << "    counts add up " << Check(countsAddUp) << ", moves keep rotation and stay close " << Check(movesClose)
+				  << ", " << (applies ? "delta applies " : "full load ") << Check(applies == target.applies) << std::endl;
+	}
+}
+
+// Streaming grid cells around a fast moving camera under a byte budget, with and without velocity prefetch
+static void BenchmarkWorldPartition()
+{
+	std::cout << "WorldPartition (camera driven cell streaming under a memory budget)" << std::endl;
+	// 200k instances over 4 km x 4 km, 64 byte matrices + a 4 byte slot each
+	const unsigned instanceCount = 200000, frames = 300;
+	const float worldSize = 4096.0f, frameSeconds = 1.0f / 60.0f, speed = 600.0f;
+	std::mt19937 rng(9);
+	std::uniform_real_distribution<float> place(0.0f, worldSize);
+	std::vector<float> positions(instanceCount * 3);
+	for (unsigned i = 0; i < instanceCount; i++)
+	{
+		positions[i * 3] = place(rng);
+		positions[i * 3 + 1] = 0;
+		positions[i * 3 + 2] = place(rng);
+	}
+	WorldGrid grid;
+	double buildMS = TimeMS([&] { grid.Build(positions.data(), instanceCount, m_partitionCellSize); }, 3);
+	std::vector<size_t> cellBytes(grid.CellCount());
+	size_t worldBytes = 0;
+	for (unsigned c = 0; c < grid.CellCount(); c++)
+		worldBytes += cellBytes[c] = grid.Cell(c).itemCount * (sizeof(GW::MATH::GMATRIXF) + sizeof(uint32_t));
+
+	// frames are shortened 8x so this runs quickly, a load takes a frame of "disk" time (a little
+	// slower than the camera needs) and the budget is cut to 256 KiB so the camera's path doesn't fit
+	const auto frameTime = std::chrono::microseconds(2000), loadTime = std::chrono::microseconds(2000);
+	const size_t budget = 256u << 10;
+	unsigned modeMisses[2] = {};
+	for (bool prefetch : { false, true })
+	{
+		CellStreamer streamer;
+		std::atomic<unsigned> loads(0);
+		streamer.Start(&grid, cellBytes, [&](unsigned _cell, std::vector<unsigned char>& _payload) {
+			std::this_thread::sleep_for(loadTime);
+			_payload.assign(cellBytes[_cell], 0);
+			loads++;
+		}, budget);
+		float eye[3] = { 200.0f, 0, 200.0f }, velocity[3] = { speed * 0.8f, 0, speed * 0.6f }, still[3] = { 0, 0, 0 };
+		unsigned misses = 0, evictions = 0;
+		size_t peakBytes = 0;
+		streamer.Update(eye, still, true);
+		for (unsigned f = 0; f < frames; f++)
+		{
+			for (int k = 0; k < 3; k += 2)
+				eye[k] += velocity[k] * frameSeconds;
+			streamer.Update(eye, prefetch ? velocity : still, false);
+			streamer.TakeLoaded().clear();
+			evictions += (unsigned)streamer.Evicted().size();
+			peakBytes = (std::max)(peakBytes, streamer.ResidentBytes());
+			unsigned under = grid.CellAt((int)std::floor(eye[0] / m_partitionCellSize), (int)std::floor(eye[2] / m_partitionCellSize));
+			misses += under != ~0u && streamer.State(under) != CellStreamer::CELL_RESIDENT;
+			std::this_thread::sleep_for(frameTime);
+		}
+		streamer.Stop();
+		modeMisses[prefetch] = misses;
+		std::cout << "  " << (prefetch ? "velocity prefetch   " : "camera radius only  ") << loads << " cell loads, " << evictions
+				  << " evictions, peak " << peakBytes / 1024 << " KiB resident, camera over an unloaded cell " << misses
+				  << "/" << frames << " frames" << std::endl;
+	}
+	std::cout << "  " << instanceCount << " instances in " << grid.CellCount() << " cells (grid built in " << std::fixed
+			  << std::setprecision(2) << buildMS << " ms), " << worldBytes / 1024 << " KiB of cell data, budget "
+			  << budget / 1024 << " KiB" << std::defaultfloat << std::endl;
+	// cells on the camera's path have to come in ahead of the ones beside it
+	std::cout << "  prefetch at least halves the misses " << Check(modeMisses[1] * 2 <= modeMisses[0] && modeMisses[0] > 0) << std::endl;
+
+	// resident cells take their slots from fixed size pools, churn them like cells coming and going
+	const unsigned poolCapacity = 1 << 17;
+	RangePool pool;
+	pool.Reset(poolCapacity);
+	std::vector<std::pair<unsigned, unsigned>> held;
+	std::vector<uint8_t> owned(poolCapacity, 0);
+	std::uniform_int_distribution<unsigned> blockSize(1, 4096);
+	bool disjoint = true;
+	unsigned allocations = 0, refused = 0;
+	double churnMS = TimeMS([&] {
+		for (unsigned i = 0; i < 20000; i++)
+		{
+			if (!held.empty() && (rng() & 1))
+			{
+				size_t pick = rng() % held.size();
+				std::fill(owned.begin() + held[pick].first, owned.begin() + held[pick].first + held[pick].second, 0);
+				pool.Free(held[pick].first, held[pick].second);
+				held[pick] = held.back();
+				held.pop_back();
+				continue;
+			}
+			unsigned count = blockSize(rng), first = pool.Allocate(count);
+			if (first == ~0u)
+			{
+				refused++;
+				continue;
+			}
+			allocations++;
+			for (unsigned s = first; s < first + count; s++)
+				disjoint &= !owned[s]++;
+			held.push_back({ first, count });
+		}
+	}, 1);
+	for (const std::pair<unsigned, unsigned>& block : held)
+		pool.Free(block.first, block.second);
+	std::cout << "  range pool: " << allocations << " allocations (" << refused << " refused) in " << std::fixed
+			  << std::setprecision(2) << churnMS << " ms" << std::defaultfloat << ", blocks never overlap " << Check(disjoint)
+			  << ", everything freed coalesces back " << Check(pool.Used() == 0 && pool.Allocate(poolCapacity) == 0) << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	std::string only = argc > 1 ? argv[1] : "";
+	if (argc > 2)
+		s_modelsFolder = argv[2];
+	struct BENCHMARK { const char* name; void (*run)(); };
+	const BENCHMARK benchmarks[] = {
+		{ "DepthSort", BenchmarkDepthSort },
+		{ "VertexCache", BenchmarkVertexCache },
+		{ "GeometryDedup", BenchmarkGeometryDedup },
+		{ "VertexQuantization", BenchmarkVertexQuantization },
+		{ "VertexStreams", BenchmarkVertexStreams },
+		{ "MeshletCulling", BenchmarkMeshletCulling },
+		{ "LOD", BenchmarkLOD },
+		{ "HLOD", BenchmarkHLOD },
+		{ "Bounds", BenchmarkBounds },
+		{ "MaterialBatches", BenchmarkMaterialBatches },
+		{ "DrawPackets", BenchmarkDrawPackets },
+		{ "LevelBake", BenchmarkLevelBake },
+		{ "ModelPack", BenchmarkModelPack },
+		{ "BlockCompression", BenchmarkBlockCompression },
+		{ "H2BWriter", BenchmarkH2BWriter },
+		{ "BinaryLevel", BenchmarkBinaryLevel },
+		{ "SceneHierarchy", BenchmarkSceneHierarchy },
+		{ "DynamicTransforms", BenchmarkDynamicTransforms },
+		{ "LevelEdits", BenchmarkLevelEdits },
+		{ "LevelDelta", BenchmarkLevelDelta },
+		{ "WorldPartition", BenchmarkWorldPartition },
+	};
+	for (const BENCHMARK& benchmark : benchmarks)
+	{
+		if (only.empty() || only == benchmark.name)
+			benchmark.run();
+	}
+	if (s_failedChecks)
+		std::cout << s_failedChecks << " check(s) failed" << std::endl;
+	return s_failedChecks ? 1 : 0;
+}
@@ -0,0 +1,311 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include "Hashing.h"
+#include "MappedFile.h"
+
+// Binary level files.
+// The text export (GameLevel.txt) prints every object's name and matrix on its own, so a model
+// placed a thousand times repeats both a thousand times and the loader has to group the records
+// by model again. The binary export (LevelExporter_MODIFIED.py with binary_export, or
+// LevelConverter from an existing .txt) is grouped when written: a model table sorted by .h2b
+// name, each model's transforms as one contiguous array and packed light records, all little
+// endian. A loader maps the file and copies each model's transforms as one range.
+//
+// Layout: LEVEL_FILE_HEADER, modelCount LEVEL_FILE_MODEL, nameBytes of null terminated names
+// (padded to 4), transformCount row major float4x4s, the point lights, the spot lights, then
+// with LEVEL_FILE_HAS_PARENTS one int32 per transform: its parent's transform index or -1.
+// A .lvl converted from a .txt stores the text's hash, so editing the text makes the loader
+// read the text again until the conversion reruns (OpenCurrentLevelFile).
+
+const uint32_t m_levelFileVersion = 2;
+
+enum LEVEL_FILE_FLAGS : uint32_t
+{
+	LEVEL_FILE_HAS_PARENTS = 1,	// exported with the object hierarchy (SceneHierarchy.h)
+};
+
+struct LEVEL_FILE_HEADER
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t modelCount, nameBytes, transformCount;
+	uint32_t pointLightCount, spotLightCount;
+	uint32_t flags;
+	uint64_t sourceHash;	// HashBytes of the .txt it was converted from, 0 when exported straight to binary
+};
+
+struct LEVEL_FILE_MODEL
+{
+	uint32_t nameOffset;	// into the name table, the .h2b file name
+	uint32_t transformStart, transformCount;
+	uint32_t reserved;
+};
+
+struct LEVEL_FILE_MATRIX
+{
+	float data[16];
+};
+
+struct LEVEL_FILE_POINT_LIGHT
+{
+	LEVEL_FILE_MATRIX transform;
+	float color[3];
+	float energy, distance, qAttenuation, lAttenuation;
+};
+
+struct LEVEL_FILE_SPOT_LIGHT
+{
+	LEVEL_FILE_MATRIX transform;
+	float color[3];
+	float energy, distance, qAttenuation, lAttenuation;
+	float spotSize, spotBlend;
+};
+
+static_assert(sizeof(LEVEL_FILE_HEADER) == 40 && sizeof(LEVEL_FILE_MODEL) == 16, "the exporter writes these layouts");
+static_assert(sizeof(LEVEL_FILE_POINT_LIGHT) == 92 && sizeof(LEVEL_FILE_SPOT_LIGHT) == 100, "the exporter writes these layouts");
+
+// What either format holds: transforms grouped by .h2b name (in file order), then the lights
+struct LEVEL_FILE_CONTENT
+{
+	std::map<std::string, std::vector<LEVEL_FILE_MATRIX>> models;
+	std::vector<LEVEL_FILE_POINT_LIGHT> pointLights;
+	std::vector<LEVEL_FILE_SPOT_LIGHT> spotLights;
+	std::vector<int> parents;	// empty or one per transform (models in name order), -1 for roots
+};
+
+// Levels/GameLevel.txt exports to Levels/GameLevel.lvl
+inline std::string GetLevelFilePath(const std::string& _levelPath)
+{
+	return std::filesystem::path(_levelPath).replace_extension(".lvl").string();
+}
+
+// Reads the text export in the layout Level_Data::ReadGameLevel reads, "Arch_bars.001" places Arch_bars.h2b
+inline bool ReadLevelText(const std::string& _path, LEVEL_FILE_CONTENT& _out)
+{
+	std::ifstream file(_path);
+	if (!file.is_open())
+		return false;
+	_out = LEVEL_FILE_CONTENT();
+	std::string line;
+	auto readLine = [&]() {
+		if (!std::getline(file, line))
+			return false;
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		return true;
+	};
+	auto readMatrix = [&](LEVEL_FILE_MATRIX& _matrix) {
+		for (int i = 0; i < 4 && readLine(); i++)
+			if (line.size() > 13)
+				std::sscanf(line.c_str() + 13, "%f, %f, %f, %f", &_matrix.data[i * 4], &_matrix.data[i * 4 + 1],
+							&_matrix.data[i * 4 + 2], &_matrix.data[i * 4 + 3]);
+	};
+	auto readFloat = [&](float& _value) {
+		if (readLine())
+			std::sscanf(line.c_str(), "%f", &_value);
+	};
+	while (readLine())
+	{
+		if (line == "MESH" && readLine())
+		{
+			std::string model = line.substr(0, line.find_last_of(".")) + ".h2b";
+			LEVEL_FILE_MATRIX transform = {};
+			readMatrix(transform);
+			_out.models[model].push_back(transform);
+		}
+		else if (line == "LIGHT" && readLine())
+		{
+			LEVEL_FILE_SPOT_LIGHT light = {};
+			readMatrix(light.transform);
+			if (!readLine())
+				break;
+			bool spot = line == "TYPE: SPOT";
+			if (!spot && line != "TYPE: POINT")
+				continue;
+			if (readLine() && line.size() > 10)
+				std::sscanf(line.c_str() + 10, "%f, g=%f, b=%f", &light.color[0], &light.color[1], &light.color[2]);
+			readFloat(light.energy);
+			readFloat(light.distance);
+			readFloat(light.qAttenuation);
+			readFloat(light.lAttenuation);
+			if (spot)
+			{
+				readFloat(light.spotSize);
+				readFloat(light.spotBlend);
+				_out.spotLights.push_back(light);
+			}
+			else
+			{
+				LEVEL_FILE_POINT_LIGHT point;
+				std::memcpy(&point, &light, sizeof(point)); // the point record is the spot record's prefix
+				_out.pointLights.push_back(point);
+			}
+		}
+	}
+	return true;
+}
+
+// HashBytes of a whole text export, what LEVEL_FILE_HEADER::sourceHash holds
+inline bool HashLevelText(const std::string& _path, uint64_t& _outHash)
+{
+	std::ifstream file(_path, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+	if (!file.is_open())
+		return false;
+	std::vector<char> bytes((size_t)file.tellg());
+	file.seekg(0);
+	file.read(bytes.data(), bytes.size());
+	if (!file)
+		return false;
+	_outHash = HashBytes(bytes.data(), bytes.size());
+	return true;
+}
+
+// Same layout LevelExporter_MODIFIED.py writes with binary_export, _sourceHash from HashLevelText
+inline bool WriteLevelFile(const LEVEL_FILE_CONTENT& _content, const std::string& _path, uint64_t _sourceHash = 0)
+{
+	std::vector<LEVEL_FILE_MODEL> models;
+	std::vector<char> names;
+	uint32_t transformCount = 0;
+	for (const auto& model : _content.models)
+	{
+		models.push_back({ (uint32_t)names.size(), transformCount, (uint32_t)model.second.size(), 0 });
+		names.insert(names.end(), model.first.c_str(), model.first.c_str() + model.first.size() + 1);
+		transformCount += (uint32_t)model.second.size();
+	}
+	names.resize((names.size() + 3) & ~(size_t)3, '\0');
+	LEVEL_FILE_HEADER header = { { 'L', 'V', 'L', '1' }, m_levelFileVersion, (uint32_t)models.size(), (uint32_t)names.size(),
+		transformCount, (uint32_t)_content.pointLights.size(), (uint32_t)_content.spotLights.size(),
+		_content.parents.empty() ? 0u : (uint32_t)LEVEL_FILE_HAS_PARENTS, _sourceHash };
+	if (!_content.parents.empty() && _content.parents.size() != transformCount)
+		return false;
+
+	std::ofstream file(_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	if (!file.is_open())
+		return false;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(models.data()), sizeof(LEVEL_FILE_MODEL) * models.size());
+	file.write(names.data(), names.size());
+	for (const auto& model : _content.models)
+		file.write(reinterpret_cast<const char*>(model.second.data()), sizeof(LEVEL_FILE_MATRIX) * model.second.size());
+	file.write(reinterpret_cast<const char*>(_content.pointLights.data()), sizeof(LEVEL_FILE_POINT_LIGHT) * _content.pointLights.size());
+	file.write(reinterpret_cast<const char*>(_content.spotLights.data()), sizeof(LEVEL_FILE_SPOT_LIGHT) * _content.spotLights.size());
+	file.write(reinterpret_cast<const char*>(_content.parents.data()), sizeof(int) * _content.parents.size());
+	return (bool)file;
+}
+
+// Maps a binary level and hands out its sections in place, valid until Close()
+class LevelFileReader
+{
+	MappedFile m_file;
+	const LEVEL_FILE_HEADER* m_header = nullptr;
+	const LEVEL_FILE_MODEL* m_models = nullptr;
+	const char* m_names = nullptr;
+	const LEVEL_FILE_MATRIX* m_transforms = nullptr;
+	const LEVEL_FILE_POINT_LIGHT* m_pointLights = nullptr;
+	const LEVEL_FILE_SPOT_LIGHT* m_spotLights = nullptr;
+	const int32_t* m_parents = nullptr;
+
+public:
+	// False (and closed) if the file is missing, isn't a binary level or is truncated
+	bool Open(const std::string& _path)
+	{
+		Close();
+		if (!m_file.Open(_path) || m_file.Size() < sizeof(LEVEL_FILE_HEADER))
+			return Fail();
+		m_header = reinterpret_cast<const LEVEL_FILE_HEADER*>(m_file.Data());
+		if (std::memcmp(m_header->magic, "LVL1", 4) != 0 || m_header->version != m_levelFileVersion || m_header->nameBytes % 4 != 0)
+			return Fail();
+		uint64_t modelsAt = sizeof(LEVEL_FILE_HEADER);
+		uint64_t namesAt = modelsAt + sizeof(LEVEL_FILE_MODEL) * (uint64_t)m_header->modelCount;
+		uint64_t transformsAt = namesAt + m_header->nameBytes;
+		uint64_t pointLightsAt = transformsAt + sizeof(LEVEL_FILE_MATRIX) * (uint64_t)m_header->transformCount;
+		uint64_t spotLightsAt = pointLightsAt + sizeof(LEVEL_FILE_POINT_LIGHT) * (uint64_t)m_header->pointLightCount;
+		uint64_t parentsAt = spotLightsAt + sizeof(LEVEL_FILE_SPOT_LIGHT) * (uint64_t)m_header->spotLightCount;
+		uint64_t parentBytes = (m_header->flags & LEVEL_FILE_HAS_PARENTS) ? sizeof(int32_t) * (uint64_t)m_header->transformCount : 0;
+		if (parentsAt + parentBytes != m_file.Size())
+			return Fail();
+		m_models = reinterpret_cast<const LEVEL_FILE_MODEL*>(m_file.Data() + modelsAt);
+		m_names = reinterpret_cast<const char*>(m_file.Data() + namesAt);
+		m_transforms = reinterpret_cast<const LEVEL_FILE_MATRIX*>(m_file.Data() + transformsAt);
+		m_pointLights = reinterpret_cast<const LEVEL_FILE_POINT_LIGHT*>(m_file.Data() + pointLightsAt);
+		m_spotLights = reinterpret_cast<const LEVEL_FILE_SPOT_LIGHT*>(m_file.Data() + spotLightsAt);
+		m_parents = parentBytes ? reinterpret_cast<const int32_t*>(m_file.Data() + parentsAt) : nullptr;
+		// every name ends inside the table and every range inside the transforms
+		if (m_header->nameBytes > 0 && m_names[m_header->nameBytes - 1] != '\0')
+			return Fail();
+		for (uint32_t i = 0; i < m_header->modelCount; i++)
+			if (m_models[i].nameOffset >= m_header->nameBytes ||
+				(uint64_t)m_models[i].transformStart + m_models[i].transformCount > m_header->transformCount)
+				return Fail();
+		return true;
+	}
+
+	void Close()
+	{
+		m_file.Close();
+		m_header = nullptr;
+	}
+
+	bool IsOpen() const { return m_header != nullptr; }
+	const unsigned char* Data() const { return m_file.Data(); }
+	size_t Size() const { return m_file.Size(); }
+
+	uint32_t ModelCount() const { return m_header->modelCount; }
+	const char* ModelName(uint32_t _model) const { return m_names + m_models[_model].nameOffset; }
+	const LEVEL_FILE_MATRIX* Transforms(uint32_t _model) const { return m_transforms + m_models[_model].transformStart; }
+	uint32_t TransformStart(uint32_t _model) const { return m_models[_model].transformStart; }
+	uint32_t TransformCount(uint32_t _model) const { return m_models[_model].transformCount; }
+	const LEVEL_FILE_POINT_LIGHT* PointLights() const { return m_pointLights; }
+	uint32_t PointLightCount() const { return m_header->pointLightCount; }
+	const LEVEL_FILE_SPOT_LIGHT* SpotLights() const { return m_spotLights; }
+	uint32_t SpotLightCount() const { return m_header->spotLightCount; }
+	// one per transform, in file order, nullptr when the level was exported without hierarchy
+	const int32_t* Parents() const { return m_parents; }
+	uint32_t TransformCount() const { return m_header->transformCount; }
+	uint64_t SourceHash() const { return m_header->sourceHash; }
+
+private:
+	bool Fail()
+	{
+		Close();
+		return false;
+	}
+};
+
+// Opens the binary export of the text level _levelPath unless the text changed since: the
+// stored source hash has to match, or without one (exported straight to binary) the .lvl can't
+// be older than the .txt. With no text next to it the .lvl is always current
+inline bool OpenCurrentLevelFile(const std::string& _levelPath, LevelFileReader& _outLevel)
+{
+	std::string binaryPath = GetLevelFilePath(_levelPath);
+	if (!_outLevel.Open(binaryPath))
+		return false;
+	std::error_code error;
+	if (!std::filesystem::exists(_levelPath, error))
+		return true;
+	uint64_t hash = 0;
+	if (_outLevel.SourceHash() != 0 ? HashLevelText(_levelPath, hash) && hash == _outLevel.SourceHash() :
+		std::filesystem::last_write_time(binaryPath, error) >= std::filesystem::last_write_time(_levelPath, error))
+		return true;
+	_outLevel.Close();
+	return false;
+}
+
+// Copies an open binary level into the layout ReadLevelText fills
+inline void ReadLevelFile(const LevelFileReader& level, LEVEL_FILE_CONTENT& _out)
+{
+	_out = LEVEL_FILE_CONTENT();
+	for (uint32_t i = 0; i < level.ModelCount(); i++)
+		_out.models[level.ModelName(i)].assign(level.Transforms(i), level.Transforms(i) + level.TransformCount(i));
+	_out.pointLights.assign(level.PointLights(), level.PointLights() + level.PointLightCount());
+	_out.spotLights.assign(level.SpotLights(), level.SpotLights() + level.SpotLightCount());
+	if (level.Parents() != nullptr)
+		_out.parents.assign(level.Parents(), level.Parents() + level.TransformCount());
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// Block compression.
+// A small LZ77 codec (LZ4 style byte oriented sequences, no entropy stage) so it decodes at
+// memory speed with no dependency. Data is cut into m_compressionBlockSize blocks that are
+// compressed on their own, any block decodes without the others, so a loader can spread the
+// blocks it needs over worker threads and write each one straight to where it belongs.
+//
+// Sequence: token (literal count << 4 | match length - m_lzMinMatch), count 15 continues in
+// 255 valued bytes, the literals, then a 16 bit little endian offset and the match length's
+// extra bytes. The last sequence of a block has literals only.
+
+const uint32_t m_compressionBlockSize = 256 * 1024;
+const unsigned m_lzMinMatch = 4;
+const unsigned m_lzHashBits = 14;
+const unsigned m_lzMaxOffset = 65535;
+
+// One independently decodable block. compressedSize == rawSize means stored uncompressed.
+struct COMPRESSED_BLOCK
+{
+	uint64_t offset;			// where its bytes start in the compressed stream
+	uint32_t compressedSize;
+	uint32_t rawSize;
+};
+
+inline void LZWriteLength(std::vector<uint8_t>& _out, size_t _length)
+{
+	for (; _length >= 255; _length -= 255)
+		_out.push_back(255);
+	_out.push_back((uint8_t)_length);
+}
+
+// Appends _size bytes of _src compressed to _out, returns the compressed size
+inline size_t LZCompress(const uint8_t* _src, size_t _size, std::vector<uint8_t>& _out)
+{
+	size_t start = _out.size();
+	std::vector<uint32_t> table(1u << m_lzHashBits, 0xFFFFFFFFu);
+	auto hash = [&](size_t _at) {
+		uint32_t sequence;
+		std::memcpy(&sequence, _src + _at, 4);
+		return (sequence * 2654435761u) >> (32 - m_lzHashBits);
+	};
+	size_t literalStart = 0, at = 0;
+	auto emit = [&](size_t _matchLength, size_t _offset) {
+		size_t literals = at - literalStart;
+		size_t matchCode = _matchLength >= m_lzMinMatch ? _matchLength - m_lzMinMatch : 0;
+		_out.push_back((uint8_t)(((std::min)(literals, (size_t)15) << 4) | (std::min)(matchCode, (size_t)15)));
+		if (literals >= 15)
+			LZWriteLength(_out, literals - 15);
+		_out.insert(_out.end(), _src + literalStart, _src + at);
+		if (_matchLength < m_lzMinMatch)
+			return;
+		_out.push_back((uint8_t)(_offset & 0xFF));
+		_out.push_back((uint8_t)(_offset >> 8));
+		if (matchCode >= 15)
+			LZWriteLength(_out, matchCode - 15);
+	};
+	while (_size >= m_lzMinMatch && at + m_lzMinMatch <= _size)
+	{
+		uint32_t& slot = table[hash(at)];
+		size_t candidate = slot;
+		slot = (uint32_t)at;
+		if (candidate == 0xFFFFFFFFu || at - candidate > m_lzMaxOffset || std::memcmp(_src + candidate, _src + at, 4) != 0)
+		{
+			at++;
+			continue;
+		}
+		size_t length = m_lzMinMatch;
+		while (at + length < _size && _src[candidate + length] == _src[at + length])
+			length++;
+		emit(length, at - candidate);
+		// keep the table warm inside the match, every other position is plenty
+		for (size_t skip = at + 2; skip + m_lzMinMatch <= at + length && skip + m_lzMinMatch <= _size; skip += 2)
+			table[hash(skip)] = (uint32_t)skip;
+		at += length;
+		literalStart = at;
+	}
+	at = _size;
+	emit(0, 0);
+	return _out.size() - start;
+}
+
+// Decodes exactly _rawSize bytes into _dst, false on any malformed or out of bounds sequence
+inline bool LZDecompress(const uint8_t* _src, size_t _size, uint8_t* _dst, size_t _rawSize)
+{
+	const uint8_t* end = _src + _size;
+	size_t out = 0;
+	auto readLength = [&](size_t& _length) {
+		uint8_t more;
+		do
+		{
+			if (_src >= end)
+				return false;
+			more = *_src++;
+			_length += more;
+		} while (more == 255);
+		return true;
+	};
+	while (_src < end)
+	{
+		uint8_t token = *_src++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !readLength(literals))
+			return false;
+		if ((size_t)(end - _src) < literals || _rawSize - out < literals)
+			return false;
+		// short runs as one fixed size copy when both sides have the room, memcpy otherwise
+		if (literals <= 16 && end - _src >= 16 && _rawSize - out >= 16)
+			std::memcpy(_dst + out, _src, 16);
+		else
+			std::memcpy(_dst + out, _src, literals);
+		_src += literals;
+		out += literals;
+		if (_src == end)
+			break; // last sequence
+		if (end - _src < 2)
+			return false;
+		size_t offset = _src[0] | (_src[1] << 8);
+		_src += 2;
+		size_t length = token & 15;
+		if (length == 15 && !readLength(length))
+			return false;
+		length += m_lzMinMatch;
+		if (offset == 0 || offset > out || _rawSize - out < length)
+			return false;
+		const uint8_t* match = _dst + out - offset;
+		if (offset >= 16 && _rawSize - out >= length + 16)
+			for (size_t i = 0; i < length; i += 16)
+				std::memcpy(_dst + out + i, match + i, 16);
+		else if (offset >= length)
+			std::memcpy(_dst + out, match, length);
+		else
+			for (size_t i = 0; i < length; i++) // overlapping, repeats the last offset bytes
+				_dst[out + i] = match[i];
+		out += length;
+	}
+	return out == _rawSize;
+}
+
+// Compresses _size bytes as m_compressionBlockSize blocks appended to _outStream, one
+// COMPRESSED_BLOCK per block appended to _outBlocks (offsets relative to _outStream's start).
+// Blocks that don't shrink are stored.
+inline void CompressBlocks(const uint8_t* _src, size_t _size, std::vector<uint8_t>& _outStream,
+						   std::vector<COMPRESSED_BLOCK>& _outBlocks)
+{
+	for (size_t first = 0; first < _size; first += m_compressionBlockSize)
+	{
+		uint32_t rawSize = (uint32_t)(std::min)((size_t)m_compressionBlockSize, _size - first);
+		COMPRESSED_BLOCK block = { (uint64_t)_outStream.size(), 0, rawSize };
+		block.compressedSize = (uint32_t)LZCompress(_src + first, rawSize, _outStream);
+		if (block.compressedSize >= rawSize)
+		{
+			_outStream.resize(block.offset);
+			_outStream.insert(_outStream.end(), _src + first, _src + first + rawSize);
+			block.compressedSize = rawSize;
+		}
+		_outBlocks.push_back(block);
+	}
+}
+
+// One block to decode and where its bytes go
+struct BLOCK_JOB
+{
+	const COMPRESSED_BLOCK* block;
+	uint8_t* destination;		// block->rawSize bytes
+};
+
+inline bool DecompressBlock(const uint8_t* _stream, const COMPRESSED_BLOCK& _block, uint8_t* _destination)
+{
+	if (_block.compressedSize == _block.rawSize)
+	{
+		std::memcpy(_destination, _stream + _block.offset, _block.rawSize);
+		return true;
+	}
+	return LZDecompress(_stream + _block.offset, _block.compressedSize, _destination, _block.rawSize);
+}
+
+// Decodes every job over _threadCount threads, the calling thread takes part. Blocks are
+// independent so the order they finish in doesn't matter. False if any block was malformed.
+inline bool DecompressBlocks(const uint8_t* _stream, const std::vector<BLOCK_JOB>& _jobs,
+							 unsigned _threadCount = std::thread::hardware_concurrency())
+{
+	std::atomic<size_t> next(0);
+	std::atomic<bool> failed(false);
+	auto work = [&]() {
+		for (size_t j = next++; j < _jobs.size(); j = next++)
+			if (!DecompressBlock(_stream, *_jobs[j].block, _jobs[j].destination))
+				failed = true;
+	};
+	_threadCount = (unsigned)(std::min<size_t>)((std::max)(_threadCount, 1u), _jobs.size());
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < _threadCount; t++)
+		workers.emplace_back(work);
+	work();
+	for (std::thread& worker : workers)
+		worker.join();
+	return !failed;
+}
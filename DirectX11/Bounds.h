@@ -0,0 +1,214 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+#include <algorithm>
+#include <emmintrin.h>
+#define GATEWARE_ENABLE_CORE // All libraries need this
+#define GATEWARE_ENABLE_MATH
+#include "../gateware-main/Gateware.h"
+
+// Bounding volumes.
+// Every mesh and model gets a local AABB + sphere at import, every transform a world AABB +
+// sphere derived from its model's. World bounds are kept SoA (one array per component) so
+// culling and spatial passes stream only the components they test.
+
+// Local (model space) bounds. The sphere is centered on the AABB and reaches the farthest vertex.
+struct LOCAL_BOUNDS
+{
+	float min[3], max[3];
+	float center[3], radius;
+};
+
+// Farthest distance from _center to any position, SSE. A 16 byte load at pos reads px py pz u,
+// the u lane is zeroed, so it never reads past a vertex.
+inline float ComputeSphereRadius(const H2B::VERTEX* _vertices, size_t _count, const float _center[3])
+{
+	const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	const __m128 center = _mm_setr_ps(_center[0], _center[1], _center[2], 0);
+	__m128 farthest = _mm_setzero_ps();
+	for (size_t v = 0; v < _count; v++)
+	{
+		__m128 d = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(&_vertices[v].pos.x), center), mask);
+		d = _mm_mul_ps(d, d);
+		// x + y + z into every lane
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+		farthest = _mm_max_ps(farthest, d);
+	}
+	return std::sqrt(_mm_cvtss_f32(farthest));
+}
+
+// Scalar reference of ComputeAABB
+inline void ComputeAABBScalar(const H2B::VERTEX* _vertices, size_t _count, float _outMin[3], float _outMax[3])
+{
+	for (int k = 0; k < 3; k++)
+	{
+		_outMin[k] = _count ? FLT_MAX : 0.0f;
+		_outMax[k] = _count ? -FLT_MAX : 0.0f;
+	}
+	for (size_t v = 0; v < _count; v++)
+		for (int k = 0; k < 3; k++)
+		{
+			_outMin[k] = (std::min)(_outMin[k], (&_vertices[v].pos.x)[k]);
+			_outMax[k] = (std::max)(_outMax[k], (&_vertices[v].pos.x)[k]);
+		}
+}
+
+// Min/max through Gateware's GCollision::ComputeAABBFromPointsF, which wants 16 byte points,
+// so positions are copied out first. A hand written SSE version measured no faster.
+inline void ComputeAABB(const H2B::VERTEX* _vertices, size_t _count, float _outMin[3], float _outMax[3])
+{
+	if (_count == 0)
+	{
+		ComputeAABBScalar(_vertices, 0, _outMin, _outMax);
+		return;
+	}
+	std::vector<GW::MATH::GVECTORF> points(_count);
+	for (size_t v = 0; v < _count; v++)
+		points[v] = { _vertices[v].pos.x, _vertices[v].pos.y, _vertices[v].pos.z, 1 };
+	GW::MATH::GAABBMMF box;
+	GW::MATH::GCollision::ComputeAABBFromPointsF(points.data(), static_cast<unsigned int>(_count), box);
+	for (int k = 0; k < 3; k++)
+	{
+		_outMin[k] = (&box.min.x)[k];
+		_outMax[k] = (&box.max.x)[k];
+	}
+}
+
+// Scalar reference of ComputeBounds
+inline LOCAL_BOUNDS ComputeBoundsScalar(const H2B::VERTEX* _vertices, size_t _count)
+{
+	LOCAL_BOUNDS bounds = {};
+	ComputeAABBScalar(_vertices, _count, bounds.min, bounds.max);
+	float radiusSquared = 0;
+	for (int k = 0; k < 3; k++)
+		bounds.center[k] = (bounds.min[k] + bounds.max[k]) * 0.5f;
+	for (size_t v = 0; v < _count; v++)
+	{
+		float dx = _vertices[v].pos.x - bounds.center[0], dy = _vertices[v].pos.y - bounds.center[1], dz = _vertices[v].pos.z - bounds.center[2];
+		radiusSquared = (std::max)(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	bounds.radius = std::sqrt(radiusSquared);
+	return bounds;
+}
+
+// AABB + sphere of _count vertices
+inline LOCAL_BOUNDS ComputeBounds(const H2B::VERTEX* _vertices, size_t _count)
+{
+	LOCAL_BOUNDS bounds = {};
+	ComputeAABB(_vertices, _count, bounds.min, bounds.max);
+	for (int k = 0; k < 3; k++)
+		bounds.center[k] = (bounds.min[k] + bounds.max[k]) * 0.5f;
+	bounds.radius = ComputeSphereRadius(_vertices, _count, bounds.center);
+	return bounds;
+}
+
+// World bounds of every transform, SoA, index = transform id
+struct INSTANCE_BOUNDS
+{
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+	std::vector<float> centerX, centerY, centerZ, radius;
+
+	void Resize(size_t _count)
+	{
+		for (std::vector<float>* component : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ, &centerX, &centerY, &centerZ, &radius })
+			component->resize(_count);
+	}
+	void Clear() { Resize(0); }
+	size_t Size() const { return radius.size(); }
+};
+
+// Scalar reference of TransformBounds
+inline void TransformBoundsScalar(const LOCAL_BOUNDS& _local, const GW::MATH::GMATRIXF* _transforms, size_t _first,
+								  size_t _count, INSTANCE_BOUNDS& _inOut)
+{
+	float center[3], extent[3];
+	for (int k = 0; k < 3; k++)
+	{
+		center[k] = (_local.min[k] + _local.max[k]) * 0.5f;
+		extent[k] = (_local.max[k] - _local.min[k]) * 0.5f;
+	}
+	for (size_t i = _first; i < _first + _count; i++)
+	{
+		const GW::MATH::GMATRIXF& w = _transforms[i];
+		const GW::MATH::GVECTORF* rows[3] = { &w.row1, &w.row2, &w.row3 };
+		float worldCenter[3], worldExtent[3], sphere[3], scale = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			worldCenter[k] = (&w.row4.x)[k];
+			worldExtent[k] = 0;
+			sphere[k] = (&w.row4.x)[k];
+			for (int r = 0; r < 3; r++)
+			{
+				worldCenter[k] += center[r] * (&rows[r]->x)[k];
+				worldExtent[k] += extent[r] * std::fabs((&rows[r]->x)[k]);
+				sphere[k] += _local.center[r] * (&rows[r]->x)[k];
+			}
+		}
+		for (int r = 0; r < 3; r++)
+			scale = (std::max)(scale, std::sqrt(rows[r]->x * rows[r]->x + rows[r]->y * rows[r]->y + rows[r]->z * rows[r]->z));
+		_inOut.minX[i] = worldCenter[0] - worldExtent[0];
+		_inOut.minY[i] = worldCenter[1] - worldExtent[1];
+		_inOut.minZ[i] = worldCenter[2] - worldExtent[2];
+		_inOut.maxX[i] = worldCenter[0] + worldExtent[0];
+		_inOut.maxY[i] = worldCenter[1] + worldExtent[1];
+		_inOut.maxZ[i] = worldCenter[2] + worldExtent[2];
+		_inOut.centerX[i] = sphere[0];
+		_inOut.centerY[i] = sphere[1];
+		_inOut.centerZ[i] = sphere[2];
+		_inOut.radius[i] = _local.radius * scale;
+	}
+}
+
+// World bounds of transforms [_first, _first + _count), which all place _local. The AABB is
+// the transformed box's center plus its extent through |rotation| (stays tight under rotation
+// and scale), the sphere is scaled by the largest axis. Rows are combined with SSE.
+inline void TransformBounds(const LOCAL_BOUNDS& _local, const GW::MATH::GMATRIXF* _transforms, size_t _first,
+							size_t _count, INSTANCE_BOUNDS& _inOut)
+{
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	float center[3], extent[3];
+	for (int k = 0; k < 3; k++)
+	{
+		center[k] = (_local.min[k] + _local.max[k]) * 0.5f;
+		extent[k] = (_local.max[k] - _local.min[k]) * 0.5f;
+	}
+	const __m128 cx = _mm_set1_ps(center[0]), cy = _mm_set1_ps(center[1]), cz = _mm_set1_ps(center[2]);
+	const __m128 ex = _mm_set1_ps(extent[0]), ey = _mm_set1_ps(extent[1]), ez = _mm_set1_ps(extent[2]);
+	const __m128 sx = _mm_set1_ps(_local.center[0]), sy = _mm_set1_ps(_local.center[1]), sz = _mm_set1_ps(_local.center[2]);
+	for (size_t i = _first; i < _first + _count; i++)
+	{
+		const GW::MATH::GMATRIXF& w = _transforms[i];
+		__m128 r1 = _mm_loadu_ps(&w.row1.x), r2 = _mm_loadu_ps(&w.row2.x);
+		__m128 r3 = _mm_loadu_ps(&w.row3.x), r4 = _mm_loadu_ps(&w.row4.x);
+		__m128 worldCenter = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, r1), _mm_mul_ps(cy, r2)), _mm_add_ps(_mm_mul_ps(cz, r3), r4));
+		__m128 worldExtent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_and_ps(r1, absMask)), _mm_mul_ps(ey, _mm_and_ps(r2, absMask))),
+										_mm_mul_ps(ez, _mm_and_ps(r3, absMask)));
+		__m128 sphere = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, r1), _mm_mul_ps(sy, r2)), _mm_add_ps(_mm_mul_ps(sz, r3), r4));
+		// Squared row lengths, transposed so lane k holds row k's
+		__m128 l1 = _mm_and_ps(_mm_mul_ps(r1, r1), xyzMask), l2 = _mm_and_ps(_mm_mul_ps(r2, r2), xyzMask);
+		__m128 l3 = _mm_and_ps(_mm_mul_ps(r3, r3), xyzMask), l4 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(l1, l2, l3, l4);
+		__m128 lengths = _mm_add_ps(_mm_add_ps(l1, l2), l3);
+		lengths = _mm_max_ps(lengths, _mm_shuffle_ps(lengths, lengths, _MM_SHUFFLE(2, 3, 0, 1)));
+		lengths = _mm_max_ps(lengths, _mm_shuffle_ps(lengths, lengths, _MM_SHUFFLE(1, 0, 3, 2)));
+
+		float lo[4], hi[4], c[4];
+		_mm_storeu_ps(lo, _mm_sub_ps(worldCenter, worldExtent));
+		_mm_storeu_ps(hi, _mm_add_ps(worldCenter, worldExtent));
+		_mm_storeu_ps(c, sphere);
+		_inOut.minX[i] = lo[0];
+		_inOut.minY[i] = lo[1];
+		_inOut.minZ[i] = lo[2];
+		_inOut.maxX[i] = hi[0];
+		_inOut.maxY[i] = hi[1];
+		_inOut.maxZ[i] = hi[2];
+		_inOut.centerX[i] = c[0];
+		_inOut.centerY[i] = c[1];
+		_inOut.centerZ[i] = c[2];
+		_inOut.radius[i] = _local.radius * _mm_cvtss_f32(_mm_sqrt_ss(lengths));
+	}
+}
@@ -193,6 +193,16 @@ void Camera::YawY(float _angle)
 	XMStoreFloat3(&m_axisForward, XMVector3TransformNormal(XMLoadFloat3(&m_axisForward), rotationY));
 }
 
+float Camera::GetNearZ() const
+{
+	return m_nearZ;
+}
+
+float Camera::GetFarZ() const
+{
+	return m_farZ;
+}
+
 void Camera::SetAspectRatio(float _ratio)
 {
 	m_aspectRatio = _ratio;
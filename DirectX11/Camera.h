@@ -54,6 +54,10 @@ public:
 	// Roate left/right, rotating all basis vectors around the global Y Axis
 	void YawY(float _angle);
 	
+	// Clip plane distances
+	float GetNearZ() const;
+	float GetFarZ() const;
+
 	// Set aspect ratio
 	void SetAspectRatio(float _ratio);
 	// Assemble the view matrix
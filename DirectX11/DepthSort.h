@@ -0,0 +1,266 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#define GATEWARE_ENABLE_CORE // All libraries need this
+#define GATEWARE_ENABLE_MATH
+#include "../gateware-main/Gateware.h"
+
+// Front to back ordering of instances.
+// Every frame each instance gets a 32 bit key: its draw group (instance set) in the high bits
+// and its quantized camera space depth in the low bits. A parallel LSD radix sort then lays the
+// instance ids out so each group is one contiguous, near-to-far range that can be handed to
+// DrawIndexedInstanced as is. Nothing in here touches D3D so it can be benchmarked headless.
+
+// Below this many keys the threads cost more than they save
+const unsigned m_radixSortParallelThreshold = 1 << 16;
+
+// Threads kept alive between sorts, so a frame's passes don't each pay for thread creation.
+// Workers start on first use and wait on a condition variable in between.
+class WorkerPool
+{
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_wake, m_done;
+	const std::function<void(unsigned)>* m_job = nullptr;
+	uint64_t m_generation = 0;		// bumped once per Run
+	unsigned m_active = 0, m_pending = 0;
+	bool m_stop = false;
+
+	void Work(unsigned _index)
+	{
+		uint64_t seen = 0;
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+			if (m_stop)
+				return;
+			seen = m_generation;
+			if (_index >= m_active)
+				continue;
+			const std::function<void(unsigned)>* job = m_job;
+			lock.unlock();
+			(*job)(_index);
+			lock.lock();
+			if (--m_pending == 0)
+				m_done.notify_one();
+		}
+	}
+
+public:
+	WorkerPool() = default;
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		for (std::thread& thread : m_threads)
+			thread.join();
+	}
+
+	// Runs _job(thread) for every thread below _threadCount and returns when all are done, the
+	// calling thread takes part as thread 0
+	void Run(unsigned _threadCount, const std::function<void(unsigned)>& _job)
+	{
+		if (_threadCount < 2)
+		{
+			_job(0);
+			return;
+		}
+		while (m_threads.size() + 1 < _threadCount)
+		{
+			unsigned index = (unsigned)m_threads.size() + 1;
+			m_threads.emplace_back([this, index] { Work(index); });
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_job = &_job;
+			m_active = _threadCount;
+			m_pending = _threadCount - 1;
+			m_generation++;
+		}
+		m_wake.notify_all();
+		_job(0);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_pending == 0; });
+	}
+};
+
+// Stable LSD radix sort of _keys (8 bits per pass) carrying _values along, on _pool's threads.
+// The scratch vectors are resized as needed and can be reused between calls to avoid allocations.
+inline void RadixSort32(std::vector<uint32_t>& _keys, std::vector<uint32_t>& _values,
+						std::vector<uint32_t>& _scratchKeys, std::vector<uint32_t>& _scratchValues,
+						WorkerPool& _pool, unsigned _threadCount = std::thread::hardware_concurrency())
+{
+	const size_t count = _keys.size();
+	_scratchKeys.resize(count);
+	_scratchValues.resize(count);
+	if (count < m_radixSortParallelThreshold || _threadCount < 2)
+		_threadCount = 1;
+	_threadCount = (unsigned)(std::min<size_t>)(_threadCount, 64);
+
+	const size_t chunk = (count + _threadCount - 1) / _threadCount;
+	std::vector<uint32_t> histograms(_threadCount * 256);
+	uint32_t* srcKeys = _keys.data();
+	uint32_t* srcValues = _values.data();
+	uint32_t* dstKeys = _scratchKeys.data();
+	uint32_t* dstValues = _scratchValues.data();
+
+	auto parallelFor = [&](const std::function<void(unsigned)>& _job) { _pool.Run(_threadCount, _job); };
+
+	for (unsigned shift = 0; shift < 32; shift += 8)
+	{
+		// 1. Per thread digit histograms
+		std::fill(histograms.begin(), histograms.end(), 0u);
+		parallelFor([&](unsigned t) {
+			uint32_t* histogram = &histograms[t * 256];
+			size_t end = (std::min)(count, (t + 1) * chunk);
+			for (size_t i = t * chunk; i < end; i++)
+				histogram[(srcKeys[i] >> shift) & 0xFF]++;
+		});
+
+		// Every key shares this digit (typical for the group byte), nothing to do
+		if (count == 0)
+			break;
+		uint32_t digitTotal = 0;
+		for (unsigned t = 0; t < _threadCount; t++)
+			digitTotal += histograms[t * 256 + ((srcKeys[0] >> shift) & 0xFF)];
+		if (digitTotal == count)
+			continue;
+
+		// 2. Exclusive prefix sum, digit major then thread so the result stays stable
+		uint32_t offset = 0;
+		for (unsigned digit = 0; digit < 256; digit++)
+		{
+			for (unsigned t = 0; t < _threadCount; t++)
+			{
+				uint32_t c = histograms[t * 256 + digit];
+				histograms[t * 256 + digit] = offset;
+				offset += c;
+			}
+		}
+
+		// 3. Scatter
+		parallelFor([&](unsigned t) {
+			uint32_t* cursor = &histograms[t * 256];
+			size_t end = (std::min)(count, (t + 1) * chunk);
+			for (size_t i = t * chunk; i < end; i++)
+			{
+				uint32_t dst = cursor[(srcKeys[i] >> shift) & 0xFF]++;
+				dstKeys[dst] = srcKeys[i];
+				dstValues[dst] = srcValues[i];
+			}
+		});
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
+	}
+
+	// An odd number of scatter passes leaves the result in the scratch buffers
+	if (srcKeys != _keys.data())
+	{
+		std::memcpy(_keys.data(), srcKeys, count * sizeof(uint32_t));
+		std::memcpy(_values.data(), srcValues, count * sizeof(uint32_t));
+	}
+}
+
+class InstanceDepthSorter
+{
+public:
+	// One draw group, a contiguous range of transforms drawn together (ex. one MODEL_INSTANCES)
+	struct SORT_GROUP
+	{
+		unsigned transformStart, transformCount;
+	};
+	// Where a group's instances ended up in GetSortedIds()
+	struct SORTED_RANGE
+	{
+		unsigned start, count;
+		float nearestDepth;		// Camera space depth of the group's closest instance
+	};
+
+	// Sorts every transform of every group by (group, depth from _camPos along _camForward).
+	// Depths are quantized over [_nearZ, _farZ]; instances outside are clamped, not dropped.
+	// _subgroups optionally splits every group further, one value below _subgroupCount per
+	// transform (ex. the LOD each instance picked this frame).
+	void Sort(const GW::MATH::GMATRIXF* _transforms, const SORT_GROUP* _groups, unsigned _groupCount,
+			  const GW::MATH::GVECTORF& _camPos, const GW::MATH::GVECTORF& _camForward,
+			  float _nearZ, float _farZ, unsigned _threadCount = std::thread::hardware_concurrency(),
+			  const uint8_t* _subgroups = nullptr, unsigned _subgroupCount = 1)
+	{
+		if (!_subgroups)
+			_subgroupCount = 1;
+		// Give the (group, subgroup) index as many bits as it needs, depth gets the rest
+		unsigned rangeCount = _groupCount * _subgroupCount;
+		unsigned groupBits = 0;
+		while ((1u << groupBits) < rangeCount)
+			groupBits++;
+		unsigned depthBits = 32 - groupBits;
+		double depthMax = (double)((1ull << depthBits) - 1);
+		double depthScale = depthMax / (_farZ - _nearZ);
+
+		unsigned total = 0;
+		for (unsigned g = 0; g < _groupCount; g++)
+			total += _groups[g].transformCount;
+		m_keys.clear();
+		m_ids.clear();
+		m_keys.reserve(total);
+		m_ids.reserve(total);
+		m_subgroupCount = _subgroupCount;
+		m_ranges.assign(rangeCount, { 0, 0, _farZ });
+		m_groupNearest.assign(_groupCount, _farZ);
+		for (unsigned g = 0; g < _groupCount; g++)
+		{
+			const SORT_GROUP& group = _groups[g];
+			for (unsigned i = 0; i < group.transformCount; i++)
+			{
+				unsigned id = group.transformStart + i;
+				unsigned r = g * _subgroupCount + (_subgroups ? (std::min)((unsigned)_subgroups[id], _subgroupCount - 1) : 0);
+				const GW::MATH::GVECTORF& p = _transforms[id].row4;
+				float depth = (p.x - _camPos.x) * _camForward.x + (p.y - _camPos.y) * _camForward.y +
+							  (p.z - _camPos.z) * _camForward.z;
+				m_ranges[r].count++;
+				m_ranges[r].nearestDepth = (std::min)(m_ranges[r].nearestDepth, depth);
+				double q = (depth - _nearZ) * depthScale;
+				q = q < 0 ? 0 : (q > depthMax ? depthMax : q);
+				m_keys.push_back((depthBits == 32 ? 0 : (r << depthBits)) | (uint32_t)q);
+				m_ids.push_back(id);
+			}
+		}
+		// Ranges come out of the sort in key order
+		unsigned start = 0;
+		for (unsigned r = 0; r < rangeCount; r++)
+		{
+			m_ranges[r].start = start;
+			start += m_ranges[r].count;
+			m_groupNearest[r / _subgroupCount] = (std::min)(m_groupNearest[r / _subgroupCount], m_ranges[r].nearestDepth);
+		}
+		RadixSort32(m_keys, m_ids, m_scratchKeys, m_scratchIds, m_pool, _threadCount);
+	}
+
+	// Transform indices, grouped by draw group (then subgroup) and near-to-far inside each
+	const std::vector<uint32_t>& GetSortedIds() const { return m_ids; }
+	// One range per (group, subgroup), group major
+	const std::vector<SORTED_RANGE>& GetSortedRanges() const { return m_ranges; }
+	const SORTED_RANGE& GetSortedRange(unsigned _group, unsigned _subgroup = 0) const { return m_ranges[_group * m_subgroupCount + _subgroup]; }
+	unsigned GetSubgroupCount() const { return m_subgroupCount; }
+	// Camera space depth of the group's closest instance over all its subgroups
+	float GetGroupNearestDepth(unsigned _group) const { return m_groupNearest[_group]; }
+
+private:
+	std::vector<uint32_t> m_keys, m_ids;
+	std::vector<uint32_t> m_scratchKeys, m_scratchIds;
+	std::vector<SORTED_RANGE> m_ranges;
+	std::vector<float> m_groupNearest;
+	unsigned m_subgroupCount = 1;
+	WorkerPool m_pool;
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Draw packets.
+// Everything one DrawIndexedInstanced needs, flattened at load into one contiguous array: one
+// packet per instance set x mesh x LOD. Per frame submission is a linear scan over 32 byte
+// packets instead of instance set -> model -> mesh -> range lookups through differently sized
+// structs. Only the per frame instance ranges (depth sorter) are looked up on the side.
+
+// DRAW_PACKET::materialIndex is 16 bits to keep packets at 32 bytes, levels with more materials
+// are refused at packet build instead of drawing with the wrong ones
+const unsigned m_drawPacketMaxMaterials = 0x10000;
+
+enum DRAW_PACKET_FLAGS : uint8_t
+{
+	DRAW_PACKET_16BIT_INDICES = 1,	// indexStart is into the 16 bit index list
+	DRAW_PACKET_MESHLETS = 2,		// drawn from the meshlet culler's visible ranges (LOD0 only)
+};
+
+struct DRAW_PACKET
+{
+	uint32_t indexCount, indexStart, baseVertex;
+	uint32_t instanceSet;						// levelInstances index, also its depth sort group
+	uint32_t transformStart, transformCount;	// the set's instances in levelTransforms
+	uint32_t meshIndex;							// levelMeshes index (quantization, meshlets)
+	uint16_t materialIndex;						// level material slot, below m_drawPacketMaxMaterials
+	uint8_t permutationBits;					// material part of the pixel shader key
+	uint8_t flags;								// DRAW_PACKET_FLAGS, LOD in the high nibble
+
+	unsigned GetLOD() const { return flags >> 4; }
+};
+static_assert(sizeof(DRAW_PACKET) == 32, "two packets per cache line");
+
+inline DRAW_PACKET MakeDrawPacket(unsigned _indexCount, unsigned _indexStart, unsigned _baseVertex, bool _is16Bit,
+								  unsigned _instanceSet, unsigned _transformStart, unsigned _transformCount,
+								  unsigned _meshIndex, unsigned _materialIndex, unsigned _permutationBits,
+								  unsigned _lod, bool _meshlets)
+{
+	DRAW_PACKET packet;
+	packet.indexCount = _indexCount;
+	packet.indexStart = _indexStart;
+	packet.baseVertex = _baseVertex;
+	packet.instanceSet = _instanceSet;
+	packet.transformStart = _transformStart;
+	packet.transformCount = _transformCount;
+	packet.meshIndex = _meshIndex;
+	packet.materialIndex = (uint16_t)_materialIndex;
+	packet.permutationBits = (uint8_t)_permutationBits;
+	packet.flags = (uint8_t)((_is16Bit ? DRAW_PACKET_16BIT_INDICES : 0) | (_meshlets ? DRAW_PACKET_MESHLETS : 0) | (_lod << 4));
+	return packet;
+}
+
+// Shader variant, then material so switches are rare, then instance sets near to far
+// (_groupDepth(instanceSet)). Packets of one mesh stay together in LOD order so its per
+// object constants are uploaded once.
+template <class GROUP_DEPTH>
+inline void SortDrawPackets(std::vector<DRAW_PACKET>& _packets, GROUP_DEPTH _groupDepth)
+{
+	std::stable_sort(_packets.begin(), _packets.end(), [&](const DRAW_PACKET& a, const DRAW_PACKET& b) {
+		if (a.permutationBits != b.permutationBits)
+			return a.permutationBits < b.permutationBits;
+		if (a.materialIndex != b.materialIndex)
+			return a.materialIndex < b.materialIndex;
+		if (a.instanceSet != b.instanceSet)
+		{
+			float depthA = _groupDepth(a.instanceSet), depthB = _groupDepth(b.instanceSet);
+			if (depthA != depthB)
+				return depthA < depthB;
+			return a.instanceSet < b.instanceSet;
+		}
+		if (a.meshIndex != b.meshIndex)
+			return a.meshIndex < b.meshIndex;
+		return a.GetLOD() < b.GetLOD();
+	});
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "SceneHierarchy.h"
+
+// Static/dynamic transform streaming.
+// Instance sets flagged dynamic have their transforms packed into one block at load, everything
+// else sits in a buffer uploaded once and only patched where a static instance is edited. Sets
+// grown at runtime land past the block, so the dynamic slots are a sorted list of ranges that the
+// GPU side packs back to back. That packed block lives in a ring of m_dynamicTransformFrames
+// copies: each frame something moved, the next copy is brought up to date and drawn from while
+// the GPU may still read the older ones. A copy only receives the transforms that changed since
+// it was last written, so upload cost follows what actually moves.
+
+const unsigned m_dynamicTransformFrames = 4;	// more than the frames the CPU may run ahead of the GPU
+
+class DynamicTransformRing
+{
+	std::vector<TRANSFORM_RANGE> m_ranges;	// dynamic transform slots, sorted and disjoint
+	std::vector<unsigned> m_packed;			// per range, where it starts in the packed block
+	unsigned m_count = 0;					// packed block size
+	unsigned m_current = 0;					// copy the GPU reads this frame
+	uint64_t m_frame = 0;					// write counter, copies start out current at 0
+	bool m_pending = false;
+	std::vector<uint64_t> m_changed;		// per packed transform, the write it needs to be in
+	std::vector<uint64_t> m_written;		// per copy, the write that last brought it up to date
+	std::vector<TRANSFORM_RANGE> m_writes;
+
+public:
+	// _ranges sorted by first slot, every copy starts out holding the loaded transforms
+	void Reset(const TRANSFORM_RANGE* _ranges, size_t _rangeCount, unsigned _copies)
+	{
+		m_ranges.assign(_ranges, _ranges + _rangeCount);
+		m_packed.clear();
+		m_count = 0;
+		for (const TRANSFORM_RANGE& range : m_ranges)
+		{
+			m_packed.push_back(m_count);
+			m_count += range.count;
+		}
+		m_current = 0;
+		m_frame = 0;
+		m_pending = false;
+		m_changed.assign(m_count, 0);
+		m_written.assign((std::max)(_copies, 1u), 0);
+		m_writes.clear();
+	}
+
+	unsigned Count() const { return m_count; }
+	unsigned Copies() const { return (unsigned)m_written.size(); }
+	unsigned CurrentCopy() const { return m_current; }
+	const std::vector<TRANSFORM_RANGE>& Ranges() const { return m_ranges; }
+
+	// Index of the first range ending past _slot, Ranges().size() if none does
+	size_t FirstRangeAfter(unsigned _slot) const
+	{
+		return std::upper_bound(m_ranges.begin(), m_ranges.end(), _slot,
+			[](unsigned _s, const TRANSFORM_RANGE& _r) { return _s < _r.first + _r.count; }) - m_ranges.begin();
+	}
+
+	// Where _slot sits in the packed block, ~0u for a static slot
+	unsigned PackedIndex(unsigned _slot) const
+	{
+		size_t r = FirstRangeAfter(_slot);
+		return r < m_ranges.size() && _slot >= m_ranges[r].first ? m_packed[r] + _slot - m_ranges[r].first : ~0u;
+	}
+
+	// Records moved transform slots, returns how many of them lie outside the dynamic ranges
+	unsigned MarkMoved(const TRANSFORM_RANGE* _ranges, size_t _count)
+	{
+		unsigned outside = 0;
+		for (size_t m = 0; m < _count; m++)
+		{
+			unsigned first = _ranges[m].first, end = first + _ranges[m].count;
+			outside += _ranges[m].count;
+			for (size_t r = FirstRangeAfter(first); r < m_ranges.size() && m_ranges[r].first < end; r++)
+			{
+				unsigned start = (std::max)(first, m_ranges[r].first), stop = (std::min)(end, m_ranges[r].first + m_ranges[r].count);
+				outside -= stop - start;
+				for (unsigned slot = start; slot < stop; slot++)
+					m_changed[m_packed[r] + slot - m_ranges[r].first] = m_frame + 1;
+				m_pending = true;
+			}
+		}
+		return outside;
+	}
+
+	// When something moved: switches to the next copy and returns the ranges it has to receive,
+	// in packed indices and never crossing from one dynamic range into the next (see Slot).
+	// Empty when nothing moved, keep drawing the current copy.
+	const std::vector<TRANSFORM_RANGE>& NextWrites()
+	{
+		m_writes.clear();
+		if (!m_pending)
+			return m_writes;
+		m_pending = false;
+		m_frame++;
+		m_current = (m_current + 1) % Copies();
+		uint64_t written = m_written[m_current];
+		for (size_t r = 0; r < m_ranges.size(); r++)
+		{
+			bool open = false;
+			for (unsigned i = m_packed[r]; i < m_packed[r] + m_ranges[r].count; i++)
+			{
+				if (m_changed[i] <= written)
+					open = false;
+				else if (open)
+					m_writes.back().count++;
+				else
+				{
+					m_writes.push_back({ i, 1 });
+					open = true;
+				}
+			}
+		}
+		m_written[m_current] = m_frame;
+		return m_writes;
+	}
+
+	// Transform slot of a packed index
+	unsigned Slot(unsigned _packed) const
+	{
+		size_t r = std::upper_bound(m_packed.begin(), m_packed.end(), _packed) - m_packed.begin() - 1;
+		return m_ranges[r].first + _packed - m_packed[r];
+	}
+};
@@ -0,0 +1,138 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "Hashing.h"
+#include "h2bParser.h"
+
+// Load time geometry deduplication.
+// 1. WeldVertices merges byte identical H2B::VERTEX entries of one model.
+// 2. GeometryPool stores every mesh as a self contained range (its own vertices in first use
+//    order + indices relative to them) keyed by a hash of that content. A mesh whose geometry
+//    was already added by any earlier model resolves to the existing range instead of a copy.
+
+// Where one mesh's geometry lives in the level wide vertex/index arrays
+struct GEOMETRY_RANGE
+{
+	unsigned indexStart, indexCount;	// Absolute, into levelIndices
+	unsigned baseVertex;				// Added to every index, into levelVertices
+	unsigned vertexCount;
+};
+
+struct GEOMETRY_DEDUP_REPORT
+{
+	unsigned meshesAdded, meshesShared;			// Shared = resolved to an existing range
+	unsigned verticesWelded;					// Duplicates removed by WeldVertices
+	unsigned long long bytesImported, bytesStored;	// Vertex + index bytes before/after
+};
+
+// Merges exact duplicate vertices and rewrites _indices, returns how many were removed.
+// Surviving vertices keep their relative order.
+inline unsigned WeldVertices(std::vector<H2B::VERTEX>& _vertices, std::vector<unsigned>& _indices)
+{
+	std::unordered_map<uint64_t, std::vector<unsigned>> lookup;
+	lookup.reserve(_vertices.size());
+	std::vector<unsigned> remap(_vertices.size());
+	std::vector<H2B::VERTEX> welded;
+	welded.reserve(_vertices.size());
+	for (size_t v = 0; v < _vertices.size(); v++)
+	{
+		std::vector<unsigned>& candidates = lookup[HashBytes(&_vertices[v], sizeof(H2B::VERTEX))];
+		unsigned slot = ~0u;
+		for (unsigned candidate : candidates)
+			if (std::memcmp(&welded[candidate], &_vertices[v], sizeof(H2B::VERTEX)) == 0)
+			{
+				slot = candidate;
+				break;
+			}
+		if (slot == ~0u)
+		{
+			slot = (unsigned)welded.size();
+			welded.push_back(_vertices[v]);
+			candidates.push_back(slot);
+		}
+		remap[v] = slot;
+	}
+	for (unsigned& index : _indices)
+		if (index < remap.size())
+			index = remap[index];
+	unsigned removed = (unsigned)(_vertices.size() - welded.size());
+	_vertices.swap(welded);
+	return removed;
+}
+
+class GeometryPool
+{
+	std::unordered_map<uint64_t, std::vector<unsigned>> m_lookup;	// content hash -> m_ranges slots
+	std::vector<GEOMETRY_RANGE> m_ranges;
+	GEOMETRY_DEDUP_REPORT m_report = {};
+	// Scratch for the mesh being added
+	std::vector<unsigned> m_remap, m_localIndices;
+	std::vector<H2B::VERTEX> m_localVertices;
+
+public:
+	// Adds the mesh _indices[_indexOffset, +_indexCount) of a model (indices into _vertices).
+	// Returns its range, appending to _outVertices/_outIndices only if the geometry is new.
+	GEOMETRY_RANGE AddMesh(const std::vector<H2B::VERTEX>& _vertices, const std::vector<unsigned>& _indices,
+						   unsigned _indexOffset, unsigned _indexCount,
+						   std::vector<H2B::VERTEX>& _outVertices, std::vector<unsigned>& _outIndices)
+	{
+		// Make the mesh self contained so equal geometry looks equal no matter where it came from
+		m_remap.assign(_vertices.size(), ~0u);
+		m_localVertices.clear();
+		m_localIndices.clear();
+		unsigned end = (std::min)(_indexOffset + _indexCount, (unsigned)_indices.size());
+		for (unsigned i = _indexOffset; i < end; i++)
+		{
+			unsigned index = _indices[i];
+			if (index >= _vertices.size())
+				index = 0; // malformed file, keep the triangle count intact
+			if (m_remap[index] == ~0u)
+			{
+				m_remap[index] = (unsigned)m_localVertices.size();
+				m_localVertices.push_back(_vertices[index]);
+			}
+			m_localIndices.push_back(m_remap[index]);
+		}
+		size_t vertexBytes = m_localVertices.size() * sizeof(H2B::VERTEX);
+		size_t indexBytes = m_localIndices.size() * sizeof(unsigned);
+		m_report.bytesImported += vertexBytes + indexBytes;
+
+		uint64_t hash = HashBytes(m_localVertices.data(), vertexBytes);
+		hash = HashBytes(m_localIndices.data(), indexBytes, hash);
+		std::vector<unsigned>& candidates = m_lookup[hash];
+		for (unsigned slot : candidates)
+		{
+			const GEOMETRY_RANGE& range = m_ranges[slot];
+			if (range.vertexCount == m_localVertices.size() && range.indexCount == m_localIndices.size() &&
+				std::memcmp(&_outVertices[range.baseVertex], m_localVertices.data(), vertexBytes) == 0 &&
+				std::memcmp(&_outIndices[range.indexStart], m_localIndices.data(), indexBytes) == 0)
+			{
+				m_report.meshesShared++;
+				return range;
+			}
+		}
+
+		GEOMETRY_RANGE range = { (unsigned)_outIndices.size(), (unsigned)m_localIndices.size(),
+								 (unsigned)_outVertices.size(), (unsigned)m_localVertices.size() };
+		_outVertices.insert(_outVertices.end(), m_localVertices.begin(), m_localVertices.end());
+		_outIndices.insert(_outIndices.end(), m_localIndices.begin(), m_localIndices.end());
+		m_ranges.push_back(range);
+		candidates.push_back((unsigned)m_ranges.size() - 1);
+		m_report.meshesAdded++;
+		m_report.bytesStored += vertexBytes + indexBytes;
+		return range;
+	}
+
+	void AddWeldedVertices(unsigned _count) { m_report.verticesWelded += _count; }
+	const GEOMETRY_DEDUP_REPORT& GetReport() const { return m_report; }
+
+	void Clear()
+	{
+		m_lookup.clear();
+		m_ranges.clear();
+		m_report = {};
+	}
+};
@@ -0,0 +1,81 @@
+// Offline build step that runs the import time optimizations over every .h2b once and writes
+// the results back as .h2b (H2B::Writer), plus a text report. Packed with --optimized the
+// loader trusts them and skips welding and vertex cache optimization at startup.
+// Usage: H2BOptimizer <path to Models folder> <output folder>
+#include "GeometryDedup.h"
+#include "MeshOptimizer.h"
+#include "Bounds.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: H2BOptimizer <models folder> <output folder>" << std::endl;
+		return 1;
+	}
+	std::string modelFolder = argv[1], outputFolder = argv[2];
+	std::error_code error;
+	std::filesystem::create_directories(outputFolder, error);
+
+	std::vector<std::string> files;
+	for (const auto& entry : std::filesystem::directory_iterator(modelFolder, error))
+		if (entry.path().extension() == ".h2b")
+			files.push_back(entry.path().string());
+	std::sort(files.begin(), files.end());
+
+	std::ofstream report(outputFolder + "/OptimizeReport.txt", std::ios_base::out | std::ios_base::trunc);
+	report << "model, vertices in -> out, welded, ACMR in -> out, ATVR in -> out, bytes in -> out, bounds center, radius, ms" << std::endl;
+	report << std::fixed << std::setprecision(3);
+	int failures = 0;
+	unsigned long long bytesIn = 0, bytesOut = 0;
+	unsigned missesIn = 0, missesOut = 0, welded = 0;
+	double totalMS = 0;
+	for (const std::string& path : files)
+	{
+		std::string name = std::filesystem::path(path).filename().string();
+		auto start = std::chrono::steady_clock::now();
+		H2B::Parser parsed;
+		if (!parsed.Parse(path.c_str()))
+		{
+			std::cout << path << ": error: not a readable .h2b" << std::endl;
+			failures++;
+			continue;
+		}
+		size_t verticesIn = parsed.vertices.size();
+		unsigned weldedHere = WeldVertices(parsed.vertices, parsed.indices);
+		MESH_OPTIMIZE_REPORT optimized = OptimizeMesh(parsed);
+		LOCAL_BOUNDS bounds = ComputeBounds(parsed.vertices.data(), parsed.vertices.size());
+		std::vector<char> bytes;
+		H2B::Writer::Serialize(parsed, bytes);
+		std::ofstream file(outputFolder + "/" + name, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (!file.write(bytes.data(), bytes.size()))
+		{
+			std::cout << outputFolder << "/" << name << ": error: could not write" << std::endl;
+			failures++;
+			continue;
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		unsigned long long sizeIn = std::filesystem::file_size(path, error);
+
+		report << name << ", " << verticesIn << " -> " << parsed.vertices.size() << ", " << weldedHere << ", "
+			   << optimized.before.acmr << " -> " << optimized.after.acmr << ", " << optimized.before.atvr << " -> " << optimized.after.atvr
+			   << ", " << sizeIn << " -> " << bytes.size() << ", (" << bounds.center[0] << " " << bounds.center[1] << " "
+			   << bounds.center[2] << "), " << bounds.radius << ", " << ms << std::endl;
+		bytesIn += sizeIn;
+		bytesOut += bytes.size();
+		missesIn += optimized.before.misses;
+		missesOut += optimized.after.misses;
+		welded += weldedHere;
+		totalMS += ms;
+	}
+	report << "total: " << files.size() - failures << " models, " << welded << " vertices welded, vertex shader invocations "
+		   << missesIn << " -> " << missesOut << ", bytes " << bytesIn << " -> " << bytesOut << ", " << totalMS << " ms" << std::endl;
+	std::cout << files.size() - failures << " models optimized into " << outputFolder << " (" << totalMS << " ms, "
+			  << missesIn << " -> " << missesOut << " vertex shader invocations)" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "GeometryDedup.h"
+#include "LevelOfDetail.h"
+
+// Hierarchical LOD.
+// Instances are bucketed into a world space grid. Every cell with enough instances gets one
+// proxy: all its members' meshes merged in world space, simplified as a whole and given one
+// material baked from theirs. Past a distance the renderer hides the members and draws the
+// proxy instead, so a far cell costs one draw however many pieces it was built from.
+// Proxies are built at level load from the members' coarsest LODs (LevelOfDetail.h).
+
+const float m_hlodCellSize = 16.0f;			// Grid cell edge (XZ), world units
+const unsigned m_hlodMinInstances = 8;		// Fewer members than this aren't worth a proxy
+const float m_hlodTriangleRatio = 0.2f;		// Proxy triangle target relative to its members
+const float m_hlodMaxRelativeError = 0.02f;	// Largest simplification error, fraction of the cell size
+const unsigned m_lodHidden = m_lodLevels + 1;	// Sort subgroup of instances replaced by a proxy this frame (never drawn)
+
+struct HLOD_CELL
+{
+	float center[3], radius;			// World space sphere around every member
+	unsigned memberStart, memberCount;	// Member transform ids, see BuildHLODCells
+	unsigned proxyTransform;			// Filled by the caller once the proxy exists
+	float error;						// World space error of the proxy, also filled by the caller
+};
+
+// One mesh of one member instance
+struct HLOD_PART
+{
+	const H2B::VERTEX* vertices;		// indices are relative to this
+	unsigned vertexCount;
+	const unsigned* indices;
+	unsigned indexCount;
+	GW::MATH::GMATRIXF world;
+	const H2B::ATTRIBUTES* material;
+};
+
+struct HLOD_PROXY_REPORT
+{
+	unsigned sourceTriangles, proxyTriangles;
+	float error;
+};
+
+// Output of one cell, see BuildHLODProxy
+struct HLOD_PROXY
+{
+	std::vector<H2B::VERTEX> vertices;
+	std::vector<unsigned> indices;
+	H2B::ATTRIBUTES material;
+	HLOD_PROXY_REPORT report;
+};
+
+// Model space sphere (see ComputeBoundingSphere) placed by _world, scaled by its largest axis
+inline void TransformBoundingSphere(const float _center[3], float _radius, const GW::MATH::GMATRIXF& _world, float _outSphere[4])
+{
+	float scale = 0;
+	for (const GW::MATH::GVECTORF* row : { &_world.row1, &_world.row2, &_world.row3 })
+		scale = (std::max)(scale, std::sqrt(row->x * row->x + row->y * row->y + row->z * row->z));
+	for (int k = 0; k < 3; k++)
+		_outSphere[k] = _center[0] * (&_world.row1.x)[k] + _center[1] * (&_world.row2.x)[k] +
+						_center[2] * (&_world.row3.x)[k] + (&_world.row4.x)[k];
+	_outSphere[3] = _radius * scale;
+}
+
+// Buckets _count transforms into cells by position. _spheres holds each transform's world
+// space bounding sphere (x, y, z, radius), anything bigger than a cell stays out of the proxies.
+// Cells keep their members contiguous in _outMembers.
+inline void BuildHLODCells(const float (*_spheres)[4], size_t _count, std::vector<HLOD_CELL>& _outCells,
+						   std::vector<unsigned>& _outMembers)
+{
+	std::unordered_map<uint64_t, std::vector<unsigned>> grid;
+	std::vector<uint64_t> order; // cells in first seen order so the output is deterministic
+	for (size_t i = 0; i < _count; i++)
+	{
+		if (_spheres[i][3] > m_hlodCellSize)
+			continue;
+		int32_t x = (int32_t)std::floor(_spheres[i][0] / m_hlodCellSize);
+		int32_t z = (int32_t)std::floor(_spheres[i][2] / m_hlodCellSize);
+		uint64_t key = ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+		std::vector<unsigned>& cell = grid[key];
+		if (cell.empty())
+			order.push_back(key);
+		cell.push_back((unsigned)i);
+	}
+	for (uint64_t key : order)
+	{
+		const std::vector<unsigned>& members = grid[key];
+		if (members.size() < m_hlodMinInstances)
+			continue;
+		HLOD_CELL cell = {};
+		float minP[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxP[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (unsigned m : members)
+			for (int k = 0; k < 3; k++)
+			{
+				minP[k] = (std::min)(minP[k], _spheres[m][k] - _spheres[m][3]);
+				maxP[k] = (std::max)(maxP[k], _spheres[m][k] + _spheres[m][3]);
+			}
+		for (int k = 0; k < 3; k++)
+			cell.center[k] = (minP[k] + maxP[k]) * 0.5f;
+		for (unsigned m : members)
+		{
+			float dx = _spheres[m][0] - cell.center[0], dy = _spheres[m][1] - cell.center[1], dz = _spheres[m][2] - cell.center[2];
+			cell.radius = (std::max)(cell.radius, std::sqrt(dx * dx + dy * dy + dz * dz) + _spheres[m][3]);
+		}
+		cell.memberStart = (unsigned)_outMembers.size();
+		cell.memberCount = (unsigned)members.size();
+		cell.proxyTransform = ~0u;
+		_outMembers.insert(_outMembers.end(), members.begin(), members.end());
+		_outCells.push_back(cell);
+	}
+}
+
+// Merges _parts in world space into one simplified mesh (indices relative to _outVertices).
+// The proxy's material is the area weighted average of the parts' materials. UVs are dropped,
+// nothing samples textures and they would only add seams.
+inline HLOD_PROXY_REPORT BuildHLODProxy(const HLOD_PART* _parts, size_t _count, std::vector<H2B::VERTEX>& _outVertices,
+										std::vector<unsigned>& _outIndices, H2B::ATTRIBUTES& _outMaterial)
+{
+	HLOD_PROXY_REPORT report = {};
+	_outVertices.clear();
+	_outIndices.clear();
+	const size_t floatCount = offsetof(H2B::ATTRIBUTES, illum) / sizeof(float);
+	double materialSum[floatCount] = {}, areaSum = 0, largestArea = -1;
+	_outMaterial = {};
+
+	for (size_t p = 0; p < _count; p++)
+	{
+		const HLOD_PART& part = _parts[p];
+		const GW::MATH::GMATRIXF& w = part.world;
+		unsigned base = (unsigned)_outVertices.size();
+		for (unsigned v = 0; v < part.vertexCount; v++)
+		{
+			const H2B::VERTEX& src = part.vertices[v];
+			H2B::VERTEX dst = {};
+			float n[3];
+			for (int k = 0; k < 3; k++)
+			{
+				(&dst.pos.x)[k] = src.pos.x * (&w.row1.x)[k] + src.pos.y * (&w.row2.x)[k] + src.pos.z * (&w.row3.x)[k] + (&w.row4.x)[k];
+				n[k] = src.nrm.x * (&w.row1.x)[k] + src.nrm.y * (&w.row2.x)[k] + src.nrm.z * (&w.row3.x)[k];
+			}
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length > 0)
+				dst.nrm = { n[0] / length, n[1] / length, n[2] / length };
+			_outVertices.push_back(dst);
+		}
+		double area = 0;
+		for (unsigned i = 0; i + 2 < part.indexCount; i += 3)
+		{
+			double c[3];
+			MeshSimplifierDetail::Cross(_outVertices[base + part.indices[i]].pos, _outVertices[base + part.indices[i + 1]].pos,
+										_outVertices[base + part.indices[i + 2]].pos, c);
+			area += 0.5 * std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+			for (int k = 0; k < 3; k++)
+				_outIndices.push_back(part.indices[i + k]);
+		}
+		const float* attributes = &part.material->Kd.x;
+		for (size_t f = 0; f < floatCount; f++)
+			materialSum[f] += attributes[f] * area;
+		areaSum += area;
+		if (area > largestArea)
+		{
+			largestArea = area;
+			_outMaterial.illum = part.material->illum;
+		}
+		// Indices were relative to the part, rebase them
+		for (size_t i = _outIndices.size() - (part.indexCount - part.indexCount % 3); i < _outIndices.size(); i++)
+			_outIndices[i] += base;
+	}
+	for (size_t f = 0; f < floatCount; f++)
+		(&_outMaterial.Kd.x)[f] = areaSum > 0 ? (float)(materialSum[f] / areaSum) : 0.0f;
+	report.sourceTriangles = (unsigned)(_outIndices.size() / 3);
+
+	// Touching pieces become one surface, then the whole cell is simplified at once
+	WeldVertices(_outVertices, _outIndices);
+	size_t target = (size_t)(_outIndices.size() * m_hlodTriangleRatio) / 3 * 3;
+	_outIndices = SimplifyMesh(_outVertices.data(), _outVertices.size(), _outIndices.data(), _outIndices.size(),
+							   target, m_hlodCellSize * m_hlodMaxRelativeError, &report.error);
+
+	// Drop the vertices the simplifier no longer uses
+	std::vector<unsigned> remap(_outVertices.size(), ~0u);
+	std::vector<H2B::VERTEX> used;
+	for (unsigned& index : _outIndices)
+	{
+		if (remap[index] == ~0u)
+		{
+			remap[index] = (unsigned)used.size();
+			used.push_back(_outVertices[index]);
+		}
+		index = remap[index];
+	}
+	_outVertices.swap(used);
+	MeshOptimizerDetail::OptimizeVertexCacheRange(_outIndices.data(), _outIndices.size(), _outVertices.size());
+	report.proxyTriangles = (unsigned)(_outIndices.size() / 3);
+	return report;
+}
+
+// BuildHLODProxy for every cell, _cellParts[c] are cell c's parts. Cells are independent so
+// they are spread over _threadCount threads, the calling thread takes part.
+inline void BuildHLODProxies(const std::vector<std::vector<HLOD_PART>>& _cellParts, std::vector<HLOD_PROXY>& _outProxies,
+							 unsigned _threadCount = std::thread::hardware_concurrency())
+{
+	_outProxies.clear();
+	_outProxies.resize(_cellParts.size());
+	std::atomic<size_t> next(0);
+	auto work = [&]() {
+		for (size_t c = next++; c < _cellParts.size(); c = next++)
+			_outProxies[c].report = BuildHLODProxy(_cellParts[c].data(), _cellParts[c].size(), _outProxies[c].vertices,
+												   _outProxies[c].indices, _outProxies[c].material);
+	};
+	_threadCount = (unsigned)(std::min<size_t>)((std::max)(_threadCount, 1u), _cellParts.size());
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < _threadCount; t++)
+		workers.emplace_back(work);
+	work();
+	for (std::thread& worker : workers)
+		worker.join();
+}
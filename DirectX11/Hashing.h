@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// 64 bit FNV-1a. Used to key load time caches (materials, geometry, shader bytecode, baked levels).
+// Not cryptographic. GeometryDedup and the MeshSimplifier weld compare the actual bytes when two
+// hashes match, ShaderCache and LevelBakeCache take a 64 bit match as a hit.
+const uint64_t m_fnvOffsetBasis = 14695981039346656037ull;
+const uint64_t m_fnvPrime = 1099511628211ull;
+
+inline uint64_t HashBytes(const void* _data, size_t _size, uint64_t _hash = m_fnvOffsetBasis)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(_data);
+	for (size_t i = 0; i < _size; i++)
+	{
+		_hash ^= bytes[i];
+		_hash *= m_fnvPrime;
+	}
+	return _hash;
+}
+
+// Hashes a null terminated string including its terminator, so "ab"+"c" != "a"+"bc".
+// A null pointer hashes like an empty string.
+inline uint64_t HashString(const char* _str, uint64_t _hash = m_fnvOffsetBasis)
+{
+	if (_str != nullptr)
+	{
+		for (; *_str != '\0'; _str++)
+		{
+			_hash ^= (unsigned char)*_str;
+			_hash *= m_fnvPrime;
+		}
+	}
+	_hash ^= 0;
+	_hash *= m_fnvPrime;
+	return _hash;
+}
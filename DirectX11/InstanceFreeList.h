@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+// Free slots inside instance sets.
+// A level's transforms are grouped per instance set (one model's instances, contiguous), and
+// everything built from them (draw packets, sort groups, LOD arrays, GPU buffers) indexes those
+// ranges. Removing an instance therefore doesn't close the gap: its slot is hidden and pushed on
+// its set's free list, and the next instance added to that set takes it back. Only a set without
+// free slots has to grow. Every hidden slot is also kept in one list the renderer walks each frame.
+
+const unsigned m_instanceSetGrowth = 16;	// fewest slots a grown instance set adds
+
+class InstanceFreeList
+{
+	std::vector<std::vector<unsigned>> m_free;	// per set, reusable slots, the last released is reused first
+	std::vector<unsigned> m_hidden;				// every hidden slot, free or not
+	std::vector<unsigned> m_hiddenAt;			// per slot, its index in m_hidden or ~0u when visible
+
+public:
+	void Clear()
+	{
+		m_free.clear();
+		m_hidden.clear();
+		m_hiddenAt.clear();
+	}
+
+	// Grows to cover _setCount sets and _slotCount transform slots, new slots start visible
+	void Resize(size_t _setCount, size_t _slotCount)
+	{
+		if (m_free.size() < _setCount)
+			m_free.resize(_setCount);
+		if (m_hiddenAt.size() < _slotCount)
+			m_hiddenAt.resize(_slotCount, ~0u);
+	}
+
+	// Hides _slot of _set. Only _reusable slots go back on the free list, the others stay hidden
+	// for good. False when the slot is already hidden
+	bool Release(unsigned _set, unsigned _slot, bool _reusable)
+	{
+		Resize(_set + 1, _slot + 1);
+		if (!Hide(_slot))
+			return false;
+		if (_reusable)
+			m_free[_set].push_back(_slot);
+		return true;
+	}
+
+	// Hides a slot without freeing it (a streamed out cell, WorldPartition.h), false if already hidden
+	bool Hide(unsigned _slot)
+	{
+		Resize(0, _slot + 1);
+		if (m_hiddenAt[_slot] != ~0u)
+			return false;
+		m_hiddenAt[_slot] = (unsigned)m_hidden.size();
+		m_hidden.push_back(_slot);
+		return true;
+	}
+
+	// Shows a slot hidden by Hide again. Never for a slot on a free list, Acquire takes those
+	void Show(unsigned _slot)
+	{
+		if (!IsHidden(_slot))
+			return;
+		unsigned at = m_hiddenAt[_slot];
+		m_hiddenAt[m_hidden.back()] = at;
+		m_hidden[at] = m_hidden.back();
+		m_hidden.pop_back();
+		m_hiddenAt[_slot] = ~0u;
+	}
+
+	// Takes a free slot of _set and makes it visible, ~0u when the set has none
+	unsigned Acquire(unsigned _set)
+	{
+		if (_set >= m_free.size() || m_free[_set].empty())
+			return ~0u;
+		unsigned slot = m_free[_set].back();
+		m_free[_set].pop_back();
+		Show(slot);
+		return slot;
+	}
+
+	bool IsHidden(unsigned _slot) const { return _slot < m_hiddenAt.size() && m_hiddenAt[_slot] != ~0u; }
+	size_t FreeCount(unsigned _set) const { return _set < m_free.size() ? m_free[_set].size() : 0; }
+	const std::vector<unsigned>& HiddenSlots() const { return m_hidden; }
+};
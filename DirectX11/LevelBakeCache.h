@@ -0,0 +1,302 @@
+#pragma once
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <type_traits>
+#include <unordered_map>
+#include "Hashing.h"
+#include "MappedFile.h"
+#include "ModelPack.h"
+#include "BinaryLevel.h"
+
+// Baked level cache.
+// A fully imported level (every Level_Data array after weld, optimize, LODs, HLODs...) is
+// written to one relocatable blob keyed by a content hash of the level file, every .h2b it
+// references and the import settings. A warm load maps the blob, checks the key and copies the
+// arrays straight out. String pointers inside the arrays are stored as offsets into the blob's
+// string table and fixed up to point into the mapping, which stays open while the level is
+// loaded. Any change to a source file or setting changes the key and the level is re-imported
+// and re-baked. Bump m_levelBakeVersion whenever an import step's output changes.
+
+const uint32_t m_levelBakeVersion = 2;
+const uint32_t m_levelBakeAlignment = 16;	// every array starts on this boundary in the blob
+
+struct LEVEL_BAKE_HEADER
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint64_t size;			// whole blob, catches truncated writes
+	uint32_t arrayCount;	// LEVEL_BAKE_ARRAY entries right after the header
+	uint32_t stringBytes;
+	uint64_t stringOffset;	// null terminated strings, stored pointers are offset + 1
+};
+
+struct LEVEL_BAKE_ARRAY
+{
+	uint32_t id, elementSize;
+	uint64_t offset, count;
+};
+
+// Levels/GameLevel.txt bakes to Levels/Cache/GameLevel.lvb
+inline std::string GetLevelBakePath(const std::string& _levelPath)
+{
+	std::filesystem::path level(_levelPath);
+	return (level.parent_path() / "Cache" / level.stem()).string() + ".lvb";
+}
+
+// One sized read instead of streaming through a buffer
+inline bool ReadWholeFile(const std::string& _path, std::vector<char>& _out)
+{
+	std::ifstream file(_path, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+	if (!file.is_open())
+		return false;
+	_out.resize((size_t)file.tellg());
+	file.seekg(0);
+	file.read(_out.data(), _out.size());
+	return (bool)file;
+}
+
+// Hashes the level file and every model file it references (sorted, each once), the level
+// either a binary level (BinaryLevel.h) or the text layout Level_Data::ReadGameLevel reads.
+// Models in _pack are hashed from the pack since that's what gets loaded. A missing model still
+// hashes its name so adding it later changes the key. False if the level file can't be read.
+inline bool HashLevelSources(const std::string& _levelPath, const std::string& _h2bFolder, uint64_t& _outKey,
+							 const ModelPack* _pack = nullptr)
+{
+	std::vector<char> bytes;
+	std::set<std::string> models;
+	uint64_t key = 0;
+	LevelFileReader binaryLevel;
+	if (binaryLevel.Open(_levelPath))
+	{
+		key = HashBytes(binaryLevel.Data(), binaryLevel.Size());
+		for (uint32_t i = 0; i < binaryLevel.ModelCount(); i++)
+			models.insert(binaryLevel.ModelName(i));
+		binaryLevel.Close();
+	}
+	else if (ReadWholeFile(_levelPath, bytes))
+		key = HashBytes(bytes.data(), bytes.size());
+	else
+		return false;
+	std::string text(bytes.begin(), bytes.end()); // empty for a binary level
+
+	size_t lineStart = 0;
+	bool meshNext = false;
+	while (lineStart < text.size())
+	{
+		size_t lineEnd = text.find('\n', lineStart);
+		if (lineEnd == std::string::npos)
+			lineEnd = text.size();
+		std::string line = text.substr(lineStart, lineEnd - lineStart);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (meshNext)
+			models.insert(line.substr(0, line.find_last_of(".")) + ".h2b");
+		meshNext = line == "MESH";
+		lineStart = lineEnd + 1;
+	}
+
+	for (const std::string& model : models)
+	{
+		key = HashString(model.c_str(), key);
+		const unsigned char* data = nullptr;
+		size_t packedSize = 0;
+		if (_pack == nullptr || !_pack->Find(model.c_str(), data, packedSize))
+		{
+			if (!ReadWholeFile(_h2bFolder + "/" + model, bytes))
+				continue;
+			data = reinterpret_cast<const unsigned char*>(bytes.data());
+			packedSize = bytes.size();
+		}
+		uint64_t size = packedSize;
+		key = HashBytes(&size, sizeof(size), key);
+		key = HashBytes(data, packedSize, key);
+	}
+	_outKey = key;
+	return true;
+}
+
+// Collects arrays and strings, then writes the blob in one go
+class LevelBakeWriter
+{
+	std::vector<LEVEL_BAKE_ARRAY> m_arrays;
+	std::vector<unsigned char> m_data;
+	std::vector<char> m_strings;
+	std::unordered_map<std::string, uint64_t> m_stringOffsets;
+
+public:
+	template <class T>
+	void AddArray(uint32_t _id, const T* _elements, size_t _count)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "baked arrays are copied as raw bytes");
+		m_data.resize((m_data.size() + m_levelBakeAlignment - 1) / m_levelBakeAlignment * m_levelBakeAlignment);
+		m_arrays.push_back({ _id, (uint32_t)sizeof(T), (uint64_t)m_data.size(), (uint64_t)_count });
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(_elements);
+		m_data.insert(m_data.end(), bytes, bytes + sizeof(T) * _count);
+	}
+	template <class T>
+	void AddArray(uint32_t _id, const std::vector<T>& _elements) { AddArray(_id, _elements.data(), _elements.size()); }
+
+	// The value to store in place of _str inside a baked element, see LevelBakeReader::Relocate
+	const char* AddString(const char* _str)
+	{
+		if (_str == nullptr)
+			return nullptr;
+		auto found = m_stringOffsets.find(_str);
+		uint64_t offset;
+		if (found != m_stringOffsets.end())
+			offset = found->second;
+		else
+		{
+			offset = m_strings.size();
+			m_strings.insert(m_strings.end(), _str, _str + std::strlen(_str) + 1);
+			m_stringOffsets.emplace(_str, offset);
+		}
+		return reinterpret_cast<const char*>((uintptr_t)(offset + 1));
+	}
+
+	// Writes next to _path first so a crash never leaves a half written blob with a valid header
+	bool Save(const std::string& _path, uint64_t _key) const
+	{
+		uint64_t tableBytes = sizeof(LEVEL_BAKE_HEADER) + sizeof(LEVEL_BAKE_ARRAY) * m_arrays.size();
+		uint64_t dataStart = (tableBytes + m_levelBakeAlignment - 1) / m_levelBakeAlignment * m_levelBakeAlignment;
+		LEVEL_BAKE_HEADER header = { { 'L', 'V', 'B', '1' }, m_levelBakeVersion, _key, 0, (uint32_t)m_arrays.size(),
+			(uint32_t)m_strings.size(), dataStart + m_data.size() };
+		header.size = header.stringOffset + m_strings.size();
+		std::vector<LEVEL_BAKE_ARRAY> arrays = m_arrays;
+		for (LEVEL_BAKE_ARRAY& array : arrays)
+			array.offset += dataStart;
+
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(_path).parent_path(), error); // fine if it already exists
+		std::string temporary = _path + ".tmp";
+		{
+			std::ofstream file(temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+			if (!file.is_open())
+				return false; // read only install, we'll just import again next launch
+			const char padding[m_levelBakeAlignment] = {};
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(arrays.data()), sizeof(LEVEL_BAKE_ARRAY) * arrays.size());
+			file.write(padding, dataStart - tableBytes);
+			file.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+			file.write(m_strings.data(), m_strings.size());
+			if (!file)
+				return false;
+		}
+		std::remove(_path.c_str()); // rename won't replace an existing file on Windows
+		return std::rename(temporary.c_str(), _path.c_str()) == 0;
+	}
+};
+
+// Maps a blob and hands its arrays back. Relocated strings point into the mapping, keep the
+// reader open for as long as they're used.
+class LevelBakeReader
+{
+	MappedFile m_file;
+	const unsigned char* m_data = nullptr;
+	const LEVEL_BAKE_HEADER* m_header = nullptr;
+	const LEVEL_BAKE_ARRAY* m_arrays = nullptr;
+
+public:
+	// False (and closed) if the blob is missing, from another version/key or truncated
+	bool Open(const std::string& _path, uint64_t _key)
+	{
+		Close();
+		if (!m_file.Open(_path))
+			return false;
+		return Attach(m_file.Data(), m_file.Size(), _key);
+	}
+
+	// Same for a blob already in memory (ex. read on a loader thread), which has to outlive the reader
+	bool Open(const unsigned char* _data, size_t _size, uint64_t _key)
+	{
+		Close();
+		return Attach(_data, _size, _key);
+	}
+
+	void Close()
+	{
+		m_file.Close();
+		m_data = nullptr;
+		m_header = nullptr;
+		m_arrays = nullptr;
+	}
+
+	bool IsOpen() const { return m_header != nullptr; }
+
+	// False if the blob has no array _id or it was baked from a different element layout
+	template <class T>
+	bool ReadArray(uint32_t _id, std::vector<T>& _out) const
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "baked arrays are copied as raw bytes");
+		for (uint32_t i = 0; m_header != nullptr && i < m_header->arrayCount; i++)
+		{
+			if (m_arrays[i].id != _id)
+				continue;
+			if (m_arrays[i].elementSize != sizeof(T))
+				return false;
+			const T* first = reinterpret_cast<const T*>(m_data + m_arrays[i].offset);
+			_out.assign(first, first + m_arrays[i].count);
+			return true;
+		}
+		return false;
+	}
+
+	// Like ReadArray without the copy, _out points into the blob
+	template <class T>
+	bool ViewArray(uint32_t _id, const T*& _out, size_t& _count) const
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "baked arrays are copied as raw bytes");
+		for (uint32_t i = 0; m_header != nullptr && i < m_header->arrayCount; i++)
+		{
+			if (m_arrays[i].id != _id)
+				continue;
+			if (m_arrays[i].elementSize != sizeof(T))
+				return false;
+			_out = reinterpret_cast<const T*>(m_data + m_arrays[i].offset);
+			_count = (size_t)m_arrays[i].count;
+			return true;
+		}
+		return false;
+	}
+
+	// Turns a value stored by LevelBakeWriter::AddString back into a pointer into the mapping
+	const char* Relocate(const char* _stored) const
+	{
+		uint64_t offset = (uint64_t)reinterpret_cast<uintptr_t>(_stored);
+		if (offset == 0 || offset > m_header->stringBytes)
+			return nullptr;
+		return reinterpret_cast<const char*>(m_data + m_header->stringOffset + offset - 1);
+	}
+
+private:
+	bool Attach(const unsigned char* _data, size_t _size, uint64_t _key)
+	{
+		if (_data == nullptr || _size < sizeof(LEVEL_BAKE_HEADER))
+			return Fail();
+		m_data = _data;
+		m_header = reinterpret_cast<const LEVEL_BAKE_HEADER*>(_data);
+		if (std::memcmp(m_header->magic, "LVB1", 4) != 0 || m_header->version != m_levelBakeVersion ||
+			m_header->key != _key || m_header->size != _size ||
+			sizeof(LEVEL_BAKE_HEADER) + sizeof(LEVEL_BAKE_ARRAY) * (uint64_t)m_header->arrayCount > _size ||
+			m_header->stringOffset + m_header->stringBytes != _size)
+			return Fail();
+		m_arrays = reinterpret_cast<const LEVEL_BAKE_ARRAY*>(m_header + 1);
+		for (uint32_t i = 0; i < m_header->arrayCount; i++)
+			if (m_arrays[i].offset + m_arrays[i].count * m_arrays[i].elementSize > m_header->stringOffset)
+				return Fail();
+		return true;
+	}
+
+	bool Fail()
+	{
+		Close();
+		return false;
+	}
+};
@@ -0,0 +1,36 @@
+// Build step that converts a text level export into the binary level layout (BinaryLevel.h).
+// Usage: LevelConverter <level .txt> [output, default the same name as .lvl]
+#include "BinaryLevel.h"
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: LevelConverter <level .txt> [output .lvl]" << std::endl;
+		return 1;
+	}
+	std::string levelPath = argv[1];
+	std::string outputPath = argc > 2 ? argv[2] : GetLevelFilePath(levelPath);
+
+	LEVEL_FILE_CONTENT content;
+	uint64_t sourceHash = 0;
+	if (!ReadLevelText(levelPath, content) || !HashLevelText(levelPath, sourceHash))
+	{
+		std::cout << levelPath << ": error: could not read the level" << std::endl;
+		return 1;
+	}
+	if (!WriteLevelFile(content, outputPath, sourceHash))
+	{
+		std::cout << outputPath << ": error: could not write the level" << std::endl;
+		return 1;
+	}
+	size_t transforms = 0;
+	for (const auto& model : content.models)
+		transforms += model.second.size();
+	std::error_code error;
+	std::cout << levelPath << " (" << std::filesystem::file_size(levelPath, error) / 1024 << " KiB) -> " << outputPath << " ("
+			  << std::filesystem::file_size(outputPath, error) / 1024 << " KiB), " << content.models.size() << " models, "
+			  << transforms << " transforms, " << content.pointLights.size() + content.spotLights.size() << " lights" << std::endl;
+	return 0;
+}
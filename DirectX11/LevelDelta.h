@@ -0,0 +1,130 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include "Hashing.h"
+#define GATEWARE_ENABLE_CORE // All libraries need this
+#define GATEWARE_ENABLE_MATH
+#include "../gateware-main/Gateware.h"
+
+// Level deltas.
+// Levels that share most of their layout (variants of one level) don't need a cold load to
+// switch between. DiffInstances matches one model's instances between the loaded level and the
+// next one: a matrix found in both (within m_levelDeltaTolerance) keeps its transform slot, and
+// with it everything built from it (bounds, LOD state, HLOD cell, GPU data). A leftover only
+// counts as moved when the same rotation/scale sits close by, everything else is removed or
+// added. Unrelated levels (GameLevel and GameLevel2 share no placement) keep next to nothing,
+// DeltaWorthApplying sends those to a full load and its bake cache.
+
+const float m_levelDeltaTolerance = 1e-3f;		// largest per element difference of matrices that are the same instance
+const float m_levelDeltaMoveDistance = 1.0f;	// farthest a leftover instance may be from its match to count as moved
+const float m_levelDeltaMinKept = 0.5f;			// fraction of instances a delta has to keep to beat a full load
+
+struct INSTANCE_DELTA
+{
+	unsigned kept = 0;
+	std::vector<std::pair<unsigned, unsigned>> moved;	// current transform slot, index in the next level
+	std::vector<unsigned> added;						// indices in the next level
+	std::vector<unsigned> removed;						// current transform slots
+
+	void Clear()
+	{
+		kept = 0;
+		moved.clear();
+		added.clear();
+		removed.clear();
+	}
+};
+
+// Largest element difference of the 3x3 part, or of the whole matrix with _translation
+inline float MatrixDifference(const GW::MATH::GMATRIXF& _a, const GW::MATH::GMATRIXF& _b, bool _translation)
+{
+	float largest = 0;
+	for (int e = 0; e < (_translation ? 16 : 12); e++)
+		if (e % 4 != 3)
+			largest = (std::max)(largest, std::fabs(_a.data[e] - _b.data[e]));
+	return largest;
+}
+
+// Grid cell of a translation, m_levelDeltaMoveDistance wide so a match is always in a neighbor
+inline uint64_t DeltaCellKey(const GW::MATH::GMATRIXF& _matrix, int _dx, int _dy, int _dz)
+{
+	int cell[3] = { (int)std::floor(_matrix.row4.x / m_levelDeltaMoveDistance) + _dx,
+					(int)std::floor(_matrix.row4.y / m_levelDeltaMoveDistance) + _dy,
+					(int)std::floor(_matrix.row4.z / m_levelDeltaMoveDistance) + _dz };
+	return HashBytes(cell, sizeof(cell));
+}
+
+// _slots are the model's visible transform slots in _transforms, _next its matrices in the next
+// level. Exact matches are paired first, then moves, each with the nearest candidate
+inline void DiffInstances(const GW::MATH::GMATRIXF* _transforms, const unsigned* _slots, size_t _slotCount,
+						  const GW::MATH::GMATRIXF* _next, size_t _nextCount, INSTANCE_DELTA& _out)
+{
+	_out.Clear();
+	std::unordered_map<uint64_t, std::vector<unsigned>> grid;	// cell -> indices into _slots
+	grid.reserve(_slotCount);
+	for (unsigned i = 0; i < _slotCount; i++)
+		grid[DeltaCellKey(_transforms[_slots[i]], 0, 0, 0)].push_back(i);
+	std::vector<uint8_t> used(_slotCount, 0);
+	std::vector<unsigned> match(_nextCount, ~0u);
+	// nearest unused slot whose matrix passes, ~0u if none does
+	auto nearest = [&](const GW::MATH::GMATRIXF& _matrix, bool _moved) {
+		unsigned best = ~0u;
+		float bestDistance = 0;
+		for (int dx = -1; dx <= 1; dx++)
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dz = -1; dz <= 1; dz++)
+				{
+					auto cell = grid.find(DeltaCellKey(_matrix, dx, dy, dz));
+					if (cell == grid.end())
+						continue;
+					for (unsigned i : cell->second)
+					{
+						const GW::MATH::GMATRIXF& current = _transforms[_slots[i]];
+						if (used[i] || MatrixDifference(current, _matrix, !_moved) > m_levelDeltaTolerance)
+							continue;
+						float x = current.row4.x - _matrix.row4.x, y = current.row4.y - _matrix.row4.y, z = current.row4.z - _matrix.row4.z;
+						float distance = std::sqrt(x * x + y * y + z * z);
+						if (distance <= m_levelDeltaMoveDistance && (best == ~0u || distance < bestDistance))
+						{
+							best = i;
+							bestDistance = distance;
+						}
+					}
+				}
+		return best;
+	};
+	for (unsigned n = 0; n < _nextCount; n++)
+		if ((match[n] = nearest(_next[n], false)) != ~0u)
+		{
+			used[match[n]] = 1;
+			_out.kept++;
+		}
+	for (unsigned n = 0; n < _nextCount; n++)
+	{
+		if (match[n] != ~0u)
+			continue;
+		unsigned moved = nearest(_next[n], true);
+		if (moved == ~0u)
+		{
+			_out.added.push_back(n);
+			continue;
+		}
+		used[moved] = 1;
+		_out.moved.push_back({ _slots[moved], n });
+	}
+	for (unsigned i = 0; i < _slotCount; i++)
+		if (!used[i])
+			_out.removed.push_back(_slots[i]);
+}
+
+// Whether editing the loaded level into the next one beats loading it: the kept instances have
+// to be at least m_levelDeltaMinKept of the bigger of the two levels
+inline bool DeltaWorthApplying(size_t _kept, size_t _current, size_t _next)
+{
+	size_t larger = (std::max)(_current, _next);
+	return larger == 0 || _kept >= m_levelDeltaMinKept * larger;
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <algorithm>
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#define GATEWARE_ENABLE_CORE // All libraries need this
+#define GATEWARE_ENABLE_MATH
+#include "../gateware-main/Gateware.h"
+
+// Automatic LOD chains.
+// At import every mesh gets m_lodLevels simplified index lists over its own vertices
+// (MeshSimplifier.h), so a LOD is only an extra index range: no new vertices, same quantization
+// block, same vertex buffers. Each frame every instance picks the coarsest LOD whose geometric
+// error, projected to the screen, stays under a pixel threshold. Going coarser needs a margin
+// (hysteresis) so instances sitting on a boundary don't pop back and forth.
+
+const unsigned m_lodLevels = 3;				// Generated LODs after LOD0
+const float m_lodTriangleRatio = 0.5f;		// Each LOD targets this fraction of the previous one
+const float m_lodMaxRelativeError = 0.02f;	// LOD1 never moves the surface more than this much of the mesh radius,
+											// every further LOD may move it m_lodErrorGrowth times more
+const float m_lodErrorGrowth = 3.0f;
+const float m_lodMinReduction = 0.9f;		// A LOD that keeps more than this of the previous one isn't worth a switch
+
+// Model space bounding sphere and the error of every LOD, error[0] is always 0
+struct LOD_BOUNDS
+{
+	float center[3], radius;
+	float error[m_lodLevels + 1];
+};
+
+// Center of the AABB and the farthest vertex from it
+inline void ComputeBoundingSphere(const H2B::VERTEX* _vertices, size_t _count, float _center[3], float& _radius)
+{
+	float minP[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxP[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t v = 0; v < _count; v++)
+		for (int k = 0; k < 3; k++)
+		{
+			minP[k] = (std::min)(minP[k], (&_vertices[v].pos.x)[k]);
+			maxP[k] = (std::max)(maxP[k], (&_vertices[v].pos.x)[k]);
+		}
+	float radiusSquared = 0;
+	for (int k = 0; k < 3; k++)
+		_center[k] = _count ? (minP[k] + maxP[k]) * 0.5f : 0.0f;
+	for (size_t v = 0; v < _count; v++)
+	{
+		float dx = _vertices[v].pos.x - _center[0], dy = _vertices[v].pos.y - _center[1], dz = _vertices[v].pos.z - _center[2];
+		radiusSquared = (std::max)(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	_radius = std::sqrt(radiusSquared);
+}
+
+// Builds the LOD chain of one mesh. _indices are relative to _vertices. Every LOD is simplified
+// from LOD0 so its error is measured against the original surface, then reordered for the
+// vertex cache. When a mesh stops reducing (seams, tiny meshes) the last LOD is repeated.
+inline void GenerateMeshLODs(const H2B::VERTEX* _vertices, unsigned _vertexCount,
+							 const unsigned* _indices, unsigned _indexCount,
+							 std::vector<unsigned> _outLods[m_lodLevels], float _outErrors[m_lodLevels])
+{
+	float center[3], radius;
+	ComputeBoundingSphere(_vertices, _vertexCount, center, radius);
+	float maxError = radius * m_lodMaxRelativeError;
+
+	std::vector<unsigned> previous(_indices, _indices + _indexCount);
+	float previousError = 0;
+	size_t target = _indexCount;
+	for (unsigned l = 0; l < m_lodLevels; l++)
+	{
+		target = (size_t)(target * m_lodTriangleRatio) / 3 * 3;
+		float error = 0;
+		std::vector<unsigned> lod = SimplifyMesh(_vertices, _vertexCount, _indices, _indexCount, target, maxError, &error);
+		if (lod.empty() || lod.size() > previous.size() * m_lodMinReduction)
+		{
+			_outLods[l] = previous;
+			_outErrors[l] = previousError;
+			maxError *= m_lodErrorGrowth;
+			continue;
+		}
+		MeshOptimizerDetail::OptimizeVertexCacheRange(lod.data(), lod.size(), _vertexCount);
+		previousError = (std::max)(previousError, error);
+		previous = lod;
+		_outLods[l] = std::move(lod);
+		_outErrors[l] = previousError;
+		maxError *= m_lodErrorGrowth;
+	}
+}
+
+// Per frame LOD choice for instances. The previous frame's choice is the hysteresis state and
+// is kept by the caller, one byte per transform.
+class LODSelector
+{
+public:
+	struct SELECT_STATS
+	{
+		unsigned instances, changes;
+		unsigned perLevel[m_lodLevels + 1];
+	};
+
+	// _pixelsPerUnit: screen pixels covered by one world unit at distance 1
+	// (0.5 * viewport height * projection[1][1])
+	void Begin(float _pixelsPerUnit, float _pixelError, float _hysteresis)
+	{
+		m_pixelsPerUnit = _pixelsPerUnit;
+		m_pixelError = _pixelError;
+		m_hysteresis = _hysteresis;
+		m_stats = {};
+	}
+
+	// Updates _inOutLods[i] for the _count transforms using _bounds
+	void SelectInstances(const LOD_BOUNDS& _bounds, const GW::MATH::GMATRIXF* _transforms,
+						 unsigned _count, const GW::MATH::GVECTORF& _eye, uint8_t* _inOutLods)
+	{
+		for (unsigned i = 0; i < _count; i++)
+		{
+			const GW::MATH::GMATRIXF& w = _transforms[i];
+			// Largest axis scale, errors and radius are in model space
+			float scale = (std::max)((std::max)(Length(w.row1), Length(w.row2)), Length(w.row3));
+			float c[3];
+			for (int k = 0; k < 3; k++)
+				c[k] = _bounds.center[0] * (&w.row1.x)[k] + _bounds.center[1] * (&w.row2.x)[k] +
+					   _bounds.center[2] * (&w.row3.x)[k] + (&w.row4.x)[k];
+			float dx = c[0] - _eye.x, dy = c[1] - _eye.y, dz = c[2] - _eye.z;
+			// Distance to the closest point of the sphere, inside it everything is LOD0
+			float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - _bounds.radius * scale;
+			float pixelsPerError = distance > 0 ? scale * m_pixelsPerUnit / distance : FLT_MAX;
+
+			unsigned lod = (std::min)((unsigned)_inOutLods[i], m_lodLevels);
+			if (_bounds.error[lod] * pixelsPerError > m_pixelError)
+			{
+				// Too coarse, refine right away
+				while (lod > 0 && _bounds.error[lod] * pixelsPerError > m_pixelError)
+					lod--;
+			}
+			else
+			{
+				// Only coarsen once the next LOD is comfortably under the threshold
+				while (lod < m_lodLevels && _bounds.error[lod + 1] * pixelsPerError <= m_pixelError * (1.0f - m_hysteresis))
+					lod++;
+			}
+			m_stats.changes += lod != _inOutLods[i];
+			m_stats.perLevel[lod]++;
+			_inOutLods[i] = (uint8_t)lod;
+		}
+		m_stats.instances += _count;
+	}
+
+	const SELECT_STATS& GetStats() const { return m_stats; }
+
+private:
+	static float Length(const GW::MATH::GVECTORF& _v) { return std::sqrt(_v.x * _v.x + _v.y * _v.y + _v.z * _v.z); }
+
+	float m_pixelsPerUnit = 1, m_pixelError = 1, m_hysteresis = 0;
+	SELECT_STATS m_stats = {};
+};
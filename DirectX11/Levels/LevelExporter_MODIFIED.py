@@ -4,20 +4,33 @@
 
 import bpy
 import os
+import struct
 from bpy_extras.io_utils import axis_conversion
 import mathutils
 import math
 
+# True writes GameLevel.lvl instead: transforms grouped by model and packed lights, little
+# endian, in the layout BinaryLevel.h reads. Several times smaller than the text and the
+# loader copies each model's transforms as one range.
+binary_export = False
+
 print("----------Begin Level Export----------")
 
-path = os.path.join(os.path.dirname(bpy.data.filepath), "GameLevel.txt")
-file = open(path,"w")
+path = os.path.join(os.path.dirname(bpy.data.filepath), "GameLevel.lvl" if binary_export else "GameLevel.txt")
+file = open(os.devnull if binary_export else path,"w")
 file.write("# Game Level Exporter v1.0\n")
 
 scene = bpy.context.scene
 
+# binary export: .h2b name -> list of transforms (16 floats, row major), light records and
+# every transform's parent, (model, index) of the nearest exported mesh above it or None
+binary_models = {}
+binary_parents = {}
+binary_point_lights = []
+binary_spot_lights = []
+
 def print_heir(ob, levels=10):
-    def recurse(ob, parent, depth):
+    def recurse(ob, parent, depth, mesh_parent=None):
         if depth > levels: 
             return
         # spacing to show hierarchy
@@ -46,6 +59,15 @@ def print_heir(ob, levels=10):
         scaleZ = mathutils.Matrix.Scale(-1.0, 4, (0.0, 0.0, 1.0))
         converted = scaleZ.transposed() @ converted  
         file.write(spaces + str(converted) + "\n")
+        rows = [converted[r][c] for r in range(4) for c in range(4)]
+        
+        # same name rule the text loader uses, "Arch_bars.001" places Arch_bars.h2b.
+        # Children are kept too, matrix_world is already in world space
+        if ob.type == 'MESH':
+            model = (ob.name[:ob.name.rfind(".")] if "." in ob.name else ob.name) + ".h2b"
+            binary_models.setdefault(model, []).append(rows)
+            binary_parents[(model, len(binary_models[model]) - 1)] = mesh_parent
+            mesh_parent = (model, len(binary_models[model]) - 1)
          
         # TODO: For a game ready exporter we would
         # probably want the delta(pivot) matrix, lights,
@@ -56,7 +78,10 @@ def print_heir(ob, levels=10):
         if ob.type == 'LIGHT':
             lamp = ob.data
             
+            record = rows + list(lamp.color) + [lamp.energy, lamp.cutoff_distance,
+                                                lamp.quadratic_attenuation, lamp.linear_attenuation]
             if lamp.type == 'POINT':
+                binary_point_lights.append(record)
                 file.write(spaces + "TYPE: POINT" + "\n")
                 file.write(spaces + str(lamp.color) + "\n")                     #vec3  [0, inf]
                 file.write(spaces + str(lamp.energy) + "\n")                     #float [-inf, inf]
@@ -64,6 +89,7 @@ def print_heir(ob, levels=10):
                 file.write(spaces + str(lamp.quadratic_attenuation) + "\n")      #float [0,1]
                 file.write(spaces + str(lamp.linear_attenuation) + "\n")         #float [0, 1]
             if lamp.type == 'SPOT':
+                binary_spot_lights.append(record + [lamp.spot_size, lamp.spot_blend])
                 file.write(spaces + "TYPE: SPOT" + "\n")
                 file.write(spaces + str(lamp.color) + "\n")                     #vec3  [0, inf]
                 file.write(spaces + str(lamp.energy) + "\n")                     #float [-inf, inf]
@@ -74,7 +100,7 @@ def print_heir(ob, levels=10):
                 file.write(spaces + str(lamp.spot_blend) + "\n")                  #float (angle of inner cone)
             
         for child in ob.children:
-            recurse(child, ob,  depth + 1)
+            recurse(child, ob,  depth + 1, mesh_parent)
     recurse(ob, ob.parent, 0)
 
 root_obs = (o for o in scene.objects if not o.parent)
@@ -84,6 +110,41 @@ for o in root_obs:
     
 file.close()
 
+# header, model table, names (padded to 4), transforms, point lights, spot lights, then the
+# parent of every transform as an index into the transforms (-1 for none). There is no .txt
+# behind this export so its source hash is 0
+if binary_export:
+    names = b""
+    table = b""
+    transforms = b""
+    starts = {}
+    start = 0
+    for model in sorted(binary_models):
+        matrices = binary_models[model]
+        table += struct.pack("<4I", len(names), start, len(matrices), 0)
+        names += model.encode("utf-8") + b"\0"
+        for rows in matrices:
+            transforms += struct.pack("<16f", *rows)
+        starts[model] = start
+        start += len(matrices)
+    names += b"\0" * (-len(names) % 4)
+    parents = b""
+    for model in sorted(binary_models):
+        for index in range(len(binary_models[model])):
+            parent = binary_parents[(model, index)]
+            parents += struct.pack("<i", -1 if parent is None else starts[parent[0]] + parent[1])
+    with open(path, "wb") as out:
+        out.write(b"LVL1" + struct.pack("<7IQ", 2, len(binary_models), len(names), start,
+                                        len(binary_point_lights), len(binary_spot_lights), 1, 0))
+        out.write(table)
+        out.write(names)
+        out.write(transforms)
+        for record in binary_point_lights:
+            out.write(struct.pack("<23f", *record))
+        for record in binary_spot_lights:
+            out.write(struct.pack("<25f", *record))
+        out.write(parents)
+
 print("----------End Level Export----------")
 
 # check the blender python API docs under "Object(ID)"
@@ -0,0 +1,349 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <type_traits>
+#include "MyDefines.h"
+
+// Light level of detail.
+// Builds a bounding volume hierarchy over the level's point and spot lights once per level load.
+// Every frame a "cut" through each tree is chosen: nodes closer than the LOD distance are split
+// down to their individual lights, far away nodes are sent to the GPU as a single aggregate light.
+// The cut never grows past the cbuffer light arrays, no matter how many lights the exporter emits.
+// Spot lights are also split by direction, so a cluster only ever merges spots pointing roughly
+// the same way and its cone stays where the sources shone.
+class LightLOD
+{
+public:
+	// Per frame statistics so the cost of aggregation can be inspected
+	struct LIGHT_LOD_REPORT
+	{
+		unsigned sourcePointLights, sourceSpotLights;	// Lights in the level
+		unsigned activePointLights, activeSpotLights;	// Lights sent to the GPU this frame
+		unsigned aggregatePointLights, aggregateSpotLights;	// Active lights that stand in for several sources
+		float maxPositionError;		// Largest distance from a source light to the aggregate replacing it
+		float meanPositionError;	// Energy weighted mean of that distance across all sources
+		float energyError;			// |sum(source energy) - sum(active energy)|, should stay ~0
+		float maxAxisError;			// Largest angle (radians) between a source spot's axis and its aggregate's
+	};
+
+	// Distance from the camera beyond which lights may be aggregated
+	void SetLODDistance(float _distance) { m_lodDistance = _distance; }
+	float GetLODDistance() const { return m_lodDistance; }
+	// Largest allowed (cluster spread / camera distance) before a distant cluster is split again
+	void SetErrorTolerance(float _tolerance) { m_errorTolerance = _tolerance; }
+	// Largest angle (radians) between spot axes that may still share an aggregate. Takes effect on Build
+	void SetAxisTolerance(float _tolerance) { m_axisTolerance = _tolerance; }
+
+	// Rebuilds both hierarchies. Call whenever the level's light lists change.
+	void Build(const std::vector<POINT_LIGHT>& _pointLights, const std::vector<SPOT_LIGHT>& _spotLights)
+	{
+		m_pointTree.Build(_pointLights, m_axisTolerance);
+		m_spotTree.Build(_spotLights, m_axisTolerance);
+	}
+
+	// Chooses this frame's active lights for a camera at _camPos. Output arrays are
+	// written from index 0 and never exceed _maxPointLights/_maxSpotLights entries.
+	void Update(const XMFLOAT3& _camPos, POINT_LIGHT* _outPointLights, UINT _maxPointLights,
+				SPOT_LIGHT* _outSpotLights, UINT _maxSpotLights)
+	{
+		m_report = {};
+		m_report.sourcePointLights = (unsigned)m_pointTree.lights.size();
+		m_report.sourceSpotLights = (unsigned)m_spotTree.lights.size();
+
+		float errorSum = 0, energySum = 0;
+		m_report.activePointLights = m_pointTree.SelectCut(_camPos, m_lodDistance, m_errorTolerance, _maxPointLights,
+			_outPointLights, m_report.aggregatePointLights, m_report.maxPositionError, m_report.maxAxisError, errorSum, energySum);
+		m_report.activeSpotLights = m_spotTree.SelectCut(_camPos, m_lodDistance, m_errorTolerance, _maxSpotLights,
+			_outSpotLights, m_report.aggregateSpotLights, m_report.maxPositionError, m_report.maxAxisError, errorSum, energySum);
+		m_report.meanPositionError = energySum > 0 ? errorSum / energySum : 0;
+
+		// Total energy of the active set must match the source set
+		float sourceEnergy = m_pointTree.TotalEnergy() + m_spotTree.TotalEnergy();
+		float activeEnergy = 0;
+		for (UINT i = 0; i < m_report.activePointLights; i++)
+			activeEnergy += _outPointLights[i].energy;
+		for (UINT i = 0; i < m_report.activeSpotLights; i++)
+			activeEnergy += _outSpotLights[i].energy;
+		m_report.energyError = std::fabs(sourceEnergy - activeEnergy);
+	}
+
+	const LIGHT_LOD_REPORT& GetReport() const { return m_report; }
+
+private:
+	// Light types share the tree code, aggregation differs slightly (see Aggregate below)
+	template<typename LIGHT>
+	struct LightTree
+	{
+		// Spots shine along their local Z axis (transform row 3), points have no axis
+		static const bool directional = std::is_same<LIGHT, SPOT_LIGHT>::value;
+
+		struct NODE
+		{
+			XMFLOAT3 boundsMin, boundsMax;
+			unsigned first, count;		// Range into sortedIndices
+			int left, right;			// Child nodes, -1 for leaves
+			LIGHT aggregate;			// Precomputed stand-in light for the whole subtree
+			float error;				// Energy weighted mean distance of sources to the aggregate
+			float maxError;				// Largest distance of a source to the aggregate
+			float maxAxisError;			// Largest angle between a source's axis and the aggregate's, 0 for points
+		};
+
+		std::vector<LIGHT> lights;
+		std::vector<unsigned> sortedIndices;
+		std::vector<NODE> nodes;
+		std::vector<int> cut;	// Scratch for SelectCut
+		float axisTolerance = 0;
+
+		void Build(const std::vector<LIGHT>& _lights, float _axisTolerance)
+		{
+			lights = _lights;
+			axisTolerance = _axisTolerance;
+			nodes.clear();
+			sortedIndices.resize(lights.size());
+			for (unsigned i = 0; i < sortedIndices.size(); i++)
+				sortedIndices[i] = i;
+			if (!lights.empty())
+				BuildNode(0, (unsigned)lights.size());
+		}
+
+		float TotalEnergy() const
+		{
+			return nodes.empty() ? 0.0f : nodes[0].aggregate.energy;
+		}
+
+		// Greedy refinement: start from the root and keep splitting the most important
+		// node until the budget is full. Nodes inside the LOD distance are always preferred.
+		unsigned SelectCut(const XMFLOAT3& _camPos, float _lodDistance, float _errorTolerance, UINT _budget, LIGHT* _out,
+						   unsigned& _aggregates, float& _maxError, float& _maxAxisError, float& _errorSum, float& _energySum)
+		{
+			cut.clear();
+			if (nodes.empty() || _budget == 0)
+				return 0;
+			cut.push_back(0);
+
+			while (cut.size() < _budget)
+			{
+				int best = -1;
+				float bestPriority = -1;
+				for (size_t i = 0; i < cut.size(); i++)
+				{
+					const NODE& n = nodes[cut[i]];
+					if (n.left < 0)
+						continue;
+					float dist = DistanceToBounds(_camPos, n);
+					// Distant clusters stay merged unless they look too spread out from here
+					bool isClose = dist < _lodDistance;
+					if (!isClose && n.maxError < _errorTolerance * dist && n.maxAxisError <= axisTolerance)
+						continue;
+					// Anything within the LOD distance outranks every distant node. A turned cone
+					// misplaces light by about angle * distance
+					float priority = n.aggregate.energy * (n.error + n.maxAxisError * dist + 1e-3f) / (dist * dist + 1.0f);
+					if (isClose)
+						priority += 1e9f;
+					if (priority > bestPriority)
+					{
+						bestPriority = priority;
+						best = (int)i;
+					}
+				}
+				if (best < 0)
+					break;	// Nothing left worth splitting
+
+				int split = cut[best];
+				cut[best] = nodes[split].left;
+				cut.push_back(nodes[split].right);
+			}
+
+			for (size_t i = 0; i < cut.size(); i++)
+			{
+				const NODE& n = nodes[cut[i]];
+				_out[i] = n.aggregate;
+				if (n.count > 1)
+				{
+					_aggregates++;
+					_maxError = (std::max)(_maxError, n.maxError);
+					_maxAxisError = (std::max)(_maxAxisError, n.maxAxisError);
+				}
+				_errorSum += n.error * n.aggregate.energy;
+				_energySum += n.aggregate.energy;
+			}
+			return (unsigned)cut.size();
+		}
+
+	private:
+		static XMFLOAT3 Position(const LIGHT& _l)
+		{
+			return { _l.transform.row4.x, _l.transform.row4.y, _l.transform.row4.z };
+		}
+
+		static XMFLOAT3 Axis(const LIGHT& _l)
+		{
+			XMFLOAT3 a = { _l.transform.row3.x, _l.transform.row3.y, _l.transform.row3.z };
+			float length = std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z);
+			return length > 0 ? XMFLOAT3(a.x / length, a.y / length, a.z / length) : XMFLOAT3(0, 0, 1);
+		}
+
+		static float AngleBetween(const XMFLOAT3& _a, const XMFLOAT3& _b)
+		{
+			return std::acos((std::max)((std::min)(_a.x * _b.x + _a.y * _b.y + _a.z * _b.z, 1.0f), -1.0f));
+		}
+
+		static float DistanceToBounds(const XMFLOAT3& _p, const NODE& _n)
+		{
+			float dx = (std::max)((std::max)(_n.boundsMin.x - _p.x, 0.0f), _p.x - _n.boundsMax.x);
+			float dy = (std::max)((std::max)(_n.boundsMin.y - _p.y, 0.0f), _p.y - _n.boundsMax.y);
+			float dz = (std::max)((std::max)(_n.boundsMin.z - _p.z, 0.0f), _p.z - _n.boundsMax.z);
+			return std::sqrt(dx * dx + dy * dy + dz * dz);
+		}
+
+		// Median split on the longest axis. Spots whose axes spread past the tolerance are split on
+		// the direction component that varies most instead. Returns the node index.
+		int BuildNode(unsigned _first, unsigned _count)
+		{
+			int index = (int)nodes.size();
+			nodes.push_back({});
+
+			NODE n = {};
+			n.first = _first;
+			n.count = _count;
+			n.left = n.right = -1;
+			n.boundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+			n.boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (unsigned i = _first; i < _first + _count; i++)
+			{
+				XMFLOAT3 p = Position(lights[sortedIndices[i]]);
+				n.boundsMin = { (std::min)(n.boundsMin.x, p.x), (std::min)(n.boundsMin.y, p.y), (std::min)(n.boundsMin.z, p.z) };
+				n.boundsMax = { (std::max)(n.boundsMax.x, p.x), (std::max)(n.boundsMax.y, p.y), (std::max)(n.boundsMax.z, p.z) };
+			}
+			Aggregate(n);
+
+			if (_count > 1)
+			{
+				unsigned half = _count / 2;
+				if (directional && n.maxAxisError > axisTolerance)
+				{
+					float dirMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, dirMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+					for (unsigned i = _first; i < _first + _count; i++)
+					{
+						XMFLOAT3 a = Axis(lights[sortedIndices[i]]);
+						for (int c = 0; c < 3; c++)
+						{
+							dirMin[c] = (std::min)(dirMin[c], (&a.x)[c]);
+							dirMax[c] = (std::max)(dirMax[c], (&a.x)[c]);
+						}
+					}
+					float spread[3] = { dirMax[0] - dirMin[0], dirMax[1] - dirMin[1], dirMax[2] - dirMin[2] };
+					int component = spread[0] > spread[1] ? (spread[0] > spread[2] ? 0 : 2) : (spread[1] > spread[2] ? 1 : 2);
+					std::nth_element(sortedIndices.begin() + _first, sortedIndices.begin() + _first + half,
+						sortedIndices.begin() + _first + _count, [&](unsigned a, unsigned b) {
+							XMFLOAT3 axisA = Axis(lights[a]), axisB = Axis(lights[b]);
+							return (&axisA.x)[component] < (&axisB.x)[component];
+						});
+				}
+				else
+				{
+					float extent[3] = { n.boundsMax.x - n.boundsMin.x, n.boundsMax.y - n.boundsMin.y, n.boundsMax.z - n.boundsMin.z };
+					int axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+					std::nth_element(sortedIndices.begin() + _first, sortedIndices.begin() + _first + half,
+						sortedIndices.begin() + _first + _count, [&](unsigned a, unsigned b) {
+							return (&lights[a].transform.row4.x)[axis] < (&lights[b].transform.row4.x)[axis];
+						});
+				}
+				n.left = BuildNode(_first, half);
+				n.right = BuildNode(_first + half, _count - half);
+			}
+			nodes[index] = n;
+			return index;
+		}
+
+		// Energy preserving merge of every light under the node
+		void Aggregate(NODE& _n)
+		{
+			const LIGHT& strongest = lights[*std::max_element(sortedIndices.begin() + _n.first,
+				sortedIndices.begin() + _n.first + _n.count, [&](unsigned a, unsigned b) {
+					return lights[a].energy < lights[b].energy;
+				})];
+			LIGHT agg = strongest;	// Keeps the dominant spot's cone shape, its axis is replaced below
+
+			float energy = 0, weight = 0;
+			XMFLOAT3 centroid = { 0, 0, 0 }, axis = { 0, 0, 0 };
+			XMFLOAT4 color = { 0, 0, 0, 0 };
+			float qAtten = 0, lAtten = 0;
+			for (unsigned i = _n.first; i < _n.first + _n.count; i++)
+			{
+				const LIGHT& l = lights[sortedIndices[i]];
+				float w = (std::max)(l.energy, 0.0f);
+				weight += w;
+				energy += l.energy;
+				centroid = { centroid.x + l.transform.row4.x * w, centroid.y + l.transform.row4.y * w, centroid.z + l.transform.row4.z * w };
+				color = { color.x + l.color.x * w, color.y + l.color.y * w, color.z + l.color.z * w, 1 };
+				qAtten += l.q_attenuation * w;
+				lAtten += l.l_attenuation * w;
+				if (directional)
+				{
+					XMFLOAT3 a = Axis(l);
+					axis = { axis.x + a.x * w, axis.y + a.y * w, axis.z + a.z * w };
+				}
+			}
+			if (weight > 0)
+			{
+				float inv = 1.0f / weight;
+				centroid = { centroid.x * inv, centroid.y * inv, centroid.z * inv };
+				color = { color.x * inv, color.y * inv, color.z * inv, 1 };
+				qAtten *= inv;
+				lAtten *= inv;
+			}
+			else
+				centroid = Position(strongest);
+			// Energy weighted mean axis, the dominant one when the axes cancel out
+			float axisLength = std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+			axis = axisLength > 1e-4f ? XMFLOAT3(axis.x / axisLength, axis.y / axisLength, axis.z / axisLength) : Axis(strongest);
+
+			// The aggregate's range has to reach everything its sources reached
+			float range = 0, errorSum = 0, maxError = 0, maxAxisError = 0;
+			for (unsigned i = _n.first; i < _n.first + _n.count; i++)
+			{
+				const LIGHT& l = lights[sortedIndices[i]];
+				XMFLOAT3 p = Position(l);
+				float d = std::sqrt((p.x - centroid.x) * (p.x - centroid.x) +
+					(p.y - centroid.y) * (p.y - centroid.y) + (p.z - centroid.z) * (p.z - centroid.z));
+				range = (std::max)(range, l.distance + d);
+				errorSum += d * (std::max)(l.energy, 0.0f);
+				maxError = (std::max)(maxError, d);
+				if (directional)
+					maxAxisError = (std::max)(maxAxisError, AngleBetween(Axis(l), axis));
+			}
+			if (directional)
+			{
+				// Orthonormal frame around the mean axis, the shader reads the cone axis from row 3
+				XMFLOAT3 up = std::fabs(axis.y) < 0.99f ? XMFLOAT3(0, 1, 0) : XMFLOAT3(1, 0, 0);
+				XMFLOAT3 right = { up.y * axis.z - up.z * axis.y, up.z * axis.x - up.x * axis.z, up.x * axis.y - up.y * axis.x };
+				float rightLength = std::sqrt(right.x * right.x + right.y * right.y + right.z * right.z);
+				right = { right.x / rightLength, right.y / rightLength, right.z / rightLength };
+				agg.transform.row1 = { right.x, right.y, right.z, 0 };
+				agg.transform.row2 = { axis.y * right.z - axis.z * right.y, axis.z * right.x - axis.x * right.z, axis.x * right.y - axis.y * right.x, 0 };
+				agg.transform.row3 = { axis.x, axis.y, axis.z, 0 };
+			}
+
+			agg.transform.row4 = { centroid.x, centroid.y, centroid.z, 1 };
+			agg.color = color;
+			agg.energy = energy;
+			agg.distance = range;
+			agg.q_attenuation = qAtten;
+			agg.l_attenuation = lAtten;
+			_n.aggregate = agg;
+			_n.error = weight > 0 ? errorSum / weight : 0;
+			_n.maxError = maxError;
+			_n.maxAxisError = maxAxisError;
+		}
+	};
+
+	LightTree<POINT_LIGHT> m_pointTree;
+	LightTree<SPOT_LIGHT> m_spotTree;
+	float m_lodDistance = 30.0f;
+	float m_errorTolerance = 0.1f;
+	float m_axisTolerance = 0.35f;	// ~20 degrees
+	LIGHT_LOD_REPORT m_report = {};
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+// Material batch merging.
+// Exporters split a model into one mesh per object, so a model can carry several meshes using
+// the same material, each costing its own draw. At import every model's meshes are regrouped
+// into one mesh per material (indices of a material made contiguous, the rest of the order
+// kept), and the original meshes survive as parts inside them for picking and debugging.
+
+// Where one original mesh ended up
+struct MESH_PART
+{
+	const char* name;
+	unsigned meshIndex;		// merged mesh it lives in (model local, see MergeMeshesByMaterial)
+	unsigned indexOffset;	// relative to the merged mesh's first index
+	unsigned indexCount;
+};
+
+// Regroups _parsed's meshes by materialIndex in first use order and rewrites meshes, batches
+// and indices to match, one mesh (and batch) per material. The triangles of every original
+// mesh stay together and in order so vertex cache optimizations survive. _outParts gets one
+// part per original mesh, in merged order. Indices no mesh refers to are dropped.
+inline void MergeMeshesByMaterial(H2B::Parser& _parsed, std::vector<MESH_PART>& _outParts)
+{
+	_outParts.clear();
+	std::vector<unsigned> materials; // in first use order
+	std::vector<unsigned> group(_parsed.meshes.size());
+	for (size_t m = 0; m < _parsed.meshes.size(); m++)
+	{
+		unsigned material = _parsed.meshes[m].materialIndex;
+		size_t g = 0;
+		while (g < materials.size() && materials[g] != material)
+			g++;
+		if (g == materials.size())
+			materials.push_back(material);
+		group[m] = (unsigned)g;
+	}
+	if (materials.size() == _parsed.meshes.size())
+	{
+		// Nothing shares a material, every mesh is its own part
+		for (size_t m = 0; m < _parsed.meshes.size(); m++)
+			_outParts.push_back({ _parsed.meshes[m].name, (unsigned)m, 0, _parsed.meshes[m].drawInfo.indexCount });
+		return;
+	}
+
+	std::vector<unsigned> indices;
+	std::vector<H2B::MESH> meshes;
+	indices.reserve(_parsed.indices.size());
+	for (unsigned g = 0; g < materials.size(); g++)
+	{
+		H2B::MESH merged = {};
+		merged.materialIndex = materials[g];
+		merged.drawInfo.indexOffset = (unsigned)indices.size();
+		for (size_t m = 0; m < _parsed.meshes.size(); m++)
+		{
+			if (group[m] != g)
+				continue;
+			const H2B::BATCH& range = _parsed.meshes[m].drawInfo;
+			unsigned first = (std::min)(range.indexOffset, (unsigned)_parsed.indices.size());
+			unsigned end = (std::min)(range.indexOffset + range.indexCount, (unsigned)_parsed.indices.size());
+			if (merged.name == nullptr)
+				merged.name = _parsed.meshes[m].name;
+			_outParts.push_back({ _parsed.meshes[m].name, g, (unsigned)indices.size() - merged.drawInfo.indexOffset, end - first });
+			indices.insert(indices.end(), _parsed.indices.begin() + first, _parsed.indices.begin() + end);
+		}
+		merged.drawInfo.indexCount = (unsigned)indices.size() - merged.drawInfo.indexOffset;
+		meshes.push_back(merged);
+	}
+	_parsed.indices.swap(indices);
+	_parsed.meshes.swap(meshes);
+	_parsed.batches.clear();
+	for (const H2B::MESH& mesh : _parsed.meshes)
+		_parsed.batches.push_back(mesh.drawInfo);
+	_parsed.indexCount = (unsigned)_parsed.indices.size();
+	_parsed.meshCount = (unsigned)_parsed.meshes.size();
+}
@@ -0,0 +1,333 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <string>
+#include "h2bParser.h"
+
+// Import time index/vertex reordering for .h2b models.
+// 1. Vertex cache: triangles of every draw range are reordered with Tom Forsyth's linear speed
+//    vertex cache optimization so the post transform cache gets reused.
+// 2. Overdraw: the cache optimized order is cut into clusters wherever the cache restarts and
+//    the clusters are sorted so outward facing geometry tends to be drawn first.
+// 3. Vertex fetch: vertices are renumbered in first use order so fetches walk memory forward.
+// Triangles never leave their range, every BATCH/MESH indexOffset + indexCount stays valid.
+// Flat shaded exports (Skull, Bag_Standing) give every quad its own 4 vertices since no two
+// faces share a normal, so ACMR is already at its floor of 2.0 and no order or weld lowers it.
+
+// Post transform cache the statistics are measured against (FIFO, typical of real hardware)
+const unsigned m_vertexCacheStatsSize = 16;
+
+struct VERTEX_CACHE_STATS
+{
+	unsigned triangles;
+	unsigned vertices;		// Unique vertices referenced
+	unsigned misses;		// Vertex shader invocations with a FIFO cache
+	float acmr;				// Average cache miss ratio, misses per triangle (0.5 is ideal, 3 is worst)
+	float atvr;				// Average transform to vertex ratio, misses per vertex (1 is ideal)
+};
+
+struct MESH_OPTIMIZE_REPORT
+{
+	VERTEX_CACHE_STATS before, after;
+};
+
+// Simulates a FIFO post transform cache over an index list
+inline VERTEX_CACHE_STATS AnalyzeVertexCache(const unsigned* _indices, size_t _indexCount, size_t _vertexCount,
+											 unsigned _cacheSize = m_vertexCacheStatsSize)
+{
+	VERTEX_CACHE_STATS stats = {};
+	std::vector<unsigned> cacheTime(_vertexCount, 0); // Time each vertex entered the cache, 0 = never
+	std::vector<bool> seen(_vertexCount, false);
+	unsigned time = _cacheSize + 1;
+	for (size_t i = 0; i < _indexCount; i++)
+	{
+		unsigned v = _indices[i];
+		if (v >= _vertexCount)
+			continue;
+		if (!seen[v])
+		{
+			seen[v] = true;
+			stats.vertices++;
+		}
+		if (cacheTime[v] == 0 || time - cacheTime[v] > _cacheSize)
+		{
+			cacheTime[v] = time++;
+			stats.misses++;
+		}
+	}
+	stats.triangles = (unsigned)(_indexCount / 3);
+	stats.acmr = stats.triangles ? (float)stats.misses / stats.triangles : 0;
+	stats.atvr = stats.vertices ? (float)stats.misses / stats.vertices : 0;
+	return stats;
+}
+
+namespace MeshOptimizerDetail
+{
+	const int m_forsythCacheSize = 32;
+
+	inline float VertexScore(int _cachePosition, unsigned _activeTriangles)
+	{
+		if (_activeTriangles == 0)
+			return -1.0f;	// No triangles left to use this vertex
+		float score = 0.0f;
+		if (_cachePosition >= 0)
+		{
+			if (_cachePosition < 3)
+				score = 0.75f;	// Used by the last triangle, fixed score so strips aren't favored
+			else
+				score = std::pow(1.0f - (float)(_cachePosition - 3) / (m_forsythCacheSize - 3), 1.5f);
+		}
+		// Bonus for vertices with few triangles left, gets rid of lone triangles early
+		return score + 2.0f * std::pow((float)_activeTriangles, -0.5f);
+	}
+
+	// Forsyth reorder of one range of triangles in place
+	inline void OptimizeVertexCacheRange(unsigned* _indices, size_t _indexCount, size_t _vertexCount)
+	{
+		const unsigned triCount = (unsigned)(_indexCount / 3);
+		if (triCount < 2)
+			return;
+
+		// Triangle lists per vertex (CSR)
+		std::vector<unsigned> triStart(_vertexCount + 1, 0);
+		for (size_t i = 0; i < triCount * 3; i++)
+			triStart[_indices[i] + 1]++;
+		for (size_t v = 0; v < _vertexCount; v++)
+			triStart[v + 1] += triStart[v];
+		std::vector<unsigned> vertexTris(triCount * 3);
+		std::vector<unsigned> fill(triStart.begin(), triStart.end() - 1);
+		for (unsigned t = 0; t < triCount; t++)
+			for (int k = 0; k < 3; k++)
+				vertexTris[fill[_indices[t * 3 + k]]++] = t;
+
+		std::vector<unsigned> activeTris(_vertexCount);
+		for (size_t v = 0; v < _vertexCount; v++)
+			activeTris[v] = triStart[v + 1] - triStart[v];
+		std::vector<int> cachePos(_vertexCount, -1);
+		std::vector<float> vertexScore(_vertexCount);
+		for (size_t v = 0; v < _vertexCount; v++)
+			vertexScore[v] = VertexScore(-1, activeTris[v]);
+		std::vector<float> triScore(triCount);
+		std::vector<bool> triAdded(triCount, false);
+		for (unsigned t = 0; t < triCount; t++)
+			triScore[t] = vertexScore[_indices[t * 3]] + vertexScore[_indices[t * 3 + 1]] + vertexScore[_indices[t * 3 + 2]];
+
+		std::vector<unsigned> cache, newCache;
+		cache.reserve(m_forsythCacheSize + 3);
+		std::vector<unsigned> output;
+		output.reserve(triCount * 3);
+		unsigned scanCursor = 0;
+
+		int best = 0;
+		for (unsigned t = 1; t < triCount; t++)
+			if (triScore[t] > triScore[best])
+				best = t;
+
+		while (best >= 0)
+		{
+			// Emit the triangle and take it out of its vertices' lists
+			triAdded[best] = true;
+			newCache.clear();
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned v = _indices[best * 3 + k];
+				output.push_back(v);
+				newCache.push_back(v);
+				unsigned* begin = &vertexTris[triStart[v]];
+				unsigned* end = begin + activeTris[v];
+				*std::find(begin, end, (unsigned)best) = *(end - 1);
+				activeTris[v]--;
+			}
+			// LRU: the triangle's vertices go to the front
+			for (unsigned v : cache)
+				if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+					newCache.push_back(v);
+			for (unsigned v : cache)
+				cachePos[v] = -1;
+			for (size_t i = 0; i < newCache.size(); i++)
+			{
+				unsigned v = newCache[i];
+				cachePos[v] = i < (size_t)m_forsythCacheSize ? (int)i : -1;
+				vertexScore[v] = VertexScore(cachePos[v], activeTris[v]);
+			}
+			if (newCache.size() > (size_t)m_forsythCacheSize)
+				newCache.resize(m_forsythCacheSize);
+			cache.swap(newCache);
+
+			// Only triangles touching the cache changed score, the best one is among them
+			best = -1;
+			float bestScore = -FLT_MAX;
+			for (unsigned v : cache)
+			{
+				for (unsigned i = 0; i < activeTris[v]; i++)
+				{
+					unsigned t = vertexTris[triStart[v] + i];
+					triScore[t] = vertexScore[_indices[t * 3]] + vertexScore[_indices[t * 3 + 1]] + vertexScore[_indices[t * 3 + 2]];
+					if (triScore[t] > bestScore)
+					{
+						bestScore = triScore[t];
+						best = (int)t;
+					}
+				}
+			}
+			// Cache ran dry, continue with the next unused triangle in original order
+			if (best < 0)
+			{
+				while (scanCursor < triCount && triAdded[scanCursor])
+					scanCursor++;
+				best = scanCursor < triCount ? (int)scanCursor : -1;
+			}
+		}
+		std::copy(output.begin(), output.end(), _indices);
+	}
+
+	// Splits a cache optimized range into clusters at cache restarts and orders the clusters
+	// outside-in (by how far each cluster sits along its own normal from the mesh center)
+	inline void OptimizeOverdrawRange(unsigned* _indices, size_t _indexCount, const H2B::VERTEX* _vertices, size_t _vertexCount)
+	{
+		const unsigned triCount = (unsigned)(_indexCount / 3);
+		if (triCount < 2)
+			return;
+
+		// Cluster boundaries: triangles where all three vertices miss the FIFO cache
+		std::vector<unsigned> clusterStart;
+		std::vector<unsigned> cacheTime(_vertexCount, 0);
+		unsigned time = m_vertexCacheStatsSize + 1;
+		for (unsigned t = 0; t < triCount; t++)
+		{
+			int misses = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned v = _indices[t * 3 + k];
+				if (cacheTime[v] == 0 || time - cacheTime[v] > m_vertexCacheStatsSize)
+				{
+					cacheTime[v] = time++;
+					misses++;
+				}
+			}
+			if (t == 0 || misses == 3)
+				clusterStart.push_back(t);
+		}
+		if (clusterStart.size() < 2)
+			return;
+		clusterStart.push_back(triCount);
+
+		float center[3] = { 0, 0, 0 };
+		for (size_t i = 0; i < _indexCount; i++)
+		{
+			const H2B::VECTOR& p = _vertices[_indices[i]].pos;
+			center[0] += p.x; center[1] += p.y; center[2] += p.z;
+		}
+		for (int k = 0; k < 3; k++)
+			center[k] /= (float)_indexCount;
+
+		struct CLUSTER { unsigned first, count; float sortKey; };
+		std::vector<CLUSTER> clusters;
+		for (size_t c = 0; c + 1 < clusterStart.size(); c++)
+		{
+			CLUSTER cluster = { clusterStart[c], clusterStart[c + 1] - clusterStart[c], 0 };
+			float centroid[3] = { 0, 0, 0 }, normal[3] = { 0, 0, 0 };
+			for (unsigned t = cluster.first; t < cluster.first + cluster.count; t++)
+			{
+				const H2B::VECTOR& a = _vertices[_indices[t * 3]].pos;
+				const H2B::VECTOR& b = _vertices[_indices[t * 3 + 1]].pos;
+				const H2B::VECTOR& c2 = _vertices[_indices[t * 3 + 2]].pos;
+				float e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+				float e2[3] = { c2.x - a.x, c2.y - a.y, c2.z - a.z };
+				// Area weighted normal
+				normal[0] += e1[1] * e2[2] - e1[2] * e2[1];
+				normal[1] += e1[2] * e2[0] - e1[0] * e2[2];
+				normal[2] += e1[0] * e2[1] - e1[1] * e2[0];
+				centroid[0] += a.x + b.x + c2.x;
+				centroid[1] += a.y + b.y + c2.y;
+				centroid[2] += a.z + b.z + c2.z;
+			}
+			float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (length > 0)
+			{
+				float inv = 1.0f / (cluster.count * 3);
+				cluster.sortKey = ((centroid[0] * inv - center[0]) * normal[0] +
+								   (centroid[1] * inv - center[1]) * normal[1] +
+								   (centroid[2] * inv - center[2]) * normal[2]) / length;
+			}
+			clusters.push_back(cluster);
+		}
+		std::stable_sort(clusters.begin(), clusters.end(), [](const CLUSTER& a, const CLUSTER& b) {
+			return a.sortKey > b.sortKey;
+		});
+
+		std::vector<unsigned> output;
+		output.reserve(triCount * 3);
+		for (const CLUSTER& cluster : clusters)
+			output.insert(output.end(), _indices + cluster.first * 3, _indices + (cluster.first + cluster.count) * 3);
+		std::copy(output.begin(), output.end(), _indices);
+	}
+}
+
+// Runs all three passes over one model. _ranges are the BATCH/MESH draw ranges of the model,
+// triangles are only reordered between consecutive range boundaries so every range stays valid.
+inline MESH_OPTIMIZE_REPORT OptimizeMesh(std::vector<H2B::VERTEX>& _vertices, std::vector<unsigned>& _indices,
+										 const std::vector<H2B::BATCH>& _ranges)
+{
+	MESH_OPTIMIZE_REPORT report;
+	report.before = AnalyzeVertexCache(_indices.data(), _indices.size(), _vertices.size());
+
+	// Reject files with out of range indices rather than reading past the vertex array
+	for (unsigned index : _indices)
+		if (index >= _vertices.size())
+		{
+			report.after = report.before;
+			return report;
+		}
+
+	// Segment boundaries from every range
+	std::vector<unsigned> cuts = { 0, (unsigned)_indices.size() };
+	for (const H2B::BATCH& range : _ranges)
+	{
+		cuts.push_back((std::min)(range.indexOffset, (unsigned)_indices.size()));
+		cuts.push_back((std::min)(range.indexOffset + range.indexCount, (unsigned)_indices.size()));
+	}
+	std::sort(cuts.begin(), cuts.end());
+	cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+	for (size_t c = 0; c + 1 < cuts.size(); c++)
+	{
+		unsigned first = cuts[c], count = cuts[c + 1] - cuts[c];
+		if (first % 3 != 0 || count % 3 != 0)
+			continue; // Not triangle aligned, leave it alone
+		MeshOptimizerDetail::OptimizeVertexCacheRange(&_indices[first], count, _vertices.size());
+		MeshOptimizerDetail::OptimizeOverdrawRange(&_indices[first], count, _vertices.data(), _vertices.size());
+	}
+
+	// Vertex fetch: renumber vertices in first use order, unused ones go to the end
+	std::vector<unsigned> remap(_vertices.size(), ~0u);
+	std::vector<H2B::VERTEX> reordered;
+	reordered.reserve(_vertices.size());
+	for (unsigned& index : _indices)
+	{
+		if (remap[index] == ~0u)
+		{
+			remap[index] = (unsigned)reordered.size();
+			reordered.push_back(_vertices[index]);
+		}
+		index = remap[index];
+	}
+	for (size_t v = 0; v < _vertices.size(); v++)
+		if (remap[v] == ~0u)
+			reordered.push_back(_vertices[v]);
+	_vertices.swap(reordered);
+
+	report.after = AnalyzeVertexCache(_indices.data(), _indices.size(), _vertices.size());
+	return report;
+}
+
+// Convenience overload for a freshly parsed file, uses both its batches and meshes as ranges
+inline MESH_OPTIMIZE_REPORT OptimizeMesh(H2B::Parser& _parsed)
+{
+	std::vector<H2B::BATCH> ranges(_parsed.batches.begin(), _parsed.batches.end());
+	for (const H2B::MESH& mesh : _parsed.meshes)
+		ranges.push_back(mesh.drawInfo);
+	return OptimizeMesh(_parsed.vertices, _parsed.indices, ranges);
+}
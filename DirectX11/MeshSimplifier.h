@@ -0,0 +1,369 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include "Hashing.h"
+#include "h2bParser.h"
+
+// Quadric error edge collapse (Garland & Heckbert) on an index list.
+// Vertices are only ever collapsed onto existing vertices, so the result is a new index list
+// over the same vertex array: a LOD is just another index range next to LOD0.
+// A position used by several vertices (wedges) is a seam. UV seams and normal creases sharper
+// than m_simplifyCreaseCos only collapse along themselves so both sides keep their own
+// attributes; softer normal splits (faceted shading, which most shipped models use) collapse
+// freely. Open borders only slide along the border and collapses that would flip a triangle
+// are rejected.
+
+// Wedge normals closer than this (cosine) are a soft split rather than a crease
+const float m_simplifyCreaseCos = 0.7f;
+const float m_simplifyMinPassReduction = 0.01f;	// Stop once a pass removes less than this fraction of the indices
+
+namespace MeshSimplifierDetail
+{
+	// Symmetric 4x4 error quadric
+	struct QUADRIC
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		void AddPlane(double _a, double _b, double _c, double _d)
+		{
+			a2 += _a * _a; ab += _a * _b; ac += _a * _c; ad += _a * _d;
+			b2 += _b * _b; bc += _b * _c; bd += _b * _d;
+			c2 += _c * _c; cd += _c * _d; d2 += _d * _d;
+		}
+		void Add(const QUADRIC& _q)
+		{
+			a2 += _q.a2; ab += _q.ab; ac += _q.ac; ad += _q.ad; b2 += _q.b2;
+			bc += _q.bc; bd += _q.bd; c2 += _q.c2; cd += _q.cd; d2 += _q.d2;
+		}
+		// Sum of squared distances from _p to every accumulated plane
+		double Error(const H2B::VECTOR& _p) const
+		{
+			double x = _p.x, y = _p.y, z = _p.z;
+			double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y + 2 * bc * y * z +
+					   2 * bd * y + c2 * z * z + 2 * cd * z + d2;
+			return e > 0 ? e : 0;
+		}
+	};
+
+	inline void Cross(const H2B::VECTOR& _a, const H2B::VECTOR& _b, const H2B::VECTOR& _c, double _out[3])
+	{
+		double e1[3] = { (double)_b.x - _a.x, (double)_b.y - _a.y, (double)_b.z - _a.z };
+		double e2[3] = { (double)_c.x - _a.x, (double)_c.y - _a.y, (double)_c.z - _a.z };
+		_out[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		_out[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		_out[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+}
+
+// Simplifies _indices (a triangle list into _vertices) towards _targetIndexCount without
+// exceeding _maxError (model space distance). Returns the new index list, _outError gets the
+// largest error actually introduced.
+inline std::vector<unsigned> SimplifyMesh(const H2B::VERTEX* _vertices, size_t _vertexCount,
+										  const unsigned* _indices, size_t _indexCount,
+										  size_t _targetIndexCount, float _maxError, float* _outError = nullptr)
+{
+	using namespace MeshSimplifierDetail;
+	std::vector<unsigned> result(_indices, _indices + (_indexCount - _indexCount % 3));
+	if (_outError)
+		*_outError = 0;
+	for (unsigned index : result)
+		if (index >= _vertexCount)
+			return result; // malformed, leave it alone
+
+	// Vertices sharing a position (seam wedges) get one position id
+	std::vector<unsigned> positionId(_vertexCount);
+	size_t positionCount = 0;
+	{
+		std::unordered_map<uint64_t, std::vector<unsigned>> lookup;
+		std::vector<unsigned> firstVertex;
+		for (size_t v = 0; v < _vertexCount; v++)
+		{
+			std::vector<unsigned>& candidates = lookup[HashBytes(&_vertices[v].pos, sizeof(H2B::VECTOR))];
+			unsigned id = ~0u;
+			for (unsigned candidate : candidates)
+				if (std::memcmp(&_vertices[firstVertex[candidate]].pos, &_vertices[v].pos, sizeof(H2B::VECTOR)) == 0)
+					id = candidate;
+			if (id == ~0u)
+			{
+				id = (unsigned)firstVertex.size();
+				firstVertex.push_back((unsigned)v);
+				candidates.push_back(id);
+			}
+			positionId[v] = id;
+		}
+		positionCount = firstVertex.size();
+	}
+	// Per pass topology, rebuilt as collapses change it:
+	// - triangles around every vertex and around every position
+	// - referenced wedges of every position
+	// - neighbor positions with their edge use: 2 = manifold, 1 = open border. Border vertices
+	//   may only slide along their border, vertices on non manifold edges or where borders meet
+	//   are locked.
+	std::vector<unsigned> triStart, vertexTris, posTriStart, posTris;
+	std::vector<unsigned> wedgeStart, wedgeList;
+	std::vector<unsigned> neighborStart, neighbors;
+	std::vector<uint8_t> neighborUse;
+	std::vector<bool> lockedPosition(positionCount, false);
+	std::vector<uint8_t> borderEdges(positionCount, 0);
+	std::vector<bool> hardSeam(positionCount, false);
+	auto wedgeCount = [&](unsigned _p) { return wedgeStart[_p + 1] - wedgeStart[_p]; };
+	auto sameUV = [&](unsigned _a, unsigned _b) {
+		return _vertices[_a].uvw.x == _vertices[_b].uvw.x && _vertices[_a].uvw.y == _vertices[_b].uvw.y;
+	};
+	auto normalCos = [&](unsigned _a, unsigned _b) {
+		const H2B::VECTOR& a = _vertices[_a].nrm;
+		const H2B::VECTOR& b = _vertices[_b].nrm;
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	};
+	auto edgeUse = [&](unsigned _from, unsigned _to) {
+		for (unsigned n = neighborStart[_from]; n < neighborStart[_from + 1]; n++)
+			if (neighbors[n] == _to)
+				return (unsigned)neighborUse[n];
+		return 0u;
+	};
+	// Counting sort of _count items into _start/_list by _key(item)
+	auto bucket = [](size_t _buckets, size_t _count, std::vector<unsigned>& _start, std::vector<unsigned>& _list, auto _key) {
+		_start.assign(_buckets + 1, 0);
+		for (size_t i = 0; i < _count; i++)
+			if (_key(i) != ~0u)
+				_start[_key(i) + 1]++;
+		for (size_t b = 0; b < _buckets; b++)
+			_start[b + 1] += _start[b];
+		_list.resize(_start[_buckets]);
+		std::vector<unsigned> fill(_start.begin(), _start.end() - 1);
+		for (size_t i = 0; i < _count; i++)
+			if (_key(i) != ~0u)
+				_list[fill[_key(i)]++] = (unsigned)i;
+	};
+	std::vector<unsigned> local;
+	auto buildTopology = [&]() {
+		bucket(_vertexCount, result.size(), triStart, vertexTris, [&](size_t i) { return result[i]; });
+		for (unsigned& corner : vertexTris)
+			corner /= 3;
+		bucket(positionCount, result.size(), posTriStart, posTris, [&](size_t i) { return positionId[result[i]]; });
+		for (unsigned& corner : posTris)
+			corner /= 3;
+		bucket(positionCount, _vertexCount, wedgeStart, wedgeList,
+			   [&](size_t v) { return triStart[v] != triStart[v + 1] ? positionId[v] : ~0u; });
+
+		neighborStart.assign(positionCount + 1, 0);
+		neighbors.clear();
+		neighborUse.clear();
+		for (size_t p = 0; p < positionCount; p++)
+		{
+			bool hard = false;
+			for (unsigned a = wedgeStart[p]; a < wedgeStart[p + 1] && !hard; a++)
+				for (unsigned b = a + 1; b < wedgeStart[p + 1] && !hard; b++)
+					hard = !sameUV(wedgeList[a], wedgeList[b]) || normalCos(wedgeList[a], wedgeList[b]) < m_simplifyCreaseCos;
+			hardSeam[p] = hard;
+
+			local.clear();
+			for (unsigned t = posTriStart[p]; t < posTriStart[p + 1]; t++)
+				for (int k = 0; k < 3; k++)
+					if (positionId[result[posTris[t] * 3 + k]] != p)
+						local.push_back(positionId[result[posTris[t] * 3 + k]]);
+			std::sort(local.begin(), local.end());
+			unsigned borders = 0;
+			for (size_t i = 0; i < local.size();)
+			{
+				size_t end = i;
+				while (end < local.size() && local[end] == local[i])
+					end++;
+				unsigned use = (unsigned)(end - i);
+				if (use > 2)
+					lockedPosition[p] = true;
+				borders += use == 1;
+				neighbors.push_back(local[i]);
+				neighborUse.push_back((uint8_t)(std::min)(use, 255u));
+				i = end;
+			}
+			neighborStart[p + 1] = (unsigned)neighbors.size();
+			borderEdges[p] = (uint8_t)(std::min)(borders, 255u);
+			if (borders != 0 && borders != 2)
+				lockedPosition[p] = true;
+		}
+	};
+	buildTopology();
+
+	// Plane quadrics per position, border edges also get a plane through them perpendicular to
+	// the triangle so the outline is held in place as well
+	std::vector<QUADRIC> quadrics(positionCount, QUADRIC());
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		double n[3];
+		Cross(_vertices[result[i]].pos, _vertices[result[i + 1]].pos, _vertices[result[i + 2]].pos, n);
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0)
+			continue;
+		for (int k = 0; k < 3; k++)
+			n[k] /= length;
+		const H2B::VECTOR& p = _vertices[result[i]].pos;
+		double d = -(n[0] * p.x + n[1] * p.y + n[2] * p.z);
+		for (int k = 0; k < 3; k++)
+			quadrics[positionId[result[i + k]]].AddPlane(n[0], n[1], n[2], d);
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned a = result[i + k], b = result[i + (k + 1) % 3];
+			if (edgeUse(positionId[a], positionId[b]) != 1)
+				continue;
+			const H2B::VECTOR& pa = _vertices[a].pos;
+			const H2B::VECTOR& pb = _vertices[b].pos;
+			double e[3] = { (double)pb.x - pa.x, (double)pb.y - pa.y, (double)pb.z - pa.z };
+			double m[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+			double mLength = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+			if (mLength == 0)
+				continue;
+			for (int c = 0; c < 3; c++)
+				m[c] /= mLength;
+			double md = -(m[0] * pa.x + m[1] * pa.y + m[2] * pa.z);
+			quadrics[positionId[a]].AddPlane(m[0], m[1], m[2], md);
+			quadrics[positionId[b]].AddPlane(m[0], m[1], m[2], md);
+		}
+	}
+
+	struct COLLAPSE { double cost; unsigned from, to; };	// positions
+	std::vector<COLLAPSE> candidates;
+	std::vector<unsigned> remap(_vertexCount), partners;
+	std::vector<bool> touched(positionCount);
+	double maxErrorSquared = (double)_maxError * _maxError, worst = 0;
+
+	while (result.size() > _targetIndexCount)
+	{
+		candidates.clear();
+		for (unsigned from = 0; from < positionCount; from++)
+		{
+			if (lockedPosition[from] || wedgeCount(from) == 0)
+				continue;
+			for (unsigned n = neighborStart[from]; n < neighborStart[from + 1]; n++)
+			{
+				unsigned to = neighbors[n];
+				// Borders only collapse along the border, hard seams only along the seam (onto a
+				// position with as many wedges, checked again when applied)
+				if (borderEdges[from] && neighborUse[n] != 1)
+					continue;
+				if (hardSeam[from] && wedgeCount(from) != wedgeCount(to))
+					continue;
+				QUADRIC q = quadrics[from];
+				q.Add(quadrics[to]);
+				double cost = q.Error(_vertices[wedgeList[wedgeStart[to]]].pos);
+				if (cost <= maxErrorSquared)
+					candidates.push_back({ cost, from, to });
+			}
+		}
+		if (candidates.empty())
+			break;
+		std::sort(candidates.begin(), candidates.end(), [](const COLLAPSE& a, const COLLAPSE& b) {
+			return a.cost < b.cost;
+		});
+
+		for (size_t v = 0; v < _vertexCount; v++)
+			remap[v] = (unsigned)v;
+		std::fill(touched.begin(), touched.end(), false);
+		size_t trianglesLeft = result.size() / 3, targetTriangles = _targetIndexCount / 3;
+		unsigned collapses = 0;
+		for (const COLLAPSE& collapse : candidates)
+		{
+			if (trianglesLeft <= targetTriangles)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// Every wedge of 'from' moves onto a wedge of 'to' it shares a triangle with, so
+			// attributes on each side of a seam stay on their side. Soft split wedges that don't
+			// touch 'to' take its wedge with the same UV and the closest normal.
+			partners.clear();
+			bool valid = true;
+			bool hard = hardSeam[collapse.from];
+			for (unsigned w = wedgeStart[collapse.from]; w < wedgeStart[collapse.from + 1] && valid; w++)
+			{
+				unsigned wedge = wedgeList[w], partner = ~0u;
+				for (unsigned t = triStart[wedge]; t < triStart[wedge + 1] && partner == ~0u; t++)
+					for (int k = 0; k < 3; k++)
+						if (positionId[result[vertexTris[t] * 3 + k]] == collapse.to)
+							partner = result[vertexTris[t] * 3 + k];
+				if (partner == ~0u && !hard)
+				{
+					float best = -2;
+					for (unsigned o = wedgeStart[collapse.to]; o < wedgeStart[collapse.to + 1]; o++)
+						if (sameUV(wedge, wedgeList[o]) && normalCos(wedge, wedgeList[o]) > best)
+						{
+							best = normalCos(wedge, wedgeList[o]);
+							partner = wedgeList[o];
+						}
+				}
+				valid = partner != ~0u &&
+					(!hard || std::find(partners.begin(), partners.end(), partner) == partners.end());
+				partners.push_back(partner);
+			}
+			if (!valid)
+				continue;
+
+			// Reject if any remaining triangle would flip or collapse to a sliver
+			bool flips = false;
+			unsigned removed = 0;
+			for (unsigned t = posTriStart[collapse.from]; t < posTriStart[collapse.from + 1] && !flips; t++)
+			{
+				const unsigned* tri = &result[posTris[t] * 3];
+				if (positionId[tri[0]] == collapse.to || positionId[tri[1]] == collapse.to || positionId[tri[2]] == collapse.to)
+				{
+					removed++;
+					continue;
+				}
+				H2B::VECTOR p[3], q[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = _vertices[tri[k]].pos;
+					q[k] = positionId[tri[k]] == collapse.from ? _vertices[partners[0]].pos : p[k];
+				}
+				double before[3], after[3];
+				Cross(p[0], p[1], p[2], before);
+				Cross(q[0], q[1], q[2], after);
+				double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+				double lengths = std::sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+										   (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+				flips = dot < 0.25 * lengths;
+			}
+			if (flips)
+				continue;
+
+			for (unsigned w = 0; w < partners.size(); w++)
+				remap[wedgeList[wedgeStart[collapse.from] + w]] = partners[w];
+			// Nothing around this collapse may change again in this pass
+			for (unsigned t = posTriStart[collapse.from]; t < posTriStart[collapse.from + 1]; t++)
+				for (int k = 0; k < 3; k++)
+					touched[positionId[result[posTris[t] * 3 + k]]] = true;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			worst = (std::max)(worst, collapse.cost);
+			trianglesLeft -= removed;
+			collapses++;
+		}
+		if (collapses == 0)
+			break;
+
+		// Apply and drop degenerate triangles
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			unsigned a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		size_t before = result.size();
+		result.resize(write);
+		// The last few passes only find a handful of collapses each, not worth a rebuild
+		if (before - write < before * m_simplifyMinPassReduction)
+			break;
+		buildTopology();
+	}
+	if (_outError)
+		*_outError = (float)std::sqrt(worst);
+	return result;
+}
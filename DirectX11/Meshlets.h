@@ -0,0 +1,275 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <unordered_map>
+#include "h2bParser.h"
+#define GATEWARE_ENABLE_CORE // All libraries need this
+#define GATEWARE_ENABLE_MATH
+#include "../gateware-main/Gateware.h"
+
+// Meshlets: small clusters of a mesh with their own bounds, culled on the CPU every frame.
+// A meshlet is a contiguous run of the mesh's (cache optimized) index range, so nothing is
+// re-indexed: the culler just emits the surviving runs, merged, as index ranges to draw.
+// Each meshlet carries a bounding sphere for frustum tests and a normal cone that rejects
+// clusters whose every triangle faces away from the camera.
+
+const unsigned m_meshletMaxVertices = 64;
+const unsigned m_meshletMaxTriangles = 124;
+
+struct MESHLET
+{
+	unsigned indexOffset, indexCount;	// Relative to the start of the mesh's index range
+	float center[3], radius;			// Bounding sphere, model space
+	float coneApex[3];
+	float coneAxis[3];
+	float coneCutoff;					// Backfacing if dot(normalize(apex - eye), axis) >= cutoff, > 1 = never
+};
+
+// Clip space planes (ax + by + cz + d >= 0 inside), from a row vector view * projection matrix
+struct FRUSTUM
+{
+	float planes[6][4];
+};
+
+inline FRUSTUM ExtractFrustum(const float _viewProj[16])
+{
+	// Column j of the row major matrix
+	auto column = [&](int _j, int _i) { return _viewProj[_i * 4 + _j]; };
+	FRUSTUM frustum;
+	for (int i = 0; i < 4; i++)
+	{
+		frustum.planes[0][i] = column(3, i) + column(0, i);	// left
+		frustum.planes[1][i] = column(3, i) - column(0, i);	// right
+		frustum.planes[2][i] = column(3, i) + column(1, i);	// bottom
+		frustum.planes[3][i] = column(3, i) - column(1, i);	// top
+		frustum.planes[4][i] = column(2, i);					// near (D3D clip z >= 0)
+		frustum.planes[5][i] = column(3, i) - column(2, i);	// far
+	}
+	for (int p = 0; p < 6; p++)
+	{
+		float* plane = frustum.planes[p];
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0)
+			for (int i = 0; i < 4; i++)
+				plane[i] /= length;
+	}
+	return frustum;
+}
+
+// Splits _indices[0, _indexCount) into meshlets of at most m_meshletMaxVertices unique vertices
+// and m_meshletMaxTriangles triangles, in index order. _vertices is indexed by _indices.
+inline void BuildMeshlets(const H2B::VERTEX* _vertices, const unsigned* _indices, unsigned _indexCount,
+						  std::vector<MESHLET>& _outMeshlets)
+{
+	std::unordered_map<unsigned, unsigned> used;
+	used.reserve(m_meshletMaxVertices * 2);
+	unsigned first = 0, triangles = 0;
+
+	auto emit = [&](unsigned _end) {
+		if (_end == first)
+			return;
+		MESHLET meshlet = {};
+		meshlet.indexOffset = first;
+		meshlet.indexCount = _end - first;
+
+		// Sphere around the AABB center
+		float minP[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxP[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (unsigned i = first; i < _end; i++)
+		{
+			const float* p = &_vertices[_indices[i]].pos.x;
+			for (int k = 0; k < 3; k++)
+			{
+				minP[k] = (std::min)(minP[k], p[k]);
+				maxP[k] = (std::max)(maxP[k], p[k]);
+			}
+		}
+		for (int k = 0; k < 3; k++)
+			meshlet.center[k] = (minP[k] + maxP[k]) * 0.5f;
+		float radius2 = 0;
+		for (unsigned i = first; i < _end; i++)
+		{
+			const float* p = &_vertices[_indices[i]].pos.x;
+			float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+			radius2 = (std::max)(radius2, dx * dx + dy * dy + dz * dz);
+		}
+		meshlet.radius = std::sqrt(radius2);
+
+		// Face normals, oriented to agree with the shading normals
+		std::vector<float> normals;
+		float axis[3] = { 0, 0, 0 };
+		for (unsigned i = first; i + 2 < _end; i += 3)
+		{
+			const H2B::VERTEX& a = _vertices[_indices[i]];
+			const H2B::VERTEX& b = _vertices[_indices[i + 1]];
+			const H2B::VERTEX& c = _vertices[_indices[i + 2]];
+			float e1[3] = { b.pos.x - a.pos.x, b.pos.y - a.pos.y, b.pos.z - a.pos.z };
+			float e2[3] = { c.pos.x - a.pos.x, c.pos.y - a.pos.y, c.pos.z - a.pos.z };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length == 0)
+				continue; // degenerate, never visible
+			float shading = (a.nrm.x + b.nrm.x + c.nrm.x) * n[0] + (a.nrm.y + b.nrm.y + c.nrm.y) * n[1] +
+							(a.nrm.z + b.nrm.z + c.nrm.z) * n[2];
+			float sign = shading < 0 ? -1.0f : 1.0f;
+			for (int k = 0; k < 3; k++)
+			{
+				n[k] *= sign / length;
+				axis[k] += n[k];
+				normals.push_back(n[k]);
+			}
+			normals.push_back(a.pos.x * n[0] + a.pos.y * n[1] + a.pos.z * n[2]); // plane distance
+		}
+		float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		meshlet.coneCutoff = 2.0f;
+		if (axisLength > 0 && !normals.empty())
+		{
+			for (int k = 0; k < 3; k++)
+				meshlet.coneAxis[k] = axis[k] / axisLength;
+			float minDot = 1.0f;
+			for (size_t n = 0; n < normals.size(); n += 4)
+				minDot = (std::min)(minDot, normals[n] * meshlet.coneAxis[0] + normals[n + 1] * meshlet.coneAxis[1] +
+											normals[n + 2] * meshlet.coneAxis[2]);
+			if (minDot > 0.1f)
+			{
+				// Apex: pull back along the axis until it is behind every triangle's plane
+				float maxT = 0;
+				for (size_t n = 0; n < normals.size(); n += 4)
+				{
+					float centerDistance = normals[n] * meshlet.center[0] + normals[n + 1] * meshlet.center[1] +
+										   normals[n + 2] * meshlet.center[2] - normals[n + 3];
+					float axisDot = normals[n] * meshlet.coneAxis[0] + normals[n + 1] * meshlet.coneAxis[1] +
+									normals[n + 2] * meshlet.coneAxis[2];
+					maxT = (std::max)(maxT, centerDistance / axisDot);
+				}
+				for (int k = 0; k < 3; k++)
+					meshlet.coneApex[k] = meshlet.center[k] - meshlet.coneAxis[k] * maxT;
+				meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+			}
+		}
+		_outMeshlets.push_back(meshlet);
+	};
+
+	for (unsigned i = 0; i + 2 < _indexCount; i += 3)
+	{
+		unsigned added = 0;
+		for (int k = 0; k < 3; k++)
+			if (used.find(_indices[i + k]) == used.end())
+				added++;
+		if (triangles + 1 > m_meshletMaxTriangles || used.size() + added > m_meshletMaxVertices)
+		{
+			emit(i);
+			first = i;
+			triangles = 0;
+			used.clear();
+		}
+		for (int k = 0; k < 3; k++)
+			used.emplace(_indices[i + k], 0u);
+		triangles++;
+	}
+	emit(_indexCount - _indexCount % 3);
+}
+
+class MeshletCuller
+{
+public:
+	// One index run to draw for one instance
+	struct VISIBLE_RANGE
+	{
+		unsigned indexOffset, indexCount;	// Relative to the mesh's index range
+		unsigned instanceSlot;				// StartInstanceLocation, position in the sorted id stream
+	};
+	struct CULL_STATS
+	{
+		unsigned meshletsTested, meshletsFrustumCulled, meshletsConeCulled;
+		unsigned trianglesTested, trianglesKept;
+	};
+
+	void Begin()
+	{
+		m_ranges.clear();
+		m_stats = {};
+	}
+
+	// Culls one instance's meshlets and appends its surviving, merged index runs.
+	// Returns how many ranges were added.
+	unsigned CullInstance(const MESHLET* _meshlets, unsigned _meshletCount, const GW::MATH::GMATRIXF& _world,
+						  unsigned _instanceSlot, const FRUSTUM& _frustum, const GW::MATH::GVECTORF& _eye)
+	{
+		const GW::MATH::GMATRIXF& w = _world;
+		float scaleX = std::sqrt(w.row1.x * w.row1.x + w.row1.y * w.row1.y + w.row1.z * w.row1.z);
+		float scaleY = std::sqrt(w.row2.x * w.row2.x + w.row2.y * w.row2.y + w.row2.z * w.row2.z);
+		float scaleZ = std::sqrt(w.row3.x * w.row3.x + w.row3.y * w.row3.y + w.row3.z * w.row3.z);
+		float maxScale = (std::max)(scaleX, (std::max)(scaleY, scaleZ));
+		float minScale = (std::min)(scaleX, (std::min)(scaleY, scaleZ));
+		// Cones only survive (near) uniform scale, and mirroring flips the winding
+		float determinant = w.row1.x * (w.row2.y * w.row3.z - w.row2.z * w.row3.y) -
+							w.row1.y * (w.row2.x * w.row3.z - w.row2.z * w.row3.x) +
+							w.row1.z * (w.row2.x * w.row3.y - w.row2.y * w.row3.x);
+		bool conesValid = minScale > 0 && maxScale / minScale < 1.01f && determinant > 0;
+
+		unsigned added = 0;
+		for (unsigned m = 0; m < _meshletCount; m++)
+		{
+			const MESHLET& meshlet = _meshlets[m];
+			m_stats.meshletsTested++;
+			m_stats.trianglesTested += meshlet.indexCount / 3;
+
+			float center[3];
+			TransformPoint(w, meshlet.center, center);
+			float radius = meshlet.radius * maxScale;
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+			{
+				const float* plane = _frustum.planes[p];
+				inside = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] >= -radius;
+			}
+			if (!inside)
+			{
+				m_stats.meshletsFrustumCulled++;
+				continue;
+			}
+			if (conesValid && meshlet.coneCutoff <= 1.0f)
+			{
+				float apex[3], axis[3];
+				TransformPoint(w, meshlet.coneApex, apex);
+				for (int k = 0; k < 3; k++)
+					axis[k] = (meshlet.coneAxis[0] * (&w.row1.x)[k] + meshlet.coneAxis[1] * (&w.row2.x)[k] +
+							   meshlet.coneAxis[2] * (&w.row3.x)[k]) / maxScale;
+				float view[3] = { apex[0] - _eye.x, apex[1] - _eye.y, apex[2] - _eye.z };
+				float viewLength = std::sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+				if (viewLength > 0 &&
+					(view[0] * axis[0] + view[1] * axis[1] + view[2] * axis[2]) >= meshlet.coneCutoff * viewLength)
+				{
+					m_stats.meshletsConeCulled++;
+					continue;
+				}
+			}
+
+			m_stats.trianglesKept += meshlet.indexCount / 3;
+			// Neighbouring survivors are contiguous in the index buffer, draw them as one range
+			if (added > 0 && m_ranges.back().indexOffset + m_ranges.back().indexCount == meshlet.indexOffset)
+				m_ranges.back().indexCount += meshlet.indexCount;
+			else
+			{
+				m_ranges.push_back({ meshlet.indexOffset, meshlet.indexCount, _instanceSlot });
+				added++;
+			}
+		}
+		return added;
+	}
+
+	const std::vector<VISIBLE_RANGE>& GetRanges() const { return m_ranges; }
+	const CULL_STATS& GetStats() const { return m_stats; }
+
+private:
+	static void TransformPoint(const GW::MATH::GMATRIXF& _w, const float _p[3], float _out[3])
+	{
+		for (int k = 0; k < 3; k++)
+			_out[k] = _p[0] * (&_w.row1.x)[k] + _p[1] * (&_w.row2.x)[k] + _p[2] * (&_w.row3.x)[k] + (&_w.row4.x)[k];
+	}
+
+	std::vector<VISIBLE_RANGE> m_ranges;
+	CULL_STATS m_stats = {};
+};
@@ -0,0 +1,279 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include "Hashing.h"
+#include "MappedFile.h"
+#include "BlockCompression.h"
+
+// Model pack.
+// Every Models/*.h2b concatenated into one file behind a table of contents sorted by name
+// hash. The loader maps the pack once and parses each model straight out of the mapping, so a
+// level costs one open instead of one open/read/close per model and the reads are sequential.
+// Each model starts on its own m_modelPackAlignment boundary. The loose .h2b files stay the
+// source, the PackModels build step (ModelPacker) rewrites the pack from them.
+// A compressed pack (MODEL_PACK_COMPRESSED) stores every model as its own run of
+// BlockCompression.h blocks, Unpack decodes the blocks of a level's models on worker threads.
+
+const uint32_t m_modelPackVersion = 2;
+const uint32_t m_modelPackAlignment = 4096;
+const char* const m_modelPackName = "Models.h2bpack"; // inside the models folder
+
+enum MODEL_PACK_FLAGS : uint32_t
+{
+	MODEL_PACK_COMPRESSED = 1,
+	MODEL_PACK_OPTIMIZED = 2,	// models went through H2BOptimizer, the import skips weld/optimize
+};
+
+struct MODEL_PACK_HEADER
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t entryCount;	// MODEL_PACK_ENTRY records right after the header, by nameHash
+	uint32_t namesBytes;	// null terminated names after the entries
+	uint32_t flags;			// MODEL_PACK_FLAGS
+	uint32_t blockCount;	// COMPRESSED_BLOCK records after the names (8 byte aligned), offsets into the pack
+	uint64_t size;			// whole pack, catches truncated writes
+};
+
+struct MODEL_PACK_ENTRY
+{
+	uint64_t nameHash;		// HashString of the file name (no folder)
+	uint64_t offset, size;	// the stored bytes, compressed blocks back to back in a compressed pack
+	uint64_t rawSize;		// the .h2b's size
+	uint32_t nameOffset;	// into the names block
+	uint32_t firstBlock;	// compressed packs only, blocks of one entry are consecutive
+};
+
+// An unpacked model, nullptr/0 if the pack doesn't have it
+struct MODEL_PACK_SPAN
+{
+	const unsigned char* data;
+	size_t size;
+};
+
+// Packs _files (full paths) into _packPath, entries are named by file name. _flags are
+// MODEL_PACK_FLAGS, with MODEL_PACK_COMPRESSED every model is stored as compressed blocks.
+// False if any file can't be read or the pack can't be written.
+inline bool WriteModelPack(const std::vector<std::string>& _files, const std::string& _packPath, uint32_t _flags = 0)
+{
+	bool compress = (_flags & MODEL_PACK_COMPRESSED) != 0;
+	std::vector<MODEL_PACK_ENTRY> entries;
+	std::vector<char> names;
+	std::vector<std::vector<uint8_t>> stored(_files.size());
+	std::vector<COMPRESSED_BLOCK> blocks;
+	for (size_t i = 0; i < _files.size(); i++)
+	{
+		std::string name = std::filesystem::path(_files[i]).filename().string();
+		std::ifstream file(_files[i], std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+		if (!file.is_open())
+			return false;
+		std::vector<uint8_t> bytes((size_t)file.tellg());
+		file.seekg(0);
+		if (!file.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+			return false;
+		MODEL_PACK_ENTRY entry = { HashString(name.c_str()), 0, 0, bytes.size(), (uint32_t)names.size(), 0 };
+		if (compress)
+		{
+			std::vector<COMPRESSED_BLOCK> entryBlocks;
+			CompressBlocks(bytes.data(), bytes.size(), stored[i], entryBlocks);
+			entry.firstBlock = (uint32_t)blocks.size();
+			blocks.insert(blocks.end(), entryBlocks.begin(), entryBlocks.end()); // offsets fixed up below
+		}
+		else
+			stored[i].swap(bytes);
+		entry.size = stored[i].size();
+		names.insert(names.end(), name.c_str(), name.c_str() + name.size() + 1);
+		entries.push_back(entry);
+	}
+	// Data goes in name hash order too so a level reading its models in TOC order streams forward
+	std::vector<unsigned> order(entries.size());
+	for (unsigned i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return entries[a].nameHash < entries[b].nameHash; });
+
+	auto align = [](uint64_t _offset, uint64_t _alignment) { return (_offset + _alignment - 1) / _alignment * _alignment; };
+	uint64_t blocksStart = align(sizeof(MODEL_PACK_HEADER) + sizeof(MODEL_PACK_ENTRY) * entries.size() + names.size(), 8);
+	uint64_t offset = align(blocksStart + sizeof(COMPRESSED_BLOCK) * blocks.size(), m_modelPackAlignment);
+	std::vector<MODEL_PACK_ENTRY> sorted;
+	for (unsigned i : order)
+	{
+		entries[i].offset = offset;
+		if (compress)
+		{
+			size_t blockCount = (entries[i].rawSize + m_compressionBlockSize - 1) / m_compressionBlockSize;
+			for (size_t b = entries[i].firstBlock; b < entries[i].firstBlock + blockCount; b++)
+				blocks[b].offset += offset;
+		}
+		offset = align(offset + entries[i].size, m_modelPackAlignment);
+		sorted.push_back(entries[i]);
+	}
+	MODEL_PACK_HEADER header = { { 'H', '2', 'B', 'P' }, m_modelPackVersion, (uint32_t)sorted.size(), (uint32_t)names.size(),
+		_flags, (uint32_t)blocks.size(), offset };
+
+	std::string temporary = _packPath + ".tmp";
+	{
+		std::ofstream pack(temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (!pack.is_open())
+			return false;
+		pack.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		pack.write(reinterpret_cast<const char*>(sorted.data()), sizeof(MODEL_PACK_ENTRY) * sorted.size());
+		pack.write(names.data(), names.size());
+		pack.seekp(blocksStart);
+		pack.write(reinterpret_cast<const char*>(blocks.data()), sizeof(COMPRESSED_BLOCK) * blocks.size());
+		for (unsigned i : order)
+		{
+			pack.seekp(entries[i].offset);
+			pack.write(reinterpret_cast<const char*>(stored[i].data()), stored[i].size());
+		}
+		// pad the tail so the size in the header is the size on disk
+		pack.seekp(offset - 1);
+		pack.put('\0');
+		if (!pack)
+			return false;
+	}
+	std::remove(_packPath.c_str()); // rename won't replace an existing file on Windows
+	return std::rename(temporary.c_str(), _packPath.c_str()) == 0;
+}
+
+// A mapped pack, entries point into the mapping and stay valid until Close()
+class ModelPack
+{
+	MappedFile m_file;
+	const MODEL_PACK_HEADER* m_header = nullptr;
+	const MODEL_PACK_ENTRY* m_entries = nullptr;
+	const char* m_names = nullptr;
+	const COMPRESSED_BLOCK* m_blocks = nullptr;
+
+public:
+	// False (and closed) if the pack is missing, from another version or truncated
+	bool Open(const std::string& _path)
+	{
+		Close();
+		if (!m_file.Open(_path) || m_file.Size() < sizeof(MODEL_PACK_HEADER))
+			return Fail();
+		m_header = reinterpret_cast<const MODEL_PACK_HEADER*>(m_file.Data());
+		uint64_t tocBytes = sizeof(MODEL_PACK_HEADER) + sizeof(MODEL_PACK_ENTRY) * (uint64_t)m_header->entryCount + m_header->namesBytes;
+		if (std::memcmp(m_header->magic, "H2BP", 4) != 0 || m_header->version != m_modelPackVersion ||
+			m_header->size != m_file.Size() || tocBytes > m_file.Size())
+			return Fail();
+		m_entries = reinterpret_cast<const MODEL_PACK_ENTRY*>(m_header + 1);
+		m_names = reinterpret_cast<const char*>(m_entries + m_header->entryCount);
+		uint64_t blocksStart = (tocBytes + 7) / 8 * 8;
+		if (blocksStart + sizeof(COMPRESSED_BLOCK) * (uint64_t)m_header->blockCount > m_file.Size())
+			return Fail();
+		m_blocks = reinterpret_cast<const COMPRESSED_BLOCK*>(m_file.Data() + blocksStart);
+		for (uint32_t i = 0; i < m_header->entryCount; i++)
+		{
+			const MODEL_PACK_ENTRY& entry = m_entries[i];
+			if (entry.offset + entry.size > m_file.Size() || entry.nameOffset >= m_header->namesBytes)
+				return Fail();
+			if (IsCompressed() && entry.firstBlock + GetBlockCount(entry) > m_header->blockCount)
+				return Fail();
+			if (!IsCompressed() && entry.rawSize != entry.size)
+				return Fail();
+		}
+		for (uint32_t b = 0; b < m_header->blockCount; b++)
+			if (m_blocks[b].offset + m_blocks[b].compressedSize > m_file.Size() || m_blocks[b].rawSize > m_compressionBlockSize)
+				return Fail();
+		if (m_header->namesBytes > 0 && m_names[m_header->namesBytes - 1] != '\0')
+			return Fail();
+		return true;
+	}
+
+	void Close()
+	{
+		m_file.Close();
+		m_header = nullptr;
+		m_entries = nullptr;
+		m_names = nullptr;
+		m_blocks = nullptr;
+	}
+
+	bool IsOpen() const { return m_header != nullptr; }
+	bool IsCompressed() const { return m_header && (m_header->flags & MODEL_PACK_COMPRESSED); }
+	bool IsOptimized() const { return m_header && (m_header->flags & MODEL_PACK_OPTIMIZED); }
+	unsigned GetEntryCount() const { return m_header ? m_header->entryCount : 0; }
+
+	// Binary search of the hash sorted TOC, the name is compared to rule out collisions
+	const MODEL_PACK_ENTRY* FindEntry(const char* _name) const
+	{
+		if (m_header == nullptr)
+			return nullptr;
+		uint64_t hash = HashString(_name);
+		const MODEL_PACK_ENTRY* end = m_entries + m_header->entryCount;
+		const MODEL_PACK_ENTRY* entry = std::lower_bound(m_entries, end, hash,
+			[](const MODEL_PACK_ENTRY& _entry, uint64_t _hash) { return _entry.nameHash < _hash; });
+		for (; entry != end && entry->nameHash == hash; entry++)
+			if (std::strcmp(m_names + entry->nameOffset, _name) == 0)
+				return entry;
+		return nullptr;
+	}
+
+	// The bytes stored for _name, compressed blocks in a compressed pack (see Unpack)
+	bool Find(const char* _name, const unsigned char*& _outData, size_t& _outSize) const
+	{
+		const MODEL_PACK_ENTRY* entry = FindEntry(_name);
+		if (entry == nullptr)
+			return false;
+		_outData = m_file.Data() + entry->offset;
+		_outSize = (size_t)entry->size;
+		return true;
+	}
+
+	// The .h2b bytes of every model in _names. An uncompressed pack hands out spans of the
+	// mapping. A compressed one decodes all their blocks over _threadCount threads straight into
+	// their slice of _outBuffer, the spans point there. False if a block is malformed.
+	bool Unpack(const std::vector<std::string>& _names, std::vector<unsigned char>& _outBuffer,
+				std::vector<MODEL_PACK_SPAN>& _outSpans, unsigned _threadCount = std::thread::hardware_concurrency()) const
+	{
+		std::vector<const MODEL_PACK_ENTRY*> entries;
+		size_t rawBytes = 0;
+		for (const std::string& name : _names)
+		{
+			entries.push_back(FindEntry(name.c_str()));
+			rawBytes += entries.back() ? (size_t)entries.back()->rawSize : 0;
+		}
+		_outSpans.assign(_names.size(), { nullptr, 0 });
+		if (!IsCompressed())
+		{
+			for (size_t i = 0; i < entries.size(); i++)
+				if (entries[i])
+					_outSpans[i] = { m_file.Data() + entries[i]->offset, (size_t)entries[i]->size };
+			return true;
+		}
+		_outBuffer.resize(rawBytes);
+		std::vector<BLOCK_JOB> jobs;
+		size_t at = 0;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (entries[i] == nullptr)
+				continue;
+			_outSpans[i] = { _outBuffer.data() + at, (size_t)entries[i]->rawSize };
+			for (uint32_t b = entries[i]->firstBlock; b < entries[i]->firstBlock + GetBlockCount(*entries[i]); b++)
+			{
+				jobs.push_back({ &m_blocks[b], _outBuffer.data() + at });
+				at += m_blocks[b].rawSize;
+			}
+			if (at != (size_t)(_outSpans[i].data - _outBuffer.data()) + _outSpans[i].size)
+				return false; // blocks don't add up to the model
+		}
+		return DecompressBlocks(m_file.Data(), jobs, _threadCount);
+	}
+
+private:
+	static uint32_t GetBlockCount(const MODEL_PACK_ENTRY& _entry)
+	{
+		return (uint32_t)((_entry.rawSize + m_compressionBlockSize - 1) / m_compressionBlockSize);
+	}
+
+	bool Fail()
+	{
+		Close();
+		return false;
+	}
+};
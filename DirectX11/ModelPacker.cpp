@@ -0,0 +1,43 @@
+// Build step that packs every .h2b in the models folder into one model pack (ModelPack.h).
+// Usage: ModelPacker <path to Models folder> [pack path, default <folder>/Models.h2bpack] [--compress] [--optimized]
+// --optimized marks the models as H2BOptimizer output.
+#include "ModelPack.h"
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> arguments;
+	uint32_t flags = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--compress")
+			flags |= MODEL_PACK_COMPRESSED;
+		else if (std::string(argv[i]) == "--optimized")
+			flags |= MODEL_PACK_OPTIMIZED;
+		else
+			arguments.push_back(argv[i]);
+	}
+	if (arguments.empty())
+	{
+		std::cout << "Usage: ModelPacker <models folder> [pack path] [--compress] [--optimized]" << std::endl;
+		return 1;
+	}
+	std::string modelFolder = arguments[0];
+	std::string packPath = arguments.size() > 1 ? arguments[1] : modelFolder + "/" + m_modelPackName;
+
+	std::vector<std::string> files;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(modelFolder, error))
+		if (entry.path().extension() == ".h2b")
+			files.push_back(entry.path().string());
+	std::sort(files.begin(), files.end());
+	if (!WriteModelPack(files, packPath, flags))
+	{
+		std::cout << packPath << ": error: could not write the model pack" << std::endl;
+		return 1;
+	}
+	std::cout << files.size() << " models packed into " << packPath << " ("
+			  << std::filesystem::file_size(packPath, error) / 1024 << " KiB" << (flags & MODEL_PACK_COMPRESSED ? ", compressed" : "")
+			  << (flags & MODEL_PACK_OPTIMIZED ? ", optimized)" : ")") << std::endl;
+	return 0;
+}
@@ -43,8 +43,32 @@ XMFLOAT3 m_originalSunlightDirection = { -1, -2, -2 };
 const UINT m_maxPointLights = 16;
 // Spot lights
 const UINT m_maxSpotLights = 16;
+// Lights further than this from the camera get merged into aggregate lights
+float m_lightLODDistance = 30.0f;
 
 //////////////////////// MISC ////////////////////////////
+bool m_optimizeMeshesOnImport = true;	// Vertex cache/overdraw/fetch reordering of .h2b data (MeshOptimizer.h)
+bool m_dedupGeometryOnImport = true;	// Vertex welding + shared mesh geometry across models (GeometryDedup.h)
+bool m_mergeMaterialBatches = true;		// One draw range per material and model, exported meshes kept as parts (MaterialBatches.h)
+bool m_compactVertexFormat = true;		// 16 byte quantized vertices + 16 bit indices where they fit
+bool m_splitVertexStreams = true;		// Position only + attribute streams next to the interleaved data (VertexStreams.h)
+bool m_depthPrepass = true;				// Depth only pass over the position stream before the lit pass (needs split streams)
+bool m_meshletCulling = true;			// Per meshlet frustum/backface cone culling of big meshes (Meshlets.h)
+UINT m_meshletMinTriangles = 512;		// Meshes smaller than this are drawn whole
+UINT m_meshletMaxInstances = 8;			// Instance sets bigger than this are drawn whole (one draw per visible instance otherwise)
+bool m_generateLODs = true;				// Simplified index ranges per mesh picked per instance by screen size (LevelOfDetail.h)
+float m_lodPixelError = 1.0f;			// Largest on screen error (pixels) a LOD may show
+float m_lodHysteresis = 0.25f;			// A coarser LOD must be this much under the threshold before switching to it
+bool m_generateHLODs = false;			// Merged, simplified proxies replacing far groups of instances (HLOD.h), built at import on bake cache misses and takes seconds
+float m_hlodDistance = 40.0f;			// A cell only switches to its proxy this far past its bounds
+float m_hlodPixelError = 4.0f;			// Largest on screen error (pixels) a proxy may show
+bool m_useModelPack = true;				// Models read from one mapped Models/Models.h2bpack when it exists, loose .h2b files otherwise (ModelPack.h)
+bool m_bakeLevelCache = true;			// Imported levels cached in Levels/Cache, re-imported only when a source or setting changes (LevelBakeCache.h)
+bool m_useBinaryLevels = true;			// A level's binary export (GameLevel.lvl next to GameLevel.txt) is read instead of the text one when it exists (BinaryLevel.h)
+bool m_transformHierarchy = true;		// Transforms keep their exported parent and move with it, only moved subtrees are recomputed (SceneHierarchy.h)
+bool m_levelDeltaSwitch = true;			// Switching levels edits the loaded one into the next, importing only the models it doesn't have yet, a full load when they share too little (LevelDelta.h)
+bool m_worldPartition = false;			// Levels bake into per cell files (Levels/Cache/<level>/) streamed around the camera into fixed size pools, needs m_bakeLevelCache (WorldPartition.h)
+const char* const m_dynamicModels[] = { "Banner.h2b" };	// Instances of these models move at runtime, their transforms are streamed through a ring of copies (DynamicTransforms.h)
 UINT m_gridDensity = 25;			// 25 is default
 
 //////////////////////// Structs ////////////////////////
@@ -55,9 +79,10 @@ struct MY_VERTEX
 	XMFLOAT3 nrm;
 };
 
+// Instance vertex stream, the world matrix itself is fetched from the transform buffer
 struct PerInstanceData
 {
-	XMFLOAT4X4 wMatrix;
+	UINT transformIndex;
 };
 
 struct POINT_LIGHT
@@ -84,9 +109,9 @@ struct SPOT_LIGHT
 };
 
 // All constant buffer structs need to be 16 byte aligned
+// Material attributes live in their own structured buffer (no fixed material cap)
 struct CB_PerScene
 {
-	H2B::ATTRIBUTES currOBJAttributes[40];	// ?
 	float numPointLights;
 	float numSpotLights;
 	float pad1;
@@ -98,6 +123,9 @@ struct CB_PerObject
 	XMFLOAT4X4 vMatrix;					// 64 bytes
 	XMFLOAT4X4 pMatrix;					// 64 bytes
 	XMFLOAT4 materialIndex;				// Replicated for byte-align
+	XMFLOAT4 quantOffset;				// Compact vertex position decode (VertexQuantization.h)
+	XMFLOAT4 quantScale;
+	XMFLOAT4 instanceRanges;			// x = drawn set's first transform, y = how many if dynamic (else 0), z = where they start in the ring
 };
 
 struct CB_PerFrame
@@ -109,6 +137,7 @@ struct CB_PerFrame
 	SPOT_LIGHT spotLights[m_maxSpotLights];
 	SPOT_LIGHT cameraFlashlight;
 	XMFLOAT4 flashlightPowerOn;
+	XMFLOAT4 numActiveLights;		// x = point lights, y = spot lights (after light LOD)
 
 };
 
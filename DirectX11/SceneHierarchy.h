@@ -0,0 +1,225 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <emmintrin.h>
+#define GATEWARE_ENABLE_CORE // All libraries need this
+#define GATEWARE_ENABLE_MATH
+#include "../gateware-main/Gateware.h"
+
+// Transform hierarchy.
+// Levels load as flat world matrices, so moving a parent would mean rewriting every child by
+// hand. The hierarchy keeps a local matrix and a parent per transform slot, with nodes stored so
+// every parent comes before its children (grouped by depth), and a dirty flag per node. Update
+// walks the nodes once: a node is recomputed when it or any ancestor is dirty, and the dirty nodes
+// of one depth are multiplied as one SSE batch (row vectors, world = local * parent world). The
+// transform slots it rewrote come back as merged ranges so only those get bounds and uploads.
+
+// Transform slots [first, first + count)
+struct TRANSFORM_RANGE
+{
+	unsigned first, count;
+};
+
+// _outWorld[i] = _local[_nodes[i]] * _world[_parents[_nodes[i]]]. Each output row is the parent's
+// rows scaled by one local row and summed, four broadcasts and four multiply-adds per row.
+inline void MultiplyTransformBatch(const unsigned* _nodes, size_t _count, const GW::MATH::GMATRIXF* _local,
+								   const int* _parents, GW::MATH::GMATRIXF* _world)
+{
+	for (size_t i = 0; i < _count; i++)
+	{
+		unsigned node = _nodes[i];
+		const float* local = _local[node].data;
+		const float* parent = _world[_parents[node]].data;
+		__m128 p0 = _mm_loadu_ps(parent), p1 = _mm_loadu_ps(parent + 4);
+		__m128 p2 = _mm_loadu_ps(parent + 8), p3 = _mm_loadu_ps(parent + 12);
+		for (int row = 0; row < 4; row++)
+		{
+			const float* l = local + row * 4;
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l[0]), p0), _mm_mul_ps(_mm_set1_ps(l[1]), p1)),
+									_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l[2]), p2), _mm_mul_ps(_mm_set1_ps(l[3]), p3)));
+			_mm_storeu_ps(_world[node].data + row * 4, sum);
+		}
+	}
+}
+
+class SceneHierarchy
+{
+	// per node, in parent before child order
+	std::vector<GW::MATH::GMATRIXF> m_local, m_world;
+	std::vector<int> m_parent;			// node index, -1 for roots
+	std::vector<unsigned> m_childCount;
+	std::vector<unsigned> m_slot;		// transform slot the node writes
+	std::vector<uint8_t> m_dirty;
+	std::vector<unsigned> m_depthStart;	// nodes of depth d are [m_depthStart[d], m_depthStart[d + 1])
+	std::vector<unsigned> m_nodeOfSlot;
+	bool m_anyDirty = false;
+	// scratch kept between updates
+	std::vector<unsigned> m_batch, m_updated, m_slots;
+
+public:
+	// _parents has one entry per transform slot, the parent's slot or -1. _worlds are the loaded
+	// world matrices, locals are derived from them so nothing moves until SetLocal is called.
+	// A parent chain that loops back on itself is cut and the slot made a root.
+	void Build(const int* _parents, const GW::MATH::GMATRIXF* _worlds, unsigned _count)
+	{
+		Clear();
+		// depth of every slot, walking up until a slot with a known depth
+		std::vector<int> depth(_count, -1);
+		std::vector<int> parents(_parents, _parents + _count);
+		std::vector<unsigned> chain;
+		for (unsigned s = 0; s < _count; s++)
+		{
+			chain.clear();
+			unsigned at = s;
+			while (depth[at] < 0)
+			{
+				depth[at] = -2; // on the current chain
+				chain.push_back(at);
+				int parent = parents[at];
+				if (parent < 0 || (unsigned)parent >= _count)
+				{
+					parents[at] = -1;
+					break;
+				}
+				if (depth[parent] == -2)
+				{
+					parents[at] = -1; // loop
+					break;
+				}
+				at = (unsigned)parent;
+			}
+			for (size_t c = chain.size(); c-- > 0;)
+			{
+				int parent = parents[chain[c]];
+				depth[chain[c]] = parent < 0 ? 0 : depth[parent] + 1;
+			}
+		}
+		// counting sort by depth, slot order kept inside a depth
+		int maxDepth = -1;
+		for (unsigned s = 0; s < _count; s++)
+			maxDepth = (std::max)(maxDepth, depth[s]);
+		m_depthStart.assign(maxDepth + 2, 0);
+		for (unsigned s = 0; s < _count; s++)
+			m_depthStart[depth[s] + 1]++;
+		for (size_t d = 1; d < m_depthStart.size(); d++)
+			m_depthStart[d] += m_depthStart[d - 1];
+		std::vector<unsigned> next(m_depthStart.begin(), m_depthStart.end() - 1);
+		m_slot.resize(_count);
+		m_nodeOfSlot.resize(_count);
+		for (unsigned s = 0; s < _count; s++)
+		{
+			unsigned node = next[depth[s]]++;
+			m_slot[node] = s;
+			m_nodeOfSlot[s] = node;
+		}
+		m_parent.resize(_count);
+		m_childCount.assign(_count, 0);
+		m_local.resize(_count);
+		m_world.resize(_count);
+		m_dirty.assign(_count, 0);
+		for (unsigned node = 0; node < _count; node++)
+		{
+			unsigned slot = m_slot[node];
+			m_world[node] = _worlds[slot];
+			m_local[node] = _worlds[slot];
+			m_parent[node] = -1;
+			// a parent without an inverse (zero scale) can't carry children, they become roots
+			GW::MATH::GMATRIXF parentInverse = GW::MATH::GIdentityMatrixF;
+			if (parents[slot] >= 0 && GW::MATH::GMatrix::InverseF(_worlds[parents[slot]], parentInverse) == GW::GReturn::SUCCESS)
+			{
+				m_parent[node] = (int)m_nodeOfSlot[parents[slot]];
+				m_childCount[m_parent[node]]++;
+				GW::MATH::GMatrix::MultiplyMatrixF(_worlds[slot], parentInverse, m_local[node]);
+			}
+		}
+	}
+
+	void Clear()
+	{
+		m_local.clear();
+		m_world.clear();
+		m_parent.clear();
+		m_childCount.clear();
+		m_slot.clear();
+		m_dirty.clear();
+		m_depthStart.clear();
+		m_nodeOfSlot.clear();
+		m_anyDirty = false;
+	}
+
+	bool IsEmpty() const { return m_slot.empty(); }
+	unsigned Depth() const { return m_depthStart.empty() ? 0 : (unsigned)m_depthStart.size() - 1; }
+	int GetParent(unsigned _slot) const
+	{
+		int parent = m_parent[m_nodeOfSlot[_slot]];
+		return parent < 0 ? -1 : (int)m_slot[parent];
+	}
+	unsigned ChildCount(unsigned _slot) const { return m_childCount[m_nodeOfSlot[_slot]]; }
+	const GW::MATH::GMATRIXF& GetLocal(unsigned _slot) const { return m_local[m_nodeOfSlot[_slot]]; }
+
+	// Makes _slot a root where it is now (as of the last Update). The node keeps its place, a root
+	// after its old depth still comes before its children
+	void Detach(unsigned _slot)
+	{
+		unsigned node = m_nodeOfSlot[_slot];
+		if (m_parent[node] < 0)
+			return;
+		m_childCount[m_parent[node]]--;
+		m_parent[node] = -1;
+		m_local[node] = m_world[node];
+	}
+
+	// Moves _slot relative to its parent, it and everything below it update on the next Update
+	void SetLocal(unsigned _slot, const GW::MATH::GMATRIXF& _local)
+	{
+		unsigned node = m_nodeOfSlot[_slot];
+		m_local[node] = _local;
+		m_dirty[node] = 1;
+		m_anyDirty = true;
+	}
+
+	// Recomputes the dirty subtrees, writes their world matrices into _transforms (indexed by slot)
+	// and sets _outRanges to the merged slot ranges written. Returns the number of nodes updated.
+	unsigned Update(GW::MATH::GMATRIXF* _transforms, std::vector<TRANSFORM_RANGE>& _outRanges)
+	{
+		_outRanges.clear();
+		if (!m_anyDirty)
+			return 0;
+		m_updated.clear();
+		for (size_t d = 0; d + 1 < m_depthStart.size(); d++)
+		{
+			m_batch.clear();
+			for (unsigned node = m_depthStart[d]; node < m_depthStart[d + 1]; node++)
+			{
+				int parent = m_parent[node];
+				if (!m_dirty[node] && (parent < 0 || !m_dirty[parent]))
+					continue;
+				m_dirty[node] = 1; // its children see it
+				m_updated.push_back(node);
+				if (parent < 0)
+					m_world[node] = m_local[node];
+				else
+					m_batch.push_back(node);
+			}
+			MultiplyTransformBatch(m_batch.data(), m_batch.size(), m_local.data(), m_parent.data(), m_world.data());
+		}
+		m_slots.clear();
+		for (unsigned node : m_updated)
+		{
+			m_dirty[node] = 0;
+			_transforms[m_slot[node]] = m_world[node];
+			m_slots.push_back(m_slot[node]);
+		}
+		m_anyDirty = false;
+		std::sort(m_slots.begin(), m_slots.end());
+		for (unsigned slot : m_slots)
+		{
+			if (!_outRanges.empty() && _outRanges.back().first + _outRanges.back().count == slot)
+				_outRanges.back().count++;
+			else
+				_outRanges.push_back({ slot, 1 });
+		}
+		return (unsigned)m_updated.size();
+	}
+};
@@ -0,0 +1,31 @@
+// Build step that compiles every shader in GetShaderBuildList() into the bytecode cache.
+// Usage: ShaderBaker <path to Shaders folder>
+#include "ShaderCache.h"
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: ShaderBaker <shader folder>" << std::endl;
+		return 1;
+	}
+	std::string shaderFolder = argv[1];
+	ShaderCache shaderCache(shaderFolder + "/Cache");
+
+	int failures = 0;
+	for (const SHADER_BUILD_DESC& desc : GetShaderBuildList(shaderFolder))
+	{
+		Microsoft::WRL::ComPtr<ID3DBlob> blob;
+		std::string errors;
+		bool fromCache = false;
+		if (FAILED(shaderCache.GetBytecode(desc, blob, errors, fromCache)))
+		{
+			std::cout << desc.sourcePath << "(" << desc.cacheName << "): error: " << errors << std::endl;
+			failures++;
+		}
+		else
+			std::cout << desc.cacheName << (fromCache ? " up to date" : " compiled") << std::endl;
+	}
+	return failures == 0 ? 0 : 1;
+}
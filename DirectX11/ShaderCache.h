@@ -0,0 +1,178 @@
+#pragma once
+#include <d3dcompiler.h>
+#include <wrl/client.h>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Hashing.h"
+#include "ShaderPermutations.h"
+#pragma comment(lib, "d3dcompiler.lib")
+
+// Compiled shader cache.
+// Every shader the game uses is described by a SHADER_BUILD_DESC. Its bytecode is stored in
+// Shaders/Cache together with a key hashed from the source text, entry point, target, defines,
+// compile flags and compiler version. The ShaderBaker build step fills the cache at build time,
+// at startup the renderer only has to hash the source and read the bytecode back. A stale or
+// missing entry falls back to D3DCompile and rewrites the cache file.
+
+struct SHADER_BUILD_DESC
+{
+	std::string sourcePath;				// .hlsl file
+	std::string cacheName;				// Unique name of this variant, used for the cache file
+	std::string target;					// vs_5_0, ps_5_0...
+	std::vector<SHADER_DEFINE> defines;	// Null terminated like D3D_SHADER_MACRO
+};
+
+// The flags used for every shader, the build step and the game must agree on these
+inline UINT GetShaderCompileFlags()
+{
+	UINT compilerFlags = D3DCOMPILE_ENABLE_STRICTNESS;
+#if _DEBUG
+	compilerFlags |= D3DCOMPILE_DEBUG;
+#endif
+	return compilerFlags;
+}
+
+// Where each shader sits in GetShaderBuildList(), pixel shader permutations follow in order
+enum SHADER_LIST_SLOTS : unsigned
+{
+	SHADER_SLOT_VERTEX = 0,				// Full float H2B::VERTEX input
+	SHADER_SLOT_VERTEX_COMPACT = 1,		// QUANTIZED_VERTEX input (VertexQuantization.h)
+	SHADER_SLOT_DEPTH = 2,				// Depth prepass over the float position stream (VertexStreams.h)
+	SHADER_SLOT_DEPTH_COMPACT = 3,		// Depth prepass over the quantized position stream
+	SHADER_SLOT_FIRST_PIXEL = 4,
+};
+
+// Every shader binary the renderer loads
+inline std::vector<SHADER_BUILD_DESC> GetShaderBuildList(const std::string& _shaderFolder)
+{
+	std::vector<SHADER_BUILD_DESC> list;
+	list.push_back({ _shaderFolder + "/VertexShader.hlsl", "VertexShader", "vs_5_0", { { nullptr, nullptr } } });
+	list.push_back({ _shaderFolder + "/VertexShader.hlsl", "VertexShader_Compact", "vs_5_0",
+		{ { "COMPACT_VERTICES", "1" }, { nullptr, nullptr } } });
+	list.push_back({ _shaderFolder + "/DepthVertexShader.hlsl", "DepthVertexShader", "vs_5_0", { { nullptr, nullptr } } });
+	list.push_back({ _shaderFolder + "/DepthVertexShader.hlsl", "DepthVertexShader_Compact", "vs_5_0",
+		{ { "COMPACT_VERTICES", "1" }, { nullptr, nullptr } } });
+	for (unsigned permutation = 0; permutation < m_psPermutationCount; permutation++)
+	{
+		SHADER_DEFINE defines[5];
+		GetPixelShaderPermutationDefines(permutation, defines);
+		list.push_back({ _shaderFolder + "/PixelShader.hlsl", GetPixelShaderPermutationName(permutation),
+			"ps_5_0", std::vector<SHADER_DEFINE>(defines, defines + 5) });
+	}
+	return list;
+}
+
+class ShaderCache
+{
+	// On disk layout: header followed by bytecodeSize bytes of bytecode
+	struct CACHE_HEADER
+	{
+		char magic[4];
+		uint32_t bytecodeSize;
+		uint64_t key;
+	};
+
+	std::string m_cacheFolder;
+
+public:
+	ShaderCache(const std::string& _cacheFolder) : m_cacheFolder(_cacheFolder) {}
+
+	// Loads the bytecode for _desc from the cache, compiling it if the cache is missing or stale.
+	// _outFromCache tells which of the two happened, _outErrors holds compiler output on failure.
+	HRESULT GetBytecode(const SHADER_BUILD_DESC& _desc, Microsoft::WRL::ComPtr<ID3DBlob>& _outBlob,
+						std::string& _outErrors, bool& _outFromCache)
+	{
+		_outFromCache = false;
+		std::string source;
+		if (!ReadFile(_desc.sourcePath, source))
+		{
+			_outErrors = "Shader source not found: " + _desc.sourcePath;
+			return E_FAIL;
+		}
+
+		UINT flags = GetShaderCompileFlags();
+		uint64_t key = ComputeKey(source, _desc, flags);
+		std::string cachePath = GetCachePath(_desc, flags);
+		if (Load(cachePath, key, _outBlob))
+		{
+			_outFromCache = true;
+			return S_OK;
+		}
+
+		// Fallback, compile from source and refresh the cache for next time
+		std::vector<D3D_SHADER_MACRO> macros;
+		for (const SHADER_DEFINE& define : _desc.defines)
+			macros.push_back({ define.name, define.value });
+
+		Microsoft::WRL::ComPtr<ID3DBlob> errors;
+		HRESULT hr = D3DCompile(source.c_str(), source.length(), _desc.sourcePath.c_str(), macros.data(),
+			nullptr, "main", _desc.target.c_str(), flags, 0, _outBlob.ReleaseAndGetAddressOf(), errors.GetAddressOf());
+		if (FAILED(hr))
+		{
+			if (errors)
+				_outErrors.assign((const char*)errors->GetBufferPointer(), errors->GetBufferSize());
+			return hr;
+		}
+		Store(cachePath, key, _outBlob.Get());
+		return S_OK;
+	}
+
+	static uint64_t ComputeKey(const std::string& _source, const SHADER_BUILD_DESC& _desc, UINT _flags)
+	{
+		uint64_t key = HashBytes(_source.data(), _source.size());
+		key = HashString("main", key);
+		key = HashString(_desc.target.c_str(), key);
+		for (const SHADER_DEFINE& define : _desc.defines)
+		{
+			key = HashString(define.name, key);
+			key = HashString(define.value, key);
+		}
+		key = HashBytes(&_flags, sizeof(_flags), key);
+		unsigned compilerVersion = D3D_COMPILER_VERSION;
+		return HashBytes(&compilerVersion, sizeof(compilerVersion), key);
+	}
+
+private:
+	// Flags are part of the name so debug and release builds don't keep evicting each other
+	std::string GetCachePath(const SHADER_BUILD_DESC& _desc, UINT _flags) const
+	{
+		return m_cacheFolder + "/" + _desc.cacheName + "_" + std::to_string(_flags) + ".cso";
+	}
+
+	static bool ReadFile(const std::string& _path, std::string& _out)
+	{
+		std::ifstream file(_path, std::ios_base::in | std::ios_base::binary);
+		if (!file.is_open())
+			return false;
+		_out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	static bool Load(const std::string& _path, uint64_t _key, Microsoft::WRL::ComPtr<ID3DBlob>& _outBlob)
+	{
+		std::ifstream file(_path, std::ios_base::in | std::ios_base::binary);
+		if (!file.is_open())
+			return false;
+		CACHE_HEADER header;
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || std::memcmp(header.magic, "SHC1", 4) != 0 || header.key != _key || header.bytecodeSize == 0)
+			return false;
+		if (FAILED(D3DCreateBlob(header.bytecodeSize, _outBlob.ReleaseAndGetAddressOf())))
+			return false;
+		file.read(reinterpret_cast<char*>(_outBlob->GetBufferPointer()), header.bytecodeSize);
+		return (bool)file;
+	}
+
+	void Store(const std::string& _path, uint64_t _key, ID3DBlob* _blob) const
+	{
+		CreateDirectoryA(m_cacheFolder.c_str(), nullptr); // fine if it already exists
+		std::ofstream file(_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (!file.is_open())
+			return; // read only install, we'll just compile again next launch
+		CACHE_HEADER header = { { 'S', 'H', 'C', '1' }, (uint32_t)_blob->GetBufferSize(), _key };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(_blob->GetBufferPointer()), _blob->GetBufferSize());
+	}
+};
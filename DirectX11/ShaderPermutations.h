@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include "h2bParser.h"
+
+// Pixel shader permutations.
+// PixelShader.hlsl is split into optional features with #if switches. Every combination is
+// compiled up front and the renderer picks one per draw from the frame's light state and the
+// material's illumination model, so each pixel only runs the code it can actually use.
+// The same bit layout is mirrored in CMakeLists.txt where the variants are compiled offline.
+enum PS_PERMUTATION_BITS : unsigned
+{
+	PS_PERMUTATION_POINT_LIGHTS = 1 << 0,	// Frame has active point lights
+	PS_PERMUTATION_SPOT_LIGHTS = 1 << 1,	// Frame has active spot lights
+	PS_PERMUTATION_FLASHLIGHT = 1 << 2,		// Camera flashlight is switched on
+	PS_PERMUTATION_SPECULAR = 1 << 3,		// Material has highlights (illum >= 2)
+};
+const unsigned m_psPermutationCount = 16;
+// Bits that can differ between draws of the same frame
+const unsigned m_psMaterialPermutationMask = PS_PERMUTATION_SPECULAR;
+
+// Same layout as D3D_SHADER_MACRO, kept D3D free so offline tools can share it
+struct SHADER_DEFINE
+{
+	const char* name;
+	const char* value;
+};
+
+// Writes the #defines for a permutation into _outDefines (5 entries, null terminated)
+inline void GetPixelShaderPermutationDefines(unsigned _permutation, SHADER_DEFINE _outDefines[5])
+{
+	const char* names[] = { "PERMUTATION_POINT_LIGHTS", "PERMUTATION_SPOT_LIGHTS",
+							"PERMUTATION_FLASHLIGHT", "PERMUTATION_SPECULAR" };
+	for (unsigned i = 0; i < 4; i++)
+		_outDefines[i] = { names[i], (_permutation & (1u << i)) ? "1" : "0" };
+	_outDefines[4] = { nullptr, nullptr };
+}
+
+// File name suffix shared with the offline build step, ex. PixelShader_P11
+inline std::string GetPixelShaderPermutationName(unsigned _permutation)
+{
+	return "PixelShader_P" + std::to_string(_permutation);
+}
+
+// Per material part of the key. MTL illum 0/1 are color(+ambient) only, 2+ add highlights.
+inline unsigned GetMaterialPermutationBits(const H2B::ATTRIBUTES& _attrib)
+{
+	return _attrib.illum >= 2 ? PS_PERMUTATION_SPECULAR : 0u;
+}
+
+// Per frame part of the key
+inline unsigned GetFramePermutationBits(unsigned _activePointLights, unsigned _activeSpotLights, bool _flashlightOn)
+{
+	unsigned bits = 0;
+	if (_activePointLights > 0)
+		bits |= PS_PERMUTATION_POINT_LIGHTS;
+	if (_activeSpotLights > 0)
+		bits |= PS_PERMUTATION_SPOT_LIGHTS;
+	if (_flashlightOn)
+		bits |= PS_PERMUTATION_FLASHLIGHT;
+	return bits;
+}
@@ -0,0 +1,62 @@
+// depth only vertex shader, reads nothing but the split position stream (see VertexStreams.h)
+#pragma pack_matrix(row_major)
+
+// 1 = QUANTIZED_POSITION input, 0 = float3 positions. Must match the lit vertex shader
+#ifndef COMPACT_VERTICES
+#define COMPACT_VERTICES 0
+#endif
+
+cbuffer CB_PerObject : register(b0)
+{
+    float4x4 vMatrix;
+    float4x4 pMatrix;
+    float4 matIndex;
+    float4 quantOffset;
+    float4 quantScale;
+    float4 instanceRanges;  // x = drawn set's first transform, y = how many if dynamic (else 0), z = where they start in the ring
+};
+
+// Every level transform as loaded, 4 rows per matrix
+Buffer<float4> instanceTransforms : register(t0);
+// Copies of the dynamic transforms (DynamicTransforms.h), the current one replaces their loaded values
+Buffer<float4> dynamicTransforms : register(t1);
+
+struct VERTEX_In
+{
+#if COMPACT_VERTICES
+    float4 PosQ         :   POSITION;
+#else
+    float3 PosL         :   POSITION;
+#endif
+    uint InstanceId     :   INSTANCEID;
+};
+
+float4x4 LoadWorldMatrix(uint id)
+{
+    uint dynamicIndex = id - (uint)instanceRanges.x;
+    if (dynamicIndex < (uint)instanceRanges.y)
+    {
+        uint at = (dynamicIndex + (uint)instanceRanges.z) * 4;
+        return float4x4(dynamicTransforms[at + 0], dynamicTransforms[at + 1],
+                        dynamicTransforms[at + 2], dynamicTransforms[at + 3]);
+    }
+    return float4x4(instanceTransforms[id * 4 + 0], instanceTransforms[id * 4 + 1],
+                    instanceTransforms[id * 4 + 2], instanceTransforms[id * 4 + 3]);
+}
+
+// Same operations in the same order as VertexShader.hlsl, both are precise so the lit pass
+// reproduces these depths bit for bit and can test against them with LESS_EQUAL
+float4 main(VERTEX_In vIn) : SV_POSITION
+{
+    float4x4 wMatrix = LoadWorldMatrix(vIn.InstanceId);
+#if COMPACT_VERTICES
+    precise float3 posL = quantOffset.xyz + vIn.PosQ.xyz * quantScale.xyz;
+#else
+    precise float3 posL = vIn.PosL;
+#endif
+    precise float4 posH = float4(posL, 1.0f);
+    posH = mul(posH, wMatrix);
+    posH = mul(posH, vMatrix);
+    posH = mul(posH, pMatrix);
+    return posH;
+}
@@ -1,6 +1,21 @@
 // an ultra simple hlsl pixel shader
 #pragma pack_matrix(row_major)
 
+// Permutation switches (see ShaderPermutations.h). Left undefined this compiles the
+// full uber shader, the renderer compiles one specialized variant per combination.
+#ifndef PERMUTATION_POINT_LIGHTS
+#define PERMUTATION_POINT_LIGHTS 1
+#endif
+#ifndef PERMUTATION_SPOT_LIGHTS
+#define PERMUTATION_SPOT_LIGHTS 1
+#endif
+#ifndef PERMUTATION_FLASHLIGHT
+#define PERMUTATION_FLASHLIGHT 1
+#endif
+#ifndef PERMUTATION_SPECULAR
+#define PERMUTATION_SPECULAR 1
+#endif
+
 struct OBJ_ATTRIBUTES
 {
     float3 diffuseReflectivity;     // Diffuse color
@@ -12,7 +27,7 @@ struct OBJ_ATTRIBUTES
     float3 transmissionFilter;
     float opticalDensity;           // Index of refraction
     float3 emissiveReflectivity;
-    float illuminationModel;
+    uint illuminationModel;
 };
 
 // Needs to be 16 byte aligned
@@ -56,11 +71,14 @@ cbuffer CB_PerFrame : register(b1)
     SPOT_LIGHT spotLights[16];
     SPOT_LIGHT cameraFlashLight;
     bool flashlightPowerOn;
+    float4 numActiveLights; // x = point, y = spot. Output of the CPU light LOD stage
 };
 
+// One entry per unique level material, indexed by matIndex.x
+StructuredBuffer<OBJ_ATTRIBUTES> atts : register(t0);
+
 cbuffer CB_PerScene : register(b2)
 {
-    OBJ_ATTRIBUTES atts[40];
     float numPointLights;
     float numSpotLights;
     float pad1;
@@ -81,7 +99,7 @@ static float4x4 identity = float4x4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0,
 
 float4 main(VERTEX_In vIn) : SV_TARGET
 {
-    float4 surfaceColor = float4(atts[matIndex.x].diffuseReflectivity, 1.0f);
+    float4 surfaceColor = float4(atts[(uint)matIndex.x].diffuseReflectivity, 1.0f);
     
     // Ambient and directional light
     float4 ambient = ambientTerm * surfaceColor;
@@ -89,12 +107,13 @@ float4 main(VERTEX_In vIn) : SV_TARGET
                                 * directionalLightColor * surfaceColor;
     float4 color = directionalLight + ambient; // Return color if you dont want specular
     
-    if (numPointLights > 0)
+#if PERMUTATION_POINT_LIGHTS
+    if (numActiveLights.x > 0)
     {
         float4 pointLightColor = float4(0, 0, 0, 0);
        
         // For each point light in scene
-        for (int i = 0; i < numPointLights; i++)
+        for (int i = 0; i < numActiveLights.x; i++)
         {
             float3 lightWorldPos = pointLights[i].transform._41_42_43;
             
@@ -114,13 +133,15 @@ float4 main(VERTEX_In vIn) : SV_TARGET
         }
         
     }
+#endif
     
-    if (numSpotLights > 0)
+#if PERMUTATION_SPOT_LIGHTS
+    if (numActiveLights.y > 0)
     {
         float4 spotLightColor = float4(0, 0, 0, 0);
         
         // For each spot light in scene
-        for (int i = 0; i < numSpotLights; i++)
+        for (int i = 0; i < numActiveLights.y; i++)
         {
             float3 lightWorldPos = spotLights[i].transform._41_42_43;
             
@@ -145,7 +166,9 @@ float4 main(VERTEX_In vIn) : SV_TARGET
         }
             color += spotLightColor;
     }
+#endif
     
+#if PERMUTATION_FLASHLIGHT
     // If camera flashlight is on
     if(flashlightPowerOn)
     {
@@ -167,15 +190,21 @@ float4 main(VERTEX_In vIn) : SV_TARGET
         
         color += spotLightColor;
     }
+#endif
     
+#if PERMUTATION_SPECULAR
     // Specular
     float3 viewDir = normalize(vIn.PositionW_Cam - vIn.PositionW);
     float3 halfVec = normalize((-directionalLightDir) + viewDir);
     //float3 reflectVec = reflect(normalize(directionalLightDir), vIn.iNrm);
     float dotProduct = max(0.0f, dot(vIn.NormalW, halfVec));
-    float specIntensity = pow(saturate(dotProduct), atts[matIndex.x].specularExponent);
+    float specIntensity = pow(saturate(dotProduct), atts[(uint)matIndex.x].specularExponent);
     
     
     // Done
-    return color += (float4(atts[matIndex.x].specularReflectivity, 1.0f) * specIntensity);
+    return color += (float4(atts[(uint)matIndex.x].specularReflectivity, 1.0f) * specIntensity);
+#else
+    // Diffuse only material (illum 0/1)
+    return color;
+#endif
 }
\ No newline at end of file
@@ -1,21 +1,65 @@
 // an ultra simple hlsl vertex shader
 #pragma pack_matrix(row_major)
 
+// 1 = QUANTIZED_VERTEX input (see VertexQuantization.h), 0 = full float H2B::VERTEX
+#ifndef COMPACT_VERTICES
+#define COMPACT_VERTICES 0
+#endif
 
 cbuffer CB_PerObject : register(b0)
 {
     float4x4 vMatrix;
     float4x4 pMatrix;
     float4 matIndex;
+    float4 quantOffset;     // position = quantOffset + unorm * quantScale
+    float4 quantScale;
+    float4 instanceRanges;  // x = drawn set's first transform, y = how many if dynamic (else 0), z = where they start in the ring
 };
 
+// Every level transform as loaded, 4 rows per matrix
+Buffer<float4> instanceTransforms : register(t0);
+// Copies of the dynamic transforms (DynamicTransforms.h), the current one replaces their loaded values
+Buffer<float4> dynamicTransforms : register(t1);
+
+#if COMPACT_VERTICES
+struct VERTEX_In
+{
+    float4 PosQ         :   POSITION;     // R16G16B16A16_UNORM, relative to the mesh bounds
+    float2 UV           :   UVCOORD;      // R16G16_FLOAT
+    float2 NormalOct    :   NORMDIR;      // R16G16_SNORM, octahedral
+    uint InstanceId     :   INSTANCEID;   // Depth sorted index into instanceTransforms
+};
+
+// Same math as OctahedralDecode in VertexQuantization.h
+float3 DecodeOctahedral(float2 e)
+{
+    float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += (n.xy >= 0.0f) ? -t : t;
+    return normalize(n);
+}
+#else
 struct VERTEX_In
 {
 	float3 PosL		    :	POSITION;
 	float3 UV		    :	UVCOORD;
     float3 NormalL		:	NORMDIR;
-    float4x4 wMatrix    :   WORLD;
+    uint InstanceId     :   INSTANCEID;   // Depth sorted index into instanceTransforms
 };
+#endif
+
+float4x4 LoadWorldMatrix(uint id)
+{
+    uint dynamicIndex = id - (uint)instanceRanges.x;
+    if (dynamicIndex < (uint)instanceRanges.y)
+    {
+        uint at = (dynamicIndex + (uint)instanceRanges.z) * 4;
+        return float4x4(dynamicTransforms[at + 0], dynamicTransforms[at + 1],
+                        dynamicTransforms[at + 2], dynamicTransforms[at + 3]);
+    }
+    return float4x4(instanceTransforms[id * 4 + 0], instanceTransforms[id * 4 + 1],
+                    instanceTransforms[id * 4 + 2], instanceTransforms[id * 4 + 3]);
+}
 
 struct VERTEX_Out
 {
@@ -29,21 +73,33 @@ struct VERTEX_Out
 VERTEX_Out main(VERTEX_In vIn)
 {
 	VERTEX_Out vOut;
+    float4x4 wMatrix = LoadWorldMatrix(vIn.InstanceId);
+    // Position math is precise and mirrored in DepthVertexShader.hlsl so the depth prepass matches
+#if COMPACT_VERTICES
+    precise float3 posL = quantOffset.xyz + vIn.PosQ.xyz * quantScale.xyz;
+    float3 normalL = DecodeOctahedral(vIn.NormalOct);
+    float3 uv = float3(vIn.UV, 0.0f);
+#else
+    precise float3 posL = vIn.PosL;
+    float3 normalL = vIn.NormalL;
+    float3 uv = vIn.UV;
+#endif
     
     // Save world position (for lighting in PS)
-    vOut.PositionW = mul(float4(vIn.PosL, 1.0f), vIn.wMatrix).xyz;
+    vOut.PositionW = mul(float4(posL, 1.0f), wMatrix).xyz;
     // Save normal position in world space (for lighting in PS)
-    vOut.NormalW = normalize(mul(vIn.NormalL, (float3x3) vIn.wMatrix));
+    vOut.NormalW = normalize(mul(normalL, (float3x3) wMatrix));
     // Save camera position in world space (for lighting in PS)
     vOut.PositionW_Cam = -float3(vMatrix._m30, vMatrix._m31, vMatrix._m32);
-    vOut.UV = vIn.UV;
+    vOut.UV = uv;
 
-    vOut.PosH = float4(vIn.PosL, 1.0f);
+    precise float4 posH = float4(posL, 1.0f);
 	
 	// Put vertex in homogenous space
-    vOut.PosH = mul(vOut.PosH, vIn.wMatrix);
-    vOut.PosH = mul(vOut.PosH, vMatrix);
-    vOut.PosH = mul(vOut.PosH, pMatrix);
+    posH = mul(posH, wMatrix);
+    posH = mul(posH, vMatrix);
+    posH = mul(posH, pMatrix);
+    vOut.PosH = posH;
 	
     // Put vertex normal in world space
 	return vOut;
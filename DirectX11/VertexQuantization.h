@@ -0,0 +1,306 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include "GeometryDedup.h"
+
+// Compact vertex format, 16 bytes instead of the 36 of H2B::VERTEX.
+//   position: R16G16B16A16_UNORM relative to the bounds of the vertex block it belongs to
+//   uv:       R16G16_FLOAT (uvw.z is never used)
+//   normal:   R16G16_SNORM octahedral encoding
+// Index ranges whose indices all fit in 16 bits are copied into a separate 16 bit index list.
+// VertexShader.hlsl decodes this layout when compiled with COMPACT_VERTICES=1.
+
+// Worst decode error of each encoding, what QUANTIZATION_REPORT is checked against
+const float m_quantPositionErrorBound = 0.5f / 65535.0f;	// half a unorm16 step of the block's largest extent
+const float m_quantNormalErrorBoundDegrees = 0.004f;		// half a snorm16 step on both octahedral axes
+const float m_quantUVErrorBound = 1.0f / 2048.0f;			// half a half float ulp, relative to |uv|
+
+#pragma pack(push,1)
+struct QUANTIZED_VERTEX
+{
+	uint16_t pos[4];	// w unused, there is no 3 channel 16 bit format
+	uint16_t uv[2];		// half floats
+	int16_t nrm[2];		// octahedral
+};
+#pragma pack(pop)
+
+// Per mesh decode data, same size as levelMeshes
+struct QUANTIZED_RANGE
+{
+	float quantOffset[3];	// position = quantOffset + unorm * quantScale
+	float quantScale[3];
+	unsigned indexStart;	// Into the 16 or 32 bit list depending on is16Bit
+	unsigned indexCount;
+	unsigned baseVertex;	// Compact vertices keep the order of levelVertices
+	bool is16Bit;
+};
+
+// Worst error measured by decoding every converted vertex again on the CPU
+struct QUANTIZATION_REPORT
+{
+	float maxPositionError;		// Model space units
+	float maxPositionErrorRelative;	// Divided by the largest extent of the block
+	float maxNormalErrorDegrees;
+	float maxUVError;
+	float maxUVErrorRelative;	// Divided by |uv|, never by less than the smallest normal half
+	unsigned ranges16, ranges32;
+	unsigned long long bytesBefore, bytesAfter;	// Vertex + index buffers
+};
+
+inline uint16_t FloatToHalf(float _value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &_value, 4);
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if (((bits >> 23) & 0xFF) == 0xFF)	// inf/nan
+		return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31)					// too big, clamp to inf
+		return (uint16_t)(sign | 0x7C00);
+	if (exponent <= 0)					// denormal or zero
+	{
+		if (exponent < -10)
+			return (uint16_t)sign;
+		mantissa |= 0x800000;
+		uint32_t shift = (uint32_t)(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t midpoint = 1u << (shift - 1);
+		if (rest > midpoint || (rest == midpoint && (half & 1)))
+			half++;
+		return (uint16_t)(sign | half);
+	}
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;	// round to nearest even, may carry into the exponent which is still correct
+	return (uint16_t)half;
+}
+
+inline float HalfToFloat(uint16_t _half)
+{
+	uint32_t sign = (uint32_t)(_half & 0x8000) << 16;
+	uint32_t exponent = (_half >> 10) & 0x1F;
+	uint32_t mantissa = _half & 0x3FF;
+	uint32_t bits;
+	if (exponent == 0x1F)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else if (exponent != 0)
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	else if (mantissa == 0)
+		bits = sign;
+	else
+	{
+		// Denormal, renormalize
+		exponent = 127 - 15 + 1;
+		while ((mantissa & 0x400) == 0)
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	}
+	float value;
+	std::memcpy(&value, &bits, 4);
+	return value;
+}
+
+inline int16_t FloatToSnorm16(float _value)
+{
+	_value = (std::max)(-1.0f, (std::min)(1.0f, _value));
+	return (int16_t)std::lround(_value * 32767.0f);
+}
+
+inline float Snorm16ToFloat(int16_t _value)
+{
+	return (std::max)(-1.0f, _value / 32767.0f);
+}
+
+// Unit vector -> octahedral [-1,1]^2
+inline void OctahedralEncode(const H2B::VECTOR& _normal, int16_t _out[2])
+{
+	float sum = std::fabs(_normal.x) + std::fabs(_normal.y) + std::fabs(_normal.z);
+	if (sum == 0)
+	{
+		_out[0] = _out[1] = 0;
+		return;
+	}
+	float x = _normal.x / sum, y = _normal.y / sum;
+	if (_normal.z < 0)
+	{
+		float foldX = (1.0f - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+		float foldY = (1.0f - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+		x = foldX;
+		y = foldY;
+	}
+	_out[0] = FloatToSnorm16(x);
+	_out[1] = FloatToSnorm16(y);
+}
+
+// Same math as DecodeOctahedral in VertexShader.hlsl
+inline H2B::VECTOR OctahedralDecode(const int16_t _in[2])
+{
+	float x = Snorm16ToFloat(_in[0]), y = Snorm16ToFloat(_in[1]);
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	float t = (std::max)(-z, 0.0f);
+	x += x >= 0 ? -t : t;
+	y += y >= 0 ? -t : t;
+	float length = std::sqrt(x * x + y * y + z * z);
+	return { x / length, y / length, z / length };
+}
+
+// Converts the level geometry. _outVertices is 1:1 with _vertices. Every mesh range is
+// quantized against the bounds of the vertex block it draws from (baseVertex, vertexCount)
+// so ranges that share geometry also share identical compact data. With _append the output
+// already holds the conversion of a shorter _vertices/_indices: it is kept, _ranges only draw
+// from what was appended since and the report covers just that part.
+inline QUANTIZATION_REPORT QuantizeLevelGeometry(const std::vector<H2B::VERTEX>& _vertices,
+												 const std::vector<unsigned>& _indices,
+												 const std::vector<GEOMETRY_RANGE>& _ranges,
+												 std::vector<QUANTIZED_VERTEX>& _outVertices,
+												 std::vector<uint16_t>& _outIndices16,
+												 std::vector<unsigned>& _outIndices32,
+												 std::vector<QUANTIZED_RANGE>& _outRanges,
+												 bool _append = false)
+{
+	QUANTIZATION_REPORT report = {};
+	size_t firstVertex = _append ? _outVertices.size() : 0;
+	size_t first16 = _append ? _outIndices16.size() : 0, first32 = _append ? _outIndices32.size() : 0;
+	size_t sourceIndices = 0;
+	if (!_append)
+	{
+		_outVertices.clear();
+		_outIndices16.clear();
+		_outIndices32.clear();
+	}
+	_outVertices.resize(_vertices.size(), QUANTIZED_VERTEX());
+	_outRanges.clear();
+
+	// Vertex blocks are quantized once, ranges sharing one reuse it
+	std::unordered_map<uint64_t, size_t> blocks;			// (baseVertex, vertexCount) -> first range using it
+	std::unordered_map<unsigned, QUANTIZED_RANGE> converted;	// source indexStart -> converted range
+
+	for (const GEOMETRY_RANGE& range : _ranges)
+	{
+		unsigned vertexEnd = (unsigned)(std::min)((size_t)range.baseVertex + range.vertexCount, _vertices.size());
+		QUANTIZED_RANGE out = {};
+		uint64_t blockKey = ((uint64_t)range.baseVertex << 32) | range.vertexCount;
+		auto block = blocks.find(blockKey);
+		if (block != blocks.end())
+		{
+			const QUANTIZED_RANGE& first = _outRanges[block->second];
+			std::memcpy(out.quantOffset, first.quantOffset, sizeof(out.quantOffset));
+			std::memcpy(out.quantScale, first.quantScale, sizeof(out.quantScale));
+		}
+		else
+		{
+			float minP[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxP[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (unsigned v = range.baseVertex; v < vertexEnd; v++)
+			{
+				const float* p = &_vertices[v].pos.x;
+				for (int k = 0; k < 3; k++)
+				{
+					minP[k] = (std::min)(minP[k], p[k]);
+					maxP[k] = (std::max)(maxP[k], p[k]);
+				}
+			}
+			float largestExtent = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				if (minP[k] > maxP[k])
+					minP[k] = maxP[k] = 0; // empty block
+				out.quantOffset[k] = minP[k];
+				out.quantScale[k] = maxP[k] - minP[k];
+				largestExtent = (std::max)(largestExtent, out.quantScale[k]);
+			}
+
+			for (unsigned v = range.baseVertex; v < vertexEnd; v++)
+			{
+				const H2B::VERTEX& src = _vertices[v];
+				QUANTIZED_VERTEX& dst = _outVertices[v];
+				const float* p = &src.pos.x;
+				for (int k = 0; k < 3; k++)
+				{
+					double unorm = out.quantScale[k] > 0 ? ((double)p[k] - out.quantOffset[k]) / out.quantScale[k] : 0.0;
+					dst.pos[k] = (uint16_t)std::lround((std::max)(0.0, (std::min)(1.0, unorm)) * 65535.0);
+					float decoded = out.quantOffset[k] + (dst.pos[k] / 65535.0f) * out.quantScale[k];
+					float error = std::fabs(decoded - p[k]);
+					report.maxPositionError = (std::max)(report.maxPositionError, error);
+					if (largestExtent > 0)
+						report.maxPositionErrorRelative = (std::max)(report.maxPositionErrorRelative, error / largestExtent);
+				}
+				dst.pos[3] = 0;
+
+				dst.uv[0] = FloatToHalf(src.uvw.x);
+				dst.uv[1] = FloatToHalf(src.uvw.y);
+				for (int k = 0; k < 2; k++)
+				{
+					float uv = (&src.uvw.x)[k], error = std::fabs(HalfToFloat(dst.uv[k]) - uv);
+					report.maxUVError = (std::max)(report.maxUVError, error);
+					report.maxUVErrorRelative = (std::max)(report.maxUVErrorRelative, error / (std::max)(std::fabs(uv), 6.103515625e-05f));
+				}
+
+				OctahedralEncode(src.nrm, dst.nrm);
+				float length = std::sqrt(src.nrm.x * src.nrm.x + src.nrm.y * src.nrm.y + src.nrm.z * src.nrm.z);
+				if (length > 0)
+				{
+					// atan2 of |cross| and dot in double, acos of a float dot can't resolve angles this small
+					H2B::VECTOR n = OctahedralDecode(dst.nrm);
+					double cx = (double)n.y * src.nrm.z - (double)n.z * src.nrm.y;
+					double cy = (double)n.z * src.nrm.x - (double)n.x * src.nrm.z;
+					double cz = (double)n.x * src.nrm.y - (double)n.y * src.nrm.x;
+					double dot = (double)n.x * src.nrm.x + (double)n.y * src.nrm.y + (double)n.z * src.nrm.z;
+					float degrees = (float)(std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot) * 57.29577951308232);
+					report.maxNormalErrorDegrees = (std::max)(report.maxNormalErrorDegrees, degrees);
+				}
+			}
+			blocks[blockKey] = _outRanges.size();
+		}
+
+		// Indices, shared ranges point at the same converted copy
+		auto done = converted.find(range.indexStart);
+		if (done != converted.end() && done->second.indexCount == range.indexCount)
+		{
+			out.indexStart = done->second.indexStart;
+			out.is16Bit = done->second.is16Bit;
+		}
+		else
+		{
+			unsigned indexEnd = (unsigned)(std::min)((size_t)range.indexStart + range.indexCount, _indices.size());
+			unsigned maxIndex = 0;
+			for (unsigned i = range.indexStart; i < indexEnd; i++)
+				maxIndex = (std::max)(maxIndex, _indices[i]);
+			out.is16Bit = maxIndex <= 0xFFFF;
+			if (out.is16Bit)
+			{
+				out.indexStart = (unsigned)_outIndices16.size();
+				for (unsigned i = range.indexStart; i < indexEnd; i++)
+					_outIndices16.push_back((uint16_t)_indices[i]);
+				report.ranges16++;
+			}
+			else
+			{
+				out.indexStart = (unsigned)_outIndices32.size();
+				_outIndices32.insert(_outIndices32.end(), _indices.begin() + range.indexStart, _indices.begin() + indexEnd);
+				report.ranges32++;
+			}
+			out.indexCount = indexEnd - range.indexStart;
+			converted[range.indexStart] = out;
+			sourceIndices += out.indexCount;
+		}
+		out.indexCount = range.indexCount;
+		out.baseVertex = range.baseVertex;
+		_outRanges.push_back(out);
+	}
+	report.bytesBefore = (_vertices.size() - firstVertex) * sizeof(H2B::VERTEX) +
+		(_append ? sourceIndices : _indices.size()) * sizeof(unsigned);
+	report.bytesAfter = (_outVertices.size() - firstVertex) * sizeof(QUANTIZED_VERTEX) +
+		(_outIndices16.size() - first16) * sizeof(uint16_t) + (_outIndices32.size() - first32) * sizeof(unsigned);
+	return report;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <emmintrin.h>
+#include "VertexQuantization.h"
+
+// Split (SoA) vertex streams.
+// Passes that only need positions (depth prepass, occluders, picking) bind a tightly packed
+// position stream instead of striding over whole interleaved vertices: 12 bytes per vertex
+// instead of 36 (8 instead of 16 with the compact format). The remaining attributes go into
+// their own stream. Every stream stays 1:1 with levelVertices so all index ranges still apply.
+
+struct VERTEX_ATTRIBUTES
+{
+	float u, v;				// uvw.z is never used
+	float nx, ny, nz;
+};
+
+// Position half of QUANTIZED_VERTEX (R16G16B16A16_UNORM)
+struct QUANTIZED_POSITION
+{
+	uint16_t pos[4];
+};
+
+// AoS -> SoA copy. A plain loop: the compiler keeps it at memory speed and an SSE transpose
+// measured no faster on a million vertices
+inline void SplitVertexStreams(const H2B::VERTEX* _vertices, size_t _count,
+							   H2B::VECTOR* _outPositions, VERTEX_ATTRIBUTES* _outAttributes)
+{
+	for (size_t i = 0; i < _count; i++)
+	{
+		_outPositions[i] = _vertices[i].pos;
+		_outAttributes[i] = { _vertices[i].uvw.x, _vertices[i].uvw.y,
+							  _vertices[i].nrm.x, _vertices[i].nrm.y, _vertices[i].nrm.z };
+	}
+}
+
+// Pulls the 8 byte positions out of 16 byte compact vertices, two vertices per SSE op
+inline void ExtractQuantizedPositions(const QUANTIZED_VERTEX* _vertices, size_t _count, QUANTIZED_POSITION* _outPositions)
+{
+	static_assert(sizeof(QUANTIZED_VERTEX) == 16 && sizeof(QUANTIZED_POSITION) == 8, "layout changed");
+	size_t i = 0;
+	for (; i + 2 <= _count; i += 2)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_vertices + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_vertices + i + 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(_outPositions + i), _mm_unpacklo_epi64(a, b));
+	}
+	for (; i < _count; i++)
+		std::memcpy(_outPositions[i].pos, _vertices[i].pos, sizeof(QUANTIZED_POSITION));
+}
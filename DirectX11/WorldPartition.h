@@ -0,0 +1,431 @@
+#pragma once
+#include <cmath>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <condition_variable>
+
+// World partition.
+// A partitioned level is cut into square cells on the XZ plane and each cell's payload (its
+// instances, its lights and the geometry of the models it places) is loaded on a background
+// thread only while the camera is near it.
+// Cells within m_partitionLoadRadius of the camera, or on the path its velocity takes it along
+// in the next m_partitionPrefetchSeconds, are wanted. Wanted cells load in the order the camera
+// can reach them: on the path by when it enters them, then the rest by distance. When
+// resident payloads would pass m_partitionBudgetBytes the cells wanted longest ago are evicted.
+// Only what is resident gets drawn. What a resident cell brings lives in fixed size pools
+// handed out by RangePool, so a partitioned level never holds more than they do.
+
+const float m_partitionCellSize = 32.0f;				// world units per cell side
+const float m_partitionLoadRadius = 96.0f;				// cells closer than this to the camera are wanted
+const float m_partitionPrefetchSeconds = 1.5f;			// look ahead along the camera's velocity
+const size_t m_partitionBudgetBytes = 8u << 20;			// resident payloads, wanted cells are never evicted
+const unsigned m_partitionMaxLoads = 4;					// cell loads queued at once
+const float m_partitionPoolSlack = 1.25f;				// pools hold this much more than the budget's share of their array
+
+struct PARTITION_CELL
+{
+	int x, z;							// grid coordinates, the cell covers [x, x + 1) * m_partitionCellSize
+	unsigned itemStart, itemCount;		// into WorldGrid::Items()
+};
+
+// Items (anything with a position) bucketed into cells, cells sorted by (x, z)
+class WorldGrid
+{
+	float m_cellSize = m_partitionCellSize;
+	std::vector<PARTITION_CELL> m_cells;
+	std::vector<unsigned> m_items;
+	std::unordered_map<uint64_t, unsigned> m_cellAt;
+
+	static uint64_t Key(int _x, int _z) { return ((uint64_t)(uint32_t)_x << 32) | (uint32_t)_z; }
+
+public:
+	// _positions holds xyz per item
+	void Build(const float* _positions, size_t _count, float _cellSize)
+	{
+		Clear();
+		m_cellSize = _cellSize;
+		std::vector<std::pair<uint64_t, unsigned>> keyed(_count);
+		for (size_t i = 0; i < _count; i++)
+		{
+			int x = (int)std::floor(_positions[i * 3] / _cellSize), z = (int)std::floor(_positions[i * 3 + 2] / _cellSize);
+			keyed[i] = { Key(x, z) ^ 0x8000000080000000ull, (unsigned)i }; // sign flipped so negative coordinates sort first
+		}
+		std::sort(keyed.begin(), keyed.end());
+		for (size_t i = 0; i < keyed.size(); i++)
+		{
+			uint64_t key = keyed[i].first ^ 0x8000000080000000ull;
+			if (m_cells.empty() || Key(m_cells.back().x, m_cells.back().z) != key)
+			{
+				m_cellAt[key] = (unsigned)m_cells.size();
+				m_cells.push_back({ (int)(int32_t)(key >> 32), (int)(int32_t)(uint32_t)key, (unsigned)i, 0 });
+			}
+			m_cells.back().itemCount++;
+			m_items.push_back(keyed[i].second);
+		}
+	}
+
+	// Cells without items, ex. read back from a partition manifest, sorted by (x, z) like Build leaves them
+	void Assign(const PARTITION_CELL* _cells, size_t _count, float _cellSize)
+	{
+		Clear();
+		m_cellSize = _cellSize;
+		m_cells.assign(_cells, _cells + _count);
+		for (unsigned c = 0; c < m_cells.size(); c++)
+		{
+			m_cells[c].itemStart = m_cells[c].itemCount = 0;
+			m_cellAt[Key(m_cells[c].x, m_cells[c].z)] = c;
+		}
+	}
+
+	void Clear()
+	{
+		m_cells.clear();
+		m_items.clear();
+		m_cellAt.clear();
+	}
+
+	float CellSize() const { return m_cellSize; }
+	unsigned CellCount() const { return (unsigned)m_cells.size(); }
+	const PARTITION_CELL& Cell(unsigned _cell) const { return m_cells[_cell]; }
+	const unsigned* Items(unsigned _cell) const { return m_items.data() + m_cells[_cell].itemStart; }
+	// ~0u when nothing lies in that cell
+	unsigned CellAt(int _x, int _z) const
+	{
+		auto found = m_cellAt.find(Key(_x, _z));
+		return found == m_cellAt.end() ? ~0u : found->second;
+	}
+	// closest distance on XZ from a point to the cell's square
+	float Distance(unsigned _cell, float _x, float _z) const
+	{
+		const PARTITION_CELL& cell = m_cells[_cell];
+		float dx = (std::max)((std::max)(cell.x * m_cellSize - _x, _x - (cell.x + 1) * m_cellSize), 0.0f);
+		float dz = (std::max)((std::max)(cell.z * m_cellSize - _z, _z - (cell.z + 1) * m_cellSize), 0.0f);
+		return std::sqrt(dx * dx + dz * dz);
+	}
+};
+
+// Decides which cells of a WorldGrid are resident and loads them on one worker thread. The load
+// function runs on that thread and must only touch data it owns or that never changes
+class CellStreamer
+{
+public:
+	typedef std::function<void(unsigned _cell, std::vector<unsigned char>& _outPayload)> LOAD_FUNCTION;
+	struct LOADED_CELL
+	{
+		unsigned cell;
+		std::vector<unsigned char> payload;
+	};
+	enum CELL_STATE : uint8_t { CELL_UNLOADED, CELL_LOADING, CELL_RESIDENT };
+
+private:
+	const WorldGrid* m_grid = nullptr;
+	std::vector<size_t> m_cellBytes;
+	LOAD_FUNCTION m_load;
+	size_t m_budget = m_partitionBudgetBytes;
+	std::vector<CELL_STATE> m_state;
+	std::vector<uint64_t> m_lastWanted;		// frame each cell was last wanted, the LRU order
+	uint64_t m_frame = 0;
+	size_t m_residentBytes = 0, m_loadingBytes = 0;
+	unsigned m_loading = 0;
+	std::vector<unsigned> m_evicted;
+	std::vector<LOADED_CELL> m_loaded;
+	std::vector<std::pair<float, unsigned>> m_candidates;
+	// shared with the worker
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_wake, m_done;
+	std::deque<unsigned> m_queue;
+	std::vector<LOADED_CELL> m_finished;
+	bool m_stop = false;
+
+public:
+	~CellStreamer() { Stop(); }
+
+	// _cellBytes is each cell's payload size, what counts against _budget
+	void Start(const WorldGrid* _grid, const std::vector<size_t>& _cellBytes, LOAD_FUNCTION _load, size_t _budget)
+	{
+		Stop();
+		m_grid = _grid;
+		m_cellBytes = _cellBytes;
+		m_load = _load;
+		m_budget = _budget;
+		m_state.assign(_grid->CellCount(), CELL_UNLOADED);
+		m_lastWanted.assign(_grid->CellCount(), 0);
+		m_frame = 0;
+		m_residentBytes = m_loadingBytes = 0;
+		m_loading = 0;
+		m_stop = false;
+		m_worker = std::thread([this] { Work(); });
+	}
+
+	// Joins the worker, every cell is unloaded afterwards
+	void Stop()
+	{
+		if (m_worker.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_wake.notify_all();
+			m_worker.join();
+		}
+		m_queue.clear();
+		m_finished.clear();
+		m_loaded.clear();
+		m_evicted.clear();
+		m_state.clear();
+		m_grid = nullptr;
+	}
+
+	bool IsRunning() const { return m_grid != nullptr; }
+	CELL_STATE State(unsigned _cell) const { return m_state[_cell]; }
+	size_t ResidentBytes() const { return m_residentBytes; }
+	unsigned LoadsInFlight() const { return m_loading; }
+
+	// Once per frame. Collects finished loads (TakeLoaded), evicts over budget (Evicted) and queues
+	// the nearest wanted cells. _wait blocks until every cell around _eye is resident
+	void Update(const float _eye[3], const float _velocity[3], bool _wait)
+	{
+		m_evicted.clear();
+		if (!m_grid)
+			return;
+		m_frame++;
+		const float still[3] = { 0, 0, 0 };
+		const float* velocity = _wait ? still : _velocity;
+		do
+		{
+			Collect(false);
+			m_candidates.clear();
+			Want(_eye, velocity);
+			WantPath(_eye, velocity);
+			std::sort(m_candidates.begin(), m_candidates.end());
+			unsigned limit = _wait ? ~0u : m_partitionMaxLoads;
+			for (const auto& candidate : m_candidates)
+			{
+				if (m_loading >= limit)
+					break;
+				unsigned cell = candidate.second;
+				if (m_state[cell] != CELL_UNLOADED || !MakeRoom(m_cellBytes[cell]))
+					continue;
+				m_state[cell] = CELL_LOADING;
+				m_loading++;
+				m_loadingBytes += m_cellBytes[cell];
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.push_back(cell);
+			}
+			m_wake.notify_one();
+			if (_wait && m_loading > 0)
+				Collect(true);
+		} while (_wait && m_loading > 0);
+	}
+
+	// cells that became resident since the last call, their payloads are the caller's
+	std::vector<LOADED_CELL>& TakeLoaded() { return m_loaded; }
+	// cells evicted by the last Update (and EvictOldest since)
+	const std::vector<unsigned>& Evicted() const { return m_evicted; }
+
+	// evicts the resident cell wanted longest ago that isn't wanted this frame and returns it, ~0u
+	// when there is none. For when something other than the budget runs out (ex. a pool)
+	unsigned EvictOldest()
+	{
+		unsigned oldest = ~0u;
+		for (unsigned cell = 0; cell < m_state.size(); cell++)
+			if (m_state[cell] == CELL_RESIDENT && m_lastWanted[cell] < m_frame &&
+				(oldest == ~0u || m_lastWanted[cell] < m_lastWanted[oldest]))
+				oldest = cell;
+		if (oldest == ~0u)
+			return ~0u;
+		m_state[oldest] = CELL_UNLOADED;
+		m_residentBytes -= m_cellBytes[oldest];
+		m_evicted.push_back(oldest);
+		return oldest;
+	}
+
+private:
+	// seconds until the camera at _eye moving at _velocity is over the cell: when it enters the cell
+	// if its path crosses it within m_partitionPrefetchSeconds, otherwise as if it turned towards it
+	// once the path is covered. A still camera ranks by distance alone
+	float TimeToReach(unsigned _cell, const float _eye[3], const float _velocity[3]) const
+	{
+		float distance = m_grid->Distance(_cell, _eye[0], _eye[2]);
+		float speed = std::sqrt(_velocity[0] * _velocity[0] + _velocity[2] * _velocity[2]);
+		if (speed <= 0.0f)
+			return distance;
+		// slab test of the path against the cell's square on XZ
+		const PARTITION_CELL& cell = m_grid->Cell(_cell);
+		float size = m_grid->CellSize(), enter = 0.0f, exit = m_partitionPrefetchSeconds;
+		const int axes[2] = { 0, 2 };
+		const int lows[2] = { cell.x, cell.z };
+		for (int a = 0; a < 2; a++)
+		{
+			float low = lows[a] * size, high = low + size, p = _eye[axes[a]], v = _velocity[axes[a]];
+			if (v == 0.0f)
+			{
+				if (p < low || p >= high)
+					exit = -1.0f;
+				continue;
+			}
+			float t0 = (low - p) / v, t1 = (high - p) / v;
+			enter = (std::max)(enter, (std::min)(t0, t1));
+			exit = (std::min)(exit, (std::max)(t0, t1));
+		}
+		return enter <= exit ? enter : m_partitionPrefetchSeconds + distance / speed;
+	}
+
+	void WantCell(unsigned _cell, const float _eye[3], const float _velocity[3])
+	{
+		if (m_lastWanted[_cell] == m_frame)
+			return;
+		m_lastWanted[_cell] = m_frame;
+		if (m_state[_cell] == CELL_UNLOADED)
+			m_candidates.push_back({ TimeToReach(_cell, _eye, _velocity), _cell });
+	}
+
+	// marks every cell within the load radius of _eye wanted, unloaded ones become candidates
+	void Want(const float _eye[3], const float _velocity[3])
+	{
+		float size = m_grid->CellSize();
+		int x0 = (int)std::floor((_eye[0] - m_partitionLoadRadius) / size), x1 = (int)std::floor((_eye[0] + m_partitionLoadRadius) / size);
+		int z0 = (int)std::floor((_eye[2] - m_partitionLoadRadius) / size), z1 = (int)std::floor((_eye[2] + m_partitionLoadRadius) / size);
+		for (int x = x0; x <= x1; x++)
+			for (int z = z0; z <= z1; z++)
+			{
+				unsigned cell = m_grid->CellAt(x, z);
+				if (cell != ~0u && m_grid->Distance(cell, _eye[0], _eye[2]) <= m_partitionLoadRadius)
+					WantCell(cell, _eye, _velocity);
+			}
+	}
+
+	// marks the cells the camera crosses in the next m_partitionPrefetchSeconds wanted, sampled
+	// a quarter cell apart so no crossed cell is skipped
+	void WantPath(const float _eye[3], const float _velocity[3])
+	{
+		float size = m_grid->CellSize();
+		float length = std::sqrt(_velocity[0] * _velocity[0] + _velocity[2] * _velocity[2]) * m_partitionPrefetchSeconds;
+		unsigned steps = (unsigned)(std::min)(std::ceil(length / (size * 0.25f)), 4096.0f);
+		for (unsigned i = 1; i <= steps; i++)
+		{
+			float t = m_partitionPrefetchSeconds * i / steps;
+			unsigned cell = m_grid->CellAt((int)std::floor((_eye[0] + _velocity[0] * t) / size),
+				(int)std::floor((_eye[2] + _velocity[2] * t) / size));
+			if (cell != ~0u)
+				WantCell(cell, _eye, _velocity);
+		}
+	}
+
+	// evicts resident cells not wanted this frame, least recently wanted first, until _bytes fit
+	bool MakeRoom(size_t _bytes)
+	{
+		while (m_residentBytes + m_loadingBytes + _bytes > m_budget)
+			if (EvictOldest() == ~0u)
+				return false;
+		return true;
+	}
+
+	// moves finished loads over, _block waits for all loads in flight
+	void Collect(bool _block)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (_block)
+			m_done.wait(lock, [this] { return m_finished.size() >= m_loading; });
+		for (LOADED_CELL& loaded : m_finished)
+		{
+			m_state[loaded.cell] = CELL_RESIDENT;
+			m_residentBytes += m_cellBytes[loaded.cell];
+			m_loadingBytes -= m_cellBytes[loaded.cell];
+			m_loading--;
+			m_loaded.push_back(std::move(loaded));
+		}
+		m_finished.clear();
+	}
+
+	void Work()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_stop)
+				return;
+			LOADED_CELL loaded = { m_queue.front(), {} };
+			m_queue.pop_front();
+			lock.unlock();
+			m_load(loaded.cell, loaded.payload);
+			lock.lock();
+			m_finished.push_back(std::move(loaded));
+			m_done.notify_all();
+		}
+	}
+};
+
+// First fit allocator over a fixed size array, [0, capacity). Freed ranges merge with their free
+// neighbours so a pool that empties out is one range again
+class RangePool
+{
+	std::map<unsigned, unsigned> m_free;	// first -> count, never adjacent
+	unsigned m_capacity = 0, m_used = 0;
+
+public:
+	void Reset(unsigned _capacity)
+	{
+		m_free.clear();
+		m_capacity = _capacity;
+		m_used = 0;
+		if (_capacity > 0)
+			m_free.emplace(0, _capacity);
+	}
+
+	unsigned Capacity() const { return m_capacity; }
+	unsigned Used() const { return m_used; }
+
+	// first element of _count free ones, ~0u when no free range is long enough. Empty ranges start at 0
+	unsigned Allocate(unsigned _count)
+	{
+		if (_count == 0)
+			return 0;
+		for (auto range = m_free.begin(); range != m_free.end(); ++range)
+		{
+			if (range->second < _count)
+				continue;
+			unsigned first = range->first, left = range->second - _count;
+			m_free.erase(range);
+			if (left > 0)
+				m_free.emplace(first + _count, left);
+			m_used += _count;
+			return first;
+		}
+		return ~0u;
+	}
+
+	void Free(unsigned _first, unsigned _count)
+	{
+		if (_count == 0)
+			return;
+		m_used -= _count;
+		auto next = m_free.lower_bound(_first);
+		if (next != m_free.begin())
+		{
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == _first)
+			{
+				_first = previous->first;
+				_count += previous->second;
+				m_free.erase(previous);
+			}
+		}
+		if (next != m_free.end() && _first + _count == next->first)
+		{
+			_count += next->second;
+			m_free.erase(next);
+		}
+		m_free.emplace(_first, _count);
+	}
+};
@@ -3,6 +3,8 @@
 #include <fstream>
 #include <vector>
 #include <set>
+#include <string>
+#include <cstring>
 
 namespace H2B {
 
@@ -61,48 +63,82 @@ namespace H2B {
 		{
 			Clear();
 			std::ifstream file;
-			char buffer[260] = { 0, };
 			file.open(h2bPath,	std::ios_base::in | 
-								std::ios_base::binary);
+								std::ios_base::binary |
+								std::ios_base::ate);
 			if (file.is_open() == false)
 				return false;
-			file.read(version, 4);
+			// one sized read, then the same parse as a packed model
+			std::vector<char> bytes((size_t)file.tellg());
+			file.seekg(0);
+			file.read(bytes.data(), bytes.size());
+			if (!file)
+				return false;
+			return Parse(bytes.data(), bytes.size());
+		}
+		// parses a whole .h2b already in memory (a mapped pack entry for instance),
+		// false if it is truncated or not a supported version
+		bool Parse(const void* h2bData, size_t size)
+		{
+			Clear();
+			const char* read = static_cast<const char*>(h2bData);
+			const char* end = read + size;
+			auto copy = [&](void* out, size_t bytes) {
+				if ((size_t)(end - read) < bytes)
+					return false;
+				std::memcpy(out, read, bytes);
+				read += bytes;
+				return true;
+			};
+			// null terminated, empty strings become nullptr
+			auto string = [&](const char*& out) {
+				const char* terminator = static_cast<const char*>(std::memchr(read, '\0', end - read));
+				if (terminator == nullptr)
+					return false;
+				out = terminator == read ? nullptr : file_strings.insert(std::string(read, terminator)).first->c_str();
+				read = terminator + 1;
+				return true;
+			};
+			if (!copy(version, 4))
+				return false;
 			if (version[1] < '1' || version[2] < '9' || version[3] < 'd')
 				return false;
-			file.read(reinterpret_cast<char*>(&vertexCount), 4);
-			file.read(reinterpret_cast<char*>(&indexCount), 4);
-			file.read(reinterpret_cast<char*>(&materialCount), 4);
-			file.read(reinterpret_cast<char*>(&meshCount), 4);
+			if (!copy(&vertexCount, 4) || !copy(&indexCount, 4) || !copy(&materialCount, 4) || !copy(&meshCount, 4))
+				return false;
+			// every array is checked against the bytes left before it is sized from a header count,
+			// so a damaged header fails here instead of allocating whatever it claims
+			auto fits = [&](unsigned long long count, unsigned long long stride) {
+				return count * stride <= (unsigned long long)(end - read);
+			};
+			if (!fits(vertexCount, 36))
+				return false;
 			vertices.resize(vertexCount);
-			file.read(reinterpret_cast<char*>(vertices.data()), 36 * vertexCount);
+			if (!copy(vertices.data(), 36ull * vertexCount) || !fits(indexCount, 4))
+				return false;
 			indices.resize(indexCount);
-			file.read(reinterpret_cast<char*>(indices.data()), 4 * indexCount);
+			if (!copy(indices.data(), 4ull * indexCount))
+				return false;
+			// a material is at least its attributes, 10 empty strings and its batch
+			if (!fits(materialCount, 80 + 10 + 8))
+				return false;
 			materials.resize(materialCount);
 			for (int i = 0; i < materialCount; ++i) {
-				file.read(reinterpret_cast<char*>(&materials[i].attrib), 80);
-				for (int j = 0; j < 10; ++j) {
-					buffer[0] = '\0';
-					*((&materials[i].name) + j) = nullptr;
-					file.getline(buffer, 260, '\0');
-					if (buffer[0] != '\0') {
-						auto last = file_strings.insert(buffer);
-						*((&materials[i].name) + j) = last.first->c_str();
-					}
-				}
+				if (!copy(&materials[i].attrib, 80))
+					return false;
+				for (int j = 0; j < 10; ++j)
+					if (!string(*((&materials[i].name) + j)))
+						return false;
 			}
 			batches.resize(materialCount);
-			file.read(reinterpret_cast<char*>(batches.data()), 8 * materialCount);
+			if (!copy(batches.data(), 8ull * materialCount))
+				return false;
+			// a mesh is at least an empty name, its batch and material index
+			if (!fits(meshCount, 1 + 8 + 4))
+				return false;
 			meshes.resize(meshCount);
 			for (int i = 0; i < meshCount; ++i) {
-				buffer[0] = '\0';
-				meshes[i].name = nullptr;
-				file.getline(buffer, 260, '\0');
-				if (buffer[0] != '\0') {
-					auto last = file_strings.insert(buffer);
-					meshes[i].name = last.first->c_str();
-				}
-				file.read(reinterpret_cast<char*>(&meshes[i].drawInfo), 8);
-				file.read(reinterpret_cast<char*>(&meshes[i].materialIndex), 4);
+				if (!string(meshes[i].name) || !copy(&meshes[i].drawInfo, 8) || !copy(&meshes[i].materialIndex, 4))
+					return false;
 			}
 			return true;
 		}
@@ -117,5 +153,58 @@ namespace H2B {
 			meshes.clear();
 		}
 	};
+	// writes the layout Parser reads, so Parse -> Write gives back the same bytes. Counts come
+	// from the arrays, not the count members, so edited geometry writes as it is
+	class Writer
+	{
+	public:
+		static void Serialize(const Parser& parsed, std::vector<char>& out)
+		{
+			out.clear();
+			auto write = [&](const void* data, size_t bytes) {
+				out.insert(out.end(), static_cast<const char*>(data), static_cast<const char*>(data) + bytes);
+			};
+			// nullptr writes as an empty string like Parse reads it
+			auto string = [&](const char* str) {
+				if (str != nullptr)
+					write(str, std::strlen(str));
+				out.push_back('\0');
+			};
+			unsigned counts[4] = { (unsigned)parsed.vertices.size(), (unsigned)parsed.indices.size(),
+				(unsigned)parsed.materials.size(), (unsigned)parsed.meshes.size() };
+			write(parsed.version, 4);
+			write(counts, sizeof(counts));
+			write(parsed.vertices.data(), 36 * parsed.vertices.size());
+			write(parsed.indices.data(), 4 * parsed.indices.size());
+			for (const MATERIAL& material : parsed.materials) {
+				write(&material.attrib, 80);
+				for (int j = 0; j < 10; ++j)
+					string(*((&material.name) + j));
+			}
+			// one batch per material, missing ones write as empty
+			for (size_t i = 0; i < parsed.materials.size(); ++i) {
+				BATCH batch = i < parsed.batches.size() ? parsed.batches[i] : BATCH{ 0, 0 };
+				write(&batch, 8);
+			}
+			for (const MESH& mesh : parsed.meshes) {
+				string(mesh.name);
+				write(&mesh.drawInfo, 8);
+				write(&mesh.materialIndex, 4);
+			}
+		}
+		static bool Write(const char* h2bPath, const Parser& parsed)
+		{
+			std::vector<char> bytes;
+			Serialize(parsed, bytes);
+			std::ofstream file;
+			file.open(h2bPath,	std::ios_base::out |
+								std::ios_base::binary |
+								std::ios_base::trunc);
+			if (file.is_open() == false)
+				return false;
+			file.write(bytes.data(), bytes.size());
+			return (bool)file;
+		}
+	};
 }
 #endif
\ No newline at end of file
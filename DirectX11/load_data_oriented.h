@@ -1,32 +1,88 @@
 // This is a sample of how to load a level in a data oriented fashion.
 // Feel free to use this code as a base and tweak it for your needs.
 #include "MyDefines.h"
+#include "Hashing.h"
+#include "MeshOptimizer.h"
+#include "GeometryDedup.h"
+#include "VertexQuantization.h"
+#include "VertexStreams.h"
+#include "Meshlets.h"
+#include "LevelOfDetail.h"
+#include "HLOD.h"
+#include "Bounds.h"
+#include "MaterialBatches.h"
+#include "LevelBakeCache.h"
+#include "BinaryLevel.h"
+#include "SceneHierarchy.h"
+#include "DynamicTransforms.h"
+#include "InstanceFreeList.h"
+#include "LevelDelta.h"
+#include "WorldPartition.h"
+#include <unordered_map>
+#include <chrono>
 
 
 class Level_Data {
 
 	// transfered from parser
 	std::set<std::string> level_strings;
+	// material content hash -> levelMaterials slots with that hash (for load time dedup)
+	std::unordered_map<uint64_t, std::vector<unsigned>> materialLookup;
+	// mesh geometry content -> shared vertex/index ranges (for load time dedup)
+	GeometryPool geometryPool;
+	// mapped bake of the current level when it was loaded warm, its string table backs the
+	// name pointers in levelMaterials/levelMeshes/levelMeshParts/levelModels
+	LevelBakeReader levelBake;
+	// parents of the binary level's transforms in file order while importing
+	std::vector<int> levelFileParents;
+	// scratch for UpdateHierarchy
+	std::vector<TRANSFORM_RANGE> hierarchyRanges;
+	// m_worldPartition: loads the level's cell files (WriteWorldPartition) around the camera, and the
+	// lights of the resident cells (levelPointLights/levelSpotLights are rebuilt from these)
+	CellStreamer levelStreamer;
+	std::vector<std::vector<POINT_LIGHT>> levelCellPointLights;
+	std::vector<std::vector<SPOT_LIGHT>> levelCellSpotLights;
 public:
 	struct LEVEL_MODEL // one model in the level
 	{
 		const char* filename; // .h2b file data was pulled from
 		unsigned vertexCount, indexCount, materialCount, meshCount;
+		// vertexStart/indexStart is where this model's new geometry was appended, meshes can
+		// also point at ranges added by earlier models, see levelMeshRanges
 		unsigned vertexStart, indexStart, materialStart, meshStart, batchStart;
+		unsigned partStart, partCount; // the model's original meshes in levelMeshParts
 	};
 	
 	struct MODEL_INSTANCES // each instance of a model in the level
 	{
-		unsigned modelIndex, transformStart, transformCount, flags; // flags optional
+		unsigned modelIndex, transformStart, transformCount, flags; // INSTANCE_FLAGS
+	};
+	enum INSTANCE_FLAGS : unsigned {
+		INSTANCE_DYNAMIC = 1, // moves at runtime (m_dynamicModels), its transforms are streamed every frame
 	};
 	struct MATERIAL_TEXTURES // swaps string pointers for loaded texture offsets
 	{
 		unsigned int albedoIndex, roughnessIndex, metalIndex, normalIndex;
 	};
+	// the geometry arrays a partitioned level (m_worldPartition) keeps as fixed size pools
+	enum PARTITION_POOLS : unsigned {
+		POOL_VERTICES,	// levelVertices + levelPositions, or their compact versions
+		POOL_INDICES,	// levelIndices, not used with m_compactVertexFormat
+		POOL_INDICES16,
+		POOL_INDICES32,
+		POOL_MESHLETS,
+		POOL_COUNT
+	};
+	// one model's geometry: its block in a cell file, or where that block landed in the pools
+	struct PARTITION_BLOCK
+	{
+		unsigned start[POOL_COUNT], count[POOL_COUNT];
+	};
 	// All geometry data combined for level to be loaded onto the video card
 	std::vector<H2B::VERTEX> levelVertices;
 	std::vector<unsigned> levelIndices;
-	// All material data used by the level
+	// All material data used by the level, deduplicated. After loading every
+	// H2B::MESH::materialIndex is a level wide slot into these arrays.
 	std::vector<H2B::MATERIAL> levelMaterials;
 	std::vector<H2B::ATTRIBUTES> levelAttributes;
 	// This could be populated by the Level_Renderer during GPU transfer
@@ -36,9 +92,62 @@ public:
 	// All required drawing information combined
 	std::vector<H2B::BATCH> levelBatches;
 	std::vector<H2B::MESH> levelMeshes;
+	// every mesh as exported, meshIndex is level wide. With m_mergeMaterialBatches a model has
+	// one levelMeshes entry per material and its exported meshes are parts of those
+	std::vector<MESH_PART> levelMeshParts;
+	// same size as levelMeshes, absolute location of each mesh's (possibly shared) geometry
+	std::vector<GEOMETRY_RANGE> levelMeshRanges;
+	// compact copy of the geometry for the GPU (m_compactVertexFormat), levelMeshQuantization
+	// is the same size as levelMeshes and says which index list each mesh lives in
+	std::vector<QUANTIZED_VERTEX> levelCompactVertices;
+	std::vector<uint16_t> levelIndices16;
+	std::vector<unsigned> levelIndices32;
+	std::vector<QUANTIZED_RANGE> levelMeshQuantization;
+	// generated LODs (m_generateLODs), m_lodLevels ranges per mesh (mesh * m_lodLevels + lod - 1)
+	// over the mesh's own vertices, levelLODQuantization is their compact version.
+	// levelModelLODs is the same size as levelModels
+	std::vector<GEOMETRY_RANGE> levelMeshLODs;
+	std::vector<QUANTIZED_RANGE> levelLODQuantization;
+	std::vector<LOD_BOUNDS> levelModelLODs;
+	// proxy cells (m_generateHLODs). Every proxy is one more model/instance set at the end of the
+	// level with a single identity transform, levelHLODMembers lists the transforms it replaces
+	std::vector<HLOD_CELL> levelHLODCells;
+	std::vector<unsigned> levelHLODMembers;
+	// split streams (m_splitVertexStreams), 1:1 with levelVertices. levelCompactPositions is
+	// only filled with m_compactVertexFormat
+	std::vector<H2B::VECTOR> levelPositions;
+	std::vector<VERTEX_ATTRIBUTES> levelVertexAttributes;
+	std::vector<QUANTIZED_POSITION> levelCompactPositions;
+	// meshlets of every mesh with at least m_meshletMinTriangles (m_meshletCulling),
+	// levelMeshMeshlets is the same size as levelMeshes, count 0 = not split
+	struct MESHLET_SPAN { unsigned first, count; };
+	std::vector<MESHLET> levelMeshlets;
+	std::vector<MESHLET_SPAN> levelMeshMeshlets;
 	std::vector<LEVEL_MODEL> levelModels;
+	// local bounds (Bounds.h) computed at import, levelMeshBounds is the same size as levelMeshes
+	// and covers the mesh's vertex block, levelModelBounds is the same size as levelModels
+	std::vector<LOCAL_BOUNDS> levelMeshBounds;
+	std::vector<LOCAL_BOUNDS> levelModelBounds;
+	// world bounds of every transform (SoA), 1:1 with levelTransforms, see UpdateTransforms
+	INSTANCE_BOUNDS levelInstanceBounds;
+	// exported parent of every transform (-1 for roots), 1:1 with levelTransforms. With
+	// m_transformHierarchy levelHierarchy holds the local matrices, see SetLocalTransform
+	std::vector<int> levelTransformParents;
+	SceneHierarchy levelHierarchy;
+	// transform ranges changed by UpdateTransforms/UpdateHierarchy that the renderer hasn't uploaded yet
+	std::vector<TRANSFORM_RANGE> levelMovedTransforms;
+	// pool ranges filled by cells that landed (UpdateStreaming) that the renderer hasn't uploaded yet
+	std::vector<PARTITION_BLOCK> levelLandedGeometry;
 	// what we actually draw once loaded (using GPU instancing)
 	std::vector<MODEL_INSTANCES> levelInstances;
+	// runtime edits (AddInstance and friends): removed instances and spare slots are hidden, never
+	// drawn. levelInstanceLayout changes when instance sets grow, levelLightsVersion when lights
+	// are added or removed, levelGeometryVersion when models are imported into the loaded level.
+	// The renderer rebuilds what depends on them when it sees a new value
+	InstanceFreeList levelFreeInstances;
+	unsigned levelInstanceLayout = 0, levelLightsVersion = 0, levelGeometryVersion = 0;
+	// m_worldPartition cells, only resident ones (UpdateStreaming) have instances and lights
+	WorldGrid levelGrid;
 
 	//LIGHTS
 	std::vector<POINT_LIGHT> levelPointLights;
@@ -59,14 +168,70 @@ public:
 		log.LogCategorized("EVENT", "LOADING GAME LEVEL [DATA ORIENTED]");
 
 		UnloadLevel();// clear previous level data if there is any
-		if (ReadGameLevel(gameLevelPath, uniqueModels, log) == false) {
+		// a bake of the same sources and settings skips everything below
+		auto loadStart = std::chrono::steady_clock::now();
+		// every model comes out of one mapped pack when there is one
+		ModelPack pack;
+		if (m_useModelPack)
+			pack.Open(std::string(h2bFolderPath) + "/" + m_modelPackName);
+		// the binary export of the level when there is one, it's already grouped by model
+		std::string levelPath = gameLevelPath;
+		LevelFileReader binaryLevel;
+		if (m_useBinaryLevels && OpenCurrentLevelFile(gameLevelPath, binaryLevel))
+			levelPath = GetLevelFilePath(gameLevelPath);
+		else if (m_useBinaryLevels && std::filesystem::exists(GetLevelFilePath(gameLevelPath)))
+			log.LogCategorized("WARNING", (GetLevelFilePath(gameLevelPath) + " is out of date with the text level, reading the text").c_str());
+		uint64_t bakeKey = 0;
+		bool bakeable = m_bakeLevelCache && HashLevelSources(levelPath, h2bFolderPath, bakeKey, &pack);
+		bakeKey = HashImportSettings(bakeKey);
+		// a partitioned level is baked into cell files instead, its warm load reads only their manifest
+		bool partitioned = m_worldPartition && bakeable;
+		std::string partitionFolder = std::filesystem::path(GetLevelBakePath(gameLevelPath)).replace_extension().string();
+		if (m_worldPartition && !bakeable)
+			log.LogCategorized("WARNING", "World partition: needs the level bake cache (m_bakeLevelCache), the level stays whole");
+		if (partitioned && ReadWorldPartition(partitionFolder, HashPartitionSettings(bakeKey), log)) {
+			log.LogCategorized("INFO", (std::string("World partition: manifest read in ") + std::to_string(std::chrono::duration<double,
+				std::milli>(std::chrono::steady_clock::now() - loadStart).count()) + " ms").c_str());
+			log.LogCategorized("EVENT", "GAME LEVEL WAS LOADED TO CPU [DATA ORIENTED]");
+			return true;
+		}
+		if (bakeable && !partitioned && ReadLevelBake(GetLevelBakePath(gameLevelPath), bakeKey)) {
+			log.LogCategorized("INFO", (std::string("Level bake: warm load in ") + std::to_string(std::chrono::duration<double,
+				std::milli>(std::chrono::steady_clock::now() - loadStart).count()) + " ms").c_str());
+			log.LogCategorized("EVENT", "GAME LEVEL WAS LOADED TO CPU [DATA ORIENTED]");
+			return true;
+		}
+		if (binaryLevel.IsOpen())
+			ReadBinaryGameLevel(binaryLevel, uniqueModels, log);
+		else if (ReadGameLevel(gameLevelPath, uniqueModels, log) == false) {
 			log.LogCategorized("ERROR", "Fatal error reading game level, aborting level load.");
 			return false;
 		}
-		if (ReadAndCombineH2Bs(h2bFolderPath, uniqueModels, log) == false) {
+		if (ReadAndCombineH2Bs(h2bFolderPath, pack, uniqueModels, log) == false) {
 			log.LogCategorized("ERROR", "Fatal error combining H2B mesh data, aborting level load.");
 			return false;
 		}
+		PartitionDynamicInstances(uniqueModels, log);
+
+		if (m_generateLODs)
+			BuildLevelLODs(log);
+		// cells far away aren't loaded at all, there is nothing for proxies to stand in for
+		if (m_generateHLODs && !partitioned)
+			BuildLevelHLODs(log);
+		BuildTransformParents(uniqueModels);
+		if (m_compactVertexFormat)
+			BuildCompactGeometry(log);
+		if (m_splitVertexStreams)
+			BuildVertexStreams();
+		if (m_meshletCulling)
+			BuildLevelMeshlets(log);
+		BuildInstanceBounds();
+		// cells place instances, so a partitioned level has no hierarchy to move them
+		if (m_transformHierarchy && !partitioned) {
+			BuildHierarchy();
+			log.LogCategorized("INFO", (std::string("Transform hierarchy: ") + std::to_string(levelHierarchy.Depth()) +
+				" levels deep").c_str());
+		}
 
 		// Copy materials' attributes to another vector, levelAttributes
 		if (levelMaterials.size() != 0)
@@ -76,6 +241,28 @@ public:
 				levelAttributes.push_back(levelMaterials[i].attrib);
 			}
 		}
+		if (partitioned) {
+			if (WriteWorldPartition(partitionFolder, HashPartitionSettings(bakeKey), log)) {
+				// the imported level goes, from here on it's the same as a warm load
+				UnloadLevel();
+				if (ReadWorldPartition(partitionFolder, HashPartitionSettings(bakeKey), log)) {
+					log.LogCategorized("INFO", (std::string("World partition: cold load in ") + std::to_string(std::chrono::duration<double,
+						std::milli>(std::chrono::steady_clock::now() - loadStart).count()) + " ms").c_str());
+					log.LogCategorized("EVENT", "GAME LEVEL WAS LOADED TO CPU [DATA ORIENTED]");
+					return true;
+				}
+				log.LogCategorized("ERROR", "World partition: could not read back the cells just written, aborting level load.");
+				return false;
+			}
+			log.LogCategorized("WARNING", (std::string("World partition: could not write ") + partitionFolder +
+				", the level stays whole").c_str());
+		}
+		else if (bakeable) {
+			bool saved = WriteLevelBake(GetLevelBakePath(gameLevelPath), bakeKey);
+			log.LogCategorized(saved ? "INFO" : "WARNING", (std::string(saved ? "Level bake: cold load in " :
+				"Level bake: could not write cache after ") + std::to_string(std::chrono::duration<double,
+				std::milli>(std::chrono::steady_clock::now() - loadStart).count()) + " ms").c_str());
+		}
 
 		// level loaded into CPU ram
 		log.LogCategorized("EVENT", "GAME LEVEL WAS LOADED TO CPU [DATA ORIENTED]");
@@ -83,6 +270,24 @@ public:
 	}
 	// used to wipe CPU level data between levels
 	void UnloadLevel() {
+		levelStreamer.Stop();
+		levelGrid.Clear();
+		levelCellPointLights.clear();
+		levelCellSpotLights.clear();
+		partitionCells.clear();
+		partitionCellModels.clear();
+		partitionBlocks.clear();
+		partitionMeshRanges.clear();
+		partitionMeshLODs.clear();
+		partitionMeshQuantization.clear();
+		partitionLODQuantization.clear();
+		partitionMeshMeshlets.clear();
+		partitionModelFlags.clear();
+		partitionModelUsers.clear();
+		partitionModelBlocks.clear();
+		partitionCellTransforms.clear();
+		partitionCellLanded.clear();
+		levelLandedGeometry.clear();
 		level_strings.clear();
 		levelVertices.clear();
 		levelIndices.clear();
@@ -90,13 +295,330 @@ public:
 		levelTextures.clear();
 		levelBatches.clear();
 		levelMeshes.clear();
+		levelMeshParts.clear();
+		levelMeshRanges.clear();
+		levelCompactVertices.clear();
+		levelIndices16.clear();
+		levelIndices32.clear();
+		levelMeshQuantization.clear();
+		levelMeshLODs.clear();
+		levelLODQuantization.clear();
+		levelModelLODs.clear();
+		levelHLODCells.clear();
+		levelHLODMembers.clear();
+		levelPositions.clear();
+		levelVertexAttributes.clear();
+		levelCompactPositions.clear();
+		levelMeshlets.clear();
+		levelMeshMeshlets.clear();
 		levelModels.clear();
+		levelMeshBounds.clear();
+		levelModelBounds.clear();
+		levelInstanceBounds.Clear();
+		levelTransformParents.clear();
+		levelHierarchy.Clear();
+		levelMovedTransforms.clear();
+		levelFreeInstances.Clear();
+		levelFileParents.clear();
 		levelTransforms.clear();
 		levelInstances.clear();
 		levelAttributes.clear();
 		levelPointLights.clear();
 		levelSpotLights.clear();
-
+		materialLookup.clear();
+		geometryPool.Clear();
+		levelBake.Close();
+	}
+	// overwrites levelTransforms[first, first + count) and refreshes their world bounds,
+	// uploading the new transforms is up to the renderer. Bypasses levelHierarchy, transforms
+	// with children should move through SetLocalTransform
+	void UpdateTransforms(unsigned first, unsigned count, const GW::MATH::GMATRIXF* transforms) {
+		std::copy(transforms, transforms + count, levelTransforms.begin() + first);
+		RefreshInstanceBounds(first, count);
+		levelMovedTransforms.push_back({ first, count });
+	}
+	// moves a transform relative to its parent (the world for roots), it and everything parented
+	// to it follow on the next UpdateHierarchy. Needs m_transformHierarchy
+	void SetLocalTransform(unsigned transform, const GW::MATH::GMATRIXF& local) {
+		if (!levelHierarchy.IsEmpty())
+			levelHierarchy.SetLocal(transform, local);
+	}
+	// recomputes the moved subtrees into levelTransforms and refreshes their world bounds, the
+	// changed ranges are added to levelMovedTransforms. Returns how many transforms moved
+	unsigned UpdateHierarchy() {
+		unsigned moved = levelHierarchy.Update(levelTransforms.data(), hierarchyRanges);
+		for (const TRANSFORM_RANGE& range : hierarchyRanges)
+			RefreshInstanceBounds(range.first, range.count);
+		levelMovedTransforms.insert(levelMovedTransforms.end(), hierarchyRanges.begin(), hierarchyRanges.end());
+		return moved;
+	}
+	// the INSTANCE_DYNAMIC transforms, sorted with adjacent sets merged. One block right after load
+	// (see PartitionDynamicInstances), sets grown later add their own range past it
+	std::vector<TRANSFORM_RANGE> GetDynamicTransforms() const {
+		std::vector<TRANSFORM_RANGE> ranges;
+		for (const MODEL_INSTANCES& instances : levelInstances)
+			if ((instances.flags & INSTANCE_DYNAMIC) && instances.transformCount > 0)
+				ranges.push_back({ instances.transformStart, instances.transformCount });
+		std::sort(ranges.begin(), ranges.end(), [](const TRANSFORM_RANGE& a, const TRANSFORM_RANGE& b) { return a.first < b.first; });
+		size_t merged = 0;
+		for (size_t r = 0; r < ranges.size(); ++r)
+			if (merged > 0 && ranges[merged - 1].first + ranges[merged - 1].count == ranges[r].first)
+				ranges[merged - 1].count += ranges[r].count;
+			else
+				ranges[merged++] = ranges[r];
+		ranges.resize(merged);
+		return ranges;
+	}
+	// Turns the loaded level into another one through the edit calls below, when there is no
+	// exported hierarchy to rewire. Every model's instances are diffed first (LevelDelta.h), a
+	// level that keeps too few of them is left to a full load. Otherwise models the other level
+	// places that aren't loaded are imported and appended (ImportLevelModels), kept instances
+	// keep their slots and GPU data, HLOD cells only go when one of their members changed. False
+	// (nothing touched) when it takes a full LoadLevel
+	bool ApplyLevelDelta(const char* gameLevelPath, const char* h2bFolderPath, GW::SYSTEM::GLog log) {
+		if (levelModels.empty() || levelStreamer.IsRunning())
+			return false; // a partitioned level's instances belong to their cells
+		auto start = std::chrono::steady_clock::now();
+		LEVEL_FILE_CONTENT next;
+		LevelFileReader binaryLevel;
+		if (m_useBinaryLevels && OpenCurrentLevelFile(gameLevelPath, binaryLevel))
+			ReadLevelFile(binaryLevel, next);
+		else if (!ReadLevelText(gameLevelPath, next))
+			return false;
+		auto hasParents = [](const std::vector<int>& parents) {
+			return std::any_of(parents.begin(), parents.end(), [](int parent) { return parent >= 0; });
+		};
+		if (!levelHierarchy.IsEmpty() && (hasParents(next.parents) || hasParents(levelTransformParents))) {
+			log.LogCategorized("INFO", "Level delta: exported hierarchy, full load");
+			return false;
+		}
+		// next level's models by index, models only it places come in with all their instances
+		std::vector<const GW::MATH::GMATRIXF*> target(levelModels.size(), nullptr);
+		std::vector<size_t> targetCount(levelModels.size(), 0);
+		std::set<MODEL_ENTRY> missing;
+		size_t nextCount = 0, currentCount = 0;
+		static_assert(sizeof(LEVEL_FILE_MATRIX) == sizeof(GW::MATH::GMATRIXF), "transforms are compared as is");
+		for (const auto& model : next.models) {
+			nextCount += model.second.size();
+			unsigned index = FindModel(model.first.c_str());
+			if (index != ~0u) {
+				target[index] = reinterpret_cast<const GW::MATH::GMATRIXF*>(model.second.data());
+				targetCount[index] = model.second.size();
+				continue;
+			}
+			MODEL_ENTRY entry;
+			entry.modelFile = model.first;
+			entry.instances.resize(model.second.size());
+			std::memcpy(entry.instances.data(), model.second.data(), sizeof(LEVEL_FILE_MATRIX) * model.second.size());
+			missing.insert(entry);
+		}
+		// HLOD proxies aren't part of either export, a cell is kept only while its members are
+		std::vector<unsigned> cellOf(levelTransforms.size(), ~0u);
+		std::vector<uint8_t> proxyModel(levelModels.size(), 0), cellChanged(levelHLODCells.size(), 0);
+		for (unsigned c = 0; c < levelHLODCells.size(); ++c) {
+			const HLOD_CELL& cell = levelHLODCells[c];
+			proxyModel[levelInstances[FindInstanceSet(cell.proxyTransform)].modelIndex] = 1;
+			for (unsigned m = cell.memberStart; m < cell.memberStart + cell.memberCount; ++m)
+				cellOf[levelHLODMembers[m]] = c;
+		}
+		std::vector<INSTANCE_DELTA> deltas(levelModels.size());
+		std::vector<unsigned> slots;
+		unsigned kept = 0, moved = 0, added = 0, removed = 0;
+		for (unsigned model = 0; model < levelModels.size(); ++model) {
+			if (proxyModel[model])
+				continue;
+			slots.clear();
+			for (const MODEL_INSTANCES& instances : levelInstances)
+				if (instances.modelIndex == model)
+					for (unsigned t = instances.transformStart; t < instances.transformStart + instances.transformCount; ++t)
+						if (!levelFreeInstances.IsHidden(t))
+							slots.push_back(t);
+			currentCount += slots.size();
+			DiffInstances(levelTransforms.data(), slots.data(), slots.size(), target[model], targetCount[model], deltas[model]);
+			kept += deltas[model].kept;
+			moved += (unsigned)deltas[model].moved.size();
+			added += (unsigned)deltas[model].added.size();
+			removed += (unsigned)deltas[model].removed.size();
+		}
+		if (!DeltaWorthApplying(kept, currentCount, nextCount)) {
+			log.LogCategorized("INFO", (std::string("Level delta: ") + std::to_string(kept) + " of " +
+				std::to_string((std::max)(currentCount, nextCount)) + " instances kept, full load").c_str());
+			return false;
+		}
+		unsigned firstImported = (unsigned)levelModels.size(), firstImportedSet = (unsigned)levelInstances.size(), imported = 0;
+		if (!missing.empty())
+			ImportLevelModels(h2bFolderPath, missing, log);
+		for (unsigned set = firstImportedSet; set < levelInstances.size(); ++set)
+			imported += levelInstances[set].transformCount;
+		for (unsigned model = 0; model < firstImported; ++model) {
+			const INSTANCE_DELTA& delta = deltas[model];
+			for (const auto& move : delta.moved) {
+				MoveInstance(move.first, target[model][move.second]);
+				if (cellOf[move.first] != ~0u)
+					cellChanged[cellOf[move.first]] = 1;
+			}
+			for (unsigned slot : delta.removed) {
+				RemoveInstance(slot);
+				if (cellOf[slot] != ~0u)
+					cellChanged[cellOf[slot]] = 1;
+			}
+			for (unsigned add : delta.added)
+				AddInstance(model, target[model][add]);
+		}
+		DropHLODCells(cellChanged);
+		// lights are few, a changed list is simply replaced
+		std::vector<POINT_LIGHT> pointLights;
+		std::vector<SPOT_LIGHT> spotLights;
+		for (const LEVEL_FILE_POINT_LIGHT& light : next.pointLights)
+			pointLights.push_back(ToPointLight(light));
+		for (const LEVEL_FILE_SPOT_LIGHT& light : next.spotLights)
+			spotLights.push_back(ToSpotLight(light));
+		if (pointLights.size() != levelPointLights.size() || spotLights.size() != levelSpotLights.size() ||
+			std::memcmp(pointLights.data(), levelPointLights.data(), sizeof(POINT_LIGHT) * pointLights.size()) != 0 ||
+			std::memcmp(spotLights.data(), levelSpotLights.data(), sizeof(SPOT_LIGHT) * spotLights.size()) != 0) {
+			levelPointLights.swap(pointLights);
+			levelSpotLights.swap(spotLights);
+			++levelLightsVersion;
+		}
+		log.LogCategorized("INFO", (std::string("Level delta: ") + std::to_string(kept) + " kept, " + std::to_string(moved) +
+			" moved, " + std::to_string(added) + " added, " + std::to_string(removed) + " removed, " +
+			std::to_string(imported) + " placed by " + std::to_string(levelModels.size() - firstImported) + " imported models, " +
+			std::to_string(levelHLODCells.size()) + " HLOD cells kept in " + std::to_string(std::chrono::duration<double,
+			std::milli>(std::chrono::steady_clock::now() - start).count()) + " ms").c_str());
+		log.LogCategorized("EVENT", "GAME LEVEL WAS SWITCHED BY DELTA [DATA ORIENTED]");
+		return true;
+	}
+	// Once per frame with the camera position and velocity (units per second) in world partition
+	// mode: drops the instances, lights and (once no resident cell uses it) geometry of evicted
+	// cells and lands the cells that finished loading in the pools, moved ranges and
+	// levelLandedGeometry carry them to the GPU. _wait blocks until the cells around _eye are in.
+	// A cell file that doesn't match the manifest stays empty, so does a cell the pools can't take
+	// even after evicting every cell not wanted this frame
+	void UpdateStreaming(const float eye[3], const float velocity[3], bool wait, GW::SYSTEM::GLog log) {
+		if (!levelStreamer.IsRunning())
+			return;
+		levelStreamer.Update(eye, velocity, wait);
+		bool lightsChanged = false;
+		for (unsigned cell : levelStreamer.Evicted())
+			lightsChanged |= ReleaseCell(cell);
+		for (CellStreamer::LOADED_CELL& loaded : levelStreamer.TakeLoaded()) {
+			LevelBakeReader file;
+			PARTITION_CELL_DATA data;
+			if (!file.Open(loaded.payload.data(), loaded.payload.size(), partitionKey) || !ViewCell(loaded.cell, file, data)) {
+				log.LogCategorized("WARNING", (std::string("World partition: cell ") + std::to_string(loaded.cell) +
+					" could not be read or is damaged, it stays empty").c_str());
+				continue;
+			}
+			while (!LandCell(loaded.cell, data)) {
+				unsigned evicted = levelStreamer.EvictOldest();
+				if (evicted == ~0u) {
+					log.LogCategorized("WARNING", (std::string("World partition: cell ") + std::to_string(loaded.cell) +
+						" doesn't fit in the pools, it stays empty").c_str());
+					break;
+				}
+				lightsChanged |= ReleaseCell(evicted);
+			}
+			lightsChanged |= partitionCellLanded[loaded.cell] && (data.pointLightCount + data.spotLightCount) > 0;
+		}
+		levelStreamer.TakeLoaded().clear();
+		if (lightsChanged) {
+			levelPointLights.clear();
+			levelSpotLights.clear();
+			for (unsigned cell = 0; cell < levelGrid.CellCount(); ++cell) {
+				levelPointLights.insert(levelPointLights.end(), levelCellPointLights[cell].begin(), levelCellPointLights[cell].end());
+				levelSpotLights.insert(levelSpotLights.end(), levelCellSpotLights[cell].begin(), levelCellSpotLights[cell].end());
+			}
+			++levelLightsVersion;
+		}
+	}
+	// index of a model the level already uses by .h2b name, ~0u if it has none
+	unsigned FindModel(const char* filename) const {
+		for (unsigned i = 0; i < levelModels.size(); ++i)
+			if (std::strcmp(levelModels[i].filename, filename) == 0)
+				return i;
+		return ~0u;
+	}
+	// places one more instance of a loaded model and returns its transform slot, ~0u for an unknown
+	// model or in a partitioned level. A removed slot of the model's sets is reused, without one the model gets a new set of
+	// spare slots at the end of the level (levelInstanceLayout changes, growth is amortized)
+	unsigned AddInstance(unsigned modelIndex, const GW::MATH::GMATRIXF& world) {
+		if (modelIndex >= levelModels.size() || levelStreamer.IsRunning())
+			return ~0u; // a partitioned level's instances belong to their cells
+		unsigned slot = ~0u, flags = 0;
+		for (unsigned set = 0; set < levelInstances.size() && slot == ~0u; ++set)
+			if (levelInstances[set].modelIndex == modelIndex) {
+				flags = levelInstances[set].flags;
+				slot = levelFreeInstances.Acquire(set);
+			}
+		if (slot == ~0u)
+			slot = GrowInstanceSet(modelIndex, flags);
+		MoveInstance(slot, world);
+		return slot;
+	}
+	// puts an instance at a new world matrix, with the hierarchy whatever is parented to it follows
+	// on the next UpdateHierarchy. False for removed instances
+	bool MoveInstance(unsigned transform, const GW::MATH::GMATRIXF& world) {
+		if (transform >= levelTransforms.size() || levelFreeInstances.IsHidden(transform))
+			return false;
+		if (levelHierarchy.IsEmpty()) {
+			UpdateTransforms(transform, 1, &world);
+			return true;
+		}
+		GW::MATH::GMATRIXF local = world;
+		int parent = levelHierarchy.GetParent(transform);
+		if (parent >= 0) {
+			// under a parent scaled to nothing the instance can't be placed relative to it, it becomes a root
+			GW::MATH::GMATRIXF parentInverse = GW::MATH::GIdentityMatrixF;
+			if (GW::MATH::GMatrix::InverseF(levelTransforms[parent], parentInverse) == GW::GReturn::SUCCESS)
+				GW::MATH::GMatrix::MultiplyMatrixF(world, parentInverse, local);
+			else
+				levelHierarchy.Detach(transform);
+		}
+		levelHierarchy.SetLocal(transform, local);
+		return true;
+	}
+	// hides an instance and frees its slot for the next AddInstance of its model. An instance other
+	// transforms are parented to stays as a hidden pivot they keep following and isn't reused.
+	// HLOD proxies keep showing what they were built from. Cells own a partitioned level's instances
+	bool RemoveInstance(unsigned transform) {
+		unsigned set = FindInstanceSet(transform);
+		if (set == ~0u || levelStreamer.IsRunning())
+			return false;
+		bool reusable = levelHierarchy.IsEmpty() || levelHierarchy.ChildCount(transform) == 0;
+		if (!levelFreeInstances.Release(set, transform, reusable))
+			return false;
+		if (reusable && !levelHierarchy.IsEmpty()) {
+			levelHierarchy.Detach(transform); // whatever reuses the slot starts out as a root
+			levelTransformParents[transform] = -1;
+		}
+		return true;
+	}
+	// lights stay packed, removing one moves the last light into its index
+	unsigned AddPointLight(const POINT_LIGHT& light) {
+		levelPointLights.push_back(light);
+		++levelLightsVersion;
+		return (unsigned)levelPointLights.size() - 1;
+	}
+	bool RemovePointLight(unsigned index) {
+		if (index >= levelPointLights.size())
+			return false;
+		levelPointLights[index] = levelPointLights.back();
+		levelPointLights.pop_back();
+		++levelLightsVersion;
+		return true;
+	}
+	unsigned AddSpotLight(const SPOT_LIGHT& light) {
+		levelSpotLights.push_back(light);
+		++levelLightsVersion;
+		return (unsigned)levelSpotLights.size() - 1;
+	}
+	bool RemoveSpotLight(unsigned index) {
+		if (index >= levelSpotLights.size())
+			return false;
+		levelSpotLights[index] = levelSpotLights.back();
+		levelSpotLights.pop_back();
+		++levelLightsVersion;
+		return true;
 	}
 	// *NO RENDERING/GPU/DRAW LOGIC IN HERE PLEASE* 
 	// *DATA ORIENTED SHOULD AIM TO SEPERATE DATA FROM THE LOGIC THAT USES IT*
@@ -104,11 +626,720 @@ public:
 	// You can use your chosen API to have one GPU buffer for each type of data.
 	// Then you loop through instances using the API features to draw each mesh only once.
 private:
+	// m_worldPartition state. The manifest's tables stay level wide, its mesh ranges are relative
+	// to their model's block and only made absolute (levelMeshRanges and friends) while the model
+	// sits in the pools
+	// a cell in the manifest, its models are partitionCellModels[modelStart, modelStart + modelCount)
+	struct PARTITION_CELL_FILE
+	{
+		int x, z;
+		unsigned modelStart, modelCount, transformCount, pointLightCount, spotLightCount;
+		uint64_t bytes; // size of the cell's file
+	};
+	// a model a cell places, its transforms follow the previous model's in the cell file
+	struct PARTITION_CELL_MODEL
+	{
+		unsigned modelIndex, transformCount;
+	};
+	// a cell file's arrays, pointing into its payload
+	struct PARTITION_CELL_DATA
+	{
+		const GW::MATH::GMATRIXF* transforms = nullptr;
+		const POINT_LIGHT* pointLights = nullptr;
+		const SPOT_LIGHT* spotLights = nullptr;
+		unsigned pointLightCount = 0, spotLightCount = 0;
+		const H2B::VERTEX* vertices = nullptr;
+		const H2B::VECTOR* positions = nullptr;
+		const QUANTIZED_VERTEX* compactVertices = nullptr;
+		const QUANTIZED_POSITION* compactPositions = nullptr;
+		const unsigned* indices = nullptr;
+		const uint16_t* indices16 = nullptr;
+		const unsigned* indices32 = nullptr;
+		const MESHLET* meshlets = nullptr;
+	};
+	// the pooled arrays of one or more blocks back to back, while baking
+	struct PARTITION_GEOMETRY
+	{
+		std::vector<H2B::VERTEX> vertices;
+		std::vector<H2B::VECTOR> positions;
+		std::vector<QUANTIZED_VERTEX> compactVertices;
+		std::vector<QUANTIZED_POSITION> compactPositions;
+		std::vector<unsigned> indices, indices32;
+		std::vector<uint16_t> indices16;
+		std::vector<MESHLET> meshlets;
+	};
+	uint64_t partitionKey = 0;
+	std::vector<PARTITION_CELL_FILE> partitionCells;
+	std::vector<PARTITION_CELL_MODEL> partitionCellModels;
+	std::vector<PARTITION_BLOCK> partitionBlocks;			// per model, its block's counts
+	std::vector<GEOMETRY_RANGE> partitionMeshRanges, partitionMeshLODs;
+	std::vector<QUANTIZED_RANGE> partitionMeshQuantization, partitionLODQuantization;
+	std::vector<MESHLET_SPAN> partitionMeshMeshlets;
+	std::vector<unsigned> partitionModelFlags;				// per model, INSTANCE_FLAGS of its sets
+	std::vector<unsigned> partitionModelUsers;				// per model, resident cells placing it
+	std::vector<PARTITION_BLOCK> partitionModelBlocks;		// per model with users, where it sits in the pools
+	std::vector<TRANSFORM_RANGE> partitionCellTransforms;	// per landed cell, its slots in levelTransforms
+	std::vector<uint8_t> partitionCellLanded;				// per cell, resident and not left empty
+	RangePool partitionPools[POOL_COUNT];
+	RangePool partitionTransformPool;
+
+	// a partition bake also depends on how the level is cut
+	static uint64_t HashPartitionSettings(uint64_t key) {
+		const float values[] = { m_partitionCellSize };
+		return HashBytes(values, sizeof(values), HashString("partition", key));
+	}
+	// bytes one element of a pool takes over every array it backs
+	static size_t PoolElementBytes(unsigned pool) {
+		switch (pool) {
+		case POOL_VERTICES:
+			if (m_compactVertexFormat)
+				return sizeof(QUANTIZED_VERTEX) + (m_splitVertexStreams ? sizeof(QUANTIZED_POSITION) : 0);
+			return sizeof(H2B::VERTEX) + (m_splitVertexStreams ? sizeof(H2B::VECTOR) : 0);
+		case POOL_INDICES16:
+			return sizeof(uint16_t);
+		case POOL_MESHLETS:
+			return sizeof(MESHLET);
+		default:
+			return sizeof(unsigned);
+		}
+	}
+	static GEOMETRY_RANGE Absolute(GEOMETRY_RANGE range, const PARTITION_BLOCK& block) {
+		range.indexStart += block.start[POOL_INDICES];
+		range.baseVertex += block.start[POOL_VERTICES];
+		return range;
+	}
+	static QUANTIZED_RANGE Absolute(QUANTIZED_RANGE range, const PARTITION_BLOCK& block) {
+		range.indexStart += block.start[range.is16Bit ? POOL_INDICES16 : POOL_INDICES32];
+		range.baseVertex += block.start[POOL_VERTICES];
+		return range;
+	}
+	// cuts the imported level into cells (WorldPartition.h) and bakes it into folder: one file per
+	// cell with its instances, its lights and the block of every model it places, then cells.lvb,
+	// the manifest with the grid and the level wide tables. Blocks only hold the arrays the
+	// renderer draws from (the compact or the plain geometry)
+	bool WriteWorldPartition(const std::string& folder, uint64_t key, GW::SYSTEM::GLog log) {
+		auto start = std::chrono::steady_clock::now();
+		unsigned transformCount = (unsigned)levelTransforms.size();
+		std::vector<unsigned> transformModel(transformCount);
+		for (const MODEL_INSTANCES& instances : levelInstances)
+			std::fill(transformModel.begin() + instances.transformStart,
+				transformModel.begin() + instances.transformStart + instances.transformCount, instances.modelIndex);
+		// items past the transforms are point lights then spot lights
+		std::vector<float> positions;
+		positions.reserve((transformCount + levelPointLights.size() + levelSpotLights.size()) * 3);
+		for (unsigned t = 0; t < transformCount; ++t)
+			positions.insert(positions.end(), { levelInstanceBounds.centerX[t], levelInstanceBounds.centerY[t], levelInstanceBounds.centerZ[t] });
+		for (const POINT_LIGHT& light : levelPointLights)
+			positions.insert(positions.end(), { light.transform.row4.x, light.transform.row4.y, light.transform.row4.z });
+		for (const SPOT_LIGHT& light : levelSpotLights)
+			positions.insert(positions.end(), { light.transform.row4.x, light.transform.row4.y, light.transform.row4.z });
+		WorldGrid grid;
+		grid.Build(positions.data(), positions.size() / 3, m_partitionCellSize);
+
+		// every model's block once, cells copy the blocks of the models they place
+		PARTITION_GEOMETRY geometry;
+		partitionBlocks.assign(levelModels.size(), PARTITION_BLOCK());
+		partitionMeshRanges.assign(levelMeshRanges.size(), GEOMETRY_RANGE());
+		partitionMeshLODs.assign(levelMeshLODs.size(), GEOMETRY_RANGE());
+		partitionMeshQuantization.assign(levelMeshQuantization.size(), QUANTIZED_RANGE());
+		partitionLODQuantization.assign(levelLODQuantization.size(), QUANTIZED_RANGE());
+		partitionMeshMeshlets.assign(levelMeshMeshlets.size(), { 0, 0 });
+		for (unsigned model = 0; model < levelModels.size(); ++model)
+			BuildPartitionBlock(model, geometry);
+
+		std::vector<PARTITION_CELL_FILE> cells(grid.CellCount());
+		std::vector<PARTITION_CELL_MODEL> cellModels;
+		std::error_code error;
+		std::filesystem::create_directories(folder, error); // fine if it already exists
+		uint64_t cellBytes = 0;
+		for (unsigned c = 0; c < grid.CellCount(); ++c) {
+			std::vector<unsigned> slots;
+			std::vector<POINT_LIGHT> pointLights;
+			std::vector<SPOT_LIGHT> spotLights;
+			const unsigned* items = grid.Items(c);
+			for (unsigned i = 0; i < grid.Cell(c).itemCount; ++i) {
+				if (items[i] < transformCount)
+					slots.push_back(items[i]);
+				else if (items[i] < transformCount + levelPointLights.size())
+					pointLights.push_back(levelPointLights[items[i] - transformCount]);
+				else
+					spotLights.push_back(levelSpotLights[items[i] - transformCount - levelPointLights.size()]);
+			}
+			// grouped by model, a model's instances keep their level order
+			std::stable_sort(slots.begin(), slots.end(), [&](unsigned a, unsigned b) { return transformModel[a] < transformModel[b]; });
+			PARTITION_CELL_FILE& cell = cells[c];
+			cell.x = grid.Cell(c).x;
+			cell.z = grid.Cell(c).z;
+			cell.modelStart = (unsigned)cellModels.size();
+			PARTITION_GEOMETRY cellGeometry;
+			std::vector<GW::MATH::GMATRIXF> transforms;
+			for (unsigned slot : slots) {
+				if (cellModels.size() == cell.modelStart || cellModels.back().modelIndex != transformModel[slot]) {
+					cellModels.push_back({ transformModel[slot], 0 });
+					AppendPartitionBlock(geometry, partitionBlocks[transformModel[slot]], cellGeometry);
+				}
+				cellModels.back().transformCount++;
+				transforms.push_back(levelTransforms[slot]);
+			}
+			cell.modelCount = (unsigned)cellModels.size() - cell.modelStart;
+			cell.transformCount = (unsigned)transforms.size();
+			cell.pointLightCount = (unsigned)pointLights.size();
+			cell.spotLightCount = (unsigned)spotLights.size();
+			LevelBakeWriter file;
+			file.AddArray(BAKE_TRANSFORMS, transforms);
+			file.AddArray(BAKE_POINT_LIGHTS, pointLights);
+			file.AddArray(BAKE_SPOT_LIGHTS, spotLights);
+			file.AddArray(BAKE_VERTICES, cellGeometry.vertices);
+			file.AddArray(BAKE_POSITIONS, cellGeometry.positions);
+			file.AddArray(BAKE_COMPACT_VERTICES, cellGeometry.compactVertices);
+			file.AddArray(BAKE_COMPACT_POSITIONS, cellGeometry.compactPositions);
+			file.AddArray(BAKE_INDICES, cellGeometry.indices);
+			file.AddArray(BAKE_INDICES16, cellGeometry.indices16);
+			file.AddArray(BAKE_INDICES32, cellGeometry.indices32);
+			file.AddArray(BAKE_MESHLETS, cellGeometry.meshlets);
+			std::string path = folder + "/" + std::to_string(c) + ".lvb";
+			if (!file.Save(path, key))
+				return false;
+			cell.bytes = std::filesystem::file_size(path, error);
+			cellBytes += cell.bytes;
+		}
+		// only the counts mean anything outside the bake
+		for (PARTITION_BLOCK& block : partitionBlocks)
+			std::fill(block.start, block.start + POOL_COUNT, 0u);
+		LevelBakeWriter manifest;
+		AddLevelTables(manifest);
+		manifest.AddArray(BAKE_MESH_RANGES, partitionMeshRanges);
+		manifest.AddArray(BAKE_MESH_LODS, partitionMeshLODs);
+		manifest.AddArray(BAKE_MESH_QUANTIZATION, partitionMeshQuantization);
+		manifest.AddArray(BAKE_LOD_QUANTIZATION, partitionLODQuantization);
+		manifest.AddArray(BAKE_MESH_MESHLETS, partitionMeshMeshlets);
+		manifest.AddArray(BAKE_PARTITION_BLOCKS, partitionBlocks);
+		manifest.AddArray(BAKE_PARTITION_CELLS, cells);
+		manifest.AddArray(BAKE_PARTITION_CELL_MODELS, cellModels);
+		if (!manifest.Save(folder + "/cells.lvb", key))
+			return false;
+		log.LogCategorized("INFO", (std::string("World partition: baked ") + std::to_string(cells.size()) + " cells, " +
+			std::to_string(cellBytes / 1024) + " KiB of cell files in " + std::to_string(std::chrono::duration<double,
+			std::milli>(std::chrono::steady_clock::now() - start).count()) + " ms").c_str());
+		return true;
+	}
+	// appends model's geometry to _geometry, only the arrays the renderer draws from, and its mesh
+	// ranges relative to the block to partitionMeshRanges and friends. What its meshes and LODs
+	// share is copied once
+	void BuildPartitionBlock(unsigned model, PARTITION_GEOMETRY& geometry) {
+		PARTITION_BLOCK& block = partitionBlocks[model];
+		block.start[POOL_VERTICES] = (unsigned)(m_compactVertexFormat ? geometry.compactVertices.size() : geometry.vertices.size());
+		block.start[POOL_INDICES] = (unsigned)geometry.indices.size();
+		block.start[POOL_INDICES16] = (unsigned)geometry.indices16.size();
+		block.start[POOL_INDICES32] = (unsigned)geometry.indices32.size();
+		block.start[POOL_MESHLETS] = (unsigned)geometry.meshlets.size();
+		// level wide start -> start in the block
+		std::unordered_map<unsigned, unsigned> vertexAt, indexAt, index16At, index32At, meshletAt;
+		auto place = [](std::unordered_map<unsigned, unsigned>& at, unsigned first, unsigned count, const auto& from,
+			auto& to, unsigned blockStart) {
+			auto found = at.find(first);
+			if (found != at.end())
+				return found->second;
+			unsigned relative = (unsigned)to.size() - blockStart;
+			to.insert(to.end(), from.begin() + first, from.begin() + first + count);
+			at.emplace(first, relative);
+			return relative;
+		};
+		// LOD ranges use the same vertex blocks as LOD0
+		auto placeVertices = [&](unsigned base, unsigned count) {
+			if (m_compactVertexFormat) {
+				if (!levelCompactPositions.empty() && vertexAt.find(base) == vertexAt.end())
+					geometry.compactPositions.insert(geometry.compactPositions.end(), levelCompactPositions.begin() + base,
+						levelCompactPositions.begin() + base + count);
+				return place(vertexAt, base, count, levelCompactVertices, geometry.compactVertices, block.start[POOL_VERTICES]);
+			}
+			if (!levelPositions.empty() && vertexAt.find(base) == vertexAt.end())
+				geometry.positions.insert(geometry.positions.end(), levelPositions.begin() + base, levelPositions.begin() + base + count);
+			return place(vertexAt, base, count, levelVertices, geometry.vertices, block.start[POOL_VERTICES]);
+		};
+		const LEVEL_MODEL& info = levelModels[model];
+		unsigned lodLevels = levelMeshLODs.empty() ? 0 : m_lodLevels;
+		for (unsigned j = info.meshStart; j < info.meshStart + info.meshCount; ++j) {
+			for (unsigned l = 0; l <= lodLevels; ++l) {
+				const GEOMETRY_RANGE& range = l == 0 ? levelMeshRanges[j] : levelMeshLODs[j * m_lodLevels + l - 1];
+				GEOMETRY_RANGE relative = range;
+				relative.baseVertex = placeVertices(range.baseVertex, range.vertexCount);
+				// compact ranges have index lists of their own, the plain range only keeps its counts
+				relative.indexStart = m_compactVertexFormat ? 0 :
+					place(indexAt, range.indexStart, range.indexCount, levelIndices, geometry.indices, block.start[POOL_INDICES]);
+				(l == 0 ? partitionMeshRanges[j] : partitionMeshLODs[j * m_lodLevels + l - 1]) = relative;
+				if (!m_compactVertexFormat)
+					continue;
+				QUANTIZED_RANGE quantized = l == 0 ? levelMeshQuantization[j] : levelLODQuantization[j * m_lodLevels + l - 1];
+				quantized.baseVertex = relative.baseVertex;
+				quantized.indexStart = quantized.is16Bit ?
+					place(index16At, quantized.indexStart, quantized.indexCount, levelIndices16, geometry.indices16, block.start[POOL_INDICES16]) :
+					place(index32At, quantized.indexStart, quantized.indexCount, levelIndices32, geometry.indices32, block.start[POOL_INDICES32]);
+				(l == 0 ? partitionMeshQuantization[j] : partitionLODQuantization[j * m_lodLevels + l - 1]) = quantized;
+			}
+			if (!levelMeshMeshlets.empty() && levelMeshMeshlets[j].count > 0) {
+				const MESHLET_SPAN& span = levelMeshMeshlets[j];
+				partitionMeshMeshlets[j] = { place(meshletAt, span.first, span.count, levelMeshlets, geometry.meshlets,
+					block.start[POOL_MESHLETS]), span.count };
+			}
+		}
+		block.count[POOL_VERTICES] = (unsigned)(m_compactVertexFormat ? geometry.compactVertices.size() : geometry.vertices.size()) -
+			block.start[POOL_VERTICES];
+		block.count[POOL_INDICES] = (unsigned)geometry.indices.size() - block.start[POOL_INDICES];
+		block.count[POOL_INDICES16] = (unsigned)geometry.indices16.size() - block.start[POOL_INDICES16];
+		block.count[POOL_INDICES32] = (unsigned)geometry.indices32.size() - block.start[POOL_INDICES32];
+		block.count[POOL_MESHLETS] = (unsigned)geometry.meshlets.size() - block.start[POOL_MESHLETS];
+	}
+	// copies one block of from to the end of to
+	static void AppendPartitionBlock(const PARTITION_GEOMETRY& from, const PARTITION_BLOCK& block, PARTITION_GEOMETRY& to) {
+		auto append = [](const auto& source, auto& destination, unsigned first, unsigned count) {
+			if (!source.empty())
+				destination.insert(destination.end(), source.begin() + first, source.begin() + first + count);
+		};
+		append(from.vertices, to.vertices, block.start[POOL_VERTICES], block.count[POOL_VERTICES]);
+		append(from.positions, to.positions, block.start[POOL_VERTICES], block.count[POOL_VERTICES]);
+		append(from.compactVertices, to.compactVertices, block.start[POOL_VERTICES], block.count[POOL_VERTICES]);
+		append(from.compactPositions, to.compactPositions, block.start[POOL_VERTICES], block.count[POOL_VERTICES]);
+		append(from.indices, to.indices, block.start[POOL_INDICES], block.count[POOL_INDICES]);
+		append(from.indices16, to.indices16, block.start[POOL_INDICES16], block.count[POOL_INDICES16]);
+		append(from.indices32, to.indices32, block.start[POOL_INDICES32], block.count[POOL_INDICES32]);
+		append(from.meshlets, to.meshlets, block.start[POOL_MESHLETS], block.count[POOL_MESHLETS]);
+	}
+	// maps the manifest in folder and gets the level ready to stream: the level wide tables, the
+	// grid, the pools (ResetPartitionPools) and the streamer reading cell files. Nothing is resident
+	// until UpdateStreaming. False leaves the level empty
+	bool ReadWorldPartition(const std::string& folder, uint64_t key, GW::SYSTEM::GLog log) {
+		if (!levelBake.Open(folder + "/cells.lvb", key))
+			return false;
+		bool read = ReadLevelTables() && levelBake.ReadArray(BAKE_MESH_RANGES, partitionMeshRanges) &&
+			levelBake.ReadArray(BAKE_MESH_LODS, partitionMeshLODs) &&
+			levelBake.ReadArray(BAKE_MESH_QUANTIZATION, partitionMeshQuantization) &&
+			levelBake.ReadArray(BAKE_LOD_QUANTIZATION, partitionLODQuantization) &&
+			levelBake.ReadArray(BAKE_MESH_MESHLETS, partitionMeshMeshlets) &&
+			levelBake.ReadArray(BAKE_PARTITION_BLOCKS, partitionBlocks) &&
+			levelBake.ReadArray(BAKE_PARTITION_CELLS, partitionCells) &&
+			levelBake.ReadArray(BAKE_PARTITION_CELL_MODELS, partitionCellModels);
+		// cell files are read against these, they have to hold together
+		read = read && partitionBlocks.size() == levelModels.size() && partitionMeshRanges.size() == levelMeshes.size();
+		for (size_t c = 0; read && c < partitionCells.size(); ++c)
+			read = (uint64_t)partitionCells[c].modelStart + partitionCells[c].modelCount <= partitionCellModels.size();
+		for (size_t m = 0; read && m < partitionCellModels.size(); ++m)
+			read = partitionCellModels[m].modelIndex < levelModels.size();
+		if (!read) {
+			UnloadLevel();
+			return false;
+		}
+		partitionKey = key;
+		levelMeshRanges = partitionMeshRanges;
+		levelMeshLODs = partitionMeshLODs;
+		levelMeshQuantization = partitionMeshQuantization;
+		levelLODQuantization = partitionLODQuantization;
+		levelMeshMeshlets = partitionMeshMeshlets;
+		partitionModelFlags.assign(levelModels.size(), 0);
+		for (unsigned model = 0; model < levelModels.size(); ++model)
+			for (const char* name : m_dynamicModels)
+				if (std::strcmp(levelModels[model].filename, name) == 0)
+					partitionModelFlags[model] |= INSTANCE_DYNAMIC;
+		partitionModelUsers.assign(levelModels.size(), 0);
+		partitionModelBlocks.assign(levelModels.size(), PARTITION_BLOCK());
+		std::vector<PARTITION_CELL> gridCells;
+		std::vector<size_t> cellBytes;
+		for (const PARTITION_CELL_FILE& cell : partitionCells) {
+			gridCells.push_back({ cell.x, cell.z, 0, 0 });
+			cellBytes.push_back((size_t)cell.bytes);
+		}
+		levelGrid.Assign(gridCells.data(), gridCells.size(), m_partitionCellSize);
+		partitionCellTransforms.assign(partitionCells.size(), { 0, 0 });
+		partitionCellLanded.assign(partitionCells.size(), 0);
+		levelCellPointLights.assign(partitionCells.size(), {});
+		levelCellSpotLights.assign(partitionCells.size(), {});
+		size_t poolBytes = ResetPartitionPools();
+		// a cell that can't be read comes back empty, UpdateStreaming refuses it
+		levelStreamer.Start(&levelGrid, cellBytes, [folder](unsigned cell, std::vector<unsigned char>& payload) {
+			std::ifstream file(folder + "/" + std::to_string(cell) + ".lvb", std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+			payload.clear();
+			if (!file.is_open())
+				return;
+			payload.resize((size_t)file.tellg());
+			if (!file.seekg(0) || !file.read(reinterpret_cast<char*>(payload.data()), payload.size()))
+				payload.clear();
+		}, m_partitionBudgetBytes);
+		log.LogCategorized("INFO", (std::string("World partition: ") + std::to_string(partitionCells.size()) + " cells, " +
+			std::to_string(m_partitionBudgetBytes / 1024) + " KiB resident budget, " + std::to_string(poolBytes / 1024) +
+			" KiB of pools").c_str());
+		return true;
+	}
+	// sizes every pool to the budget's share of what all cells hold of its arrays (m_partitionPoolSlack
+	// more), never below what the biggest cell needs alone nor above all cells together, and gives the
+	// level's arrays that size. A model several cells place counts once per cell, so the share errs on
+	// the big side. Returns the bytes the pools take
+	size_t ResetPartitionPools() {
+		uint64_t total[POOL_COUNT + 1] = {}, biggest[POOL_COUNT + 1] = {}, cellBytes = 0; // the last one is transforms
+		for (const PARTITION_CELL_FILE& cell : partitionCells) {
+			uint64_t need[POOL_COUNT + 1] = {};
+			for (unsigned i = cell.modelStart; i < cell.modelStart + cell.modelCount; ++i)
+				for (unsigned pool = 0; pool < POOL_COUNT; ++pool)
+					need[pool] += partitionBlocks[partitionCellModels[i].modelIndex].count[pool];
+			need[POOL_COUNT] = cell.transformCount;
+			for (unsigned pool = 0; pool <= POOL_COUNT; ++pool) {
+				total[pool] += need[pool];
+				biggest[pool] = (std::max)(biggest[pool], need[pool]);
+			}
+			cellBytes += cell.bytes;
+		}
+		double share = cellBytes > 0 ? (double)m_partitionBudgetBytes * m_partitionPoolSlack / cellBytes : 1.0;
+		unsigned capacity[POOL_COUNT + 1];
+		size_t bytes = 0;
+		for (unsigned pool = 0; pool <= POOL_COUNT; ++pool) {
+			capacity[pool] = (unsigned)(std::min)(total[pool], (std::max)(biggest[pool], (uint64_t)std::ceil(total[pool] * share)));
+			bytes += capacity[pool] * (pool < POOL_COUNT ? PoolElementBytes(pool) : sizeof(GW::MATH::GMATRIXF));
+		}
+		for (unsigned pool = 0; pool < POOL_COUNT; ++pool)
+			partitionPools[pool].Reset(capacity[pool]);
+		partitionTransformPool.Reset(capacity[POOL_COUNT]);
+		unsigned vertices = capacity[POOL_VERTICES], positions = m_splitVertexStreams ? vertices : 0;
+		if (m_compactVertexFormat) {
+			levelCompactVertices.assign(vertices, QUANTIZED_VERTEX());
+			levelCompactPositions.assign(positions, QUANTIZED_POSITION());
+		}
+		else {
+			levelVertices.assign(vertices, H2B::VERTEX());
+			levelPositions.assign(positions, H2B::VECTOR());
+		}
+		levelIndices.assign(capacity[POOL_INDICES], 0);
+		levelIndices16.assign(capacity[POOL_INDICES16], 0);
+		levelIndices32.assign(capacity[POOL_INDICES32], 0);
+		levelMeshlets.assign(capacity[POOL_MESHLETS], MESHLET());
+		levelTransforms.assign(capacity[POOL_COUNT], GW::MATH::GIdentityMatrixF);
+		levelTransformParents.assign(levelTransforms.size(), -1);
+		levelInstanceBounds.Resize(levelTransforms.size());
+		levelFreeInstances.Resize(0, levelTransforms.size());
+		return bytes;
+	}
+	// points _data at a cell file's arrays, false unless every one is as long as the manifest says
+	bool ViewCell(unsigned cell, const LevelBakeReader& file, PARTITION_CELL_DATA& data) const {
+		const PARTITION_CELL_FILE& info = partitionCells[cell];
+		size_t expected[POOL_COUNT] = {};
+		for (unsigned i = info.modelStart; i < info.modelStart + info.modelCount; ++i)
+			for (unsigned pool = 0; pool < POOL_COUNT; ++pool)
+				expected[pool] += partitionBlocks[partitionCellModels[i].modelIndex].count[pool];
+		size_t compact = m_compactVertexFormat ? expected[POOL_VERTICES] : 0, plain = expected[POOL_VERTICES] - compact;
+		size_t split = m_splitVertexStreams ? 1 : 0;
+		auto view = [&file](uint32_t id, auto& out, size_t count) {
+			size_t found = 0;
+			return file.ViewArray(id, out, found) && found == count;
+		};
+		data.pointLightCount = info.pointLightCount;
+		data.spotLightCount = info.spotLightCount;
+		return view(BAKE_TRANSFORMS, data.transforms, info.transformCount) &&
+			view(BAKE_POINT_LIGHTS, data.pointLights, info.pointLightCount) &&
+			view(BAKE_SPOT_LIGHTS, data.spotLights, info.spotLightCount) &&
+			view(BAKE_VERTICES, data.vertices, plain) && view(BAKE_POSITIONS, data.positions, plain * split) &&
+			view(BAKE_COMPACT_VERTICES, data.compactVertices, compact) &&
+			view(BAKE_COMPACT_POSITIONS, data.compactPositions, compact * split) &&
+			view(BAKE_INDICES, data.indices, expected[POOL_INDICES]) &&
+			view(BAKE_INDICES16, data.indices16, expected[POOL_INDICES16]) &&
+			view(BAKE_INDICES32, data.indices32, expected[POOL_INDICES32]) &&
+			view(BAKE_MESHLETS, data.meshlets, expected[POOL_MESHLETS]);
+	}
+	// copies a cell's transforms, lights and the blocks of its models not resident yet into the
+	// pools and adds one instance set per model it places. False (nothing taken) when a pool is full
+	bool LandCell(unsigned cell, const PARTITION_CELL_DATA& data) {
+		const PARTITION_CELL_FILE& info = partitionCells[cell];
+		unsigned first = partitionTransformPool.Allocate(info.transformCount);
+		if (first == ~0u)
+			return false;
+		PARTITION_BLOCK at = {}; // the next model's block in the cell file
+		for (unsigned i = info.modelStart; i < info.modelStart + info.modelCount; ++i) {
+			unsigned model = partitionCellModels[i].modelIndex;
+			if (partitionModelUsers[model] == 0 && !PlaceModel(model, data, at)) {
+				while (i-- > info.modelStart)
+					ReleaseModel(partitionCellModels[i].modelIndex);
+				partitionTransformPool.Free(first, info.transformCount);
+				return false;
+			}
+			++partitionModelUsers[model];
+			for (unsigned pool = 0; pool < POOL_COUNT; ++pool)
+				at.start[pool] += partitionBlocks[model].count[pool];
+		}
+		std::copy(data.transforms, data.transforms + info.transformCount, levelTransforms.begin() + first);
+		unsigned transform = first;
+		for (unsigned i = info.modelStart; i < info.modelStart + info.modelCount; ++i) {
+			const PARTITION_CELL_MODEL& placed = partitionCellModels[i];
+			levelInstances.push_back({ placed.modelIndex, transform, placed.transformCount, partitionModelFlags[placed.modelIndex] });
+			transform += placed.transformCount;
+		}
+		if (info.transformCount > 0) {
+			RefreshInstanceBounds(first, info.transformCount);
+			levelMovedTransforms.push_back({ first, info.transformCount });
+			++levelInstanceLayout;
+		}
+		levelCellPointLights[cell].assign(data.pointLights, data.pointLights + info.pointLightCount);
+		levelCellSpotLights[cell].assign(data.spotLights, data.spotLights + info.spotLightCount);
+		partitionCellTransforms[cell] = { first, info.transformCount };
+		partitionCellLanded[cell] = 1;
+		return true;
+	}
+	// takes room for model's block in every pool and copies it over from the cell file's block at
+	// _at, its mesh ranges become absolute. False (nothing taken) when a pool is full
+	bool PlaceModel(unsigned model, const PARTITION_CELL_DATA& data, const PARTITION_BLOCK& at) {
+		PARTITION_BLOCK& to = partitionModelBlocks[model];
+		to = partitionBlocks[model];
+		for (unsigned pool = 0; pool < POOL_COUNT; ++pool) {
+			to.start[pool] = partitionPools[pool].Allocate(to.count[pool]);
+			if (to.start[pool] == ~0u) {
+				while (pool-- > 0)
+					partitionPools[pool].Free(to.start[pool], to.count[pool]);
+				return false;
+			}
+		}
+		auto copy = [&](const auto* from, unsigned pool, auto& level) {
+			std::copy(from + at.start[pool], from + at.start[pool] + to.count[pool], level.begin() + to.start[pool]);
+		};
+		if (m_compactVertexFormat) {
+			copy(data.compactVertices, POOL_VERTICES, levelCompactVertices);
+			if (m_splitVertexStreams)
+				copy(data.compactPositions, POOL_VERTICES, levelCompactPositions);
+		}
+		else {
+			copy(data.vertices, POOL_VERTICES, levelVertices);
+			if (m_splitVertexStreams)
+				copy(data.positions, POOL_VERTICES, levelPositions);
+		}
+		copy(data.indices, POOL_INDICES, levelIndices);
+		copy(data.indices16, POOL_INDICES16, levelIndices16);
+		copy(data.indices32, POOL_INDICES32, levelIndices32);
+		copy(data.meshlets, POOL_MESHLETS, levelMeshlets);
+		const LEVEL_MODEL& info = levelModels[model];
+		for (unsigned j = info.meshStart; j < info.meshStart + info.meshCount; ++j) {
+			levelMeshRanges[j] = Absolute(partitionMeshRanges[j], to);
+			if (m_compactVertexFormat)
+				levelMeshQuantization[j] = Absolute(partitionMeshQuantization[j], to);
+			for (unsigned l = j * m_lodLevels; l < (j + 1) * m_lodLevels && l < partitionMeshLODs.size(); ++l) {
+				levelMeshLODs[l] = Absolute(partitionMeshLODs[l], to);
+				if (m_compactVertexFormat)
+					levelLODQuantization[l] = Absolute(partitionLODQuantization[l], to);
+			}
+			if (!partitionMeshMeshlets.empty())
+				levelMeshMeshlets[j] = { partitionMeshMeshlets[j].first + to.start[POOL_MESHLETS], partitionMeshMeshlets[j].count };
+		}
+		levelLandedGeometry.push_back(to);
+		return true;
+	}
+	// one resident cell less places model, its block goes back to the pools with the last one
+	void ReleaseModel(unsigned model) {
+		if (--partitionModelUsers[model] > 0)
+			return;
+		const PARTITION_BLOCK& block = partitionModelBlocks[model];
+		for (unsigned pool = 0; pool < POOL_COUNT; ++pool)
+			partitionPools[pool].Free(block.start[pool], block.count[pool]);
+	}
+	// drops what a landed cell added: its instance sets, transforms and lights, and the blocks of
+	// its models no other resident cell places. True when it had lights
+	bool ReleaseCell(unsigned cell) {
+		if (!partitionCellLanded[cell])
+			return false;
+		partitionCellLanded[cell] = 0;
+		const PARTITION_CELL_FILE& info = partitionCells[cell];
+		TRANSFORM_RANGE range = partitionCellTransforms[cell];
+		if (range.count > 0) {
+			levelInstances.erase(std::remove_if(levelInstances.begin(), levelInstances.end(), [&](const MODEL_INSTANCES& instances) {
+				return instances.transformStart - range.first < range.count;
+			}), levelInstances.end());
+			partitionTransformPool.Free(range.first, range.count);
+			++levelInstanceLayout;
+		}
+		for (unsigned i = info.modelStart; i < info.modelStart + info.modelCount; ++i)
+			ReleaseModel(partitionCellModels[i].modelIndex);
+		bool lights = !levelCellPointLights[cell].empty() || !levelCellSpotLights[cell].empty();
+		levelCellPointLights[cell].clear();
+		levelCellSpotLights[cell].clear();
+		return lights;
+	}
+	// hides the proxies of the flagged cells and lets their members draw themselves again, kept
+	// members go through levelMovedTransforms so the renderer un-hides them
+	void DropHLODCells(const std::vector<uint8_t>& drop) {
+		std::vector<HLOD_CELL> cells;
+		for (unsigned c = 0; c < levelHLODCells.size(); ++c) {
+			const HLOD_CELL& cell = levelHLODCells[c];
+			if (!drop[c]) {
+				cells.push_back(cell);
+				continue;
+			}
+			RemoveInstance(cell.proxyTransform);
+			for (unsigned m = cell.memberStart; m < cell.memberStart + cell.memberCount; ++m)
+				if (!levelFreeInstances.IsHidden(levelHLODMembers[m]))
+					levelMovedTransforms.push_back({ levelHLODMembers[m], 1 });
+		}
+		levelHLODCells.swap(cells);
+	}
+	// instance set holding a transform slot, ~0u if none does
+	unsigned FindInstanceSet(unsigned transform) const {
+		for (unsigned set = 0; set < levelInstances.size(); ++set)
+			if (transform - levelInstances[set].transformStart < levelInstances[set].transformCount)
+				return set;
+		return ~0u;
+	}
+	// appends a set of spare slots for modelIndex, as many as the model already has (at least
+	// m_instanceSetGrowth), and returns its first slot, the others start out free
+	unsigned GrowInstanceSet(unsigned modelIndex, unsigned flags) {
+		unsigned capacity = 0;
+		for (const MODEL_INSTANCES& instances : levelInstances)
+			if (instances.modelIndex == modelIndex)
+				capacity += instances.transformCount;
+		capacity = (std::max)(capacity, m_instanceSetGrowth);
+		unsigned set = (unsigned)levelInstances.size(), first = (unsigned)levelTransforms.size();
+		levelInstances.push_back({ modelIndex, first, capacity, flags });
+		levelTransforms.resize(first + capacity, GW::MATH::GIdentityMatrixF);
+		levelTransformParents.resize(levelTransforms.size(), -1);
+		levelInstanceBounds.Resize(levelTransforms.size());
+		levelFreeInstances.Resize(levelInstances.size(), levelTransforms.size());
+		for (unsigned slot = first + capacity; slot-- > first + 1;)
+			levelFreeInstances.Release(set, slot, true);
+		if (!levelHierarchy.IsEmpty()) {
+			UpdateHierarchy(); // pending moves land before the rebuild reads the world matrices
+			BuildHierarchy();
+		}
+		++levelInstanceLayout;
+		return first;
+	}
+	// world bounds of levelTransforms[first, first + count) from their models' local bounds
+	void RefreshInstanceBounds(unsigned first, unsigned count) {
+		for (const MODEL_INSTANCES& instances : levelInstances) {
+			unsigned start = (std::max)(first, instances.transformStart);
+			unsigned end = (std::min)(first + count, instances.transformStart + instances.transformCount);
+			if (start < end)
+				TransformBounds(levelModelBounds[instances.modelIndex], levelTransforms.data(), start, end - start,
+					levelInstanceBounds);
+		}
+	}
+	// array ids inside a level bake, never reuse a number
+	enum LEVEL_BAKE_ARRAYS : uint32_t {
+		BAKE_VERTICES, BAKE_INDICES, BAKE_MATERIALS, BAKE_ATTRIBUTES, BAKE_TRANSFORMS, BAKE_BATCHES, BAKE_MESHES,
+		BAKE_MESH_PARTS, BAKE_MESH_RANGES, BAKE_COMPACT_VERTICES, BAKE_INDICES16, BAKE_INDICES32, BAKE_MESH_QUANTIZATION,
+		BAKE_MESH_LODS, BAKE_LOD_QUANTIZATION, BAKE_MODEL_LODS, BAKE_HLOD_CELLS, BAKE_HLOD_MEMBERS, BAKE_POSITIONS,
+		BAKE_VERTEX_ATTRIBUTES, BAKE_COMPACT_POSITIONS, BAKE_MESHLETS, BAKE_MESH_MESHLETS, BAKE_MODELS, BAKE_MESH_BOUNDS,
+		BAKE_MODEL_BOUNDS, BAKE_INSTANCES, BAKE_POINT_LIGHTS, BAKE_SPOT_LIGHTS, BAKE_TRANSFORM_PARENTS,
+		BAKE_PARTITION_BLOCKS, BAKE_PARTITION_CELLS, BAKE_PARTITION_CELL_MODELS,
+	};
+	// every setting that changes what an import produces, algorithm changes bump m_levelBakeVersion
+	static uint64_t HashImportSettings(uint64_t key) {
+		const bool flags[] = { m_optimizeMeshesOnImport, m_dedupGeometryOnImport, m_mergeMaterialBatches,
+			m_compactVertexFormat, m_splitVertexStreams, m_meshletCulling, m_generateLODs, m_generateHLODs };
+		const unsigned values[] = { m_meshletMinTriangles, m_lodLevels, (unsigned)sizeof(void*) };
+		for (const char* name : m_dynamicModels)
+			key = HashString(name, key);
+		key = HashBytes(flags, sizeof(flags), key);
+		return HashBytes(values, sizeof(values), key);
+	}
+	// the level wide tables every bake holds, name pointers become string table offsets
+	void AddLevelTables(LevelBakeWriter& bake) const {
+		std::vector<H2B::MATERIAL> materials = levelMaterials;
+		for (H2B::MATERIAL& material : materials)
+			for (int k = 0; k < 10; ++k)
+				*((&material.name) + k) = bake.AddString(*((&material.name) + k));
+		std::vector<H2B::MESH> meshes = levelMeshes;
+		for (H2B::MESH& mesh : meshes)
+			mesh.name = bake.AddString(mesh.name);
+		std::vector<MESH_PART> parts = levelMeshParts;
+		for (MESH_PART& part : parts)
+			part.name = bake.AddString(part.name);
+		std::vector<LEVEL_MODEL> models = levelModels;
+		for (LEVEL_MODEL& model : models)
+			model.filename = bake.AddString(model.filename);
+		bake.AddArray(BAKE_MATERIALS, materials);
+		bake.AddArray(BAKE_ATTRIBUTES, levelAttributes);
+		bake.AddArray(BAKE_BATCHES, levelBatches);
+		bake.AddArray(BAKE_MESHES, meshes);
+		bake.AddArray(BAKE_MESH_PARTS, parts);
+		bake.AddArray(BAKE_MODEL_LODS, levelModelLODs);
+		bake.AddArray(BAKE_MODELS, models);
+		bake.AddArray(BAKE_MESH_BOUNDS, levelMeshBounds);
+		bake.AddArray(BAKE_MODEL_BOUNDS, levelModelBounds);
+	}
+	// reads AddLevelTables' arrays back from levelBake and points their names into its mapping
+	bool ReadLevelTables() {
+		bool read = levelBake.ReadArray(BAKE_MATERIALS, levelMaterials) && levelBake.ReadArray(BAKE_ATTRIBUTES, levelAttributes) &&
+			levelBake.ReadArray(BAKE_BATCHES, levelBatches) && levelBake.ReadArray(BAKE_MESHES, levelMeshes) &&
+			levelBake.ReadArray(BAKE_MESH_PARTS, levelMeshParts) && levelBake.ReadArray(BAKE_MODEL_LODS, levelModelLODs) &&
+			levelBake.ReadArray(BAKE_MODELS, levelModels) && levelBake.ReadArray(BAKE_MESH_BOUNDS, levelMeshBounds) &&
+			levelBake.ReadArray(BAKE_MODEL_BOUNDS, levelModelBounds);
+		if (!read)
+			return false;
+		for (H2B::MATERIAL& material : levelMaterials)
+			for (int k = 0; k < 10; ++k)
+				*((&material.name) + k) = levelBake.Relocate(*((&material.name) + k));
+		for (H2B::MESH& mesh : levelMeshes)
+			mesh.name = levelBake.Relocate(mesh.name);
+		for (MESH_PART& part : levelMeshParts)
+			part.name = levelBake.Relocate(part.name);
+		for (LEVEL_MODEL& model : levelModels)
+			model.filename = levelBake.Relocate(model.filename);
+		return true;
+	}
+	// the final arrays as one blob
+	bool WriteLevelBake(const std::string& path, uint64_t key) const {
+		LevelBakeWriter bake;
+		AddLevelTables(bake);
+		bake.AddArray(BAKE_VERTICES, levelVertices);
+		bake.AddArray(BAKE_INDICES, levelIndices);
+		bake.AddArray(BAKE_TRANSFORMS, levelTransforms);
+		bake.AddArray(BAKE_MESH_RANGES, levelMeshRanges);
+		bake.AddArray(BAKE_COMPACT_VERTICES, levelCompactVertices);
+		bake.AddArray(BAKE_INDICES16, levelIndices16);
+		bake.AddArray(BAKE_INDICES32, levelIndices32);
+		bake.AddArray(BAKE_MESH_QUANTIZATION, levelMeshQuantization);
+		bake.AddArray(BAKE_MESH_LODS, levelMeshLODs);
+		bake.AddArray(BAKE_LOD_QUANTIZATION, levelLODQuantization);
+		bake.AddArray(BAKE_HLOD_CELLS, levelHLODCells);
+		bake.AddArray(BAKE_HLOD_MEMBERS, levelHLODMembers);
+		bake.AddArray(BAKE_POSITIONS, levelPositions);
+		bake.AddArray(BAKE_VERTEX_ATTRIBUTES, levelVertexAttributes);
+		bake.AddArray(BAKE_COMPACT_POSITIONS, levelCompactPositions);
+		bake.AddArray(BAKE_MESHLETS, levelMeshlets);
+		bake.AddArray(BAKE_MESH_MESHLETS, levelMeshMeshlets);
+		bake.AddArray(BAKE_INSTANCES, levelInstances);
+		bake.AddArray(BAKE_POINT_LIGHTS, levelPointLights);
+		bake.AddArray(BAKE_SPOT_LIGHTS, levelSpotLights);
+		bake.AddArray(BAKE_TRANSFORM_PARENTS, levelTransformParents);
+		return bake.Save(path, key);
+	}
+	// maps a bake with a matching key and fixes its name pointers up, false leaves the level empty
+	bool ReadLevelBake(const std::string& path, uint64_t key) {
+		if (!levelBake.Open(path, key))
+			return false;
+		bool read = ReadLevelTables() && levelBake.ReadArray(BAKE_VERTICES, levelVertices) &&
+			levelBake.ReadArray(BAKE_INDICES, levelIndices) && levelBake.ReadArray(BAKE_TRANSFORMS, levelTransforms) &&
+			levelBake.ReadArray(BAKE_MESH_RANGES, levelMeshRanges) &&
+			levelBake.ReadArray(BAKE_COMPACT_VERTICES, levelCompactVertices) &&
+			levelBake.ReadArray(BAKE_INDICES16, levelIndices16) && levelBake.ReadArray(BAKE_INDICES32, levelIndices32) &&
+			levelBake.ReadArray(BAKE_MESH_QUANTIZATION, levelMeshQuantization) &&
+			levelBake.ReadArray(BAKE_MESH_LODS, levelMeshLODs) &&
+			levelBake.ReadArray(BAKE_LOD_QUANTIZATION, levelLODQuantization) &&
+			levelBake.ReadArray(BAKE_HLOD_CELLS, levelHLODCells) &&
+			levelBake.ReadArray(BAKE_HLOD_MEMBERS, levelHLODMembers) && levelBake.ReadArray(BAKE_POSITIONS, levelPositions) &&
+			levelBake.ReadArray(BAKE_VERTEX_ATTRIBUTES, levelVertexAttributes) &&
+			levelBake.ReadArray(BAKE_COMPACT_POSITIONS, levelCompactPositions) &&
+			levelBake.ReadArray(BAKE_MESHLETS, levelMeshlets) && levelBake.ReadArray(BAKE_MESH_MESHLETS, levelMeshMeshlets) &&
+			levelBake.ReadArray(BAKE_INSTANCES, levelInstances) &&
+			levelBake.ReadArray(BAKE_POINT_LIGHTS, levelPointLights) && levelBake.ReadArray(BAKE_SPOT_LIGHTS, levelSpotLights) &&
+			levelBake.ReadArray(BAKE_TRANSFORM_PARENTS, levelTransformParents);
+		if (!read) {
+			UnloadLevel();
+			return false;
+		}
+		BuildInstanceBounds();
+		if (m_transformHierarchy)
+			BuildHierarchy();
+		return true;
+	}
 	// internal defintion for reading the GameLevel layout 
 	struct MODEL_ENTRY
 	{
 		std::string modelFile; // path to .h2b file
 		mutable std::vector<GW::MATH::GMATRIXF> instances; // where to draw
+		unsigned fileTransformStart = 0; // binary levels, where instances start in the file
+		mutable unsigned levelTransformStart = ~0u; // where instances landed, ~0u if the model is missing
 		bool operator<(const MODEL_ENTRY& cmp) const {
 			return modelFile < cmp.modelFile; // you need this for std::set to work
 		}
@@ -270,17 +1501,82 @@ private:
 		log.LogCategorized("MESSAGE", "Game Level File Reading Complete.");
 		return true;
 	}
+	// internal helper for reading a binary level (BinaryLevel.h), every model's transforms are
+	// one contiguous range already and models come sorted, so nothing is looked up or grouped
+	void ReadBinaryGameLevel(const LevelFileReader& level,
+							 std::set<MODEL_ENTRY>& outModels,
+							 GW::SYSTEM::GLog log) {
+		log.LogCategorized("MESSAGE", "Begin Reading Binary Game Level.");
+		static_assert(sizeof(LEVEL_FILE_MATRIX) == sizeof(GW::MATH::GMATRIXF), "transforms are copied as is");
+		for (uint32_t i = 0; i < level.ModelCount(); ++i) {
+			MODEL_ENTRY add = { level.ModelName(i), };
+			const GW::MATH::GMATRIXF* first = reinterpret_cast<const GW::MATH::GMATRIXF*>(level.Transforms(i));
+			add.instances.assign(first, first + level.TransformCount(i));
+			add.fileTransformStart = level.TransformStart(i);
+			log.LogCategorized("INFO", (std::string("Model Detected: ") + add.modelFile + " x" +
+				std::to_string(add.instances.size())).c_str());
+			outModels.emplace_hint(outModels.end(), std::move(add));
+		}
+		for (uint32_t i = 0; i < level.PointLightCount(); ++i)
+			levelPointLights.push_back(ToPointLight(level.PointLights()[i]));
+		for (uint32_t i = 0; i < level.SpotLightCount(); ++i)
+			levelSpotLights.push_back(ToSpotLight(level.SpotLights()[i]));
+		if (level.Parents() != nullptr)
+			levelFileParents.assign(level.Parents(), level.Parents() + level.TransformCount());
+		log.LogCategorized("INFO", (std::string("Binary level: ") + std::to_string(level.ModelCount()) + " models, " +
+			std::to_string(level.PointLightCount() + level.SpotLightCount()) + " lights").c_str());
+		log.LogCategorized("MESSAGE", "Binary Game Level Reading Complete.");
+	}
+	static POINT_LIGHT ToPointLight(const LEVEL_FILE_POINT_LIGHT& read) {
+		POINT_LIGHT light;
+		std::memcpy(&light.transform, &read.transform, sizeof(light.transform));
+		light.color = { read.color[0], read.color[1], read.color[2], 1 };
+		light.energy = read.energy;
+		light.distance = read.distance;
+		light.q_attenuation = read.qAttenuation;
+		light.l_attenuation = read.lAttenuation;
+		return light;
+	}
+	static SPOT_LIGHT ToSpotLight(const LEVEL_FILE_SPOT_LIGHT& read) {
+		SPOT_LIGHT light;
+		std::memcpy(&light.transform, &read.transform, sizeof(light.transform));
+		light.color = { read.color[0], read.color[1], read.color[2], 1 };
+		light.energy = read.energy;
+		light.distance = read.distance;
+		light.q_attenuation = read.qAttenuation;
+		light.l_attenuation = read.lAttenuation;
+		light.spotSize = read.spotSize;
+		light.spotBlend = read.spotBlend;
+		return light;
+	}
 	// internal helper for collecting all .h2b data into unified arrays
 	bool ReadAndCombineH2Bs(const char* h2bFolderPath, 
+							const ModelPack& pack,
 							const std::set<MODEL_ENTRY>& modelSet,
 							GW::SYSTEM::GLog log) {
 		log.LogCategorized("MESSAGE", "Begin Importing .H2B File Data.");
 		// parse each model adding to overall arrays
 		H2B::Parser p; // reads the .h2b format
 		const std::string modelPath = h2bFolderPath;
-		for (auto i = modelSet.begin(); i != modelSet.end(); ++i)
+		unsigned missesBefore = 0, missesAfter = 0, uniqueVertices = 0, meshesMerged = 0, packed = 0;
+		// every model the level uses comes out of the pack in one go (decompressed on worker
+		// threads if the pack is compressed), a model it doesn't have is read loose
+		std::vector<std::string> modelNames;
+		for (const MODEL_ENTRY& entry : modelSet)
+			modelNames.push_back(entry.modelFile);
+		std::vector<unsigned char> unpacked;
+		std::vector<MODEL_PACK_SPAN> packedModels;
+		if (pack.IsOpen() && !pack.Unpack(modelNames, unpacked, packedModels)) {
+			log.LogCategorized("WARNING", "Model pack is damaged, reading loose .h2b files.");
+			packedModels.clear();
+		}
+		packedModels.resize(modelSet.size(), { nullptr, 0 });
+		auto packedModel = packedModels.begin();
+		for (auto i = modelSet.begin(); i != modelSet.end(); ++i, ++packedModel)
 		{
-			if (p.Parse((modelPath + "/" + i->modelFile).c_str()))
+			bool inPack = packedModel->data != nullptr;
+			packed += inPack ? 1 : 0;
+			if (inPack ? p.Parse(packedModel->data, packedModel->size) : p.Parse((modelPath + "/" + i->modelFile).c_str()))
 			{
 				log.LogCategorized("INFO", (std::string("H2B Imported: ") + i->modelFile).c_str());
 				// transfer all string data
@@ -296,11 +1592,26 @@ private:
 						p.meshes[j].name =
 						level_strings.insert(p.meshes[j].name).first->c_str();
 				}
+				// an optimized pack already went through both steps at build time (H2BOptimizer)
+				bool preOptimized = inPack && pack.IsOptimized();
+				// merge duplicate vertices first so the optimizer sees the real connectivity
+				if (m_dedupGeometryOnImport && !preOptimized)
+					geometryPool.AddWeldedVertices(WeldVertices(p.vertices, p.indices));
+				// reorder triangles/vertices for the post transform cache, draw ranges are preserved
+				if (m_optimizeMeshesOnImport && !preOptimized) {
+					MESH_OPTIMIZE_REPORT report = OptimizeMesh(p);
+					missesBefore += report.before.misses;
+					missesAfter += report.after.misses;
+					uniqueVertices += report.after.vertices;
+					log.LogCategorized("INFO", (std::string("Vertex cache ") + i->modelFile +
+						": ACMR " + std::to_string(report.before.acmr) + " -> " + std::to_string(report.after.acmr) +
+						", ATVR " + std::to_string(report.before.atvr) + " -> " + std::to_string(report.after.atvr)).c_str());
+				}
 				// record source file name & sizes
 				LEVEL_MODEL model;
 				model.filename = level_strings.insert(i->modelFile).first->c_str();
-				model.vertexCount = p.vertexCount;
-				model.indexCount = p.indexCount;
+				model.vertexCount = (unsigned)p.vertices.size();
+				model.indexCount = (unsigned)p.indices.size();
 				model.materialCount = p.materialCount;
 				model.meshCount = p.meshCount;
 				// record offsets
@@ -309,12 +1620,45 @@ private:
 				model.materialStart = levelMaterials.size();
 				model.batchStart = levelBatches.size();
 				model.meshStart = levelMeshes.size();
-				// append/move all data
-				levelVertices.insert(levelVertices.end(), p.vertices.begin(), p.vertices.end());
-				levelIndices.insert(levelIndices.end(), p.indices.begin(), p.indices.end());
-				levelMaterials.insert(levelMaterials.end(), p.materials.begin(), p.materials.end());
+				// only materials not seen before get a new slot, meshes are remapped to the shared one
+				std::vector<unsigned> materialSlots(p.materialCount);
+				for (int j = 0; j < p.materialCount; ++j)
+					materialSlots[j] = AddUniqueMaterial(p.materials[j]);
+				for (int j = 0; j < p.meshCount; ++j)
+					p.meshes[j].materialIndex = materialSlots[p.meshes[j].materialIndex];
+				// one draw range per level material, the exported meshes become parts of them
+				std::vector<MESH_PART> parts;
+				unsigned meshesBefore = p.meshCount;
+				if (m_mergeMaterialBatches)
+					MergeMeshesByMaterial(p, parts);
+				else
+					for (unsigned j = 0; j < p.meshCount; ++j)
+						parts.push_back({ p.meshes[j].name, j, 0, p.meshes[j].drawInfo.indexCount });
+				for (MESH_PART& part : parts)
+					part.meshIndex += model.meshStart;
+				model.partStart = (unsigned)levelMeshParts.size();
+				model.partCount = (unsigned)parts.size();
+				model.meshCount = p.meshCount;
+				model.indexCount = (unsigned)p.indices.size();
+				levelMeshParts.insert(levelMeshParts.end(), parts.begin(), parts.end());
+				meshesMerged += meshesBefore - p.meshCount;
+				// append/move all data, each mesh reuses identical geometry from any earlier model
+				if (m_dedupGeometryOnImport) {
+					for (int j = 0; j < p.meshCount; ++j)
+						levelMeshRanges.push_back(geometryPool.AddMesh(p.vertices, p.indices,
+							p.meshes[j].drawInfo.indexOffset, p.meshes[j].drawInfo.indexCount,
+							levelVertices, levelIndices));
+				}
+				else {
+					for (int j = 0; j < p.meshCount; ++j)
+						levelMeshRanges.push_back({ model.indexStart + p.meshes[j].drawInfo.indexOffset,
+							p.meshes[j].drawInfo.indexCount, model.vertexStart, model.vertexCount });
+					levelVertices.insert(levelVertices.end(), p.vertices.begin(), p.vertices.end());
+					levelIndices.insert(levelIndices.end(), p.indices.begin(), p.indices.end());
+				}
 				levelBatches.insert(levelBatches.end(), p.batches.begin(), p.batches.end());
 				levelMeshes.insert(levelMeshes.end(), p.meshes.begin(), p.meshes.end());
+				AddModelBounds(model);
 				// add level model
 				levelModels.push_back(model);
 				// add level model instances
@@ -322,6 +1666,7 @@ private:
 				instances.flags = 0; // shadows? transparency? much we could do with this.
 				instances.modelIndex = levelModels.size() - 1;
 				instances.transformStart = levelTransforms.size();
+				i->levelTransformStart = instances.transformStart;
 				instances.transformCount = i->instances.size();
 				levelTransforms.insert(levelTransforms.end(), i->instances.begin(), i->instances.end());
 				// add instance set
@@ -334,9 +1679,415 @@ private:
 				log.LogCategorized("WARNING", "Loading will continue but model(s) are missing.");
 			}
 		}
+		if (pack.IsOpen())
+			log.LogCategorized("INFO", (std::string("Model pack: ") + std::to_string(packed) + " of " +
+				std::to_string(modelSet.size()) + " models read from " + m_modelPackName +
+				(pack.IsCompressed() ? " (compressed)" : "") +
+				(pack.IsOptimized() ? ", pre-optimized" : "")).c_str());
+		unsigned totalMaterials = 0;
+		for (auto& model : levelModels)
+			totalMaterials += model.materialCount;
+		log.LogCategorized("INFO", (std::string("Materials: ") + std::to_string(levelMaterials.size()) +
+			" unique of " + std::to_string(totalMaterials) + " imported").c_str());
+		if (m_mergeMaterialBatches)
+			log.LogCategorized("INFO", (std::string("Material batches: ") + std::to_string(levelMeshParts.size()) +
+				" meshes -> " + std::to_string(levelMeshes.size()) + " draw ranges (" + std::to_string(meshesMerged) +
+				" merged)").c_str());
+		if (m_dedupGeometryOnImport) {
+			const GEOMETRY_DEDUP_REPORT& dedup = geometryPool.GetReport();
+			log.LogCategorized("INFO", (std::string("Geometry: ") + std::to_string(dedup.meshesShared) + " of " +
+				std::to_string(dedup.meshesAdded + dedup.meshesShared) + " meshes shared, " +
+				std::to_string(dedup.verticesWelded) + " vertices welded, " +
+				std::to_string(dedup.bytesStored / 1024) + " KiB stored of " +
+				std::to_string(dedup.bytesImported / 1024) + " KiB").c_str());
+		}
+		if (m_optimizeMeshesOnImport && uniqueVertices > 0)
+			log.LogCategorized("INFO", (std::string("Vertex shader invocations per level draw: ") +
+				std::to_string(missesBefore) + " -> " + std::to_string(missesAfter) +
+				" (ATVR " + std::to_string((float)missesAfter / uniqueVertices) + ")").c_str());
 		log.LogCategorized("MESSAGE", "Importing of .H2B File Data Complete.");
 		return true;
 	}
+	// imports models into the loaded level without touching what's there: their geometry and
+	// materials are appended, each gets one instance set holding its entries' instances, and the
+	// derived data is extended to them. levelGeometryVersion and levelInstanceLayout change so the
+	// renderer grows its buffers
+	void ImportLevelModels(const char* h2bFolderPath, const std::set<MODEL_ENTRY>& models, GW::SYSTEM::GLog log) {
+		unsigned firstSet = (unsigned)levelInstances.size(), firstMesh = (unsigned)levelMeshes.size();
+		unsigned firstTransform = (unsigned)levelTransforms.size();
+		size_t firstVertex = levelVertices.size();
+		ModelPack pack;
+		if (m_useModelPack)
+			pack.Open(std::string(h2bFolderPath) + "/" + m_modelPackName);
+		ReadAndCombineH2Bs(h2bFolderPath, pack, models, log);
+		for (unsigned set = firstSet; set < levelInstances.size(); ++set)
+			for (const char* name : m_dynamicModels)
+				if (std::strcmp(levelModels[levelInstances[set].modelIndex].filename, name) == 0)
+					levelInstances[set].flags |= INSTANCE_DYNAMIC;
+		if (m_generateLODs)
+			BuildLevelLODs(log, firstMesh);
+		if (m_compactVertexFormat)
+			BuildCompactGeometry(log, true);
+		if (m_splitVertexStreams)
+			BuildVertexStreams(firstVertex);
+		if (m_meshletCulling)
+			BuildLevelMeshlets(log, firstMesh);
+		for (size_t i = levelAttributes.size(); i < levelMaterials.size(); ++i)
+			levelAttributes.push_back(levelMaterials[i].attrib);
+
+		levelTransformParents.resize(levelTransforms.size(), -1);
+		levelInstanceBounds.Resize(levelTransforms.size());
+		RefreshInstanceBounds(firstTransform, (unsigned)levelTransforms.size() - firstTransform);
+		levelFreeInstances.Resize(levelInstances.size(), levelTransforms.size());
+		if (!levelHierarchy.IsEmpty()) {
+			UpdateHierarchy();
+			BuildHierarchy();
+		}
+		++levelGeometryVersion;
+		++levelInstanceLayout;
+	}
+	// simplified index ranges for every mesh from firstMesh on (LevelOfDetail.h) and per model
+	// bounds + LOD error, meshes sharing geometry share their LODs too
+	void BuildLevelLODs(GW::SYSTEM::GLog log, unsigned firstMesh = 0) {
+		std::unordered_map<unsigned, unsigned> built; // geometry indexStart -> mesh that built its LODs
+		std::vector<float> meshErrors(levelMeshes.size() * m_lodLevels, 0.0f);
+		levelMeshLODs.resize(levelMeshes.size() * m_lodLevels);
+		// meshes built before only kept their model's worst error, a new mesh sharing one gets that
+		for (size_t m = 0; m < levelModelLODs.size(); ++m)
+			for (unsigned j = levelModels[m].meshStart; j < levelModels[m].meshStart + levelModels[m].meshCount && j < firstMesh; ++j) {
+				built.emplace(levelMeshRanges[j].indexStart, j);
+				for (unsigned l = 0; l < m_lodLevels; ++l)
+					meshErrors[j * m_lodLevels + l] = levelModelLODs[m].error[l + 1];
+			}
+		unsigned shared = (unsigned)built.size();
+		unsigned long long triangles[m_lodLevels + 1] = {};
+		for (size_t j = firstMesh; j < levelMeshRanges.size(); ++j) {
+			const GEOMETRY_RANGE& range = levelMeshRanges[j];
+			auto found = built.find(range.indexStart);
+			if (found != built.end()) {
+				for (unsigned l = 0; l < m_lodLevels; ++l) {
+					levelMeshLODs[j * m_lodLevels + l] = levelMeshLODs[found->second * m_lodLevels + l];
+					meshErrors[j * m_lodLevels + l] = meshErrors[found->second * m_lodLevels + l];
+				}
+			}
+			else {
+				std::vector<unsigned> lods[m_lodLevels];
+				GenerateMeshLODs(&levelVertices[range.baseVertex], range.vertexCount,
+					&levelIndices[range.indexStart], range.indexCount, lods, &meshErrors[j * m_lodLevels]);
+				for (unsigned l = 0; l < m_lodLevels; ++l) {
+					// a LOD that didn't reduce any further reuses the previous range
+					const GEOMETRY_RANGE& previous = l == 0 ? range : levelMeshLODs[j * m_lodLevels + l - 1];
+					if (lods[l].size() == previous.indexCount) {
+						levelMeshLODs[j * m_lodLevels + l] = previous;
+						continue;
+					}
+					levelMeshLODs[j * m_lodLevels + l] = { (unsigned)levelIndices.size(), (unsigned)lods[l].size(),
+						range.baseVertex, range.vertexCount };
+					levelIndices.insert(levelIndices.end(), lods[l].begin(), lods[l].end());
+				}
+				built.emplace(range.indexStart, (unsigned)j);
+			}
+			triangles[0] += range.indexCount / 3;
+			for (unsigned l = 0; l < m_lodLevels; ++l)
+				triangles[l + 1] += levelMeshLODs[j * m_lodLevels + l].indexCount / 3;
+		}
+		// error is the worst of the model's meshes
+		for (size_t m = levelModelLODs.size(); m < levelModels.size(); ++m) {
+			const LEVEL_MODEL& model = levelModels[m];
+			LOD_BOUNDS bounds = ToLODBounds(levelModelBounds[m]);
+			for (unsigned j = model.meshStart; j < model.meshStart + model.meshCount; ++j)
+				for (unsigned l = 0; l < m_lodLevels; ++l)
+					bounds.error[l + 1] = (std::max)(bounds.error[l + 1], meshErrors[j * m_lodLevels + l]);
+			levelModelLODs.push_back(bounds);
+		}
+		std::string counts = std::to_string(triangles[0]);
+		for (unsigned l = 1; l <= m_lodLevels; ++l)
+			counts += " / " + std::to_string(triangles[l]);
+		log.LogCategorized("INFO", (std::string("LODs: ") + std::to_string(built.size() - shared) +
+			" meshes simplified, triangles per LOD " + counts).c_str());
+	}
+	// mesh bounds over each mesh's vertex block (SSE), the model's box is their union and its
+	// sphere reaches the farthest vertex of any of them
+	void AddModelBounds(const LEVEL_MODEL& model) {
+		LOCAL_BOUNDS bounds = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+		for (unsigned j = model.meshStart; j < model.meshStart + model.meshCount; ++j) {
+			const GEOMETRY_RANGE& range = levelMeshRanges[j];
+			levelMeshBounds.push_back(ComputeBounds(&levelVertices[range.baseVertex], range.vertexCount));
+			for (int k = 0; k < 3; ++k) {
+				bounds.min[k] = (std::min)(bounds.min[k], levelMeshBounds.back().min[k]);
+				bounds.max[k] = (std::max)(bounds.max[k], levelMeshBounds.back().max[k]);
+			}
+		}
+		for (int k = 0; k < 3; ++k) {
+			if (model.meshCount == 0)
+				bounds.min[k] = bounds.max[k] = 0;
+			bounds.center[k] = (bounds.min[k] + bounds.max[k]) * 0.5f;
+		}
+		bounds.radius = 0;
+		for (unsigned j = model.meshStart; j < model.meshStart + model.meshCount; ++j)
+			bounds.radius = (std::max)(bounds.radius, ComputeSphereRadius(&levelVertices[levelMeshRanges[j].baseVertex],
+				levelMeshRanges[j].vertexCount, bounds.center));
+		levelModelBounds.push_back(bounds);
+	}
+	static LOD_BOUNDS ToLODBounds(const LOCAL_BOUNDS& local) {
+		LOD_BOUNDS bounds = {};
+		for (int k = 0; k < 3; ++k)
+			bounds.center[k] = local.center[k];
+		bounds.radius = local.radius;
+		return bounds;
+	}
+	// flags every instance set of an m_dynamicModels model INSTANCE_DYNAMIC and moves their
+	// transforms behind all the static ones, so the renderer streams one block and the static
+	// rest never changes. Runs before anything else refers to transform slots
+	void PartitionDynamicInstances(const std::set<MODEL_ENTRY>& modelSet, GW::SYSTEM::GLog log) {
+		std::vector<GW::MATH::GMATRIXF> transforms;
+		transforms.reserve(levelTransforms.size());
+		std::unordered_map<unsigned, unsigned> moved; // old transformStart -> new
+		unsigned dynamicCount = 0;
+		for (MODEL_INSTANCES& instances : levelInstances)
+			for (const char* name : m_dynamicModels)
+				if (std::strcmp(levelModels[instances.modelIndex].filename, name) == 0)
+					instances.flags |= INSTANCE_DYNAMIC;
+		for (unsigned dynamic = 0; dynamic < 2; ++dynamic)
+			for (MODEL_INSTANCES& instances : levelInstances) {
+				if (((instances.flags & INSTANCE_DYNAMIC) != 0) != (dynamic != 0))
+					continue;
+				moved[instances.transformStart] = (unsigned)transforms.size();
+				transforms.insert(transforms.end(), levelTransforms.begin() + instances.transformStart,
+					levelTransforms.begin() + instances.transformStart + instances.transformCount);
+				instances.transformStart = moved[instances.transformStart];
+				dynamicCount += dynamic ? instances.transformCount : 0;
+			}
+		levelTransforms.swap(transforms);
+		for (const MODEL_ENTRY& entry : modelSet)
+			if (entry.levelTransformStart != ~0u)
+				entry.levelTransformStart = moved[entry.levelTransformStart];
+		if (dynamicCount > 0)
+			log.LogCategorized("INFO", (std::string("Dynamic transforms: ") + std::to_string(dynamicCount) + " of " +
+				std::to_string(levelTransforms.size())).c_str());
+	}
+	// levelTransformParents from the binary level's parents (file order) through where each
+	// model's transforms landed, everything else (text levels, HLOD proxies) is a root
+	void BuildTransformParents(const std::set<MODEL_ENTRY>& modelSet) {
+		levelTransformParents.assign(levelTransforms.size(), -1);
+		if (levelFileParents.empty())
+			return;
+		std::vector<int> fileToLevel(levelFileParents.size(), -1);
+		for (const MODEL_ENTRY& entry : modelSet)
+			for (unsigned k = 0; entry.levelTransformStart != ~0u && k < entry.instances.size(); ++k)
+				if (entry.fileTransformStart + k < fileToLevel.size())
+					fileToLevel[entry.fileTransformStart + k] = entry.levelTransformStart + k;
+		for (size_t f = 0; f < levelFileParents.size(); ++f) {
+			int parent = levelFileParents[f];
+			if (fileToLevel[f] >= 0 && parent >= 0 && (size_t)parent < fileToLevel.size())
+				levelTransformParents[fileToLevel[f]] = fileToLevel[parent];
+		}
+		levelFileParents.clear();
+	}
+	// local matrices from the loaded world matrices, nothing moves until SetLocalTransform
+	void BuildHierarchy() {
+		levelHierarchy.Build(levelTransformParents.data(), levelTransforms.data(), (unsigned)levelTransforms.size());
+	}
+	// world bounds of every transform from its model's local bounds
+	void BuildInstanceBounds() {
+		levelInstanceBounds.Resize(levelTransforms.size());
+		for (const MODEL_INSTANCES& instances : levelInstances)
+			TransformBounds(levelModelBounds[instances.modelIndex], levelTransforms.data(),
+				instances.transformStart, instances.transformCount, levelInstanceBounds);
+	}
+	// merges grid cells of small instances into one proxy model each (HLOD.h). Proxies are made
+	// from the members' coarsest LODs when there are LODs and appended like any imported model
+	void BuildLevelHLODs(GW::SYSTEM::GLog log) {
+		std::vector<unsigned> transformModel(levelTransforms.size());
+		for (const MODEL_INSTANCES& instances : levelInstances)
+			for (unsigned t = instances.transformStart; t < instances.transformStart + instances.transformCount; ++t)
+				transformModel[t] = instances.modelIndex;
+		std::vector<float> spheres(levelTransforms.size() * 4);
+		for (size_t t = 0; t < levelTransforms.size(); ++t)
+			TransformBoundingSphere(levelModelBounds[transformModel[t]].center, levelModelBounds[transformModel[t]].radius,
+				levelTransforms[t], &spheres[t * 4]);
+		// dynamic transforms are the last block and never get merged into a proxy
+		std::vector<TRANSFORM_RANGE> dynamic = GetDynamicTransforms();
+		BuildHLODCells(reinterpret_cast<const float(*)[4]>(spheres.data()), dynamic.empty() ? levelTransforms.size() : dynamic.front().first,
+			levelHLODCells, levelHLODMembers);
+
+		unsigned long long memberDraws = 0, memberTriangles = 0, proxyTriangles = 0;
+		std::vector<std::vector<HLOD_PART>> cellParts(levelHLODCells.size());
+		for (size_t c = 0; c < levelHLODCells.size(); ++c) {
+			const HLOD_CELL& cell = levelHLODCells[c];
+			for (unsigned m = cell.memberStart; m < cell.memberStart + cell.memberCount; ++m) {
+				unsigned transform = levelHLODMembers[m];
+				const LEVEL_MODEL& model = levelModels[transformModel[transform]];
+				for (unsigned j = model.meshStart; j < model.meshStart + model.meshCount; ++j) {
+					const GEOMETRY_RANGE& range = levelMeshLODs.empty() ? levelMeshRanges[j] :
+						levelMeshLODs[j * m_lodLevels + m_lodLevels - 1];
+					cellParts[c].push_back({ &levelVertices[range.baseVertex], range.vertexCount,
+						&levelIndices[range.indexStart], range.indexCount, levelTransforms[transform],
+						&levelMaterials[levelMeshes[j].materialIndex].attrib });
+					memberTriangles += levelMeshRanges[j].indexCount / 3;
+				}
+				memberDraws += model.meshCount;
+			}
+		}
+		std::vector<HLOD_PROXY> proxies;
+		BuildHLODProxies(cellParts, proxies);
+
+		for (size_t c = 0; c < proxies.size(); ++c) {
+			HLOD_PROXY& proxy = proxies[c];
+			HLOD_CELL& cell = levelHLODCells[c];
+			cell.error = proxy.report.error;
+			proxyTriangles += proxy.report.proxyTriangles;
+			// one model with one mesh using one baked material
+			std::string name = "HLOD_" + std::to_string(c);
+			H2B::MATERIAL material = {};
+			material.attrib = proxy.material;
+			material.name = level_strings.insert(name).first->c_str();
+			H2B::MESH mesh = {};
+			mesh.name = material.name;
+			mesh.drawInfo = { (unsigned)proxy.indices.size(), 0 };
+			LEVEL_MODEL model;
+			model.filename = material.name;
+			model.vertexCount = (unsigned)proxy.vertices.size();
+			model.indexCount = (unsigned)proxy.indices.size();
+			model.materialCount = 1;
+			model.meshCount = 1;
+			model.vertexStart = (unsigned)levelVertices.size();
+			model.indexStart = (unsigned)levelIndices.size();
+			model.materialStart = (unsigned)levelMaterials.size();
+			model.batchStart = (unsigned)levelBatches.size();
+			model.meshStart = (unsigned)levelMeshes.size();
+			model.partStart = (unsigned)levelMeshParts.size();
+			model.partCount = 1;
+			levelMeshParts.push_back({ mesh.name, model.meshStart, 0, model.indexCount });
+			mesh.materialIndex = AddUniqueMaterial(material);
+			GEOMETRY_RANGE range = { model.indexStart, model.indexCount, model.vertexStart, model.vertexCount };
+			levelMeshRanges.push_back(range);
+			levelVertices.insert(levelVertices.end(), proxy.vertices.begin(), proxy.vertices.end());
+			levelIndices.insert(levelIndices.end(), proxy.indices.begin(), proxy.indices.end());
+			levelBatches.push_back({ model.indexCount, 0 });
+			levelMeshes.push_back(mesh);
+			AddModelBounds(model);
+			// proxies have no LODs of their own, every level is the proxy itself
+			if (!levelMeshLODs.empty()) {
+				for (unsigned l = 0; l < m_lodLevels; ++l)
+					levelMeshLODs.push_back(range);
+				levelModelLODs.push_back(ToLODBounds(levelModelBounds.back()));
+			}
+			levelModels.push_back(model);
+			MODEL_INSTANCES instances;
+			instances.flags = 0;
+			instances.modelIndex = (unsigned)levelModels.size() - 1;
+			instances.transformStart = (unsigned)levelTransforms.size();
+			instances.transformCount = 1;
+			cell.proxyTransform = instances.transformStart;
+			levelTransforms.push_back(GW::MATH::GIdentityMatrixF);
+			levelInstances.push_back(instances);
+		}
+		log.LogCategorized("INFO", (std::string("HLOD: ") + std::to_string(levelHLODCells.size()) + " proxies over " +
+			std::to_string(levelHLODMembers.size()) + " instances, far draws " + std::to_string(memberDraws) + " -> " +
+			std::to_string(levelHLODCells.size()) + ", triangles " + std::to_string(memberTriangles) + " -> " +
+			std::to_string(proxyTriangles)).c_str());
+	}
+	// converts the combined geometry into the quantized GPU layout and logs the measured error.
+	// With append only meshes and LODs added since the last call are converted, onto the end of
+	// the compact arrays; one sharing geometry with an earlier mesh reuses its converted range
+	void BuildCompactGeometry(GW::SYSTEM::GLog log, bool append = false) {
+		size_t firstMesh = append ? levelMeshQuantization.size() : 0, firstLOD = append ? levelLODQuantization.size() : 0;
+		std::unordered_map<unsigned, QUANTIZED_RANGE> converted; // source indexStart -> compact range
+		for (size_t j = 0; j < firstMesh; ++j)
+			converted.emplace(levelMeshRanges[j].indexStart, levelMeshQuantization[j]);
+		for (size_t l = 0; l < firstLOD; ++l)
+			converted.emplace(levelMeshLODs[l].indexStart, levelLODQuantization[l]);
+		// LOD ranges use the same vertex blocks as LOD0 so they share its decode
+		std::vector<GEOMETRY_RANGE> ranges(levelMeshRanges.begin() + firstMesh, levelMeshRanges.end());
+		ranges.insert(ranges.end(), levelMeshLODs.begin() + firstLOD, levelMeshLODs.end());
+		std::vector<QUANTIZED_RANGE> done(ranges.size());
+		std::vector<GEOMETRY_RANGE> fresh;
+		std::vector<unsigned> freshSlots;
+		for (unsigned r = 0; r < ranges.size(); ++r) {
+			auto found = converted.find(ranges[r].indexStart);
+			if (found != converted.end() && found->second.indexCount == ranges[r].indexCount &&
+				found->second.baseVertex == ranges[r].baseVertex) {
+				done[r] = found->second;
+				continue;
+			}
+			fresh.push_back(ranges[r]);
+			freshSlots.push_back(r);
+		}
+		std::vector<QUANTIZED_RANGE> quantized;
+		QUANTIZATION_REPORT report = QuantizeLevelGeometry(levelVertices, levelIndices, fresh,
+			levelCompactVertices, levelIndices16, levelIndices32, quantized, append);
+		for (size_t f = 0; f < fresh.size(); ++f)
+			done[freshSlots[f]] = quantized[f];
+		size_t meshCount = levelMeshRanges.size() - firstMesh;
+		levelMeshQuantization.resize(firstMesh);
+		levelMeshQuantization.insert(levelMeshQuantization.end(), done.begin(), done.begin() + meshCount);
+		levelLODQuantization.resize(firstLOD);
+		levelLODQuantization.insert(levelLODQuantization.end(), done.begin() + meshCount, done.end());
+		log.LogCategorized("INFO", (std::string(append ? "Compact geometry (appended): " : "Compact geometry: ") +
+			std::to_string(report.bytesBefore / 1024) + " KiB -> " + std::to_string(report.bytesAfter / 1024) + " KiB, " +
+			std::to_string(report.ranges16) + " ranges 16 bit, " + std::to_string(report.ranges32) + " ranges 32 bit").c_str());
+		log.LogCategorized("INFO", (std::string("Quantization error: position ") +
+			std::to_string(report.maxPositionError) + " (" + std::to_string(report.maxPositionErrorRelative) +
+			" of extent), normal " + std::to_string(report.maxNormalErrorDegrees) + " deg, uv " +
+			std::to_string(report.maxUVError)).c_str());
+	}
+	// copies the interleaved vertices from firstVertex on into the position/attribute streams
+	void BuildVertexStreams(size_t firstVertex = 0) {
+		levelPositions.resize(levelVertices.size());
+		levelVertexAttributes.resize(levelVertices.size());
+		SplitVertexStreams(levelVertices.data() + firstVertex, levelVertices.size() - firstVertex,
+			levelPositions.data() + firstVertex, levelVertexAttributes.data() + firstVertex);
+		levelCompactPositions.resize(levelCompactVertices.size());
+		firstVertex = (std::min)(firstVertex, levelCompactVertices.size());
+		ExtractQuantizedPositions(levelCompactVertices.data() + firstVertex, levelCompactVertices.size() - firstVertex,
+			levelCompactPositions.data() + firstVertex);
+	}
+	// splits big meshes from firstMesh on into meshlets, meshes sharing geometry share their meshlets too
+	void BuildLevelMeshlets(GW::SYSTEM::GLog log, unsigned firstMesh = 0) {
+		std::unordered_map<unsigned, MESHLET_SPAN> built; // geometry indexStart -> meshlets
+		levelMeshMeshlets.resize(firstMesh);
+		for (unsigned j = 0; j < firstMesh; ++j)
+			if (levelMeshMeshlets[j].count > 0)
+				built.emplace(levelMeshRanges[j].indexStart, levelMeshMeshlets[j]);
+		unsigned shared = (unsigned)built.size();
+		levelMeshMeshlets.resize(levelMeshes.size(), { 0, 0 });
+		for (size_t j = firstMesh; j < levelMeshRanges.size(); ++j) {
+			const GEOMETRY_RANGE& range = levelMeshRanges[j];
+			if (range.indexCount / 3 < m_meshletMinTriangles)
+				continue;
+			auto found = built.find(range.indexStart);
+			if (found == built.end()) {
+				MESHLET_SPAN span = { (unsigned)levelMeshlets.size(), 0 };
+				BuildMeshlets(&levelVertices[range.baseVertex], &levelIndices[range.indexStart],
+					range.indexCount, levelMeshlets);
+				span.count = (unsigned)levelMeshlets.size() - span.first;
+				found = built.emplace(range.indexStart, span).first;
+			}
+			levelMeshMeshlets[j] = found->second;
+		}
+		log.LogCategorized("INFO", (std::string("Meshlets: ") + std::to_string(levelMeshlets.size()) +
+			" from " + std::to_string(built.size() - shared) + " meshes").c_str());
+	}
+	// returns the levelMaterials slot holding an identical material, adding one if needed.
+	// strings are already interned in level_strings so equal paths share a pointer.
+	unsigned AddUniqueMaterial(const H2B::MATERIAL& mat) {
+		uint64_t hash = HashBytes(&mat.attrib, sizeof(H2B::ATTRIBUTES));
+		for (int k = 1; k < 10; ++k) // texture paths, the material name doesn't affect rendering
+			hash = HashString(*((&mat.name) + k), hash);
+		std::vector<unsigned>& candidates = materialLookup[hash];
+		for (unsigned slot : candidates) {
+			const H2B::MATERIAL& cmp = levelMaterials[slot];
+			bool same = std::memcmp(&cmp.attrib, &mat.attrib, sizeof(H2B::ATTRIBUTES)) == 0;
+			for (int k = 1; k < 10 && same; ++k)
+				same = *((&cmp.name) + k) == *((&mat.name) + k);
+			if (same)
+				return slot;
+		}
+		levelMaterials.push_back(mat);
+		candidates.push_back((unsigned)levelMaterials.size() - 1);
+		return candidates.back();
+	}
 };
 
 struct GameManager
@@ -375,13 +2126,18 @@ struct GameManager
 		currentLevelData.LoadLevel(levelFilePaths[currentLevelIndex], "../Models", gameLevelLog);
 	}
 
-	void SwitchLevel()
+	// True when the level was loaded from scratch and the renderer has to re-initialize, a delta
+	// switch (m_levelDeltaSwitch) reaches the renderer through the level's edit state
+	bool SwitchLevel()
 	{
 		currentLevelIndex++;
 		if (currentLevelIndex >= levelFilePaths.size())
 			currentLevelIndex = 0;
 
+		if (m_levelDeltaSwitch && currentLevelData.ApplyLevelDelta(levelFilePaths[currentLevelIndex], "../Models", gameLevelLog))
+			return false;
 		LoadLevel();
+		return true;
 	}
 };
 
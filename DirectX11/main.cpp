@@ -58,8 +58,8 @@ int main()
 					if (GetAsyncKeyState(VK_F1))
 					{
 						GameManager* gm = renderer.GetGameManager();
-						gm->SwitchLevel();
-						renderer.ReInitializeBuffers();
+						if (gm->SwitchLevel())
+							renderer.ReInitializeBuffers();
 						renderer.BeginMusic();
 					}
 
@@ -1,7 +1,10 @@
 #include "load_data_oriented.h"
-#include <d3dcompiler.h>
+#include "LightLOD.h"
+#include "ShaderPermutations.h"
+#include "ShaderCache.h"		// Precompiled bytecode, runtime compilation is only a fallback
+#include "DepthSort.h"
+#include "DrawPackets.h"
 #include <commdlg.h>	// For open file dialog
-#pragma comment(lib, "d3dcompiler.lib") //needed for runtime shader compilation. Consider compiling shaders before runtime 
 
 void PrintLabeledDebugString(const char* label, const char* toPrint)
 {
@@ -25,14 +28,27 @@ class Renderer
 	bool isMusicPlaying = false;
 
 	Microsoft::WRL::ComPtr<ID3D11Buffer>		vertexBuffer;
+	Microsoft::WRL::ComPtr<ID3D11Buffer>		positionBuffer;	// Position only stream for the depth prepass
 	Microsoft::WRL::ComPtr<ID3D11Buffer>		indexBuffer;
-	Microsoft::WRL::ComPtr<ID3D11Buffer>		instanceBuffer;
+	Microsoft::WRL::ComPtr<ID3D11Buffer>		indexBuffer16;	// 16 bit ranges (m_compactVertexFormat)
+	Microsoft::WRL::ComPtr<ID3D11Buffer>		instanceBuffer;		// Every level transform, patched where static instances are edited, read by the VS through instanceView
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> instanceView;
+	Microsoft::WRL::ComPtr<ID3D11Buffer>		dynamicInstanceBuffer;	// Ring of copies of the packed INSTANCE_DYNAMIC ranges (DynamicTransforms.h)
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> dynamicInstanceView;
+	Microsoft::WRL::ComPtr<ID3D11Buffer>		instanceIdBuffer;	// Per frame depth sorted transform indices (vertex slot 1)
+	Microsoft::WRL::ComPtr<ID3D11Buffer>		materialBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> materialView;
 	ID3D11Buffer*								CB_PerSceneBuffer;
 	ID3D11Buffer*								CB_PerObjectBuffer;
 	ID3D11Buffer*								CB_PerFrameBuffer;
 	Microsoft::WRL::ComPtr<ID3D11VertexShader>	vertexShader;
-	Microsoft::WRL::ComPtr<ID3D11PixelShader>	pixelShader;
+	// One specialized pixel shader per permutation key (see ShaderPermutations.h)
+	Microsoft::WRL::ComPtr<ID3D11PixelShader>	pixelShaders[m_psPermutationCount];
 	Microsoft::WRL::ComPtr<ID3D11InputLayout>	vertexFormat;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader>	depthVertexShader;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout>	depthVertexFormat;
+	// Lit pass after the depth prepass: depth is final, test LESS_EQUAL and don't write
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthStateEqual;
 
 	// Rasterizer states
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterStateNormal;
@@ -48,10 +64,43 @@ class Renderer
 
 	// Create a GameManager for level loading/switching
 	GameManager gameManager;
+	// Picks the bounded set of point/spot lights sent to the GPU each frame
+	LightLOD lightLOD;
 	Clock flashlightBlockTimer;
 
 	bool goingUp = true;
 
+	// Every draw (instance set x mesh x LOD) flattened at load, re-sorted every frame
+	std::vector<DRAW_PACKET> drawPackets;
+	// This frame's ranges in meshletCuller.GetRanges() of meshlet culled meshes, per levelMeshes entry
+	struct VISIBLE_SPAN { unsigned first, count; };
+	std::vector<VISIBLE_SPAN> meshletVisible;
+
+	// Front to back ordering of each instance set's transforms, redone every frame
+	InstanceDepthSorter depthSorter;
+	std::vector<InstanceDepthSorter::SORT_GROUP> sortGroups;
+	// Per frame meshlet culling of big, rarely instanced meshes
+	MeshletCuller meshletCuller;
+	// LOD each transform drew with last frame (hysteresis state), also the sort subgroup
+	LODSelector lodSelector;
+	std::vector<uint8_t> instanceLODs;
+	// Whether each HLOD cell drew its proxy last frame (hysteresis state)
+	std::vector<uint8_t> hlodActive;
+	// Which copy of the dynamic transforms is current and what each one is missing
+	DynamicTransformRing dynamicRing;
+	// D3D11.1 lets dynamic SRV buffers be mapped NO_OVERWRITE, otherwise one copy refilled on DISCARD
+	bool dynamicNoOverwrite = false;
+	// Level_Data::levelInstanceLayout/levelLightsVersion/levelGeometryVersion the GPU side was built for, see ApplyLevelEdits
+	unsigned builtInstanceLayout = 0, builtLightsVersion = 0, builtGeometryVersion = 0;
+	// Elements uploaded to the geometry and material buffers, models a delta switch imports go after them
+	unsigned builtVertexCount = 0, builtIndexCount = 0, builtIndex16Count = 0, builtMaterialCount = 0;
+	// Size of the instance buffer, a streamed level keeps it while cells come and go
+	unsigned builtTransformCount = 0;
+	// Camera position and time of the last streaming update, for the prefetch velocity (m_worldPartition)
+	XMFLOAT3 streamingEye = {};
+	std::chrono::steady_clock::time_point streamingTime;
+	bool streamingPrimed = false;
+
 public:
 	Renderer(GW::SYSTEM::GWindow _win, GW::GRAPHICS::GDirectX11Surface _d3d)
 	{
@@ -97,7 +146,10 @@ public:
 		InitializeVertexBuffer(creator);
 		InitializeIndexBuffer(creator);
 		InitializeInstanceBuffer(creator);
+		InitializeMaterialBuffer(creator);
 		InitializeConstantBuffer(creator);
+		InitializeDrawPackets();
+		streamingPrimed = false;
 	}
 
 private:
@@ -109,7 +161,10 @@ private:
 		InitializeVertexBuffer(creator);
 		InitializeIndexBuffer(creator);
 		InitializeInstanceBuffer(creator);
+		InitializeMaterialBuffer(creator);
 		InitializeConstantBuffer(creator);
+		InitializeDrawPackets();
+		streamingPrimed = false;
 		InitializeRenderStates(creator);
 		InitializePipeline(creator);
 		
@@ -119,38 +174,206 @@ private:
 
 	void InitializeVertexBuffer(ID3D11Device* creator)
 	{
-		CreateVertexBuffer(creator, gameManager.currentLevelData.levelVertices.data(), sizeof(H2B::VERTEX) * gameManager.currentLevelData.levelVertices.size());
+		Level_Data& level = gameManager.currentLevelData;
+		builtGeometryVersion = level.levelGeometryVersion;
+		builtVertexCount = (unsigned)(m_compactVertexFormat ? level.levelCompactVertices.size() : level.levelVertices.size());
+		// Depth only passes read just the positions, in the same format as the lit pass
+		if (m_compactVertexFormat)
+			CreateVertexBuffer(creator, level.levelCompactPositions.data(), sizeof(QUANTIZED_POSITION) * level.levelCompactPositions.size(), positionBuffer);
+		else
+			CreateVertexBuffer(creator, level.levelPositions.data(), sizeof(H2B::VECTOR) * level.levelPositions.size(), positionBuffer);
+
+		if (m_compactVertexFormat)
+		{
+			CreateVertexBuffer(creator, level.levelCompactVertices.data(), sizeof(QUANTIZED_VERTEX) * level.levelCompactVertices.size(), vertexBuffer);
+			return;
+		}
+		CreateVertexBuffer(creator, level.levelVertices.data(), sizeof(H2B::VERTEX) * level.levelVertices.size(), vertexBuffer);
 	}
 
-	void CreateVertexBuffer(ID3D11Device* creator, const void* data, unsigned int sizeInBytes)
+	void CreateVertexBuffer(ID3D11Device* creator, const void* data, unsigned int sizeInBytes, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer)
 	{
+		buffer.Reset();
+		if (sizeInBytes == 0)
+			return;
 		D3D11_SUBRESOURCE_DATA bData = { data, 0, 0 };
-		CD3D11_BUFFER_DESC bDesc(sizeInBytes, D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_IMMUTABLE);
-		creator->CreateBuffer(&bDesc, &bData, vertexBuffer.GetAddressOf());
+		CD3D11_BUFFER_DESC bDesc(sizeInBytes, D3D11_BIND_VERTEX_BUFFER, GeometryUsage());
+		creator->CreateBuffer(&bDesc, &bData, buffer.GetAddressOf());
+	}
+
+	// A streamed level's pools are rewritten as models land (UploadLandedGeometry), a delta switch
+	// appends the models it imports (AppendLevelGeometry)
+	D3D11_USAGE GeometryUsage() const
+	{
+		return m_worldPartition || m_levelDeltaSwitch ? D3D11_USAGE_DEFAULT : D3D11_USAGE_IMMUTABLE;
 	}
 
 	void InitializeIndexBuffer(ID3D11Device* creator)
 	{
-		CreateIndexBuffer(creator, gameManager.currentLevelData.levelIndices.data(), sizeof(UINT) * gameManager.currentLevelData.levelIndices.size());
+		if (m_compactVertexFormat)
+		{
+			// Ranges that fit use 16 bit indices, the rest stay 32 bit
+			Level_Data& level = gameManager.currentLevelData;
+			builtIndexCount = (unsigned)level.levelIndices32.size();
+			builtIndex16Count = (unsigned)level.levelIndices16.size();
+			CreateIndexBuffer(creator, level.levelIndices32.data(), sizeof(UINT) * level.levelIndices32.size(), indexBuffer);
+			CreateIndexBuffer(creator, level.levelIndices16.data(), sizeof(uint16_t) * level.levelIndices16.size(), indexBuffer16);
+			return;
+		}
+		builtIndexCount = (unsigned)gameManager.currentLevelData.levelIndices.size();
+		CreateIndexBuffer(creator, gameManager.currentLevelData.levelIndices.data(), sizeof(UINT) * gameManager.currentLevelData.levelIndices.size(), indexBuffer);
 	}
 
-	void CreateIndexBuffer(ID3D11Device* creator, const void* data, unsigned int sizeInBytes)
+	void CreateIndexBuffer(ID3D11Device* creator, const void* data, unsigned int sizeInBytes, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer)
 	{
+		buffer.Reset();
+		if (sizeInBytes == 0)
+			return;
 		D3D11_SUBRESOURCE_DATA bData = { data, 0, 0 };
-		CD3D11_BUFFER_DESC bDesc(sizeInBytes, D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
-		creator->CreateBuffer(&bDesc, &bData, indexBuffer.GetAddressOf());
+		CD3D11_BUFFER_DESC bDesc(sizeInBytes, D3D11_BIND_INDEX_BUFFER, GeometryUsage());
+		creator->CreateBuffer(&bDesc, &bData, buffer.GetAddressOf());
 	}
 
 	void InitializeInstanceBuffer(ID3D11Device* creator)
 	{
-		CreateInstanceBuffer(creator, gameManager.currentLevelData.levelTransforms.data(), sizeof(XMFLOAT4X4) * gameManager.currentLevelData.levelTransforms.size());
+		Level_Data& level = gameManager.currentLevelData;
+		builtTransformCount = (unsigned)level.levelTransforms.size();
+		CreateInstanceBuffer(creator, level.levelTransforms.data(), builtTransformCount);
+		CreateDynamicInstanceBuffer(creator, level.levelTransforms.data(), level.GetDynamicTransforms());
 	}
 
-	void CreateInstanceBuffer(ID3D11Device* creator, const void* data, unsigned int sizeInBytes)
+	// Transforms are a Buffer<float4> (4 rows each) so instances can be drawn in any order
+	void CreateInstanceBuffer(ID3D11Device* creator, const void* data, unsigned int transformCount)
 	{
+		instanceBuffer.Reset();
+		instanceView.Reset();
+		instanceIdBuffer.Reset();
+		if (transformCount == 0)
+			return;
+
 		D3D11_SUBRESOURCE_DATA bData = { data, 0, 0 };
-		CD3D11_BUFFER_DESC bDesc(sizeInBytes, D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		CD3D11_BUFFER_DESC bDesc(sizeof(XMFLOAT4X4) * transformCount, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DEFAULT);
 		creator->CreateBuffer(&bDesc, &bData, instanceBuffer.GetAddressOf());
+		CD3D11_SHADER_RESOURCE_VIEW_DESC vDesc(D3D11_SRV_DIMENSION_BUFFER, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, transformCount * 4);
+		creator->CreateShaderResourceView(instanceBuffer.Get(), &vDesc, instanceView.GetAddressOf());
+
+		// Filled every frame by SortInstances
+		CD3D11_BUFFER_DESC idDesc(sizeof(PerInstanceData) * transformCount, D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		creator->CreateBuffer(&idDesc, nullptr, instanceIdBuffer.GetAddressOf());
+	}
+
+	// m_dynamicTransformFrames copies of the packed dynamic ranges back to back, each starting out as loaded
+	void CreateDynamicInstanceBuffer(ID3D11Device* creator, const GW::MATH::GMATRIXF* transforms, const std::vector<TRANSFORM_RANGE>& dynamic)
+	{
+		dynamicInstanceBuffer.Reset();
+		dynamicInstanceView.Reset();
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+		dynamicNoOverwrite = SUCCEEDED(creator->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+			options.MapNoOverwriteOnDynamicBufferSRV;
+		unsigned copies = dynamicNoOverwrite ? m_dynamicTransformFrames : 1;
+		dynamicRing.Reset(dynamic.data(), dynamic.size(), copies);
+		if (dynamicRing.Count() == 0)
+			return;
+
+		std::vector<GW::MATH::GMATRIXF> initial;
+		for (unsigned c = 0; c < copies; c++)
+			for (const TRANSFORM_RANGE& range : dynamic)
+				initial.insert(initial.end(), transforms + range.first, transforms + range.first + range.count);
+		D3D11_SUBRESOURCE_DATA bData = { initial.data(), 0, 0 };
+		CD3D11_BUFFER_DESC bDesc(sizeof(XMFLOAT4X4) * (UINT)initial.size(), D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+		creator->CreateBuffer(&bDesc, &bData, dynamicInstanceBuffer.GetAddressOf());
+		CD3D11_SHADER_RESOURCE_VIEW_DESC vDesc(D3D11_SRV_DIMENSION_BUFFER, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, (UINT)initial.size() * 4);
+		creator->CreateShaderResourceView(dynamicInstanceBuffer.Get(), &vDesc, dynamicInstanceView.GetAddressOf());
+	}
+
+	// Flattens instance sets x meshes x LODs into draw packets grouped by shader variant and material
+	void InitializeDrawPackets()
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		drawPackets.clear();
+		// Packets can't address more materials, such a level builds none rather than draw wrong ones
+		bool materialsFit = level.levelAttributes.size() <= m_drawPacketMaxMaterials;
+		if (!materialsFit)
+			gameManager.gameLevelLog.LogCategorized("ERROR", (std::string("Level has ") + std::to_string(level.levelAttributes.size()) +
+				" materials, draw packets address " + std::to_string(m_drawPacketMaxMaterials) + ". Nothing will be drawn.").c_str());
+		unsigned lodCount = level.levelMeshLODs.empty() ? 1 : m_lodLevels + 1;
+		for (unsigned i = 0; materialsFit && i < level.levelInstances.size(); i++)
+		{
+			const Level_Data::MODEL_INSTANCES& instances = level.levelInstances[i];
+			const Level_Data::LEVEL_MODEL& model = level.levelModels[instances.modelIndex];
+			for (unsigned j = 0; j < model.meshCount; j++)
+			{
+				unsigned meshIndex = model.meshStart + j;
+				const H2B::MESH& mesh = level.levelMeshes[meshIndex];
+				unsigned permutationBits = GetMaterialPermutationBits(level.levelAttributes[mesh.materialIndex]);
+				// Splitting into one draw per instance only pays off for a handful of big instances
+				bool meshletCulled = m_meshletCulling && level.levelMeshMeshlets[meshIndex].count > 0 &&
+					instances.transformCount <= m_meshletMaxInstances;
+				for (unsigned lod = 0; lod < lodCount; lod++)
+				{
+					unsigned indexStart, indexCount, baseVertex;
+					bool is16Bit = false;
+					if (m_compactVertexFormat)
+					{
+						const QUANTIZED_RANGE& geometry = lod == 0 ? level.levelMeshQuantization[meshIndex] : level.levelLODQuantization[meshIndex * m_lodLevels + lod - 1];
+						indexStart = geometry.indexStart;
+						indexCount = geometry.indexCount;
+						baseVertex = geometry.baseVertex;
+						is16Bit = geometry.is16Bit;
+					}
+					else
+					{
+						const GEOMETRY_RANGE& geometry = lod == 0 ? level.levelMeshRanges[meshIndex] : level.levelMeshLODs[meshIndex * m_lodLevels + lod - 1];
+						indexStart = geometry.indexStart;
+						indexCount = geometry.indexCount;
+						baseVertex = geometry.baseVertex;
+					}
+					drawPackets.push_back(MakeDrawPacket(indexCount, indexStart, baseVertex, is16Bit, i, instances.transformStart,
+						instances.transformCount, meshIndex, mesh.materialIndex, permutationBits, lod, meshletCulled && lod == 0));
+				}
+			}
+		}
+		SortDrawPackets(drawPackets, [](unsigned) { return 0.0f; });
+		meshletVisible.assign(level.levelMeshes.size(), { 0, 0 });
+
+		// Each instance set is one depth sort group, split per LOD every frame
+		sortGroups.clear();
+		builtInstanceLayout = level.levelInstanceLayout;
+		for (const Level_Data::MODEL_INSTANCES& instance : level.levelInstances)
+			sortGroups.push_back({ instance.transformStart, instance.transformCount });
+		instanceLODs.assign(level.levelTransforms.size(), 0);
+		hlodActive.assign(level.levelHLODCells.size(), 0);
+		// Proxies start hidden, SelectHLODs shows them once their cell is far enough
+		for (const HLOD_CELL& cell : level.levelHLODCells)
+			instanceLODs[cell.proxyTransform] = m_lodHidden;
+	}
+
+	void InitializeMaterialBuffer(ID3D11Device* creator)
+	{
+		CreateMaterialBuffer(creator, gameManager.currentLevelData.levelAttributes.data(), gameManager.currentLevelData.levelAttributes.size());
+	}
+
+	// Materials are a structured buffer so a level can have any number of them
+	void CreateMaterialBuffer(ID3D11Device* creator, const H2B::ATTRIBUTES* data, unsigned int count)
+	{
+		materialBuffer.Reset();
+		materialView.Reset();
+		builtMaterialCount = count;
+		if (count == 0)
+			return;
+
+		D3D11_SUBRESOURCE_DATA bData = { data, 0, 0 };
+		CD3D11_BUFFER_DESC bDesc(sizeof(H2B::ATTRIBUTES) * count, D3D11_BIND_SHADER_RESOURCE, GeometryUsage(),
+			0, D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, sizeof(H2B::ATTRIBUTES));
+		creator->CreateBuffer(&bDesc, &bData, materialBuffer.GetAddressOf());
+		CreateMaterialView(creator, count);
+	}
+
+	void CreateMaterialView(ID3D11Device* creator, unsigned int count)
+	{
+		materialView.Reset();
+		CD3D11_SHADER_RESOURCE_VIEW_DESC vDesc(D3D11_SRV_DIMENSION_BUFFER, DXGI_FORMAT_UNKNOWN, 0, count);
+		creator->CreateShaderResourceView(materialBuffer.Get(), &vDesc, materialView.GetAddressOf());
 	}
 
 	void InitializeConstantBuffer(ID3D11Device* creator)
@@ -165,23 +388,21 @@ private:
 		// Setup original perFrame (lighting) constant buffer structure
 		XMStoreFloat4(&CB_currentPerFrame.dirLight_Color, XMLoadFloat4(&m_origSunlightColor));
 		XMStoreFloat3(&CB_currentPerFrame.dirLight_Direction, XMVector3Normalize(XMLoadFloat3(&m_originalSunlightDirection)));
-		for (size_t i = 0; i < gameManager.currentLevelData.levelPointLights.size(); i++)
-		{
-			CB_currentPerFrame.pointLights[i] = gameManager.currentLevelData.levelPointLights[i];
-		}
-		for (size_t i = 0; i < gameManager.currentLevelData.levelSpotLights.size(); i++)
-		{
-			CB_currentPerFrame.spotLights[i] = gameManager.currentLevelData.levelSpotLights[i];
-		}
+		// Lights are chosen per frame by the light LOD stage, never copied over directly
+		lightLOD.SetLODDistance(m_lightLODDistance);
+		lightLOD.Build(gameManager.currentLevelData.levelPointLights, gameManager.currentLevelData.levelSpotLights);
+		builtLightsVersion = gameManager.currentLevelData.levelLightsVersion;
+		UpdateActiveLights();
+		const LightLOD::LIGHT_LOD_REPORT& lodReport = lightLOD.GetReport();
+		gameManager.gameLevelLog.LogCategorized("INFO", (std::string("Light LOD: ") +
+			std::to_string(lodReport.activePointLights) + "/" + std::to_string(lodReport.sourcePointLights) + " point, " +
+			std::to_string(lodReport.activeSpotLights) + "/" + std::to_string(lodReport.sourceSpotLights) + " spot, max error " +
+			std::to_string(lodReport.maxPositionError) + ", max spot axis error " + std::to_string(lodReport.maxAxisError)).c_str());
 		// Flashlight
 		CB_currentPerFrame.cameraFlashlight = gameManager.cameraFlashlight;
 		CB_currentPerFrame.flashlightPowerOn.x = gameManager.flashlightPowerOn; // bool
 
 		// Setup per scene buffer
-		for (size_t i = 0; i < gameManager.currentLevelData.levelAttributes.size(); i++)
-		{
-			CB_currentPerScene.currOBJAttributes[i] = gameManager.currentLevelData.levelAttributes[i];
-		}
 		CB_currentPerScene.numPointLights = gameManager.currentLevelData.levelPointLights.size();
 		CB_currentPerScene.numSpotLights = gameManager.currentLevelData.levelSpotLights.size();
 
@@ -213,69 +434,55 @@ private:
 		wireframeDesc.FillMode = D3D11_FILL_WIREFRAME;
 		//wireframeDesc.CullMode = D3D11_CULL_NONE;
 		res = creator->CreateRasterizerState(&wireframeDesc, rasterStateWireframe.GetAddressOf());
-	}
 
-	void InitializePipeline(ID3D11Device* creator)
-	{
-		UINT compilerFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if _DEBUG
-		compilerFlags |= D3DCOMPILE_DEBUG;
-#endif
-		Microsoft::WRL::ComPtr<ID3DBlob> vsBlob = CompileVertexShader(creator, compilerFlags);
-		Microsoft::WRL::ComPtr<ID3DBlob> psBlob = CompilePixelShader(creator, compilerFlags);
-		CreateVertexInstancedInputLayout(creator, vsBlob);
+		CD3D11_DEPTH_STENCIL_DESC equalDesc = CD3D11_DEPTH_STENCIL_DESC(CD3D11_DEFAULT());
+		equalDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+		equalDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+		res = creator->CreateDepthStencilState(&equalDesc, depthStateEqual.GetAddressOf());
 	}
 
-	Microsoft::WRL::ComPtr<ID3DBlob> CompileVertexShader(ID3D11Device* creator, UINT compilerFlags)
+	void InitializePipeline(ID3D11Device* creator)
 	{
-		std::string vertexShaderSource = ReadFileIntoString("../Shaders/VertexShader.hlsl");
+		// Bytecode comes from Shaders/Cache (filled by the ShaderBaker build step)
+		ShaderCache shaderCache("../Shaders/Cache");
+		std::vector<SHADER_BUILD_DESC> shaders = GetShaderBuildList("../Shaders");
 
-		Microsoft::WRL::ComPtr<ID3DBlob> vsBlob, errors;
+		Microsoft::WRL::ComPtr<ID3DBlob> vsBlob = LoadShaderBytecode(shaderCache,
+			shaders[m_compactVertexFormat ? SHADER_SLOT_VERTEX_COMPACT : SHADER_SLOT_VERTEX]);
+		creator->CreateVertexShader(vsBlob->GetBufferPointer(),
+			vsBlob->GetBufferSize(), nullptr, vertexShader.GetAddressOf());
 
-		HRESULT compilationResult = 
-			D3DCompile(vertexShaderSource.c_str(), vertexShaderSource.length(),
-				nullptr, nullptr, nullptr, "main", "vs_4_0", compilerFlags, 0,
-				vsBlob.GetAddressOf(), errors.GetAddressOf());
-
-		if (SUCCEEDED(compilationResult))
+		// Every pixel shader permutation follows the vertex shaders in the build list
+		for (unsigned permutation = 0; permutation < m_psPermutationCount; permutation++)
 		{
-			creator->CreateVertexShader(vsBlob->GetBufferPointer(),
-				vsBlob->GetBufferSize(), nullptr, vertexShader.GetAddressOf());
-		}
-		else
-		{
-			PrintLabeledDebugString("Vertex Shader Errors:\n", (char*)errors->GetBufferPointer());
-			abort();
-			return nullptr;
+			Microsoft::WRL::ComPtr<ID3DBlob> psBlob = LoadShaderBytecode(shaderCache, shaders[SHADER_SLOT_FIRST_PIXEL + permutation]);
+			creator->CreatePixelShader(psBlob->GetBufferPointer(),
+				psBlob->GetBufferSize(), nullptr, pixelShaders[permutation].GetAddressOf());
 		}
+		CreateVertexInstancedInputLayout(creator, vsBlob);
 
-		return vsBlob;
+		Microsoft::WRL::ComPtr<ID3DBlob> depthBlob = LoadShaderBytecode(shaderCache,
+			shaders[m_compactVertexFormat ? SHADER_SLOT_DEPTH_COMPACT : SHADER_SLOT_DEPTH]);
+		creator->CreateVertexShader(depthBlob->GetBufferPointer(),
+			depthBlob->GetBufferSize(), nullptr, depthVertexShader.GetAddressOf());
+		CreateDepthInputLayout(creator, depthBlob);
 	}
 
-	Microsoft::WRL::ComPtr<ID3DBlob> CompilePixelShader(ID3D11Device* creator, UINT compilerFlags)
+	Microsoft::WRL::ComPtr<ID3DBlob> LoadShaderBytecode(ShaderCache& shaderCache, const SHADER_BUILD_DESC& desc)
 	{
-		std::string pixelShaderSource = ReadFileIntoString("../Shaders/PixelShader.hlsl");
-
-		Microsoft::WRL::ComPtr<ID3DBlob> psBlob, errors;
-
-		HRESULT compilationResult =
-			D3DCompile(pixelShaderSource.c_str(), pixelShaderSource.length(),
-				nullptr, nullptr, nullptr, "main", "ps_4_0", compilerFlags, 0,
-				psBlob.GetAddressOf(), errors.GetAddressOf());
-
-		if (SUCCEEDED(compilationResult))
+		Microsoft::WRL::ComPtr<ID3DBlob> blob;
+		std::string errors;
+		bool fromCache = false;
+		if (FAILED(shaderCache.GetBytecode(desc, blob, errors, fromCache)))
 		{
-			creator->CreatePixelShader(psBlob->GetBufferPointer(),
-				psBlob->GetBufferSize(), nullptr, pixelShader.GetAddressOf());
-		}
-		else
-		{
-			PrintLabeledDebugString("Pixel Shader Errors:\n", (char*)errors->GetBufferPointer());
+			PrintLabeledDebugString((desc.cacheName + " Errors:\n").c_str(), errors.c_str());
 			abort();
 			return nullptr;
 		}
-
-		return psBlob;
+		if (!fromCache)
+			gameManager.gameLevelLog.LogCategorized("WARNING",
+				(std::string("Shader cache miss, compiled at runtime: ") + desc.cacheName).c_str());
+		return blob;
 	}
 
 	void CreateVertexInputLayout(ID3D11Device* creator, Microsoft::WRL::ComPtr<ID3DBlob>& vsBlob)
@@ -301,6 +508,11 @@ private:
 
 	void CreateVertexInstancedInputLayout(ID3D11Device* creator, Microsoft::WRL::ComPtr<ID3DBlob>& vsBlob)
 	{
+		if (m_compactVertexFormat)
+		{
+			CreateCompactInstancedInputLayout(creator, vsBlob);
+			return;
+		}
 		D3D11_INPUT_ELEMENT_DESC format[] = {
 			// PER VERTEX DATA
 			{
@@ -316,21 +528,38 @@ private:
 				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0
 			},
 
-			// PER INSTANCE DATA
+			// PER INSTANCE DATA (index into the transform buffer)
 			{
-				"WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1,
+				"INSTANCEID", 0, DXGI_FORMAT_R32_UINT, 1,
 				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1
+			}
+		};
+		creator->CreateInputLayout(format, ARRAYSIZE(format),
+			vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(),
+			vertexFormat.GetAddressOf());
+	}
+
+	// QUANTIZED_VERTEX, decoded in VertexShader.hlsl (COMPACT_VERTICES)
+	void CreateCompactInstancedInputLayout(ID3D11Device* creator, Microsoft::WRL::ComPtr<ID3DBlob>& vsBlob)
+	{
+		D3D11_INPUT_ELEMENT_DESC format[] = {
+			// PER VERTEX DATA
+			{
+				"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0,
+				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0
 			},
 			{
-				"WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1,
-				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1
+				"UVCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0,
+				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0
 			},
 			{
-				"WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1,
-				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1
+				"NORMDIR", 0, DXGI_FORMAT_R16G16_SNORM, 0,
+				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0
 			},
+
+			// PER INSTANCE DATA (index into the transform buffer)
 			{
-				"WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1,
+				"INSTANCEID", 0, DXGI_FORMAT_R32_UINT, 1,
 				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1
 			}
 		};
@@ -339,6 +568,24 @@ private:
 			vertexFormat.GetAddressOf());
 	}
 
+	// Position stream + instance id, see DepthVertexShader.hlsl
+	void CreateDepthInputLayout(ID3D11Device* creator, Microsoft::WRL::ComPtr<ID3DBlob>& vsBlob)
+	{
+		D3D11_INPUT_ELEMENT_DESC format[] = {
+			{
+				"POSITION", 0, m_compactVertexFormat ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT, 0,
+				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0
+			},
+			{
+				"INSTANCEID", 0, DXGI_FORMAT_R32_UINT, 1,
+				D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1
+			}
+		};
+		creator->CreateInputLayout(format, ARRAYSIZE(format),
+			vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(),
+			depthVertexFormat.GetAddressOf());
+	}
+
 public:
 	void Render()
 	{
@@ -361,33 +608,46 @@ public:
 		CB_currentPerFrame.cameraFlashlight = gameManager.cameraFlashlight;
 		CB_currentPerFrame.flashlightPowerOn.x = gameManager.flashlightPowerOn;	// On or off
 
+		// Cells around the camera in and far ones out (m_worldPartition), then the structural edits
+		// since last frame: instances that outgrew their set and added or removed lights
+		UpdateStreaming();
+		ApplyLevelEdits(curHandles);
+
+		// Re-pick lights around the new camera position
+		UpdateActiveLights();
+
 		 static float temp = 0.0001f;
 		
 		// Upload per frame constant buffer (lighting changes)
 		CB_currentPerFrame.time = temp;
 		CB_GPU_UPLOAD_PER_FRAME(curHandles);
 
-		// Draw via GPU instancing 
-		for (auto instance : gameManager.currentLevelData.levelInstances)
-		{
-			Level_Data::LEVEL_MODEL* model
-				= &gameManager.currentLevelData.levelModels[instance.modelIndex];
+		// Moved hierarchy nodes (and their children) into the instance buffer before anything reads them
+		UploadMovedTransforms(curHandles);
 
-			// Call draw indexed instanced for each mesh of each model
-			for (size_t meshIndex = 0; meshIndex < model->meshCount; meshIndex++)
-			{
-				H2B::MESH* mesh =
-					&gameManager.currentLevelData.levelMeshes[model->meshStart + meshIndex];
+		// Detail level of every instance for this camera, far cells swap to their proxy
+		SelectLODs();
+		SelectHLODs();
+		HideRemovedInstances();
 
-				// Pick which material to use
-				CB_currentPerObject.materialIndex.x = model->materialStart + mesh->materialIndex;
+		// Near-to-far instance order for this camera
+		SortInstances(curHandles);
 
-				// Upload per-object constant buffer
-				CB_GPU_UPLOAD_PER_OBJECT(curHandles);
-				curHandles.context->DrawIndexedInstanced(mesh->drawInfo.indexCount, instance.transformCount,
-					model->indexStart + mesh->drawInfo.indexOffset, model->vertexStart, instance.transformStart);
-			}
-		}
+		// Visible index ranges of the meshlet culled draw packets
+		CullMeshlets();
+
+		// Lay down depth from the position stream first so the lit pass shades each pixel once
+		bool prepass = m_depthPrepass && positionBuffer;
+		if (prepass)
+			RenderDepthPrepass(curHandles);
+		curHandles.context->OMSetDepthStencilState(prepass ? depthStateEqual.Get() : nullptr, 0);
+
+		// Shader variant bits shared by every draw this frame
+		unsigned frameBits = GetFramePermutationBits(lightLOD.GetReport().activePointLights,
+			lightLOD.GetReport().activeSpotLights, gameManager.flashlightPowerOn);
+
+		// Draw via GPU instancing, packets are pre-sorted so shader switches are rare
+		SubmitDrawPackets(curHandles, frameBits, true);
 
 		// DELETE. THIS IS MAKING THE SPOTLIGHTS ROTATE AT THIS MOMENT, BUT MUST DO BETTER
 		if (temp < 2 && goingUp)
@@ -563,10 +823,13 @@ private:
 
 	void SetVertexBuffers(PipelineHandles handles)
 	{
-		const UINT strides[] = {sizeof(H2B::VERTEX), sizeof(PerInstanceData)};
+		const UINT strides[] = { m_compactVertexFormat ? (UINT)sizeof(QUANTIZED_VERTEX) : (UINT)sizeof(H2B::VERTEX), sizeof(PerInstanceData) };
 		const UINT offsets[] = { 0, 0 };
-		ID3D11Buffer* const buffs[] = { vertexBuffer.Get(), instanceBuffer.Get()};
+		ID3D11Buffer* const buffs[] = { vertexBuffer.Get(), instanceIdBuffer.Get()};
 		handles.context->IASetVertexBuffers(0, ARRAYSIZE(buffs), buffs, strides, offsets);
+
+		ID3D11ShaderResourceView* const views[] = { instanceView.Get(), dynamicInstanceView.Get() };
+		handles.context->VSSetShaderResources(0, ARRAYSIZE(views), views);
 	}
 
 	void SetIndexBuffer(PipelineHandles handles)
@@ -583,12 +846,15 @@ private:
 		handles.context->PSSetConstantBuffers(0, 1, &constantBuffers[0]);
 		handles.context->PSSetConstantBuffers(1, 1, &constantBuffers[1]);
 		handles.context->PSSetConstantBuffers(2, 1, &constantBuffers[2]);
+
+		ID3D11ShaderResourceView* const views[] = { materialView.Get() };
+		handles.context->PSSetShaderResources(0, ARRAYSIZE(views), views);
 	}
 
 	void SetShaders(PipelineHandles handles)
 	{
 		handles.context->VSSetShader(vertexShader.Get(), nullptr, 0);
-		handles.context->PSSetShader(pixelShader.Get(), nullptr, 0);
+		handles.context->PSSetShader(pixelShaders[m_psPermutationCount - 1].Get(), nullptr, 0);
 	}
 
 	void SetRasterizerState(PipelineHandles handles, ID3D11RasterizerState* newState)
@@ -605,6 +871,474 @@ private:
 
 	/////////////////////////////////////////////////////////////////////////////
 
+	// Radix sorts every instance by (instance set, depth), uploads the resulting id stream and
+	// orders draws sharing a shader variant and material so the closest instance set goes first
+	void SortInstances(Renderer::PipelineHandles& curHandles)
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		if (level.levelTransforms.empty())
+			return;
+
+		XMFLOAT3 pos = viewCamera.GetPosition();
+		XMFLOAT3 forward = viewCamera.GetForward();
+		// One subgroup per LOD plus one for instances hidden behind a proxy
+		bool lods = (m_generateLODs && !level.levelModelLODs.empty()) || !level.levelHLODCells.empty() ||
+			!level.levelFreeInstances.HiddenSlots().empty();
+		depthSorter.Sort(level.levelTransforms.data(), sortGroups.data(), (unsigned)sortGroups.size(),
+			{ pos.x, pos.y, pos.z, 1 }, { forward.x, forward.y, forward.z, 0 },
+			viewCamera.GetNearZ(), viewCamera.GetFarZ(), std::thread::hardware_concurrency(),
+			lods ? instanceLODs.data() : nullptr, m_lodHidden + 1);
+
+		D3D11_MAPPED_SUBRESOURCE gpuBuffer;
+		const std::vector<uint32_t>& ids = depthSorter.GetSortedIds();
+		HRESULT hr = curHandles.context->Map(instanceIdBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &gpuBuffer);
+		if (FAILED(hr))
+			return;
+		memcpy(gpuBuffer.pData, ids.data(), sizeof(uint32_t) * ids.size());
+		curHandles.context->Unmap(instanceIdBuffer.Get(), 0);
+
+		SortDrawPackets(drawPackets, [&](unsigned instanceSet) { return depthSorter.GetGroupNearestDepth(instanceSet); });
+	}
+
+	// Rebuilds only what a structural edit invalidated: imported models grow the geometry and
+	// material buffers, a grown instance set changes the instance buffers and draw packets, added
+	// or removed lights the light tree. Plain moves never get here. Streamed cells only change
+	// pool contents: landed models are copied into the geometry buffers and the instance buffer
+	// keeps its size, their transforms go up with the moved ranges
+	void ApplyLevelEdits(Renderer::PipelineHandles& curHandles)
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		UploadLandedGeometry(curHandles);
+		if (level.levelGeometryVersion != builtGeometryVersion)
+		{
+			AppendLevelGeometry(curHandles);
+			SetVertexBuffers(curHandles);
+			SetIndexBuffer(curHandles);
+			SetConstantBuffers(curHandles); // rebinds the material view
+		}
+		if (level.levelInstanceLayout != builtInstanceLayout)
+		{
+			ID3D11Device* creator = nullptr;
+			curHandles.context->GetDevice(&creator);
+			if (level.levelTransforms.size() == builtTransformCount)
+				CreateDynamicInstanceBuffer(creator, level.levelTransforms.data(), level.GetDynamicTransforms());
+			else
+				InitializeInstanceBuffer(creator);
+			creator->Release();
+			InitializeDrawPackets();
+			SetVertexBuffers(curHandles);
+		}
+		if (level.levelLightsVersion != builtLightsVersion)
+		{
+			lightLOD.Build(level.levelPointLights, level.levelSpotLights);
+			builtLightsVersion = level.levelLightsVersion;
+			CB_currentPerScene.numPointLights = level.levelPointLights.size();
+			CB_currentPerScene.numSpotLights = level.levelSpotLights.size();
+			CB_GPU_UPLOAD_PER_SCENE(curHandles);
+		}
+	}
+
+	// Copies the pool blocks models landed in since last frame into the geometry buffers
+	void UploadLandedGeometry(Renderer::PipelineHandles& curHandles)
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		for (const Level_Data::PARTITION_BLOCK& block : level.levelLandedGeometry)
+		{
+			unsigned first = block.start[Level_Data::POOL_VERTICES], count = block.count[Level_Data::POOL_VERTICES];
+			if (m_compactVertexFormat)
+			{
+				UpdateBufferRange(curHandles, vertexBuffer.Get(), level.levelCompactVertices.data(), sizeof(QUANTIZED_VERTEX), first, count);
+				UpdateBufferRange(curHandles, positionBuffer.Get(), level.levelCompactPositions.data(), sizeof(QUANTIZED_POSITION), first, count);
+				UpdateBufferRange(curHandles, indexBuffer.Get(), level.levelIndices32.data(), sizeof(UINT),
+					block.start[Level_Data::POOL_INDICES32], block.count[Level_Data::POOL_INDICES32]);
+				UpdateBufferRange(curHandles, indexBuffer16.Get(), level.levelIndices16.data(), sizeof(uint16_t),
+					block.start[Level_Data::POOL_INDICES16], block.count[Level_Data::POOL_INDICES16]);
+				continue;
+			}
+			UpdateBufferRange(curHandles, vertexBuffer.Get(), level.levelVertices.data(), sizeof(H2B::VERTEX), first, count);
+			UpdateBufferRange(curHandles, positionBuffer.Get(), level.levelPositions.data(), sizeof(H2B::VECTOR), first, count);
+			UpdateBufferRange(curHandles, indexBuffer.Get(), level.levelIndices.data(), sizeof(UINT),
+				block.start[Level_Data::POOL_INDICES], block.count[Level_Data::POOL_INDICES]);
+		}
+		level.levelLandedGeometry.clear();
+	}
+
+	// Imported models only add to the end of the level's geometry and materials, so just that
+	// tail goes up
+	void AppendLevelGeometry(Renderer::PipelineHandles& curHandles)
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		builtGeometryVersion = level.levelGeometryVersion;
+		CD3D11_BUFFER_DESC vertexDesc(0, D3D11_BIND_VERTEX_BUFFER), indexDesc(0, D3D11_BIND_INDEX_BUFFER);
+		unsigned vertexCount = 0;
+		if (m_compactVertexFormat)
+		{
+			vertexCount = (unsigned)level.levelCompactVertices.size();
+			AppendToBuffer(curHandles, positionBuffer, vertexDesc, level.levelCompactPositions.data(), sizeof(QUANTIZED_POSITION),
+				builtVertexCount, (unsigned)level.levelCompactPositions.size());
+			AppendToBuffer(curHandles, vertexBuffer, vertexDesc, level.levelCompactVertices.data(), sizeof(QUANTIZED_VERTEX),
+				builtVertexCount, vertexCount);
+			AppendToBuffer(curHandles, indexBuffer, indexDesc, level.levelIndices32.data(), sizeof(UINT),
+				builtIndexCount, (unsigned)level.levelIndices32.size());
+			AppendToBuffer(curHandles, indexBuffer16, indexDesc, level.levelIndices16.data(), sizeof(uint16_t),
+				builtIndex16Count, (unsigned)level.levelIndices16.size());
+			builtIndexCount = (unsigned)level.levelIndices32.size();
+			builtIndex16Count = (unsigned)level.levelIndices16.size();
+		}
+		else
+		{
+			vertexCount = (unsigned)level.levelVertices.size();
+			AppendToBuffer(curHandles, positionBuffer, vertexDesc, level.levelPositions.data(), sizeof(H2B::VECTOR),
+				builtVertexCount, (unsigned)level.levelPositions.size());
+			AppendToBuffer(curHandles, vertexBuffer, vertexDesc, level.levelVertices.data(), sizeof(H2B::VERTEX),
+				builtVertexCount, vertexCount);
+			AppendToBuffer(curHandles, indexBuffer, indexDesc, level.levelIndices.data(), sizeof(UINT),
+				builtIndexCount, (unsigned)level.levelIndices.size());
+			builtIndexCount = (unsigned)level.levelIndices.size();
+		}
+		builtVertexCount = vertexCount;
+
+		unsigned materialCount = (unsigned)level.levelAttributes.size();
+		if (materialCount == builtMaterialCount)
+			return;
+		CD3D11_BUFFER_DESC materialDesc(0, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DEFAULT, 0,
+			D3D11_RESOURCE_MISC_BUFFER_STRUCTURED, sizeof(H2B::ATTRIBUTES));
+		AppendToBuffer(curHandles, materialBuffer, materialDesc, level.levelAttributes.data(), sizeof(H2B::ATTRIBUTES),
+			builtMaterialCount, materialCount);
+		builtMaterialCount = materialCount;
+		// the view covers every material, the buffer may have been re-created too
+		ID3D11Device* creator = nullptr;
+		curHandles.context->GetDevice(&creator);
+		CreateMaterialView(creator, materialCount);
+		creator->Release();
+	}
+
+	// Grows buffer to count elements of data, uploading only [builtCount, count). A buffer that is
+	// full is re-created at twice its size (at least count) and the old contents are copied over on
+	// the GPU. desc describes the buffer when there is none yet
+	void AppendToBuffer(Renderer::PipelineHandles& curHandles, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, D3D11_BUFFER_DESC desc,
+		const void* data, unsigned elementSize, unsigned builtCount, unsigned count)
+	{
+		if (count <= builtCount)
+			return;
+		if (buffer)
+			buffer->GetDesc(&desc);
+		if (!buffer || desc.ByteWidth < count * elementSize)
+		{
+			desc.ByteWidth = (std::max)(count * elementSize, desc.ByteWidth * 2);
+			desc.Usage = D3D11_USAGE_DEFAULT;
+			ID3D11Device* creator = nullptr;
+			curHandles.context->GetDevice(&creator);
+			Microsoft::WRL::ComPtr<ID3D11Buffer> grown;
+			HRESULT hr = creator->CreateBuffer(&desc, nullptr, grown.GetAddressOf());
+			creator->Release();
+			if (FAILED(hr))
+				return;
+			if (buffer && builtCount > 0)
+			{
+				D3D11_BOX box = { 0, 0, 0, builtCount * elementSize, 1, 1 };
+				curHandles.context->CopySubresourceRegion(grown.Get(), 0, 0, 0, 0, buffer.Get(), 0, &box);
+			}
+			buffer = grown;
+		}
+		UpdateBufferRange(curHandles, buffer.Get(), data, elementSize, builtCount, count - builtCount);
+	}
+
+	// Elements [first, first + count) of data into the same place of a DEFAULT buffer
+	void UpdateBufferRange(Renderer::PipelineHandles& curHandles, ID3D11Buffer* buffer, const void* data, unsigned elementSize,
+		unsigned first, unsigned count)
+	{
+		if (!buffer || count == 0)
+			return;
+		D3D11_BOX box = { first * elementSize, 0, 0, (first + count) * elementSize, 1, 1 };
+		curHandles.context->UpdateSubresource(buffer, 0, &box, static_cast<const char*>(data) + first * elementSize, 0, 0);
+	}
+
+	// Feeds the camera to the level's cell streamer. The first frame after a load waits for the
+	// cells around the camera, later ones only queue loads and pick up what finished
+	void UpdateStreaming()
+	{
+		if (!m_worldPartition)
+			return;
+		XMFLOAT3 eye = viewCamera.GetPosition();
+		auto now = std::chrono::steady_clock::now();
+		float seconds = std::chrono::duration<float>(now - streamingTime).count();
+		float velocity[3] = { 0, 0, 0 };
+		if (streamingPrimed && seconds > 0)
+		{
+			velocity[0] = (eye.x - streamingEye.x) / seconds;
+			velocity[1] = (eye.y - streamingEye.y) / seconds;
+			velocity[2] = (eye.z - streamingEye.z) / seconds;
+		}
+		const float position[3] = { eye.x, eye.y, eye.z };
+		gameManager.currentLevelData.UpdateStreaming(position, velocity, !streamingPrimed, gameManager.gameLevelLog);
+		streamingEye = eye;
+		streamingTime = now;
+		streamingPrimed = true;
+	}
+
+	// Removed instances, spare slots and streamed out cells sort into the never drawn subgroup
+	void HideRemovedInstances()
+	{
+		for (unsigned slot : gameManager.currentLevelData.levelFreeInstances.HiddenSlots())
+			instanceLODs[slot] = m_lodHidden;
+	}
+
+	// Brings the next copy of the dynamic transforms up to date with only what moved since it was
+	// last written, SubmitDrawPackets points each dynamic set's draws at it. Nothing moved = no
+	// upload at all. Static transforms that moved (edits, models not in m_dynamicModels) are
+	// patched in place
+	void UploadMovedTransforms(Renderer::PipelineHandles& curHandles)
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		level.UpdateHierarchy();
+		if (!level.levelMovedTransforms.empty())
+		{
+			dynamicRing.MarkMoved(level.levelMovedTransforms.data(), level.levelMovedTransforms.size());
+			const std::vector<TRANSFORM_RANGE>& dynamic = dynamicRing.Ranges();
+			for (const TRANSFORM_RANGE& moved : level.levelMovedTransforms)
+			{
+				// the static gaps between the dynamic ranges it overlaps
+				unsigned end = moved.first + moved.count, first = moved.first;
+				for (size_t r = dynamicRing.FirstRangeAfter(first); r < dynamic.size() && dynamic[r].first < end; r++)
+				{
+					UpdateStaticTransforms(curHandles, first, dynamic[r].first);
+					first = (std::max)(first, dynamic[r].first + dynamic[r].count);
+				}
+				UpdateStaticTransforms(curHandles, first, end);
+				// a re-added instance shows again, the LOD passes hide whatever still has to be
+				for (unsigned t = moved.first; t < end; t++)
+					if (instanceLODs[t] == m_lodHidden)
+						instanceLODs[t] = 0;
+			}
+			level.levelMovedTransforms.clear();
+		}
+		const std::vector<TRANSFORM_RANGE>& writes = dynamicRing.NextWrites();
+		D3D11_MAPPED_SUBRESOURCE gpuBuffer;
+		if (!writes.empty() && dynamicInstanceBuffer && SUCCEEDED(curHandles.context->Map(dynamicInstanceBuffer.Get(), 0,
+			dynamicNoOverwrite ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD, 0, &gpuBuffer)))
+		{
+			GW::MATH::GMATRIXF* copy = static_cast<GW::MATH::GMATRIXF*>(gpuBuffer.pData) + dynamicRing.CurrentCopy() * dynamicRing.Count();
+			const GW::MATH::GMATRIXF* transforms = level.levelTransforms.data();
+			if (dynamicNoOverwrite)
+				for (const TRANSFORM_RANGE& write : writes)
+					memcpy(copy + write.first, transforms + dynamicRing.Slot(write.first), sizeof(GW::MATH::GMATRIXF) * write.count);
+			else
+				for (const TRANSFORM_RANGE& range : dynamicRing.Ranges()) // a discarded buffer is refilled whole
+				{
+					memcpy(copy, transforms + range.first, sizeof(GW::MATH::GMATRIXF) * range.count);
+					copy += range.count;
+				}
+			curHandles.context->Unmap(dynamicInstanceBuffer.Get(), 0);
+		}
+	}
+
+	// Where the shaders find a set's transforms: (first slot, count, start in the dynamic buffer)
+	// for a dynamic set in this frame's copy, zero for a static one
+	XMFLOAT4 DynamicInstanceRanges(const Level_Data::MODEL_INSTANCES& instances) const
+	{
+		unsigned packed = (instances.flags & Level_Data::INSTANCE_DYNAMIC) && instances.transformCount > 0 ?
+			dynamicRing.PackedIndex(instances.transformStart) : ~0u;
+		if (packed == ~0u)
+			return XMFLOAT4(0, 0, 0, 0);
+		return XMFLOAT4((float)instances.transformStart, (float)instances.transformCount,
+			(float)(dynamicRing.CurrentCopy() * dynamicRing.Count() + packed), 0);
+	}
+
+	// levelTransforms[first, end) into the static instance buffer, one box sized update
+	void UpdateStaticTransforms(Renderer::PipelineHandles& curHandles, unsigned first, unsigned end)
+	{
+		if (first >= end || !instanceBuffer)
+			return;
+		D3D11_BOX box = { first * (UINT)sizeof(XMFLOAT4X4), 0, 0, end * (UINT)sizeof(XMFLOAT4X4), 1, 1 };
+		curHandles.context->UpdateSubresource(instanceBuffer.Get(), 0, &box,
+			&gameManager.currentLevelData.levelTransforms[first], 0, 0);
+	}
+
+	// Picks every instance's LOD from its projected error, keeping last frame's choice near the thresholds
+	void SelectLODs()
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		if (!m_generateLODs || level.levelModelLODs.empty())
+			return;
+		unsigned height;
+		win.GetClientHeight(height);
+		XMFLOAT3 eye = viewCamera.GetPosition();
+		lodSelector.Begin(0.5f * height * CB_currentPerObject.pMatrix._22, m_lodPixelError, m_lodHysteresis);
+		for (const Level_Data::MODEL_INSTANCES& instance : level.levelInstances)
+			lodSelector.SelectInstances(level.levelModelLODs[instance.modelIndex], &level.levelTransforms[instance.transformStart],
+				instance.transformCount, { eye.x, eye.y, eye.z, 1 }, &instanceLODs[instance.transformStart]);
+	}
+
+	// Swaps whole cells between their members and their proxy. A cell goes to its proxy once it
+	// is past m_hlodDistance and the proxy's projected error is under m_hlodPixelError, and only
+	// comes back once one of them fails by the LOD hysteresis margin.
+	void SelectHLODs()
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		if (level.levelHLODCells.empty())
+			return;
+		unsigned height;
+		win.GetClientHeight(height);
+		float pixelsPerUnit = 0.5f * height * CB_currentPerObject.pMatrix._22;
+		XMFLOAT3 eye = viewCamera.GetPosition();
+		for (size_t c = 0; c < level.levelHLODCells.size(); c++)
+		{
+			const HLOD_CELL& cell = level.levelHLODCells[c];
+			float dx = cell.center[0] - eye.x, dy = cell.center[1] - eye.y, dz = cell.center[2] - eye.z;
+			float distance = std::sqrt(dx * dx + dy * dy + dz * dz) - cell.radius;
+			float pixels = distance > 0 ? cell.error * pixelsPerUnit / distance : FLT_MAX;
+			float margin = hlodActive[c] ? 1.0f : 1.0f - m_lodHysteresis;
+			hlodActive[c] = distance * margin > m_hlodDistance && pixels <= m_hlodPixelError * margin;
+
+			instanceLODs[cell.proxyTransform] = hlodActive[c] ? 0 : m_lodHidden;
+			for (unsigned m = cell.memberStart; m < cell.memberStart + cell.memberCount; m++)
+			{
+				uint8_t& lod = instanceLODs[level.levelHLODMembers[m]];
+				if (hlodActive[c])
+					lod = m_lodHidden;
+				else if (lod == m_lodHidden || !m_generateLODs)
+					lod = 0; // SelectLODs picks the real one from next frame on
+			}
+		}
+	}
+
+	// One linear pass over the draw packets. The lit pass (_lit) switches pixel shaders and
+	// materials, both passes upload per object constants only when the mesh or material changes.
+	// Instances hidden behind an HLOD proxy (m_lodHidden) have no packet and are never drawn.
+	void SubmitDrawPackets(PipelineHandles& curHandles, unsigned frameBits, bool lit)
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		unsigned boundPermutation = m_psPermutationCount, boundMesh = ~0u, boundMaterial = ~0u;
+		bool bound16BitIndices = false; // SetIndexBuffer binds the 32 bit list
+		bool sorted = depthSorter.GetSubgroupCount() > 0;
+		for (const DRAW_PACKET& packet : drawPackets)
+		{
+			if (packet.transformCount == 0)
+				continue;
+			unsigned lod = packet.GetLOD();
+			// Instances come from this set's near-to-far range of the sorted id stream
+			InstanceDepthSorter::SORTED_RANGE range = { 0, 0 };
+			if (sorted && lod < depthSorter.GetSubgroupCount())
+				range = depthSorter.GetSortedRange(packet.instanceSet, lod);
+			if (range.count == 0)
+				continue;
+
+			if (lit)
+			{
+				unsigned permutation = frameBits | packet.permutationBits;
+				if (permutation != boundPermutation)
+				{
+					curHandles.context->PSSetShader(pixelShaders[permutation].Get(), nullptr, 0);
+					boundPermutation = permutation;
+				}
+			}
+			// Pick which material to use (already a level wide slot), LODs share their mesh's decode
+			bool upload = lit && packet.materialIndex != boundMaterial;
+			// Dynamic sets read their own range of the ring, static ones all share the zero range
+			XMFLOAT4 ranges = DynamicInstanceRanges(level.levelInstances[packet.instanceSet]);
+			if (memcmp(&ranges, &CB_currentPerObject.instanceRanges, sizeof(ranges)) != 0)
+			{
+				CB_currentPerObject.instanceRanges = ranges;
+				upload = true;
+			}
+			if (m_compactVertexFormat && packet.meshIndex != boundMesh)
+			{
+				const QUANTIZED_RANGE& geometry = level.levelMeshQuantization[packet.meshIndex];
+				CB_currentPerObject.quantOffset = XMFLOAT4(geometry.quantOffset[0], geometry.quantOffset[1], geometry.quantOffset[2], 0);
+				CB_currentPerObject.quantScale = XMFLOAT4(geometry.quantScale[0], geometry.quantScale[1], geometry.quantScale[2], 0);
+				upload = true;
+			}
+			if (upload)
+			{
+				CB_currentPerObject.materialIndex.x = packet.materialIndex;
+				CB_GPU_UPLOAD_PER_OBJECT(curHandles);
+				boundMaterial = packet.materialIndex;
+				boundMesh = packet.meshIndex;
+			}
+			bool is16Bit = (packet.flags & DRAW_PACKET_16BIT_INDICES) != 0;
+			if (is16Bit != bound16BitIndices)
+			{
+				curHandles.context->IASetIndexBuffer(is16Bit ? indexBuffer16.Get() : indexBuffer.Get(),
+					is16Bit ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+				bound16BitIndices = is16Bit;
+			}
+
+			if (!(packet.flags & DRAW_PACKET_MESHLETS))
+			{
+				curHandles.context->DrawIndexedInstanced(packet.indexCount, range.count, packet.indexStart, packet.baseVertex, range.start);
+				continue;
+			}
+			// One draw per visible index range of the meshlet culled instances
+			const std::vector<MeshletCuller::VISIBLE_RANGE>& visible = meshletCuller.GetRanges();
+			const VISIBLE_SPAN& span = meshletVisible[packet.meshIndex];
+			for (unsigned i = span.first; i < span.first + span.count; i++)
+				curHandles.context->DrawIndexedInstanced(visible[i].indexCount, 1,
+					packet.indexStart + visible[i].indexOffset, packet.baseVertex, visible[i].instanceSlot);
+		}
+		if (bound16BitIndices)
+			SetIndexBuffer(curHandles);
+	}
+
+	// Frustum + normal cone tests per meshlet of every instance of the meshlet culled draw items
+	void CullMeshlets()
+	{
+		Level_Data& level = gameManager.currentLevelData;
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMMatrixMultiply(XMLoadFloat4x4(&CB_currentPerObject.vMatrix),
+			XMLoadFloat4x4(&CB_currentPerObject.pMatrix)));
+		FRUSTUM frustum = ExtractFrustum(&viewProj._11);
+		XMFLOAT3 eye = viewCamera.GetPosition();
+
+		meshletCuller.Begin();
+		const std::vector<uint32_t>& ids = depthSorter.GetSortedIds();
+		for (const DRAW_PACKET& packet : drawPackets)
+		{
+			if (!(packet.flags & DRAW_PACKET_MESHLETS))
+				continue;
+			const Level_Data::MESHLET_SPAN& span = level.levelMeshMeshlets[packet.meshIndex];
+			// Only LOD0 instances are split, coarser LODs draw whole
+			const InstanceDepthSorter::SORTED_RANGE& range = depthSorter.GetSortedRange(packet.instanceSet, 0);
+			VISIBLE_SPAN& visible = meshletVisible[packet.meshIndex];
+			visible.first = (unsigned)meshletCuller.GetRanges().size();
+			visible.count = 0;
+			for (unsigned slot = range.start; slot < range.start + range.count; slot++)
+				visible.count += meshletCuller.CullInstance(&level.levelMeshlets[span.first], span.count,
+					level.levelTransforms[ids[slot]], slot, frustum, { eye.x, eye.y, eye.z, 1 });
+		}
+	}
+
+	// Draws every draw packet depth only, then puts the lit pass's input state back
+	void RenderDepthPrepass(PipelineHandles& curHandles)
+	{
+		const UINT strides[] = { m_compactVertexFormat ? (UINT)sizeof(QUANTIZED_POSITION) : (UINT)sizeof(H2B::VECTOR), sizeof(PerInstanceData) };
+		const UINT offsets[] = { 0, 0 };
+		ID3D11Buffer* const buffs[] = { positionBuffer.Get(), instanceIdBuffer.Get() };
+		curHandles.context->IASetVertexBuffers(0, ARRAYSIZE(buffs), buffs, strides, offsets);
+		curHandles.context->IASetInputLayout(depthVertexFormat.Get());
+		curHandles.context->VSSetShader(depthVertexShader.Get(), nullptr, 0);
+		curHandles.context->PSSetShader(nullptr, nullptr, 0);
+		curHandles.context->OMSetDepthStencilState(nullptr, 0);
+		if (!m_compactVertexFormat)
+			CB_GPU_UPLOAD_PER_OBJECT(curHandles); // only the view/projection matrices are read
+
+		SubmitDrawPackets(curHandles, 0, false);
+
+		SetVertexBuffers(curHandles);
+		SetIndexBuffer(curHandles);
+		curHandles.context->IASetInputLayout(vertexFormat.Get());
+		curHandles.context->VSSetShader(vertexShader.Get(), nullptr, 0);
+	}
+
+	// Runs the light LOD stage and writes its output into the per frame constant buffer
+	void UpdateActiveLights()
+	{
+		lightLOD.Update(viewCamera.GetPosition(), CB_currentPerFrame.pointLights, m_maxPointLights,
+			CB_currentPerFrame.spotLights, m_maxSpotLights);
+		CB_currentPerFrame.numActiveLights.x = (float)lightLOD.GetReport().activePointLights;
+		CB_currentPerFrame.numActiveLights.y = (float)lightLOD.GetReport().activeSpotLights;
+	}
+
 	// UPDATE PER-SCENE CONSTANT BUFFER
 	void CB_GPU_UPLOAD_PER_SCENE(Renderer::PipelineHandles& curHandles)
 	{